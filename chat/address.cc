@@ -3,6 +3,9 @@
 #include "endian.h"
 #include <arpa/inet.h>
 #include "log.h"
+#include "config.h"
+#include "hook.h"
+#include "dns.h"
 #include <netdb.h>
 #include <ifaddrs.h>
 
@@ -10,6 +13,9 @@ namespace chat {
 
 static chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
 
+static chat::ConfigVar<bool>::ptr g_dns_async =
+    chat::Config::Lookup("dns.async", true, "resolve domain by DnsResolver in fiber instead of blocking getaddrinfo");
+
 template<class T>
 static T CreateMask(uint32_t bits) {
     return (1 << (sizeof(T) * 8 - bits)) - 1;
@@ -109,6 +115,31 @@ bool Address::Lookup(std::vector<Address::ptr>& result, const std::string& host,
     if (node.empty()) {
         node = host;
     }
+
+    //协程内解析域名走异步DNS, 避免getaddrinfo阻塞整个IOManager线程
+    if (g_dns_async->getValue() && chat::is_hook_enable()
+            && (family == AF_INET || family == AF_INET6 || family == AF_UNSPEC)
+            && (!service || isdigit(*service))) {
+        in6_addr tmp;
+        if (inet_pton(AF_INET, node.c_str(), &tmp) != 1
+                && inet_pton(AF_INET6, node.c_str(), &tmp) != 1) {
+            std::vector<IPAddress::ptr> addrs;
+            if (!DnsMgr::GetInstance()->resolve(addrs, node, family)) {
+                CHAT_LOG_DEBUG(g_logger) << "Address::Lookup resolve(" << host << ", "
+                    << family << ") fail";
+                return false;
+            }
+            uint16_t port = service ? atoi(service) : 0;
+            for (auto& i : addrs) {
+                //缓存中的地址是共享的, 复制后再设置端口
+                IPAddress::ptr addr = std::dynamic_pointer_cast<IPAddress>(Create(i->getAddr(), i->getAddrLen()));
+                addr->setPort(port);
+                result.push_back(addr);
+            }
+            return !result.empty();
+        }
+    }
+
     int error = getaddrinfo(node.c_str(), service, &hints, &results);
     if (error) {
         CHAT_LOG_DEBUG(g_logger) << "Address::Lookup getaddress(" << host << ", "
@@ -4,21 +4,31 @@
 #include "address.h"
 #include "application.h"
 #include "bytearray.h"
+#include "clock.h"
 #include "config.h"
 #include "daemon.h"
+#include "dns.h"
 #include "endian.h"
 #include "env.h"
 #include "fiber.h"
 #include "fd_manager.h"
+#include "file_io.h"
 #include "hook.h"
+#include "http/async_http_client.h"
 #include "http/http.h"
 #include "http/http_connection.h"
 #include "http/http_parser.h"
 #include "http/http_session.h"
 #include "http/http_server.h"
 #include "http/servlet.h"
+#include "http/cache_servlet.h"
+#include "http/http_compress.h"
+#include "http/proxy_servlet.h"
+#include "http/static_file_servlet.h"
 #include "http/session_data.h"
 #include "http/ws_connection.h"
+#include "http/ws_broadcast.h"
+#include "http/ws_deflate.h"
 #include "http/ws_server.h"
 #include "http/ws_servlet.h"
 #include "http/ws_session.h"
@@ -39,6 +49,7 @@
 #include "thread.h"
 #include "tcp_server.h"
 #include "timer.h"
+#include "udp_server.h"
 #include "util.h"
 #include "worker.h"
 #include "zk_client.h"
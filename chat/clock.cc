@@ -0,0 +1,56 @@
+#include "clock.h"
+#include <time.h>
+
+namespace chat {
+
+static thread_local uint64_t t_cached_us = 0;
+
+static inline uint64_t ReadUs(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec * 1000 * 1000ul + ts.tv_nsec / 1000;
+}
+
+uint64_t Clock::NowUs() {
+    return ReadUs(CLOCK_REALTIME);
+}
+
+uint64_t Clock::NowMs() {
+    return ReadUs(CLOCK_REALTIME) / 1000;
+}
+
+uint64_t Clock::CoarseUs() {
+    return ReadUs(CLOCK_REALTIME_COARSE);
+}
+
+uint64_t Clock::CoarseMs() {
+    return ReadUs(CLOCK_REALTIME_COARSE) / 1000;
+}
+
+uint64_t Clock::CoarseSec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return ts.tv_sec;
+}
+
+uint64_t Clock::MonotonicCoarseMs() {
+    return ReadUs(CLOCK_MONOTONIC_COARSE) / 1000;
+}
+
+uint64_t Clock::CachedUs() {
+    if (t_cached_us) {
+        return t_cached_us;
+    }
+    return CoarseUs();
+}
+
+uint64_t Clock::Refresh() {
+    t_cached_us = NowUs();
+    return t_cached_us;
+}
+
+void Clock::Invalidate() {
+    t_cached_us = 0;
+}
+
+}
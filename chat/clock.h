@@ -0,0 +1,38 @@
+#ifndef __CHAT_CLOCK_H__
+#define __CHAT_CLOCK_H__
+
+#include <stdint.h>
+
+namespace chat {
+
+//时钟服务
+//  Now*:       精确时间(CLOCK_REALTIME), 与GetCurrentMs/GetCurrentUs一致
+//  Coarse*:    粗粒度时间(CLOCK_REALTIME_COARSE), 精度为一个jiffy(1~4ms)
+//  Monotonic*: 单调粗粒度时间(CLOCK_MONOTONIC_COARSE), 只用于计算间隔
+//  Cached*:    本线程缓存的精确时间, 调度线程在idle的epoll_wait返回(含定时器触发)后刷新,
+//              未刷新过或已退出调度的线程退化为Coarse*
+//              任务连续执行期间不刷新, 只用于日志和定时器到期扫描, 不能用来计算截止时间
+class Clock {
+public:
+    static uint64_t NowUs();
+    static uint64_t NowMs();
+
+    static uint64_t CoarseUs();
+    static uint64_t CoarseMs();
+    static uint64_t CoarseSec();
+
+    static uint64_t MonotonicCoarseMs();
+
+    static uint64_t CachedUs();
+    static uint64_t CachedMs() { return CachedUs() / 1000; }
+    static uint64_t CachedSec() { return CachedUs() / 1000000; }
+
+    //刷新本线程缓存, 返回刷新后的微秒时间
+    static uint64_t Refresh();
+    //清除本线程缓存, 线程离开调度循环时调用
+    static void Invalidate();
+};
+
+}
+
+#endif
@@ -0,0 +1,654 @@
+#include "dns.h"
+#include "socket.h"
+#include "scheduler.h"
+#include "config.h"
+#include "clock.h"
+#include "hook.h"
+#include "log.h"
+#include "util.h"
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <random>
+#include <string.h>
+#include <sys/random.h>
+
+namespace chat {
+
+static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
+
+static chat::ConfigVar<uint32_t>::ptr g_dns_negative_ttl =
+    chat::Config::Lookup("dns.negative_ttl", (uint32_t)30, "dns negative cache ttl in second(used when no SOA)");
+static chat::ConfigVar<uint32_t>::ptr g_dns_max_ttl =
+    chat::Config::Lookup("dns.max_ttl", (uint32_t)3600, "dns cache max ttl in second");
+static chat::ConfigVar<uint32_t>::ptr g_dns_shard_size =
+    chat::Config::Lookup("dns.shard_size", (uint32_t)4096, "dns cache max entries per shard");
+
+static const uint16_t s_class_in = 1;
+static const uint16_t s_type_cname = 5;
+static const uint16_t s_type_soa = 6;
+
+static std::vector<std::string> Tokens(const std::string& line) {
+    std::vector<std::string> rt;
+    for (auto& i : split(line, " \t\r")) {
+        if (!i.empty()) {
+            rt.push_back(i);
+        }
+    }
+    return rt;
+}
+
+//去掉末尾的'.'并转小写, 作为缓存和hosts的key
+static std::string Normalize(const std::string& name) {
+    std::string rt = ToLower(name);
+    while (!rt.empty() && rt.back() == '.') {
+        rt.pop_back();
+    }
+    return rt;
+}
+
+static uint16_t ReadU16(const uint8_t* p) {
+    return (uint16_t)p[0] << 8 | p[1];
+}
+
+static uint32_t ReadU32(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void WriteU16(std::string& out, uint16_t v) {
+    out.push_back((char)(v >> 8));
+    out.push_back((char)(v & 0xff));
+}
+
+static bool EncodeQuery(std::string& out, uint16_t id, const std::string& name, uint16_t qtype) {
+    if (name.empty() || name.size() > 253) {
+        return false;
+    }
+    out.clear();
+    WriteU16(out, id);
+    WriteU16(out, 0x0100);  //RD
+    WriteU16(out, 1);
+    WriteU16(out, 0);
+    WriteU16(out, 0);
+    WriteU16(out, 0);
+    for (auto& label : split(name, '.')) {
+        if (label.empty() || label.size() > 63) {
+            return false;
+        }
+        out.push_back((char)label.size());
+        out.append(label);
+    }
+    out.push_back('\0');
+    WriteU16(out, qtype);
+    WriteU16(out, s_class_in);
+    return true;
+}
+
+//跳过一个(可能被压缩的)域名
+static bool SkipName(const uint8_t* data, size_t len, size_t& off) {
+    while (off < len) {
+        uint8_t c = data[off];
+        if ((c & 0xc0) == 0xc0) {
+            off += 2;
+            return off <= len;
+        }
+        if (c == 0) {
+            ++off;
+            return true;
+        }
+        off += 1 + c;
+    }
+    return false;
+}
+
+//读出一个(可能被压缩的)域名, 转小写, 不带末尾的'.'
+static bool ReadName(const uint8_t* data, size_t len, size_t off, std::string& name) {
+    name.clear();
+    for (int jumps = 0; off < len; ) {
+        uint8_t c = data[off];
+        if ((c & 0xc0) == 0xc0) {
+            if (off + 2 > len || ++jumps > 16) {
+                return false;
+            }
+            off = (c & 0x3f) << 8 | data[off + 1];
+            continue;
+        }
+        if (c == 0) {
+            return true;
+        }
+        if (off + 1 + c > len || name.size() + c > 254) {
+            return false;
+        }
+        if (!name.empty()) {
+            name.push_back('.');
+        }
+        for (size_t i = 1; i <= c; ++i) {
+            name.push_back(tolower(data[off + i]));
+        }
+        off += 1 + c;
+    }
+    return false;
+}
+
+//EncodeQuery生成的请求中的问题名
+static std::string QueryName(const std::string& req) {
+    std::string name;
+    ReadName((const uint8_t*)req.c_str(), req.size(), 12, name);
+    return name;
+}
+
+//解析应答: 问题必须与qname/qtype一致, 只收集owner为qname或其CNAME链上名字的qtype记录,
+//负应答从SOA取TTL
+//返回值: -1报文非法, 其它为rcode
+static int ParseResponse(const uint8_t* data, size_t len, uint16_t id
+                         ,const std::string& qname, uint16_t qtype
+                         ,std::vector<IPAddress::ptr>& addrs, uint32_t& ttl, bool& truncated) {
+    if (len < 12 || ReadU16(data) != id || !(data[2] & 0x80)) {
+        return -1;
+    }
+    truncated = data[2] & 0x02;
+    int rcode = data[3] & 0x0f;
+    uint16_t qdcount = ReadU16(data + 4);
+    uint16_t ancount = ReadU16(data + 6);
+    uint16_t nscount = ReadU16(data + 8);
+
+    //必须回显我们发出的问题, 否则可能是对别的查询的应答或伪造报文
+    size_t off = 12;
+    std::string name;
+    if (qdcount != 1 || !ReadName(data, len, off, name) || !SkipName(data, len, off)
+            || off + 4 > len || name != qname
+            || ReadU16(data + off) != qtype || ReadU16(data + off + 2) != s_class_in) {
+        return -1;
+    }
+    off += 4;
+
+    struct Record {
+        std::string owner;
+        uint16_t type;
+        uint32_t ttl;
+        size_t rdata;
+        uint16_t rdlen;
+    };
+    std::vector<Record> answers;
+    ttl = (uint32_t)-1;
+    uint32_t soa_ttl = (uint32_t)-1;
+    for (int i = 0; i < ancount + nscount; ++i) {
+        size_t name_off = off;
+        if (!SkipName(data, len, off) || off + 10 > len) {
+            return -1;
+        }
+        uint16_t type = ReadU16(data + off);
+        uint16_t cls = ReadU16(data + off + 2);
+        uint32_t rttl = ReadU32(data + off + 4);
+        uint16_t rdlen = ReadU16(data + off + 8);
+        off += 10;
+        if (off + rdlen > len) {
+            return -1;
+        }
+        if (cls == s_class_in) {
+            if (i < ancount) {
+                Record r;
+                if (!ReadName(data, len, name_off, r.owner)) {
+                    return -1;
+                }
+                r.type = type;
+                r.ttl = rttl;
+                r.rdata = off;
+                r.rdlen = rdlen;
+                answers.push_back(std::move(r));
+            } else if (type == s_type_soa) {
+                //RFC2308: 负缓存TTL取SOA的TTL与minimum中较小者
+                size_t soff = off;
+                if (SkipName(data, off + rdlen, soff) && SkipName(data, off + rdlen, soff)
+                        && soff + 20 <= off + rdlen) {
+                    soa_ttl = std::min(rttl, ReadU32(data + soff + 16));
+                }
+            }
+        }
+        off += rdlen;
+    }
+
+    //从qname沿CNAME走到最终名字, 链上每个名字的qtype记录都有效
+    std::vector<std::string> chain = {qname};
+    for (size_t i = 0; i < chain.size() && chain.size() <= 8; ++i) {
+        for (auto& r : answers) {
+            if (r.type != s_type_cname || r.owner != chain[i]) {
+                continue;
+            }
+            if (!ReadName(data, len, r.rdata, name)) {
+                return -1;
+            }
+            if (std::find(chain.begin(), chain.end(), name) == chain.end()) {
+                chain.push_back(name);
+                ttl = std::min(ttl, r.ttl);
+            }
+            break;
+        }
+    }
+    for (auto& r : answers) {
+        if (r.type != qtype || std::find(chain.begin(), chain.end(), r.owner) == chain.end()) {
+            continue;
+        }
+        const uint8_t* rdata = data + r.rdata;
+        if (r.type == DnsResolver::A && r.rdlen == 4) {
+            sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            memcpy(&addr.sin_addr, rdata, 4);
+            addrs.push_back(std::make_shared<IPv4Address>(addr));
+            ttl = std::min(ttl, r.ttl);
+        } else if (r.type == DnsResolver::AAAA && r.rdlen == 16) {
+            sockaddr_in6 addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin6_family = AF_INET6;
+            memcpy(&addr.sin6_addr, rdata, 16);
+            addrs.push_back(std::make_shared<IPv6Address>(addr));
+            ttl = std::min(ttl, r.ttl);
+        }
+    }
+    if (addrs.empty() && soa_ttl != (uint32_t)-1) {
+        ttl = soa_ttl;
+    }
+    return rcode;
+}
+
+DnsResolver::DnsResolver() {
+    loadHosts();
+    loadResolvConf();
+}
+
+DnsResolver::Shard& DnsResolver::getShard(const std::string& key) {
+    return m_shards[std::hash<std::string>()(key) % s_shards];
+}
+
+void DnsResolver::loadHosts(const std::string& path) {
+    std::ifstream ifs(path);
+    std::map<std::string, std::vector<IPAddress::ptr> > hosts;
+    std::string line;
+    while (std::getline(ifs, line)) {
+        size_t pos = line.find('#');
+        if (pos != std::string::npos) {
+            line.resize(pos);
+        }
+        auto items = Tokens(line);
+        if (items.size() < 2) {
+            continue;
+        }
+        IPAddress::ptr addr = IPAddress::Create(items[0].c_str());
+        if (!addr) {
+            continue;
+        }
+        for (size_t i = 1; i < items.size(); ++i) {
+            hosts[Normalize(items[i])].push_back(addr);
+        }
+    }
+    RWMutex::WriteLock lock(m_mutex);
+    m_hosts.swap(hosts);
+}
+
+void DnsResolver::loadResolvConf(const std::string& path) {
+    std::ifstream ifs(path);
+    std::vector<Address::ptr> servers;
+    std::vector<std::string> search;
+    int ndots = 1;
+    uint64_t timeout = 5000;
+    int attempts = 2;
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+        auto items = Tokens(line);
+        if (items.empty() || items[0][0] == '#' || items[0][0] == ';') {
+            continue;
+        }
+        if (items[0] == "nameserver" && items.size() > 1) {
+            IPAddress::ptr addr = IPAddress::Create(items[1].c_str(), 53);
+            if (addr) {
+                servers.push_back(addr);
+            }
+        } else if ((items[0] == "search" || items[0] == "domain") && items.size() > 1) {
+            search.assign(items.begin() + 1, items.end());
+        } else if (items[0] == "options") {
+            for (size_t i = 1; i < items.size(); ++i) {
+                if (items[i].compare(0, 6, "ndots:") == 0) {
+                    ndots = atoi(items[i].c_str() + 6);
+                } else if (items[i].compare(0, 8, "timeout:") == 0) {
+                    timeout = atoi(items[i].c_str() + 8) * 1000;
+                } else if (items[i].compare(0, 9, "attempts:") == 0) {
+                    attempts = atoi(items[i].c_str() + 9);
+                }
+            }
+        }
+    }
+    if (servers.empty()) {
+        servers.push_back(IPAddress::Create("127.0.0.1", 53));
+    }
+
+    RWMutex::WriteLock lock(m_mutex);
+    m_servers.swap(servers);
+    m_search.swap(search);
+    m_ndots = ndots;
+    m_timeout = timeout ? timeout : 5000;
+    m_attempts = attempts > 0 ? attempts : 1;
+}
+
+void DnsResolver::setNameServers(const std::vector<Address::ptr>& v) {
+    RWMutex::WriteLock lock(m_mutex);
+    m_servers = v;
+}
+
+std::vector<Address::ptr> DnsResolver::getNameServers() {
+    RWMutex::ReadLock lock(m_mutex);
+    return m_servers;
+}
+
+void DnsResolver::setSearch(const std::vector<std::string>& v) {
+    RWMutex::WriteLock lock(m_mutex);
+    m_search = v;
+}
+
+void DnsResolver::clearCache() {
+    for (size_t i = 0; i < s_shards; ++i) {
+        MutexType::Lock lock(m_shards[i].mutex);
+        m_shards[i].entries.clear();
+    }
+}
+
+bool DnsResolver::resolve(std::vector<IPAddress::ptr>& result, const std::string& name, int family) {
+    std::string host = Normalize(name);
+    if (host.empty()) {
+        return false;
+    }
+    {
+        RWMutex::ReadLock lock(m_mutex);
+        auto it = m_hosts.find(host);
+        if (it != m_hosts.end()) {
+            size_t size = result.size();
+            for (auto& i : it->second) {
+                if (family == AF_UNSPEC || i->getFamily() == family) {
+                    result.push_back(i);
+                }
+            }
+            if (result.size() > size) {
+                return true;
+            }
+        }
+    }
+
+    size_t size = result.size();
+    if (family == AF_INET || family == AF_UNSPEC) {
+        resolveType(result, host, A);
+    }
+    if (family == AF_INET6 || family == AF_UNSPEC) {
+        resolveType(result, host, AAAA);
+    }
+    return result.size() > size;
+}
+
+//按search列表依次尝试, 点数不少于ndots时先查原名
+int DnsResolver::resolveType(std::vector<IPAddress::ptr>& result, const std::string& name, uint16_t qtype) {
+    std::vector<std::string> names;
+    {
+        RWMutex::ReadLock lock(m_mutex);
+        bool absolute = std::count(name.begin(), name.end(), '.') >= m_ndots;
+        if (absolute) {
+            names.push_back(name);
+        }
+        for (auto& i : m_search) {
+            names.push_back(name + "." + Normalize(i));
+        }
+        if (!absolute) {
+            names.push_back(name);
+        }
+    }
+
+    int rt = ERROR;
+    for (auto& i : names) {
+        rt = lookup(result, i, qtype);
+        if (rt == OK) {
+            break;
+        }
+    }
+    return rt;
+}
+
+int DnsResolver::lookup(std::vector<IPAddress::ptr>& result, const std::string& name, uint16_t qtype) {
+    std::string key = name + "#" + std::to_string(qtype);
+    Shard& shard = getShard(key);
+    Scheduler* scheduler = Scheduler::GetThis();
+    bool can_wait = scheduler && chat::is_hook_enable();
+
+    Inflight::ptr inflight;
+    {
+        MutexType::Lock lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+            if (it->second.expire > Clock::MonotonicCoarseMs()) {
+                ++m_hits;
+                result.insert(result.end(), it->second.addrs.begin(), it->second.addrs.end());
+                return it->second.negative ? NEGATIVE : OK;
+            }
+            shard.entries.erase(it);
+        }
+
+        auto iit = shard.inflight.find(key);
+        if (iit != shard.inflight.end() && can_wait) {
+            //已有协程在查询, 挂起等待; 回到本线程恢复, 保证切出后才被换入
+            inflight = iit->second;
+            inflight->waiters.push_back(std::make_pair(scheduler
+                        , std::make_pair(Fiber::GetThis(), (int)chat::GetThreadId())));
+            lock.unlock();
+            Fiber::YieldToHold();
+            result.insert(result.end(), inflight->answer.addrs.begin(), inflight->answer.addrs.end());
+            return inflight->answer.status;
+        }
+        if (iit == shard.inflight.end()) {
+            inflight.reset(new Inflight);
+            shard.inflight[key] = inflight;
+        }
+    }
+
+    Answer ans;
+    query(ans, name, qtype);
+
+    if (inflight) {
+        decltype(inflight->waiters) waiters;
+        {
+            MutexType::Lock lock(shard.mutex);
+            if (ans.status != ERROR) {
+                if (shard.entries.size() >= g_dns_shard_size->getValue()) {
+                    uint64_t now = Clock::MonotonicCoarseMs();
+                    for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+                        if (it->second.expire <= now) {
+                            shard.entries.erase(it++);
+                        } else {
+                            ++it;
+                        }
+                    }
+                    if (shard.entries.size() >= g_dns_shard_size->getValue()) {
+                        shard.entries.erase(shard.entries.begin());
+                    }
+                }
+                Entry& entry = shard.entries[key];
+                entry.addrs = ans.addrs;
+                entry.negative = ans.status == NEGATIVE;
+                entry.expire = Clock::MonotonicCoarseMs() + ans.ttl * 1000ul;
+            }
+            inflight->answer = ans;
+            waiters.swap(inflight->waiters);
+            shard.inflight.erase(key);
+        }
+        for (auto& i : waiters) {
+            i.first->schedule(i.second.first, i.second.second);
+        }
+    }
+
+    result.insert(result.end(), ans.addrs.begin(), ans.addrs.end());
+    return ans.status;
+}
+
+//TXID与源端口取自getrandom, rand()的序列可预测, 容易被伪造应答投毒
+static uint16_t SecureRandomU16() {
+    uint16_t v;
+    if (getrandom(&v, sizeof(v), 0) != (ssize_t)sizeof(v)) {
+        std::random_device rd;
+        v = (uint16_t)rd();
+    }
+    return v;
+}
+
+//绑定随机的源端口, 与TXID一起让伪造应答需要同时猜中两者; 端口被占用时重试, 都失败则交给内核选择
+static void BindRandomPort(Socket::ptr sock, Address::ptr server) {
+    for (int i = 0; i < 3; ++i) {
+        IPAddress::ptr local;
+        if (server->getFamily() == AF_INET6) {
+            local.reset(new IPv6Address);
+        } else {
+            local.reset(new IPv4Address);
+        }
+        local->setPort(1024 + SecureRandomU16() % (65536 - 1024));
+        if (sock->bind(local)) {
+            return;
+        }
+    }
+}
+
+void DnsResolver::query(Answer& ans, const std::string& name, uint16_t qtype) {
+    std::vector<Address::ptr> servers;
+    int attempts;
+    {
+        RWMutex::ReadLock lock(m_mutex);
+        servers = m_servers;
+        attempts = m_attempts;
+    }
+
+    uint16_t id = SecureRandomU16();
+    std::string req;
+    if (!EncodeQuery(req, id, name, qtype)) {
+        ans.status = NEGATIVE;
+        ans.ttl = g_dns_negative_ttl->getValue();
+        return;
+    }
+
+    for (int n = 0; n < attempts; ++n) {
+        for (auto& server : servers) {
+            ++m_queries;
+            int rcode = queryUdp(ans, server, req, id, qtype);
+            if (rcode == 0 || rcode == 3) {  //NOERROR/NXDOMAIN
+                if (ans.addrs.empty()) {
+                    ans.status = NEGATIVE;
+                    if (ans.ttl == (uint32_t)-1) {
+                        ans.ttl = g_dns_negative_ttl->getValue();
+                    }
+                } else {
+                    ans.status = OK;
+                }
+                ans.ttl = std::min(ans.ttl, g_dns_max_ttl->getValue());
+                return;
+            }
+            CHAT_LOG_DEBUG(g_logger) << "dns query " << name << " type=" << qtype
+                << " server=" << *server << " rcode=" << rcode;
+            ans.addrs.clear();
+        }
+    }
+    ans.status = ERROR;
+    CHAT_LOG_WARN(g_logger) << "dns query " << name << " type=" << qtype << " fail";
+}
+
+int DnsResolver::queryUdp(Answer& ans, Address::ptr server, const std::string& req, uint16_t id, uint16_t qtype) {
+    Socket::ptr sock = Socket::CreateUDP(server);
+    sock->setRecvTimeout(m_timeout);
+    BindRandomPort(sock, server);
+    if (!sock->connect(server)) {
+        return -1;
+    }
+    if (sock->send(req.c_str(), req.size()) != (int)req.size()) {
+        return -1;
+    }
+
+    uint8_t buf[1500];
+    while (true) {
+        int rt = sock->recv(buf, sizeof(buf));
+        if (rt <= 0) {
+            return -1;
+        }
+        bool truncated = false;
+        int rcode = ParseResponse(buf, rt, id, QueryName(req), qtype, ans.addrs, ans.ttl, truncated);
+        if (rcode < 0) {
+            ans.addrs.clear();
+            continue;  //id不符或报文非法, 继续等真正的应答
+        }
+        if (truncated) {
+            ans.addrs.clear();
+            return queryTcp(ans, server, req, id, qtype);
+        }
+        return rcode;
+    }
+}
+
+int DnsResolver::queryTcp(Answer& ans, Address::ptr server, const std::string& req, uint16_t id, uint16_t qtype) {
+    Socket::ptr sock = Socket::CreateTCP(server);
+    if (!sock->connect(server, m_timeout)) {
+        return -1;
+    }
+    sock->setRecvTimeout(m_timeout);
+    std::string data;
+    WriteU16(data, req.size());
+    data.append(req);
+    if (sock->send(data.c_str(), data.size()) != (int)data.size()) {
+        return -1;
+    }
+
+    uint8_t head[2];
+    std::string buf;
+    size_t len = 2;
+    size_t off = 0;
+    uint8_t* ptr = head;
+    for (int i = 0; i < 2; ++i) {
+        while (off < len) {
+            int rt = sock->recv(ptr + off, len - off);
+            if (rt <= 0) {
+                return -1;
+            }
+            off += rt;
+        }
+        if (i == 0) {
+            len = ReadU16(head);
+            off = 0;
+            buf.resize(len);
+            ptr = (uint8_t*)&buf[0];
+        }
+    }
+
+    bool truncated = false;
+    return ParseResponse((const uint8_t*)buf.c_str(), buf.size(), id, QueryName(req), qtype
+                         , ans.addrs, ans.ttl, truncated);
+}
+
+std::ostream& DnsResolver::dump(std::ostream& os) {
+    {
+        RWMutex::ReadLock lock(m_mutex);
+        os << "[DnsResolver servers=";
+        for (size_t i = 0; i < m_servers.size(); ++i) {
+            os << (i ? "," : "") << *m_servers[i];
+        }
+        os << " search=" << Join(m_search.begin(), m_search.end(), ",")
+           << " ndots=" << m_ndots
+           << " timeout=" << m_timeout
+           << " attempts=" << m_attempts
+           << " hosts=" << m_hosts.size();
+    }
+    size_t entries = 0;
+    for (size_t i = 0; i < s_shards; ++i) {
+        MutexType::Lock lock(m_shards[i].mutex);
+        entries += m_shards[i].entries.size();
+    }
+    os << " cache=" << entries
+       << " queries=" << m_queries
+       << " hits=" << m_hits
+       << "]";
+    return os;
+}
+
+}
@@ -0,0 +1,109 @@
+#ifndef __CHAT_DNS_H__
+#define __CHAT_DNS_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <atomic>
+#include "address.h"
+#include "mutex.h"
+#include "singleton.h"
+
+namespace chat {
+
+class Scheduler;
+
+//协程友好的DNS解析: 走hook后的UDP socket查询, 不阻塞IOManager线程
+//读取/etc/hosts与/etc/resolv.conf, 结果按TTL分片缓存, 不存在的域名做负缓存
+//同一域名的并发查询只发一次请求, 其余协程挂起等待结果
+class DnsResolver {
+public:
+    typedef std::shared_ptr<DnsResolver> ptr;
+    typedef Mutex MutexType;
+
+    enum QType {
+        A = 1,
+        AAAA = 28
+    };
+
+    DnsResolver();
+
+    //family: AF_INET/AF_INET6/AF_UNSPEC, 返回的地址端口为0且不可修改(共享缓存)
+    bool resolve(std::vector<IPAddress::ptr>& result, const std::string& name, int family = AF_INET);
+
+    void loadHosts(const std::string& path = "/etc/hosts");
+    void loadResolvConf(const std::string& path = "/etc/resolv.conf");
+
+    void setNameServers(const std::vector<Address::ptr>& v);
+    std::vector<Address::ptr> getNameServers();
+    void setSearch(const std::vector<std::string>& v);
+    void setTimeout(uint64_t ms) { m_timeout = ms;}
+    void setAttempts(int v) { m_attempts = v;}
+    void clearCache();
+
+    //实际发往服务器的查询数
+    uint64_t getQueryCount() const { return m_queries;}
+    uint64_t getCacheHitCount() const { return m_hits;}
+
+    std::ostream& dump(std::ostream& os);
+private:
+    enum Status {
+        OK = 0,
+        NEGATIVE = 1,  //NXDOMAIN或无该类型记录, 可缓存
+        ERROR = 2      //超时/服务端错误, 不缓存
+    };
+
+    struct Answer {
+        std::vector<IPAddress::ptr> addrs;
+        uint32_t ttl = 0;
+        int status = ERROR;
+    };
+
+    struct Entry {
+        std::vector<IPAddress::ptr> addrs;
+        uint64_t expire = 0;
+        bool negative = false;
+    };
+
+    //进行中的查询, 后来者挂在waiters上
+    struct Inflight {
+        typedef std::shared_ptr<Inflight> ptr;
+        std::vector<std::pair<Scheduler*, std::pair<Fiber::ptr, int> > > waiters;
+        Answer answer;
+    };
+
+    struct Shard {
+        MutexType mutex;
+        std::unordered_map<std::string, Entry> entries;
+        std::unordered_map<std::string, Inflight::ptr> inflight;
+    };
+
+    Shard& getShard(const std::string& key);
+    int resolveType(std::vector<IPAddress::ptr>& result, const std::string& name, uint16_t qtype);
+    int lookup(std::vector<IPAddress::ptr>& result, const std::string& name, uint16_t qtype);
+    void query(Answer& ans, const std::string& name, uint16_t qtype);
+    int queryUdp(Answer& ans, Address::ptr server, const std::string& req, uint16_t id, uint16_t qtype);
+    int queryTcp(Answer& ans, Address::ptr server, const std::string& req, uint16_t id, uint16_t qtype);
+private:
+    static const size_t s_shards = 16;
+    Shard m_shards[s_shards];
+
+    RWMutex m_mutex;
+    std::map<std::string, std::vector<IPAddress::ptr> > m_hosts;
+    std::vector<Address::ptr> m_servers;
+    std::vector<std::string> m_search;
+    int m_ndots = 1;
+    uint64_t m_timeout = 5000;
+    int m_attempts = 2;
+
+    std::atomic<uint64_t> m_queries = {0};
+    std::atomic<uint64_t> m_hits = {0};
+};
+
+typedef Singleton<DnsResolver> DnsMgr;
+
+}
+
+#endif
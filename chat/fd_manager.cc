@@ -48,6 +48,11 @@ bool FdCtx::init() {
     return m_isInit;
 }
 
+bool FdCtx::close() {
+    m_isClosed = true;
+    return true;
+}
+
 void FdCtx::setTimeout(int type, uint64_t v) {
     if(type == SO_RCVTIMEO) {
         m_recvTimeout = v;
@@ -81,11 +86,25 @@ FdCtx::ptr FdManager::get(int fd, bool auto_create) {
     lock.unlock();
 
     RWMutexType::WriteLock lock2(m_mutex);
+    if ((int)m_datas.size() <= fd) {
+        m_datas.resize(fd * 1.5);
+    }
     FdCtx::ptr ctx = std::make_shared<FdCtx>(fd);
     m_datas[fd] = ctx;
     return ctx;
 }
 
+FdCtx::ptr FdManager::lookup(int fd) {
+    if (fd < 0) {
+        return nullptr;
+    }
+    RWMutexType::ReadLock lock(m_mutex);
+    if ((int)m_datas.size() <= fd) {
+        return nullptr;
+    }
+    return m_datas[fd];
+}
+
 void FdManager::del(int fd) {
     RWMutexType::WriteLock lock(m_mutex);
     if((int)m_datas.size() <= fd) {
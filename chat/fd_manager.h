@@ -46,6 +46,8 @@ public:
 
     FdManager();
     FdCtx::ptr get(int fd, bool auto_create = false);
+    //只查找不创建, 返回的引用让ctx在协程让出期间被其他线程del后仍然有效
+    FdCtx::ptr lookup(int fd);
     void del(int fd);
 
 private:
@@ -0,0 +1,264 @@
+#include "file_io.h"
+#include "scheduler.h"
+#include "config.h"
+#include "hook.h"
+#include "log.h"
+#include "util.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <errno.h>
+
+namespace chat {
+
+static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
+
+static chat::ConfigVar<int>::ptr g_file_io_threads =
+    chat::Config::Lookup("file_io.threads", 4, "file io offload thread num");
+
+//单次preadv/pwritev的上限, 受IOV_MAX约束
+static const size_t s_max_io_size = 1024 * 1024;
+
+FileIOManager::FileIOManager(int threads, const std::string& name) {
+    if (threads <= 0) {
+        threads = g_file_io_threads->getValue();
+    }
+    if (threads <= 0) {
+        threads = 1;
+    }
+    m_threads.resize(threads);
+    for (int i = 0; i < threads; ++i) {
+        m_threads[i].reset(new Thread(std::bind(&FileIOManager::run, this)
+                            , name + "_" + std::to_string(i)));
+    }
+}
+
+FileIOManager::~FileIOManager() {
+    stop();
+}
+
+void FileIOManager::stop() {
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_stopping) {
+            return;
+        }
+        m_stopping = true;
+    }
+    for (size_t i = 0; i < m_threads.size(); ++i) {
+        m_sem.notify();
+    }
+    for (auto& i : m_threads) {
+        i->join();
+    }
+    m_threads.clear();
+}
+
+size_t FileIOManager::getPending() {
+    MutexType::Lock lock(m_mutex);
+    return m_tasks.size();
+}
+
+ssize_t FileIOManager::submit(std::function<ssize_t()> op) {
+    Scheduler* scheduler = Scheduler::GetThis();
+    if (!scheduler || !chat::is_hook_enable()) {
+        return op();  //不在调度器协程内, 挂起没有意义
+    }
+
+    Task task;
+    task.op.swap(op);
+    task.scheduler = scheduler;
+    task.fiber = Fiber::GetThis();
+    task.thread = chat::GetThreadId();  //回到原线程恢复, 避免协程未切出就被别的线程换入
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_stopping) {
+            lock.unlock();
+            task.fiber.reset();
+            return task.op();
+        }
+        m_tasks.push_back(&task);
+    }
+    m_sem.notify();
+    Fiber::YieldToHold();
+
+    errno = task.error;
+    return task.result;
+}
+
+void FileIOManager::run() {
+    while (true) {
+        m_sem.wait();
+        Task* task = nullptr;
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_tasks.empty()) {
+                if (m_stopping) {
+                    return;
+                }
+                continue;
+            }
+            task = m_tasks.front();
+            m_tasks.pop_front();
+        }
+
+        ssize_t rt = task->op();
+        task->error = rt < 0 ? errno : 0;
+        task->result = rt;
+
+        //schedule之后task所在协程栈随时可能失效
+        Scheduler* scheduler = task->scheduler;
+        Fiber::ptr fiber = std::move(task->fiber);
+        int thread = task->thread;
+        scheduler->schedule(fiber, thread);
+    }
+}
+
+int FileIOManager::open(const char* path, int flags, mode_t mode) {
+    return submit([path, flags, mode]() -> ssize_t {
+        return ::open(path, flags, mode);
+    });
+}
+
+int FileIOManager::close(int fd) {
+    return submit([fd]() -> ssize_t {
+        return ::close(fd);
+    });
+}
+
+ssize_t FileIOManager::pread(int fd, void* buf, size_t count, off_t offset) {
+    return submit([=]() -> ssize_t {
+        return ::pread(fd, buf, count, offset);
+    });
+}
+
+ssize_t FileIOManager::pwrite(int fd, const void* buf, size_t count, off_t offset) {
+    return submit([=]() -> ssize_t {
+        return ::pwrite(fd, buf, count, offset);
+    });
+}
+
+ssize_t FileIOManager::preadv(int fd, const iovec* iov, int iovcnt, off_t offset) {
+    return submit([=]() -> ssize_t {
+        return ::preadv(fd, iov, iovcnt, offset);
+    });
+}
+
+ssize_t FileIOManager::pwritev(int fd, const iovec* iov, int iovcnt, off_t offset) {
+    return submit([=]() -> ssize_t {
+        return ::pwritev(fd, iov, iovcnt, offset);
+    });
+}
+
+int FileIOManager::fsync(int fd) {
+    return submit([fd]() -> ssize_t {
+        return ::fsync(fd);
+    });
+}
+
+int FileIOManager::fdatasync(int fd) {
+    return submit([fd]() -> ssize_t {
+        return ::fdatasync(fd);
+    });
+}
+
+//open/fstat/preadv/close合并为一次提交, 只切换一次协程
+bool FileIOManager::readFile(const std::string& path, ByteArray::ptr ba) {
+    size_t pos = ba->getPosition();
+    ssize_t rt = submit([&path, &ba]() -> ssize_t {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return -1;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) < 0) {
+            int err = errno;
+            ::close(fd);
+            errno = err;
+            return -1;
+        }
+
+        ssize_t total = 0;
+        std::vector<iovec> iovs;
+        while (true) {
+            size_t len = st.st_size > total ? st.st_size - total : 4096;
+            len = std::min(len, s_max_io_size);
+            iovs.clear();
+            ba->getWriteBuffers(iovs, len);
+            ssize_t n = ::preadv(fd, &iovs[0], std::min((int)iovs.size(), IOV_MAX), total);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                int err = errno;
+                ::close(fd);
+                errno = err;
+                return -1;
+            }
+            if (n == 0) {
+                break;
+            }
+            ba->setPosition(ba->getPosition() + n);
+            total += n;
+        }
+        ::close(fd);
+        return total;
+    });
+    ba->setPosition(pos);
+
+    if (rt < 0) {
+        CHAT_LOG_ERROR(g_logger) << "readFile name=" << path
+            << " error, errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool FileIOManager::writeFile(const std::string& path, ByteArray::ptr ba, bool sync) {
+    ssize_t rt = submit([&path, &ba, sync]() -> ssize_t {
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return -1;
+        }
+
+        uint64_t size = ba->getReadSize();
+        uint64_t pos = ba->getPosition();
+        ssize_t total = 0;
+        std::vector<iovec> iovs;
+        while ((uint64_t)total < size) {
+            size_t len = std::min((size_t)(size - total), s_max_io_size);
+            iovs.clear();
+            ba->getReadBuffers(iovs, len, pos + total);
+            ssize_t n = ::pwritev(fd, &iovs[0], std::min((int)iovs.size(), IOV_MAX), total);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                int err = errno;
+                ::close(fd);
+                errno = err;
+                return -1;
+            }
+            total += n;
+        }
+        if (sync && ::fdatasync(fd) < 0) {
+            int err = errno;
+            ::close(fd);
+            errno = err;
+            return -1;
+        }
+        ::close(fd);
+        return total;
+    });
+
+    if (rt < 0) {
+        CHAT_LOG_ERROR(g_logger) << "writeFile name=" << path
+            << " error, errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+}
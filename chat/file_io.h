@@ -0,0 +1,71 @@
+#ifndef __CHAT_FILE_IO_H__
+#define __CHAT_FILE_IO_H__
+
+#include <memory>
+#include <functional>
+#include <list>
+#include <vector>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "thread.h"
+#include "mutex.h"
+#include "singleton.h"
+#include "bytearray.h"
+
+namespace chat {
+
+//普通文件不支持epoll, hook后的read/write会阻塞整个IOManager线程
+//这里把文件IO卸载到专用线程池, 调用协程挂起等待完成; 不在协程调度器内时直接同步执行
+class FileIOManager {
+public:
+    typedef std::shared_ptr<FileIOManager> ptr;
+    typedef Mutex MutexType;
+
+    //threads<=0时使用配置file_io.threads
+    FileIOManager(int threads = 0, const std::string& name = "file_io");
+    ~FileIOManager();
+
+    //返回值与errno同对应的系统调用
+    int open(const char* path, int flags, mode_t mode = 0644);
+    int close(int fd);
+    ssize_t pread(int fd, void* buf, size_t count, off_t offset);
+    ssize_t pwrite(int fd, const void* buf, size_t count, off_t offset);
+    ssize_t preadv(int fd, const iovec* iov, int iovcnt, off_t offset);
+    ssize_t pwritev(int fd, const iovec* iov, int iovcnt, off_t offset);
+    int fsync(int fd);
+    int fdatasync(int fd);
+
+    //整个文件读入ba(从ba当前位置写入), 结束后position复位到起点
+    bool readFile(const std::string& path, ByteArray::ptr ba);
+    //ba中可读数据写入文件(覆盖), sync为true时落盘后返回
+    bool writeFile(const std::string& path, ByteArray::ptr ba, bool sync = false);
+
+    void stop();
+    size_t getPending();
+private:
+    struct Task {
+        std::function<ssize_t()> op;
+        ssize_t result = -1;
+        int error = 0;
+        Scheduler* scheduler = nullptr;
+        Fiber::ptr fiber;
+        int thread = -1;
+    };
+
+    //在线程池执行op并挂起当前协程, 完成后恢复errno
+    ssize_t submit(std::function<ssize_t()> op);
+    void run();
+private:
+    MutexType m_mutex;
+    Semaphore m_sem;
+    std::list<Task*> m_tasks;
+    std::vector<Thread::ptr> m_threads;
+    bool m_stopping = false;
+};
+
+typedef Singleton<FileIOManager> FileIOMgr;
+
+}
+
+#endif
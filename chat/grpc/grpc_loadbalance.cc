@@ -57,8 +57,50 @@ void GrpcSDLoadBalance::stop() {
     SDLoadBalance::stop();
 }
 
+//消息内容原样放进key, 用哈希时不同的请求碰撞后会拿到别人的响应
+//消息带长度前缀, 后面追加的头部(名字和值不含换行)不会与它混淆
+static std::string SingleFlightKey(const std::string& domain, const std::string& service
+                                   , const std::string& method, const std::string& data) {
+    std::string key = domain + "\n" + service + "\n" + method;
+    key.append("\n").append(std::to_string(data.size())).append("\n").append(data);
+    return key;
+}
+
 GrpcResponse::ptr GrpcSDLoadBalance::request(const std::string& domain, const std::string& service,
                                            GrpcRequest::ptr req, uint32_t timeout_ms, uint64_t idx) {
+    if (!m_singleFlight) {
+        return innerRequest(domain, service, req, timeout_ms, idx);
+    }
+    std::string key = SingleFlightKey(domain, service, req->getRequest()->getPath()
+            , req->getData() ? req->getData()->data : "");
+    for (auto& i : req->getRequest()->getHeaders()) {
+        key.append("\n").append(i.first).append(":").append(i.second);
+    }
+    return m_flight.call(key, [&]() {
+        return innerRequest(domain, service, req, timeout_ms, idx);
+    });
+}
+
+GrpcResponse::ptr GrpcSDLoadBalance::requestShared(const std::string& key,
+                                           const std::string& domain, const std::string& service,
+                                           const std::string& method, PbMessagePtr message,
+                                           uint32_t timeout_ms,
+                                           const std::map<std::string, std::string>& headers,
+                                           uint64_t idx) {
+    std::string k = key;
+    if (k.empty()) {
+        k = SingleFlightKey(domain, service, method, message->SerializeAsString());
+        for (auto& i : headers) {
+            k.append("\n").append(i.first).append(":").append(i.second);
+        }
+    }
+    return m_flight.call(k, [&]() {
+        return innerRequest(domain, service, method, message, timeout_ms, headers, idx);
+    });
+}
+
+GrpcResponse::ptr GrpcSDLoadBalance::innerRequest(const std::string& domain, const std::string& service,
+                                           GrpcRequest::ptr req, uint32_t timeout_ms, uint64_t idx) {
     auto lb = get(domain, service);
     if(!lb) {
         return std::make_shared<GrpcResponse>(ILoadBalance::NO_SERVICE, "no_service", 0);
@@ -67,12 +109,13 @@ GrpcResponse::ptr GrpcSDLoadBalance::request(const std::string& domain, const st
     if(!conn) {
         return std::make_shared<GrpcResponse>(ILoadBalance::NO_CONNECTION, "no_connection", 0);
     }
-    uint64_t ts = chat::GetCurrentMs();
+    //耗时要精确计算, 缓存时间在任务连续执行时不刷新
+    uint64_t ts = chat::Clock::NowMs();
     auto& stats = conn->get(ts / 1000);
     stats.incDoing(1);
     stats.incTotal(1);
     auto r = conn->getStreamAs<GrpcConnection>()->request(req, timeout_ms);
-    uint64_t ts2 = chat::GetCurrentMs();
+    uint64_t ts2 = chat::Clock::NowMs();
     r->setUsed(ts2 - ts);
     if(r->getResult() == 0) {
         stats.incOks(1);
@@ -91,6 +134,17 @@ GrpcResponse::ptr GrpcSDLoadBalance::request(const std::string& domain, const st
                                            uint32_t timeout_ms,
                                            const std::map<std::string, std::string>& headers,
                                            uint64_t idx) {
+    if (m_singleFlight) {
+        return requestShared("", domain, service, method, message, timeout_ms, headers, idx);
+    }
+    return innerRequest(domain, service, method, message, timeout_ms, headers, idx);
+}
+
+GrpcResponse::ptr GrpcSDLoadBalance::innerRequest(const std::string& domain, const std::string& service,
+                                           const std::string& method, PbMessagePtr message,
+                                           uint32_t timeout_ms,
+                                           const std::map<std::string, std::string>& headers,
+                                           uint64_t idx) {
     auto lb = get(domain, service);
     if(!lb) {
         return std::make_shared<GrpcResponse>(ILoadBalance::NO_SERVICE, "no_service", 0);
@@ -99,12 +153,13 @@ GrpcResponse::ptr GrpcSDLoadBalance::request(const std::string& domain, const st
     if(!conn) {
         return std::make_shared<GrpcResponse>(ILoadBalance::NO_CONNECTION, "no_connection", 0);
     }
-    uint64_t ts = chat::GetCurrentMs();
+    //耗时要精确计算, 缓存时间在任务连续执行时不刷新
+    uint64_t ts = chat::Clock::NowMs();
     auto& stats = conn->get(ts / 1000);
     stats.incDoing(1);
     stats.incTotal(1);
     auto r = conn->getStreamAs<GrpcConnection>()->request(method, message, timeout_ms, headers);
-    uint64_t ts2 = chat::GetCurrentMs();
+    uint64_t ts2 = chat::Clock::NowMs();
     r->setUsed(ts2 - ts);
     if(r->getResult() == 0) {
         stats.incOks(1);
@@ -5,6 +5,7 @@
 #include "grpc_protocol.h"
 #include "chat/streams/load_balance.h"
 #include "chat/util.h"
+#include "chat/singleflight.h"
 
 namespace chat {
 namespace grpc {
@@ -28,6 +29,21 @@ public:
                              const std::map<std::string, std::string>& headers = {},
                              uint64_t idx = -1);
 
+    //按key合并并发的相同unary请求, 不受setSingleFlight影响
+    //key为空时按domain/service/method+消息内容+headers生成
+    GrpcResponse::ptr requestShared(const std::string& key,
+                             const std::string& domain, const std::string& service,
+                             const std::string& method, PbMessagePtr message,
+                             uint32_t timeout_ms,
+                             const std::map<std::string, std::string>& headers = {},
+                             uint64_t idx = -1);
+
+    //开启后request发起的并发相同unary请求合并为一次上游调用
+    void setSingleFlight(bool v) { m_singleFlight = v;}
+    bool isSingleFlight() const { return m_singleFlight;}
+    //合并到其他协程请求上的请求数
+    uint64_t getCoalescedCount() const { return m_flight.getCoalescedCount();}
+
     GrpcStream::ptr openGrpcStream(const std::string& domain, const std::string& service,
                                    const std::string& method,
                                    const std::map<std::string, std::string>& headers = {},
@@ -73,6 +89,17 @@ public:
         return conn->openGrpcBidirectionStream<Req, Rsp>(method, headers);
     }
 
+private:
+    GrpcResponse::ptr innerRequest(const std::string& domain, const std::string& service,
+                             GrpcRequest::ptr req, uint32_t timeout_ms, uint64_t idx);
+    GrpcResponse::ptr innerRequest(const std::string& domain, const std::string& service,
+                             const std::string& method, PbMessagePtr message,
+                             uint32_t timeout_ms,
+                             const std::map<std::string, std::string>& headers,
+                             uint64_t idx);
+private:
+    bool m_singleFlight = false;
+    SingleFlight<GrpcResponse::ptr> m_flight;
 };
 
 
@@ -7,12 +7,14 @@
 #include "iomanager.h"
 #include "config.h"
 #include "fd_manager.h"
+#include <atomic>
 
 static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
 
 namespace chat {
 
 static chat::ConfigVar<int>::ptr g_tcp_connect_timeout = chat::Config::Lookup("tcp.connect.timeout", 5000, "tcp connect timeout");
+static chat::ConfigVar<uint64_t>::ptr g_sleep_slack = chat::Config::Lookup("timer.sleep_slack_us", (uint64_t)0, "hooked sleep timer slack in us");
 static thread_local bool t_hook_enable = false;
 
 #define HOOK_FUN(XX) \
@@ -27,11 +29,14 @@ static thread_local bool t_hook_enable = false;
     XX(recv) \
     XX(recvfrom) \
     XX(recvmsg) \
+    XX(recvmmsg) \
     XX(write) \
     XX(writev) \
     XX(send) \
     XX(sendto) \
     XX(sendmsg) \
+    XX(sendmmsg) \
+    XX(sendfile) \
     XX(close) \
     XX(fcntl) \
     XX(ioctl) \
@@ -50,10 +55,17 @@ void hook_init() {
 }
 
 static uint64_t s_connect_timeout = -1;
+static uint64_t s_sleep_slack = 0;
 struct _HOOKIniter {  
     _HOOKIniter() {
         hook_init();
         s_connect_timeout = g_tcp_connect_timeout->getValue();
+        s_sleep_slack = g_sleep_slack->getValue();
+
+        g_sleep_slack->addListener([](const uint64_t& old_value, const uint64_t& new_value){
+            CHAT_LOG_INFO(g_logger) << "sleep slack changed from " << old_value << " to " << new_value;
+            s_sleep_slack = new_value;
+        });
 
         g_tcp_connect_timeout->addListener([](const int& old_value, const int& new_value){
             CHAT_LOG_INFO(g_logger) << "tcp connect timeout changed from " << old_value << " to " << new_value;
@@ -74,17 +86,85 @@ void set_hook_enable(bool flag) {
 
 }
 
+//阻塞等待时的超时状态, 由等待的协程持有, 超时回调只持有weak_ptr
+//回调可能已从定时器中取出但还没执行(cancel失败), 协程返回后它只能拿到空指针
+//state保证同一次等待只会被超时回调或唤醒的协程之一处理
 struct timer_info {
+    enum State {
+        WAITING = 0,
+        FIRING = 1,
+        DONE = 2
+    };
+    std::atomic<int> state = {WAITING};
     int cancelled = 0;
+    int fd = -1;
+    uint32_t event = 0;
+    chat::IOManager* iom = nullptr;
 };
 
+static void OnIoTimeout(std::weak_ptr<timer_info> weak_info) {
+    std::shared_ptr<timer_info> info = weak_info.lock();
+    if (!info) {
+        return;
+    }
+    int expected = timer_info::WAITING;
+    if (!info->state.compare_exchange_strong(expected, timer_info::FIRING)) {
+        return;
+    }
+    int fd = info->fd;
+    chat::IOManager::Event event = (chat::IOManager::Event)info->event;
+    chat::IOManager* iom = info->iom;
+    info->cancelled = ETIMEDOUT;
+    iom->cancelEvent(fd, event);
+    info->state = timer_info::DONE;
+}
+
+//每个线程缓存已失效的Timer对象, 阻塞路径上复用
+static thread_local std::vector<chat::Timer::ptr> t_timer_pool;
+
+static chat::Timer::ptr arm_io_timer(chat::IOManager* iom, uint64_t ms
+                                     , const std::shared_ptr<timer_info>& info) {
+    std::weak_ptr<timer_info> weak_info(info);
+    auto cb = [weak_info]() { OnIoTimeout(weak_info); };
+    while (!t_timer_pool.empty()) {
+        chat::Timer::ptr timer;
+        timer.swap(t_timer_pool.back());
+        t_timer_pool.pop_back();
+        if (iom->rearmTimerUs(timer, ms * 1000, cb)) {
+            return timer;
+        }
+    }
+    return iom->addTimer(ms, cb);
+}
+
+//协程被唤醒后调用, 返回后超时回调不会再对这次等待的fd做cancelEvent
+static void disarm_io_timer(chat::Timer::ptr& timer, timer_info* info) {
+    if (timer) {
+        timer->cancel();
+    }
+    int expected = timer_info::WAITING;
+    if (!info->state.compare_exchange_strong(expected, timer_info::DONE)) {
+        while (info->state.load() != timer_info::DONE);  //超时回调正在cancelEvent, 很快结束
+    }
+    if (timer) {
+        if (t_timer_pool.size() < 64) {
+            if (t_timer_pool.capacity() < 64) {
+                t_timer_pool.reserve(64);
+            }
+            t_timer_pool.push_back(std::move(timer));
+        }
+        timer.reset();
+    }
+}
+
 template<typename OriginFun, typename ... Args>
 static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t event, int timeout_so, Args&&... args) {
     if (!chat::t_hook_enable) {
         return fun(fd, std::forward<Args>(args)...);
     }
 
-    chat::FdCtx::ptr ctx = chat::FdMgr::GetInstance()->get(fd);
+    //持有引用, 让出期间fd被其他线程关闭时ctx不会被释放
+    chat::FdCtx::ptr ctx = chat::FdMgr::GetInstance()->lookup(fd);
     if (!ctx) {
         return fun(fd, std::forward<Args>(args)...);
     }
@@ -99,7 +179,6 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t
     }
 
     uint64_t to = ctx->getTimeout(timeout_so);
-    std::shared_ptr<timer_info> tinfo = std::make_shared<timer_info>();
 
 retry:
     ssize_t n = fun(fd, std::forward<Args>(args)...);
@@ -107,36 +186,35 @@ retry:
         n = fun(fd, std::forward<Args>(args)...);
     }
 
-    if (n == -1 && errno == EAGAIN) {
+    if (CHAT_UNLIKELY(n == -1 && errno == EAGAIN)) {
         chat::IOManager* iom = chat::IOManager::GetThis();
         chat::Timer::ptr timer;
-        std::weak_ptr<timer_info> winfo(tinfo);
+        std::shared_ptr<timer_info> tinfo = std::make_shared<timer_info>();
+        tinfo->fd = fd;
+        tinfo->event = event;
+        tinfo->iom = iom;
 
         if (to != (uint64_t)-1) {
-            timer = iom->addConditionTimer(to, [winfo, fd, iom, event]() {
-                auto t = winfo.lock();
-                if (!t || t->cancelled) return;
-                t->cancelled = ETIMEDOUT;
-                iom->cancelEvent(fd, (chat::IOManager::Event)(event));
-            }, winfo);
+            timer = arm_io_timer(iom, to, tinfo);
         }
 
         int rt = iom->addEvent(fd, (chat::IOManager::Event)(event));
         if (rt) {
             CHAT_LOG_ERROR(g_logger) << hook_fun_name << " addEvent(" << fd << ", " << event << ")";
-            if (timer) {
-                timer->cancel();
-            }
+            disarm_io_timer(timer, tinfo.get());
             return -1;
         } else {
             chat::Fiber::YieldToHold();
-            if (timer) {
-                timer->cancel();
-            }
+            disarm_io_timer(timer, tinfo.get());
             if (tinfo->cancelled) {
                 errno = tinfo->cancelled;
                 return -1;
             }
+            //被close唤醒, fd号可能已被复用, 不能再重试
+            if (ctx->isClosed()) {
+                errno = EBADF;
+                return -1;
+            }
             goto retry;
         }
     }
@@ -157,7 +235,8 @@ unsigned int sleep(unsigned int seconds) {
 
     chat::Fiber::ptr fiber = chat::Fiber::GetThis();
     chat::IOManager* iom = chat::IOManager::GetThis();
-    iom->addTimer(seconds * 1000, std::bind((void(chat::Scheduler::*)(chat::Fiber::ptr, int thread))&chat::IOManager::schedule, iom, fiber, -1));
+    iom->addTimerUs(seconds * 1000 * 1000ull, std::bind((void(chat::Scheduler::*)(chat::Fiber::ptr, int thread))&chat::IOManager::schedule, iom, fiber, -1)
+                    , false, chat::s_sleep_slack);
     chat::Fiber::YieldToHold();
     return 0;
 }
@@ -169,7 +248,8 @@ int usleep(useconds_t usec) {
 
     chat::Fiber::ptr fiber = chat::Fiber::GetThis();
     chat::IOManager* iom = chat::IOManager::GetThis();
-    iom->addTimer(usec / 1000, std::bind((void(chat::Scheduler::*)(chat::Fiber::ptr, int thread))&chat::IOManager::schedule, iom, fiber, -1));
+    iom->addTimerUs(usec, std::bind((void(chat::Scheduler::*)(chat::Fiber::ptr, int thread))&chat::IOManager::schedule, iom, fiber, -1)
+                    , false, chat::s_sleep_slack);
     chat::Fiber::YieldToHold();
     return 0;
 }
@@ -179,10 +259,11 @@ int nanosleep(const struct timespec* req, struct timespec* rem) {
         return nanosleep_f(req, rem);
     }
 
-    int timeout_ms = req->tv_sec * 1000 + req->tv_nsec / 1000 / 1000;
+    uint64_t timeout_us = req->tv_sec * 1000 * 1000ull + (req->tv_nsec + 999) / 1000;
     chat::Fiber::ptr fiber = chat::Fiber::GetThis();
     chat::IOManager* iom = chat::IOManager::GetThis();
-    iom->addTimer(timeout_ms, std::bind((void(chat::Scheduler::*)(chat::Fiber::ptr, int thread))&chat::IOManager::schedule, iom, fiber, -1));
+    iom->addTimerUs(timeout_us, std::bind((void(chat::Scheduler::*)(chat::Fiber::ptr, int thread))&chat::IOManager::schedule, iom, fiber, -1)
+                    , false, chat::s_sleep_slack);
     chat::Fiber::YieldToHold();
     return 0;
 }
@@ -225,31 +306,24 @@ int connect_with_timeout(int fd, const struct sockaddr *addr, socklen_t addrlen,
     chat::IOManager* iom = chat::IOManager::GetThis();
     chat::Timer::ptr timer;
     std::shared_ptr<timer_info> tinfo = std::make_shared<timer_info>();
-    std::weak_ptr<timer_info> winfo(tinfo);
+    tinfo->fd = fd;
+    tinfo->event = chat::IOManager::WRITE;
+    tinfo->iom = iom;
 
     if (timeout_ms != (uint64_t)-1) {
-        timer = iom->addConditionTimer(timeout_ms, [winfo, fd, iom]() {
-            auto t = winfo.lock();
-            if (!t || t->cancelled) return;
-            t->cancelled = ETIMEDOUT;
-            iom->cancelEvent(fd, chat::IOManager::WRITE);
-        }, winfo);
+        timer = arm_io_timer(iom, timeout_ms, tinfo);
     }
 
     int rt = iom->addEvent(fd, chat::IOManager::WRITE);
     if (rt == 0) {
         chat::Fiber::YieldToHold();
-        if (timer) {
-            timer->cancel();
-        }
+        disarm_io_timer(timer, tinfo.get());
         if(tinfo->cancelled) {
             errno = tinfo->cancelled;
             return -1;
         }
     } else {
-        if (timer) {
-            timer->cancel();
-        }
+        disarm_io_timer(timer, tinfo.get());
         CHAT_LOG_ERROR(g_logger) << "connect addEvent(" << fd << ", WRITE) error";
     }
 
@@ -299,6 +373,10 @@ ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
     return do_io(sockfd, recvmsg_f, "recvmsg", chat::IOManager::READ, SO_RCVTIMEO, msg, flags);
 }
 
+int recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout) {
+    return do_io(sockfd, recvmmsg_f, "recvmmsg", chat::IOManager::READ, SO_RCVTIMEO, msgvec, vlen, flags, timeout);
+}
+
 ssize_t write(int fd, const void *buf, size_t count) {
     return do_io(fd, write_f, "write", chat::IOManager::WRITE, SO_SNDTIMEO, buf, count);
 }
@@ -319,10 +397,20 @@ ssize_t sendmsg(int s, const struct msghdr *msg, int flags) {
     return do_io(s, sendmsg_f, "sendmsg", chat::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
 }
 
+int sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags) {
+    return do_io(sockfd, sendmmsg_f, "sendmmsg", chat::IOManager::WRITE, SO_SNDTIMEO, msgvec, vlen, flags);
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+    return do_io(out_fd, sendfile_f, "sendfile", chat::IOManager::WRITE, SO_SNDTIMEO, in_fd, offset, count);
+}
+
 int close(int fd) {
-    if (chat::t_hook_enable) return close_f(fd);
+    if (!chat::t_hook_enable) return close_f(fd);
     chat::FdCtx::ptr ctx = chat::FdMgr::GetInstance()->get(fd);
     if (ctx) {
+        //先标记关闭再唤醒, 被唤醒的协程不会在旧fd上重新注册事件
+        ctx->close();
         auto iom = chat::IOManager::GetThis();
         if (iom) {
             iom->cancelAll(fd);
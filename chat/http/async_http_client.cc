@@ -0,0 +1,419 @@
+#include "async_http_client.h"
+#include "http_parser.h"
+#include "chat/log.h"
+#include "chat/util.h"
+#include "chat/streams/zlib_stream.h"
+#include <string.h>
+#include <strings.h>
+
+namespace chat {
+namespace http {
+
+static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
+
+bool AsyncHttpConnection::RequestCtx::doSend(AsyncSocketStream::ptr stream) {
+    auto conn = std::static_pointer_cast<AsyncHttpConnection>(stream);
+    //发送前已超时的请求不再发出
+    if (!conn->getCtx(sn)) {
+        return false;
+    }
+    {
+        MutexType::Lock lock(conn->m_mutex);
+        conn->m_pending.push_back({sn, request->getMethod() == HttpMethod::HEAD});
+    }
+    conn->m_wbuf.append(request->toString());
+    return true;
+}
+
+AsyncHttpConnection::AsyncHttpConnection()
+    :AsyncSocketStream(nullptr, true)
+    ,m_rcap(HttpResponseParser::GetHttpResponseBufferSize()) {
+    m_autoConnect = true;
+    m_rbuf.reset(new char[m_rcap + 1]);
+}
+
+AsyncHttpConnection::~AsyncHttpConnection() {
+}
+
+bool AsyncHttpConnection::connect(Address::ptr addr, bool ssl) {
+    m_socket = ssl ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
+    return m_socket->connect(addr);
+}
+
+size_t AsyncHttpConnection::getPendingCount() {
+    MutexType::Lock lock(m_mutex);
+    return m_pending.size();
+}
+
+HttpResult::ptr AsyncHttpConnection::request(HttpRequest::ptr req, uint64_t timeout_ms) {
+    if (!isConnected()) {
+        return std::make_shared<HttpResult>(AsyncSocketStream::NOT_CONNECT, nullptr
+                , "not_connect " + getRemoteAddressString());
+    }
+    RequestCtx::ptr ctx = std::make_shared<RequestCtx>();
+    ctx->request = req;
+    ctx->sn = chat::Atomic::addFetch(m_sn, 1);
+    ctx->timeout = timeout_ms;
+    ctx->scheduler = chat::Scheduler::GetThis();
+    ctx->fiber = chat::Fiber::GetThis();
+    addCtx(ctx);
+    ctx->timer = chat::IOManager::GetThis()->addTimer(timeout_ms,
+            std::bind(&AsyncHttpConnection::onTimeOut
+                , std::static_pointer_cast<AsyncHttpConnection>(shared_from_this()), ctx));
+    enqueue(ctx);
+    chat::Fiber::YieldToHold();
+    if (ctx->result == 0 && !ctx->response) {
+        return std::make_shared<HttpResult>((int)HttpResult::Error::SEND_CLOSE_BY_PEER
+                , nullptr, "closed by peer " + getRemoteAddressString());
+    }
+    return std::make_shared<HttpResult>((int32_t)ctx->result, ctx->response, ctx->resultStr);
+}
+
+void AsyncHttpConnection::doWrite() {
+    try {
+        while (isConnected()) {
+            m_sem.wait();
+            std::list<SendCtx::ptr> ctxs;
+            {
+                RWMutexType::WriteLock lock(m_queueMutex);
+                m_queue.swap(ctxs);
+            }
+            auto self = shared_from_this();
+            for (auto& i : ctxs) {
+                i->doSend(self);
+            }
+            if (m_wbuf.empty()) {
+                continue;
+            }
+            int rt = writeFixSize(m_wbuf.c_str(), m_wbuf.size());
+            m_wbuf.clear();
+            if (rt <= 0) {
+                //读协程随之出错, 由它回收请求并重连
+                SocketStream::close();
+                break;
+            }
+        }
+    } catch (...) {
+        CHAT_LOG_ERROR(g_logger) << "AsyncHttpConnection doWrite exception - " << getRemoteAddressString();
+    }
+    {
+        RWMutexType::WriteLock lock(m_queueMutex);
+        m_queue.clear();
+    }
+    m_wbuf.clear();
+    m_waitSem.notify();
+}
+
+void AsyncHttpConnection::onClose() {
+    MutexType::Lock lock(m_mutex);
+    m_pending.clear();
+    m_rlen = 0;
+}
+
+bool AsyncHttpConnection::fill() {
+    if (m_rlen >= m_rcap) {
+        return false;
+    }
+    int rt = read(m_rbuf.get() + m_rlen, m_rcap - m_rlen);
+    if (rt <= 0) {
+        return false;
+    }
+    m_rlen += rt;
+    m_rbuf[m_rlen] = '\0';
+    return true;
+}
+
+void AsyncHttpConnection::consume(size_t n) {
+    memmove(m_rbuf.get(), m_rbuf.get() + n, m_rlen - n);
+    m_rlen -= n;
+}
+
+bool AsyncHttpConnection::readLine(std::string& line) {
+    size_t scanned = 0;
+    while (true) {
+        char* p = m_rlen > scanned ? (char*)memmem(m_rbuf.get() + scanned
+                , m_rlen - scanned, "\r\n", 2) : nullptr;
+        if (p) {
+            line.assign(m_rbuf.get(), p - m_rbuf.get());
+            consume(p - m_rbuf.get() + 2);
+            return true;
+        }
+        scanned = m_rlen ? m_rlen - 1 : 0;
+        if (!fill()) {
+            return false;
+        }
+    }
+}
+
+bool AsyncHttpConnection::readBody(std::string& body, size_t length) {
+    size_t offset = body.size();
+    if (offset + length > HttpResponseParser::GetHttpResponseMaxBodySize()) {
+        return false;
+    }
+    body.resize(offset + length);
+    size_t n = std::min(length, m_rlen);
+    memcpy(&body[offset], m_rbuf.get(), n);
+    consume(n);
+    if (length > n) {
+        return readFixSize(&body[offset + n], length - n) > 0;
+    }
+    return true;
+}
+
+bool AsyncHttpConnection::readUntilClose(std::string& body) {
+    size_t max = HttpResponseParser::GetHttpResponseMaxBodySize();
+    while (true) {
+        body.append(m_rbuf.get(), m_rlen);
+        m_rlen = 0;
+        m_rbuf[0] = '\0';
+        if (body.size() > max) {
+            return false;
+        }
+        int rt = read(m_rbuf.get(), m_rcap);
+        if (rt == 0) {
+            return true;
+        }
+        if (rt < 0) {
+            return false;
+        }
+        m_rlen = rt;
+        m_rbuf[m_rlen] = '\0';
+    }
+}
+
+bool AsyncHttpConnection::readChunked(std::string& body) {
+    std::string line;
+    while (true) {
+        if (!readLine(line)) {
+            return false;
+        }
+        char* end = nullptr;
+        uint64_t size = strtoull(line.c_str(), &end, 16);
+        if (end == line.c_str() || (*end && *end != ';' && *end != ' ')) {
+            return false;
+        }
+        if (size == 0) {
+            break;
+        }
+        if (!readBody(body, size)
+                || !readLine(line) || !line.empty()) {
+            return false;
+        }
+    }
+    //trailer, 以空行结束
+    do {
+        if (!readLine(line)) {
+            return false;
+        }
+    } while (!line.empty());
+    return true;
+}
+
+AsyncSocketStream::Ctx::ptr AsyncHttpConnection::doRecv() {
+    //等完整的头部到齐再一次性解析, ragel解析器不支持从字段中间续解析
+    size_t scanned = 0;
+    char* end = nullptr;
+    while (!(end = m_rlen > scanned ? (char*)memmem(m_rbuf.get() + scanned
+                    , m_rlen - scanned, "\r\n\r\n", 4) : nullptr)) {
+        scanned = m_rlen > 3 ? m_rlen - 3 : 0;
+        if (!fill()) {
+            SocketStream::close();
+            return nullptr;
+        }
+    }
+    size_t hlen = end - m_rbuf.get() + 4;
+    char c = m_rbuf[hlen];
+    m_rbuf[hlen] = '\0';
+    HttpResponseParser parser;
+    parser.execute(m_rbuf.get(), hlen, false);
+    m_rbuf[hlen] = c;
+    consume(hlen);
+    if (parser.hasError() || !parser.isFinished()) {
+        CHAT_LOG_ERROR(g_logger) << "AsyncHttpConnection parse response error - "
+            << getRemoteAddressString();
+        SocketStream::close();
+        return nullptr;
+    }
+
+    HttpResponse::ptr rsp = parser.getData();
+    int status = (int)rsp->getStatus();
+    //1xx是中间响应, 后面还有最终响应
+    if (status >= 100 && status < 200 && status != 101) {
+        return nullptr;
+    }
+
+    Pending pending;
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_pending.empty()) {
+            lock.unlock();
+            CHAT_LOG_ERROR(g_logger) << "AsyncHttpConnection unexpected response - "
+                << getRemoteAddressString();
+            SocketStream::close();
+            return nullptr;
+        }
+        pending = m_pending.front();
+        m_pending.pop_front();
+    }
+
+    std::string body;
+    bool ok = true;
+    bool until_close = false;
+    if (!pending.head && status != 204 && status != 304) {
+        if (parser.getParser().chunked) {
+            ok = readChunked(body);
+        } else if (!rsp->getHeader("content-length").empty()) {
+            ok = readBody(body, parser.getContentLength());
+        } else {
+            //没有长度, 以连接关闭为结束
+            until_close = true;
+            ok = readUntilClose(body);
+        }
+    }
+    if (!ok) {
+        SocketStream::close();
+        return nullptr;
+    }
+
+    if (!body.empty()) {
+        auto content_encoding = rsp->getHeader("content-encoding");
+        if (strcasecmp(content_encoding.c_str(), "gzip") == 0) {
+            auto zs = ZlibStream::CreateGzip(false);
+            zs->write(body.c_str(), body.size());
+            zs->flush();
+            zs->getResult().swap(body);
+        } else if (strcasecmp(content_encoding.c_str(), "deflate") == 0) {
+            auto zs = ZlibStream::CreateDeflate(false);
+            zs->write(body.c_str(), body.size());
+            zs->flush();
+            zs->getResult().swap(body);
+        }
+        rsp->setBody(body);
+    }
+    rsp->initConnection();
+
+    auto ctx = getAndDelCtxAs<RequestCtx>(pending.sn);
+    if (ctx) {
+        ctx->response = rsp;
+    } else {
+        CHAT_LOG_WARN(g_logger) << "AsyncHttpConnection request timeout response - "
+            << getRemoteAddressString();
+    }
+    if (until_close || rsp->isClose()) {
+        //先交付本响应, 连接关闭后排在后面的请求以io_error返回
+        if (ctx) {
+            ctx->doRsp();
+        }
+        SocketStream::close();
+        return nullptr;
+    }
+    return ctx;
+}
+
+AsyncHttpClient::ptr AsyncHttpClient::Create(const std::string& uri
+                                             ,const std::string& vhost
+                                             ,uint32_t conns) {
+    Uri::ptr turi = Uri::Create(uri);
+    if (!turi) {
+        CHAT_LOG_ERROR(g_logger) << "invalid uri=" << uri;
+        return nullptr;
+    }
+    return std::make_shared<AsyncHttpClient>(turi->getHost()
+            , vhost, turi->getPort(), turi->getScheme() == "https", conns);
+}
+
+AsyncHttpClient::AsyncHttpClient(const std::string& host
+                                 ,const std::string& vhost
+                                 ,uint32_t port
+                                 ,bool is_https
+                                 ,uint32_t conns)
+    :m_host(host)
+    ,m_vhost(vhost)
+    ,m_port(port ? port : (is_https ? 443 : 80))
+    ,m_isHttps(is_https)
+    ,m_size(conns ? conns : 1) {
+}
+
+AsyncHttpClient::~AsyncHttpClient() {
+    stop();
+}
+
+uint32_t AsyncHttpClient::start() {
+    IPAddress::ptr addr = Address::LookupAnyIPAddress(m_host);
+    if (!addr) {
+        CHAT_LOG_ERROR(g_logger) << "get addr fail: " << m_host;
+        return 0;
+    }
+    addr->setPort(m_port);
+    uint32_t connected = 0;
+    std::vector<AsyncSocketStream::ptr> conns;
+    for (uint32_t i = 0; i < m_size; ++i) {
+        AsyncHttpConnection::ptr conn = std::make_shared<AsyncHttpConnection>();
+        //连不上的连接由自动重连继续尝试
+        if (conn->connect(addr, m_isHttps)) {
+            ++connected;
+        }
+        conn->start();
+        conns.push_back(conn);
+    }
+    m_conns.setConnection(conns);
+    return connected;
+}
+
+void AsyncHttpClient::stop() {
+    m_conns.clear();
+}
+
+HttpResult::ptr AsyncHttpClient::doGet(const std::string& url
+                                       , uint64_t timeout_ms
+                                       , const std::map<std::string, std::string>& headers
+                                       , const std::string& body) {
+    return doRequest(HttpMethod::GET, url, timeout_ms, headers, body);
+}
+
+HttpResult::ptr AsyncHttpClient::doPost(const std::string& url
+                                        , uint64_t timeout_ms
+                                        , const std::map<std::string, std::string>& headers
+                                        , const std::string& body) {
+    return doRequest(HttpMethod::POST, url, timeout_ms, headers, body);
+}
+
+HttpResult::ptr AsyncHttpClient::doRequest(HttpMethod method
+                                           , const std::string& url
+                                           , uint64_t timeout_ms
+                                           , const std::map<std::string, std::string>& headers
+                                           , const std::string& body) {
+    HttpRequest::ptr req = std::make_shared<HttpRequest>();
+    req->setPath(url);
+    req->setMethod(method);
+    bool has_host = false;
+    for (auto& i : headers) {
+        //流水线连接必须保持keep-alive
+        if (strcasecmp(i.first.c_str(), "connection") == 0) {
+            continue;
+        }
+        if (!has_host && strcasecmp(i.first.c_str(), "host") == 0) {
+            has_host = !i.second.empty();
+        }
+        req->setHeader(i.first, i.second);
+    }
+    if (!has_host) {
+        req->setHeader("Host", m_vhost.empty() ? m_host : m_vhost);
+    }
+    req->setBody(body);
+    return doRequest(req, timeout_ms);
+}
+
+HttpResult::ptr AsyncHttpClient::doRequest(HttpRequest::ptr req
+                                           , uint64_t timeout_ms) {
+    req->setClose(false);
+    auto conn = m_conns.getAs<AsyncHttpConnection>();
+    if (!conn) {
+        return std::make_shared<HttpResult>((int)HttpResult::Error::POOL_GET_CONNECTION
+                , nullptr, "no connection host:" + m_host + " port:" + std::to_string(m_port));
+    }
+    return conn->request(req, timeout_ms);
+}
+
+}
+}
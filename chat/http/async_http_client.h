@@ -0,0 +1,114 @@
+#ifndef __CHAT_HTTP_ASYNC_HTTP_CLIENT_H__
+#define __CHAT_HTTP_ASYNC_HTTP_CLIENT_H__
+
+#include "chat/streams/async_socket_stream.h"
+#include "http_connection.h"
+#include <deque>
+
+namespace chat {
+namespace http {
+
+//基于AsyncSocketStream的HTTP/1.1长连接, 请求流水线发送
+//写协程把队列中的请求合并成一次write, 并按写出顺序记录序号
+//读协程按FIFO把响应交给对应请求, 已超时的请求的响应被丢弃
+class AsyncHttpConnection : public AsyncSocketStream {
+public:
+    typedef std::shared_ptr<AsyncHttpConnection> ptr;
+    typedef Mutex MutexType;
+
+    AsyncHttpConnection();
+    ~AsyncHttpConnection();
+
+    bool connect(Address::ptr addr, bool ssl = false);
+
+    //在协程中调用, 挂起直到收到响应/超时/连接断开
+    HttpResult::ptr request(HttpRequest::ptr req, uint64_t timeout_ms);
+
+    //已发送未响应的请求数
+    size_t getPendingCount();
+protected:
+    struct RequestCtx : public Ctx {
+        typedef std::shared_ptr<RequestCtx> ptr;
+        HttpRequest::ptr request;
+        HttpResponse::ptr response;
+
+        virtual bool doSend(AsyncSocketStream::ptr stream) override;
+    };
+
+    struct Pending {
+        uint32_t sn;
+        bool head;  //HEAD请求的响应没有body
+    };
+
+    virtual Ctx::ptr doRecv() override;
+    virtual void doWrite() override;
+    virtual void onClose() override;
+
+    bool fill();
+    void consume(size_t n);
+    bool readLine(std::string& line);
+    bool readBody(std::string& body, size_t length);
+    bool readChunked(std::string& body);
+    //没有长度的响应读到对端关闭, 出错或超过响应体上限返回false
+    bool readUntilClose(std::string& body);
+private:
+    MutexType m_mutex;
+    std::deque<Pending> m_pending;
+    //写协程合并发送的缓冲
+    std::string m_wbuf;
+    //读缓冲, 保留上一个响应之后已读到的数据
+    std::unique_ptr<char[]> m_rbuf;
+    size_t m_rlen = 0;
+    size_t m_rcap = 0;
+};
+
+//异步HTTP客户端, 请求分散到少量流水线长连接上, 断线自动重连
+class AsyncHttpClient {
+public:
+    typedef std::shared_ptr<AsyncHttpClient> ptr;
+
+    static AsyncHttpClient::ptr Create(const std::string& uri
+                                       ,const std::string& vhost
+                                       ,uint32_t conns);
+
+    AsyncHttpClient(const std::string& host
+                    ,const std::string& vhost
+                    ,uint32_t port
+                    ,bool is_https
+                    ,uint32_t conns);
+    ~AsyncHttpClient();
+
+    //建立连接, 需要在IOManager中调用, 返回连上的连接数
+    uint32_t start();
+    void stop();
+
+    HttpResult::ptr doGet(const std::string& url
+                          , uint64_t timeout_ms
+                          , const std::map<std::string, std::string>& headers = {}
+                          , const std::string& body = "");
+
+    HttpResult::ptr doPost(const std::string& url
+                           , uint64_t timeout_ms
+                           , const std::map<std::string, std::string>& headers = {}
+                           , const std::string& body = "");
+
+    HttpResult::ptr doRequest(HttpMethod method
+                            , const std::string& url
+                            , uint64_t timeout_ms
+                            , const std::map<std::string, std::string>& headers = {}
+                            , const std::string& body = "");
+    HttpResult::ptr doRequest(HttpRequest::ptr req
+                            , uint64_t timeout_ms);
+private:
+    std::string m_host;
+    std::string m_vhost;
+    uint32_t m_port;
+    bool m_isHttps;
+    uint32_t m_size;
+    AsyncSocketStreamManager m_conns;
+};
+
+}
+}
+
+#endif
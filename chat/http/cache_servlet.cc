@@ -0,0 +1,466 @@
+#include "cache_servlet.h"
+#include "chat/clock.h"
+#include "chat/config.h"
+#include "chat/log.h"
+#include "chat/scheduler.h"
+#include <string.h>
+#include <strings.h>
+#include <functional>
+
+namespace chat {
+namespace http {
+
+static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
+
+static chat::ConfigVar<uint64_t>::ptr g_http_cache_max_bytes =
+    chat::Config::Lookup("http.cache.max_bytes", (uint64_t)(64 * 1024 * 1024), "http response cache max bytes");
+static chat::ConfigVar<uint32_t>::ptr g_http_cache_shards =
+    chat::Config::Lookup("http.cache.shards", (uint32_t)16, "http response cache shards");
+static chat::ConfigVar<uint64_t>::ptr g_http_cache_default_ttl =
+    chat::Config::Lookup("http.cache.default_ttl", (uint64_t)0, "http response cache ttl in ms when no Cache-Control, 0 means not cache");
+static chat::ConfigVar<uint64_t>::ptr g_http_cache_stale_while_revalidate =
+    chat::Config::Lookup("http.cache.stale_while_revalidate", (uint64_t)0, "http response cache stale-while-revalidate in ms");
+
+size_t CacheEntry::getBytes() const {
+    size_t rt = sizeof(CacheEntry) + key.size() + body.size() + etag.size();
+    for (auto& i : headers) {
+        rt += i.first.size() + i.second.size() + sizeof(HttpHeaders::Field);
+    }
+    return rt;
+}
+
+CacheSketch::CacheSketch(size_t width) {
+    size_t w = 64;
+    while (w < width) {
+        w <<= 1;
+    }
+    m_table.resize(w * 4);
+    m_mask = w - 1;
+    m_sampleSize = w * 10;
+}
+
+size_t CacheSketch::index(uint64_t hash, int row) const {
+    static const uint64_t s_seeds[4] = {0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full
+                                       ,0x165667B19E3779F9ull, 0xD6E8FEB86659FD93ull};
+    uint64_t h = (hash + s_seeds[row]) * s_seeds[row];
+    return row * (m_mask + 1) + ((h >> 32) & m_mask);
+}
+
+void CacheSketch::increment(uint64_t hash) {
+    bool added = false;
+    for (int i = 0; i < 4; ++i) {
+        uint8_t& c = m_table[index(hash, i)];
+        if (c < 15) {
+            ++c;
+            added = true;
+        }
+    }
+    if (added && ++m_additions >= m_sampleSize) {
+        reset();
+    }
+}
+
+uint8_t CacheSketch::frequency(uint64_t hash) const {
+    uint8_t rt = 15;
+    for (int i = 0; i < 4; ++i) {
+        rt = std::min(rt, m_table[index(hash, i)]);
+    }
+    return rt;
+}
+
+void CacheSketch::reset() {
+    //老化: 计数减半, 让过去的热点逐渐让位
+    for (auto& i : m_table) {
+        i >>= 1;
+    }
+    m_additions /= 2;
+}
+
+ResponseCache::ResponseCache(uint64_t max_bytes, uint32_t shards)
+    :m_maxBytes(max_bytes) {
+    if (shards == 0) {
+        shards = std::max(1u, g_http_cache_shards->getValue());
+    }
+    m_shardBytes = std::max(m_maxBytes / shards, (uint64_t)1);
+    //按平均1KB一条估计条目数, 决定频率表宽度
+    size_t width = std::min(std::max(m_shardBytes / 1024, (uint64_t)256), (uint64_t)65536);
+    for (uint32_t i = 0; i < shards; ++i) {
+        m_shards.emplace_back(new Shard(width));
+    }
+}
+
+CacheEntry::ptr ResponseCache::get(const std::string& key, uint64_t hash, uint64_t now_ms
+                                   , bool public_only) {
+    Shard& s = getShard(hash);
+    MutexType::Lock lock(s.mutex);
+    s.sketch.increment(hash);
+    auto it = s.index.find(key);
+    if (it == s.index.end()) {
+        ++m_misses;
+        return nullptr;
+    }
+    CacheEntry::ptr entry = *it->second;
+    if (now_ms >= entry->staleTime) {
+        s.bytes -= entry->getBytes();
+        s.lru.erase(it->second);
+        s.index.erase(it);
+        ++m_misses;
+        return nullptr;
+    }
+    if (public_only && !entry->isPublic) {
+        ++m_misses;
+        return nullptr;
+    }
+    s.lru.splice(s.lru.begin(), s.lru, it->second);
+    if (now_ms >= entry->expireTime) {
+        ++m_staleHits;
+    } else {
+        ++m_hits;
+    }
+    return entry;
+}
+
+bool ResponseCache::put(CacheEntry::ptr entry) {
+    size_t bytes = entry->getBytes();
+    //单条不超过分片容量的一半, 避免一个大响应冲掉整片
+    if (bytes > m_shardBytes / 2) {
+        ++m_rejected;
+        return false;
+    }
+    Shard& s = getShard(entry->hash);
+    MutexType::Lock lock(s.mutex);
+    auto it = s.index.find(entry->key);
+    if (it != s.index.end()) {
+        //更新已有条目不需要准入
+        s.bytes -= (*it->second)->getBytes();
+        s.lru.erase(it->second);
+        s.index.erase(it);
+    } else if (s.bytes + bytes > m_shardBytes) {
+        //先确认需要淘汰的尾部条目频率都低于新条目, 否则拒绝且不淘汰任何条目
+        uint8_t freq = s.sketch.frequency(entry->hash);
+        uint64_t need = s.bytes + bytes - m_shardBytes;
+        uint64_t freed = 0;
+        for (auto rit = s.lru.rbegin(); rit != s.lru.rend() && freed < need; ++rit) {
+            auto& victim = *rit;
+            if (entry->createTime < victim->staleTime
+                    && s.sketch.frequency(victim->hash) >= freq) {
+                ++m_rejected;
+                return false;
+            }
+            freed += victim->getBytes();
+        }
+        while (s.bytes + bytes > m_shardBytes && !s.lru.empty()) {
+            auto& victim = s.lru.back();
+            s.bytes -= victim->getBytes();
+            s.index.erase(victim->key);
+            s.lru.pop_back();
+            ++m_evictions;
+        }
+    }
+    s.lru.push_front(entry);
+    s.index[entry->key] = s.lru.begin();
+    s.bytes += bytes;
+    ++m_stores;
+    return true;
+}
+
+void ResponseCache::erase(const std::string& key, uint64_t hash) {
+    Shard& s = getShard(hash);
+    MutexType::Lock lock(s.mutex);
+    auto it = s.index.find(key);
+    if (it == s.index.end()) {
+        return;
+    }
+    s.bytes -= (*it->second)->getBytes();
+    s.lru.erase(it->second);
+    s.index.erase(it);
+}
+
+void ResponseCache::clear() {
+    for (auto& s : m_shards) {
+        MutexType::Lock lock(s->mutex);
+        s->lru.clear();
+        s->index.clear();
+        s->bytes = 0;
+    }
+}
+
+ResponseCache::Stats ResponseCache::getStats() {
+    Stats st;
+    st.hits = m_hits;
+    st.staleHits = m_staleHits;
+    st.misses = m_misses;
+    st.notModified = m_notModified;
+    st.stores = m_stores;
+    st.rejected = m_rejected;
+    st.evictions = m_evictions;
+    st.refreshes = m_refreshes;
+    for (auto& s : m_shards) {
+        MutexType::Lock lock(s->mutex);
+        st.entries += s->index.size();
+        st.bytes += s->bytes;
+    }
+    return st;
+}
+
+static bool EtagMatch(const std::string& header, const std::string& etag) {
+    if (StringUtil::Trim(header) == "*") {
+        return true;
+    }
+    for (auto& i : split(header, ',')) {
+        std::string tag = StringUtil::Trim(i);
+        if (tag.compare(0, 2, "W/") == 0) {
+            tag = tag.substr(2);
+        }
+        if (tag == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool AcceptGzip(const std::string& v) {
+    for (auto& i : split(v, ',')) {
+        auto items = split(i, ';');
+        if (strcasecmp(StringUtil::Trim(items[0]).c_str(), "gzip") != 0) {
+            continue;
+        }
+        if (items.size() > 1) {
+            std::string q = StringUtil::Trim(items[1]);
+            if (q.compare(0, 2, "q=") == 0 && atof(q.c_str() + 2) <= 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+static bool HasNoCache(HttpRequest::ptr request) {
+    auto& headers = request->getHeaders();
+    auto it = headers.find(HttpHeaderId::CACHE_CONTROL);
+    if (it != headers.end() && strcasestr(std::string(it->second).c_str(), "no-cache")) {
+        return true;
+    }
+    it = headers.find(HttpHeaderId::PRAGMA);
+    return it != headers.end() && strcasestr(std::string(it->second).c_str(), "no-cache");
+}
+
+static bool HasCookie(HttpRequest::ptr request) {
+    auto& headers = request->getHeaders();
+    return headers.find(HttpHeaderId::COOKIE) != headers.end();
+}
+
+CacheServlet::CacheServlet(Servlet::ptr servlet, uint64_t max_bytes)
+    :Servlet("CacheServlet")
+    ,m_servlet(servlet)
+    ,m_cache(max_bytes ? max_bytes : g_http_cache_max_bytes->getValue())
+    ,m_defaultTtl(g_http_cache_default_ttl->getValue())
+    ,m_staleTime(g_http_cache_stale_while_revalidate->getValue()) {
+}
+
+std::string CacheServlet::MakeKey(HttpRequest::ptr request) {
+    std::string key = request->getHeader("Host");
+    key.append(request->getPath());
+    if (!request->getQuery().empty()) {
+        key.append("?");
+        key.append(request->getQuery());
+    }
+    //只区分是否接受gzip, 配合Vary: Accept-Encoding
+    key.append(AcceptGzip(request->getHeader("Accept-Encoding")) ? "\ngzip" : "\n");
+    return key;
+}
+
+CacheEntry::ptr CacheServlet::makeEntry(const std::string& key, uint64_t hash
+                                        , HttpResponse::ptr response, uint64_t now_ms) {
+    switch (response->getStatus()) {
+        case HttpStatus::OK:
+        case HttpStatus::NON_AUTHORITATIVE_INFORMATION:
+        case HttpStatus::MOVED_PERMANENTLY:
+        case HttpStatus::NOT_FOUND:
+        case HttpStatus::GONE:
+            break;
+        default:
+            return nullptr;
+    }
+    if (response->getStreamBody() || response->getFileBody()
+            || !response->getCookies().empty() || response->isWebsocket()) {
+        return nullptr;
+    }
+    auto& headers = response->getHeaders();
+    if (headers.find(HttpHeaderId::SET_COOKIE) != headers.end()) {
+        return nullptr;
+    }
+    auto it = headers.find(HttpHeaderId::VARY);
+    if (it != headers.end()) {
+        for (auto& i : split(std::string(it->second), ',')) {
+            if (strcasecmp(StringUtil::Trim(i).c_str(), "Accept-Encoding") != 0) {
+                return nullptr;
+            }
+        }
+    }
+
+    int64_t max_age = -1;
+    int64_t s_maxage = -1;
+    uint64_t stale = m_staleTime;
+    bool is_public = false;
+    it = headers.find(HttpHeaderId::CACHE_CONTROL);
+    if (it != headers.end()) {
+        for (auto& i : split(std::string(it->second), ',')) {
+            std::string v = ToLower(StringUtil::Trim(i));
+            if (v == "no-store" || v == "private" || v == "no-cache") {
+                return nullptr;
+            } else if (v == "public") {
+                is_public = true;
+            } else if (v.compare(0, 9, "s-maxage=") == 0) {
+                s_maxage = atoll(v.c_str() + 9);
+            } else if (v.compare(0, 8, "max-age=") == 0) {
+                max_age = atoll(v.c_str() + 8);
+            } else if (v.compare(0, 23, "stale-while-revalidate=") == 0) {
+                stale = atoll(v.c_str() + 23) * 1000;
+            }
+        }
+    }
+    uint64_t ttl = s_maxage >= 0 ? s_maxage * 1000
+                 : max_age >= 0 ? max_age * 1000 : m_defaultTtl;
+    if (ttl == 0) {
+        return nullptr;
+    }
+
+    CacheEntry::ptr entry = std::make_shared<CacheEntry>();
+    entry->key = key;
+    entry->hash = hash;
+    entry->status = response->getStatus();
+    entry->isPublic = is_public;
+    entry->headers = headers;
+    //连接/长度相关的头部在发送时重新生成
+    entry->headers.erase("Date");
+    entry->headers.erase("Content-Length");
+    entry->headers.erase("Connection");
+    entry->headers.erase("Keep-Alive");
+    entry->headers.erase("Transfer-Encoding");
+    entry->body = response->getBody();
+    it = entry->headers.find(HttpHeaderId::ETAG);
+    if (it != entry->headers.end()) {
+        entry->etag = std::string(it->second);
+    } else {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "\"%zx-%zx\"", entry->body.size()
+                , std::hash<std::string>()(entry->body));
+        entry->etag = buf;
+        entry->headers.set("ETag", entry->etag);
+    }
+    entry->createTime = now_ms;
+    entry->expireTime = now_ms + ttl;
+    entry->staleTime = entry->expireTime + stale;
+    return entry;
+}
+
+void CacheServlet::serve(CacheEntry::ptr entry, HttpRequest::ptr request
+                         , HttpResponse::ptr response, uint64_t now_ms) {
+    response->setStatus(entry->status);
+    response->getHeaders() = entry->headers;
+    response->setHeader("Age", std::to_string((now_ms - entry->createTime) / 1000));
+    response->setBody(std::string());
+    response->setFileBody(nullptr);
+
+    auto& headers = request->getHeaders();
+    auto it = headers.find(HttpHeaderId::IF_NONE_MATCH);
+    if (entry->status == HttpStatus::OK && it != headers.end()
+            && EtagMatch(std::string(it->second), entry->etag)) {
+        ++m_cache.m_notModified;
+        response->setStatus(HttpStatus::NOT_MODIFIED);
+        response->getHeaders().erase("Content-Type");
+        return;
+    }
+    if (request->getMethod() == HttpMethod::HEAD) {
+        response->setHeader("Content-Length", std::to_string(entry->body.size()));
+        return;
+    }
+    if (!entry->body.empty()) {
+        HttpResponse::FileBody::ptr body = std::make_shared<HttpResponse::FileBody>();
+        body->data = entry->body.data();
+        body->length = entry->body.size();
+        body->holder = entry;
+        response->setFileBody(body);
+    }
+}
+
+void CacheServlet::refresh(CacheEntry::ptr entry, HttpRequest::ptr request
+                           , SocketStream::ptr session) {
+    Scheduler* scheduler = Scheduler::GetThis();
+    if (!scheduler) {
+        entry->refreshing.clear();
+        return;
+    }
+    //复制一个不带条件头的GET请求, 路由参数指向原请求的path, 原请求一起保留到刷新结束
+    HttpRequest::ptr req = std::make_shared<HttpRequest>(request->getVersion(), false);
+    req->setMethod(HttpMethod::GET);
+    req->setPath(request->getPath());
+    req->setQuery(request->getQuery());
+    req->setHeaders(request->getHeaders());
+    req->delHeader("If-None-Match");
+    req->delHeader("If-Modified-Since");
+    req->delHeader("Range");
+    req->delHeader("If-Range");
+    req->setRouteParams(request->getRouteParams(), request->getRouteParamCount());
+
+    CacheServlet::ptr self = shared_from_this();
+    scheduler->schedule([self, entry, req, request, session]() {
+        HttpResponse::ptr rsp = std::make_shared<HttpResponse>(req->getVersion(), false);
+        self->m_servlet->handle(req, rsp, session);
+        ++self->m_cache.m_refreshes;
+        CacheEntry::ptr e = self->makeEntry(entry->key, entry->hash, rsp
+                                , Clock::MonotonicCoarseMs());
+        if (e && (e->isPublic || !HasCookie(req))) {
+            self->m_cache.put(e);
+        } else if ((int)rsp->getStatus() < 500) {
+            //5xx时继续使用旧响应直到stale窗口结束
+            self->m_cache.erase(entry->key, entry->hash);
+        }
+        entry->refreshing.clear();
+    });
+}
+
+int32_t CacheServlet::handle(chat::http::HttpRequest::ptr request
+                   , chat::http::HttpResponse::ptr response
+                   , chat::SocketStream::ptr session) {
+    HttpMethod method = request->getMethod();
+    auto& headers = request->getHeaders();
+    if ((method != HttpMethod::GET && method != HttpMethod::HEAD)
+            || headers.find(HttpHeaderId::AUTHORIZATION) != headers.end()) {
+        return m_servlet->handle(request, response, session);
+    }
+
+    std::string key = MakeKey(request);
+    uint64_t hash = std::hash<std::string>()(key);
+    uint64_t now = Clock::MonotonicCoarseMs();
+    bool cookie = HasCookie(request);
+    if (!HasNoCache(request)) {
+        CacheEntry::ptr entry = m_cache.get(key, hash, now, cookie);
+        if (entry) {
+            if (now >= entry->expireTime && !entry->refreshing.test_and_set()) {
+                refresh(entry, request, session);
+            }
+            serve(entry, request, response, now);
+            return 0;
+        }
+    } else {
+        ++m_cache.m_misses;
+    }
+
+    int32_t rt = m_servlet->handle(request, response, session);
+    //HEAD的响应可能没有body, 不能当作GET缓存
+    if (method != HttpMethod::GET) {
+        return rt;
+    }
+    CacheEntry::ptr entry = makeEntry(key, hash, response, now);
+    if (entry && (entry->isPublic || !cookie)) {
+        m_cache.put(entry);
+        serve(entry, request, response, now);
+    }
+    return rt;
+}
+
+}
+}
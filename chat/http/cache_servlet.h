@@ -0,0 +1,158 @@
+#ifndef __CHAT_HTTP_CACHE_SERVLET_H__
+#define __CHAT_HTTP_CACHE_SERVLET_H__
+
+#include <memory>
+#include <string>
+#include <list>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+#include "servlet.h"
+#include "chat/mutex.h"
+
+namespace chat {
+namespace http {
+
+//缓存的一个完整响应, 命中时响应体作为FileBody(fd=-1)直接发出, 不拷贝
+struct CacheEntry {
+    typedef std::shared_ptr<CacheEntry> ptr;
+    std::string key;
+    uint64_t hash = 0;
+    HttpStatus status = HttpStatus::OK;
+    HttpHeaders headers;
+    std::string body;
+    std::string etag;
+    uint64_t createTime = 0;    //ms
+    uint64_t expireTime = 0;    //过期后进入stale-while-revalidate窗口
+    uint64_t staleTime = 0;     //超过后不可再使用
+    bool isPublic = false;      //Cache-Control含public, 可以给带Cookie的请求使用
+    std::atomic_flag refreshing = ATOMIC_FLAG_INIT;
+
+    size_t getBytes() const;
+};
+
+//count-min频率统计, 4行4bit计数(按字节存放), 累计到采样数后全部减半
+//用于TinyLFU准入: 新条目的访问频率高于LRU尾部条目时才淘汰它
+class CacheSketch {
+public:
+    CacheSketch(size_t width = 1024);
+    void increment(uint64_t hash);
+    uint8_t frequency(uint64_t hash) const;
+private:
+    size_t index(uint64_t hash, int row) const;
+    void reset();
+private:
+    std::vector<uint8_t> m_table;
+    size_t m_mask;
+    uint32_t m_additions = 0;
+    uint32_t m_sampleSize;
+};
+
+//按字节限制容量的响应缓存, 分片加锁, 片内LRU + TinyLFU准入
+class ResponseCache {
+public:
+    typedef std::shared_ptr<ResponseCache> ptr;
+    typedef Mutex MutexType;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t staleHits = 0;
+        uint64_t misses = 0;
+        uint64_t notModified = 0;
+        uint64_t stores = 0;
+        uint64_t rejected = 0;      //未通过准入
+        uint64_t evictions = 0;
+        uint64_t refreshes = 0;
+        uint64_t entries = 0;
+        uint64_t bytes = 0;
+    };
+
+    //shards为0时使用配置http.cache.shards
+    ResponseCache(uint64_t max_bytes, uint32_t shards = 0);
+
+    //返回未超过staleTime的条目, 同时记录一次访问频率
+    //public_only为true时只返回Cache-Control含public的条目
+    CacheEntry::ptr get(const std::string& key, uint64_t hash, uint64_t now_ms
+                        , bool public_only = false);
+    //放入缓存, 未通过准入或超过单条上限返回false
+    bool put(CacheEntry::ptr entry);
+    void erase(const std::string& key, uint64_t hash);
+    void clear();
+
+    uint64_t getMaxBytes() const { return m_maxBytes;}
+    Stats getStats();
+private:
+    friend class CacheServlet;
+    struct Shard {
+        MutexType mutex;
+        std::list<CacheEntry::ptr> lru;     //头部为最近使用
+        std::unordered_map<std::string, std::list<CacheEntry::ptr>::iterator> index;
+        uint64_t bytes = 0;
+        CacheSketch sketch;
+        Shard(size_t width):sketch(width) {}
+    };
+    Shard& getShard(uint64_t hash) { return *m_shards[hash % m_shards.size()];}
+private:
+    uint64_t m_maxBytes;
+    uint64_t m_shardBytes;
+    std::vector<std::unique_ptr<Shard> > m_shards;
+    std::atomic<uint64_t> m_hits = {0};
+    std::atomic<uint64_t> m_staleHits = {0};
+    std::atomic<uint64_t> m_misses = {0};
+    std::atomic<uint64_t> m_notModified = {0};
+    std::atomic<uint64_t> m_stores = {0};
+    std::atomic<uint64_t> m_rejected = {0};
+    std::atomic<uint64_t> m_evictions = {0};
+    std::atomic<uint64_t> m_refreshes = {0};
+};
+
+//响应缓存Servlet: 包装任意Servlet, 缓存其GET/HEAD响应
+//  key = Host + path + query, 客户端接受gzip与否各缓存一份
+//  按响应的Cache-Control(s-maxage/max-age/no-store/private)决定是否缓存及TTL, 没有时使用默认TTL
+//  带Authorization的请求、带Set-Cookie或Vary(Accept-Encoding除外)的响应不缓存
+//  带Cookie的请求可能得到个性化的响应, 只使用和缓存Cache-Control显式public的响应
+//  命中时处理If-None-Match, 返回304; 没有ETag的响应按内容生成
+//  过期但在stale-while-revalidate窗口内时直接返回旧响应, 由后台协程刷新
+class CacheServlet : public Servlet, public std::enable_shared_from_this<CacheServlet> {
+public:
+    typedef std::shared_ptr<CacheServlet> ptr;
+
+    //max_bytes为0时使用配置http.cache.max_bytes
+    CacheServlet(Servlet::ptr servlet, uint64_t max_bytes = 0);
+
+    virtual int32_t handle(chat::http::HttpRequest::ptr request
+                   , chat::http::HttpResponse::ptr response
+                   , chat::SocketStream::ptr session) override;
+
+    //响应没有Cache-Control时的TTL(ms), 0表示不缓存
+    void setDefaultTtl(uint64_t v) { m_defaultTtl = v;}
+    uint64_t getDefaultTtl() const { return m_defaultTtl;}
+    //响应没有stale-while-revalidate时的窗口(ms)
+    void setStaleWhileRevalidate(uint64_t v) { m_staleTime = v;}
+    uint64_t getStaleWhileRevalidate() const { return m_staleTime;}
+
+    Servlet::ptr getServlet() const { return m_servlet;}
+    ResponseCache& getCache() { return m_cache;}
+    ResponseCache::Stats getStats() { return m_cache.getStats();}
+
+    static std::string MakeKey(HttpRequest::ptr request);
+private:
+    //根据响应生成缓存条目, 不可缓存返回nullptr
+    CacheEntry::ptr makeEntry(const std::string& key, uint64_t hash
+                              , HttpResponse::ptr response, uint64_t now_ms);
+    void serve(CacheEntry::ptr entry, HttpRequest::ptr request
+               , HttpResponse::ptr response, uint64_t now_ms);
+    //后台刷新时把原连接传给被包装的Servlet, 供其读取对端地址等信息;
+    //可缓存的响应不会是直接写连接的流式响应, 刷新结果也不会写回这个连接
+    void refresh(CacheEntry::ptr entry, HttpRequest::ptr request, SocketStream::ptr session);
+private:
+    Servlet::ptr m_servlet;
+    ResponseCache m_cache;
+    uint64_t m_defaultTtl;
+    uint64_t m_staleTime;
+};
+
+}
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include "http.h"
+#include "http_parser.h"
 #include "chat/util.h"
+#include "chat/clock.h"
 
 namespace chat {
 namespace http {
@@ -24,6 +26,16 @@ HttpMethod CharsToHttpMethod(const char* m) {
     return HttpMethod::INVALID_METHOD;
 }
 
+HttpMethod CharsToHttpMethod(const char* m, size_t len) {
+#define XX(num, name, string) \
+    if(len == sizeof(#string) - 1 && memcmp(#string, m, len) == 0) { \
+        return HttpMethod::name; \
+    }
+    HTTP_METHOD_MAP(XX)
+#undef XX
+    return HttpMethod::INVALID_METHOD;
+}
+
 static const char* s_method_string[] = {
 #define XX(num, name, string) #string,
     HTTP_METHOD_MAP(XX)
@@ -61,13 +73,14 @@ HttpRequest::HttpRequest(uint8_t version, bool close)
     ,m_close(close)
     ,m_websocket(false)
     ,m_parserParamFlag(0)
+    ,m_routeParamCount(0)
     ,m_streamId(0)
     ,m_path("/") {
 }
 
 std::string HttpRequest::getHeader(const std::string& key, const std::string& def) const {
     auto it = m_headers.find(key);
-    return it == m_headers.end() ? def : it->second;
+    return it == m_headers.end() ? def : std::string(it->second);
 }
 
 std::shared_ptr<HttpResponse> HttpRequest::createResponse() {
@@ -103,24 +116,83 @@ std::string HttpRequest::getUri() {
 }
 
 void HttpRequest::paramToQuery() {
-    m_query = chat::MapJoin(m_params.begin(), m_params.end());
+    auto& params = getParams();
+    std::string query = chat::MapJoin(params.begin(), params.end());
+    setQuery(query);
 }
 
-std::string HttpRequest::getParam(const std::string& key, const std::string& def) {
+void HttpRequest::setQuery(const std::string& v) {
+    m_query = v;
+    resetParams(QUERY);
+}
+
+void HttpRequest::setBody(const std::string& v) {
+    m_body = v;
+    m_bodyStream = nullptr;
+    resetParams(BODY);
+}
+
+const std::string& HttpRequest::getBody() const {
+    if (!m_bodyStream) {
+        return m_body;
+    }
+    //chunked请求的Content-Length已被HttpSession删除
+    uint64_t length = 0;
+    auto it = m_headers.find(HttpHeaderId::CONTENT_LENGTH);
+    if (it != m_headers.end()) {
+        length = strtoull(std::string(it->second).c_str(), nullptr, 10);
+    }
+    if (length > 0) {
+        if (length <= HttpRequestParser::GetHttpRequestMaxBodySize()) {
+            m_body.resize(length);
+            if (m_bodyStream->readFixSize(&m_body[0], length) <= 0) {
+                m_body.clear();
+            }
+        }
+    } else {
+        char buf[4096];
+        int rt = 0;
+        while ((rt = m_bodyStream->read(buf, sizeof(buf))) > 0) {
+            m_body.append(buf, rt);
+        }
+        if (rt < 0) {
+            //不完整的请求体不交给业务
+            m_body.clear();
+        }
+    }
+    m_bodyStream = nullptr;
+    return m_body;
+}
+
+const HttpRequest::MapType& HttpRequest::getParams() {
     initQueryParam();
     initBodyParam();
-    auto it = m_params.find(key);
-    return it == m_params.end() ? def : it->second;
+    expandParams(QUERY, m_params);
+    expandParams(BODY, m_params);
+    return m_params;
 }
 
-std::string HttpRequest::getCookie(const std::string& key, const std::string& def) {
+const HttpRequest::MapType& HttpRequest::getCookies() {
     initCookies();
-    auto it = m_cookies.find(key);
-    return it == m_cookies.end() ? def : it->second;
+    expandParams(COOKIE, m_cookies);
+    return m_cookies;
+}
+
+std::string HttpRequest::getParam(const std::string& key, const std::string& def) {
+    std::string val;
+    return hasParam(key, &val) ? val : def;
+}
+
+std::string HttpRequest::getCookie(const std::string& key, const std::string& def) {
+    std::string val;
+    return hasCookie(key, &val) ? val : def;
 }
 
 void HttpRequest::setHeader(const std::string& key, const std::string& val) {
-    m_headers[key] = val;
+    m_headers.set(key, val);
+    if (strcasecmp(key.c_str(), "cookie") == 0) {
+        resetParams(COOKIE);
+    }
 }
 
 void HttpRequest::setParam(const std::string& key, const std::string& val) {
@@ -133,14 +205,23 @@ void HttpRequest::setCookie(const std::string& key, const std::string& val) {
 
 void HttpRequest::delHeader(const std::string& key) {
     m_headers.erase(key);
+    if (strcasecmp(key.c_str(), "cookie") == 0) {
+        resetParams(COOKIE);
+    }
 }
 
 void HttpRequest::delParam(const std::string& key) {
+    initQueryParam();
+    initBodyParam();
     m_params.erase(key);
+    eraseParam(QUERY, key);
+    eraseParam(BODY, key);
 }
 
 void HttpRequest::delCookie(const std::string& key) {
+    initCookies();
     m_cookies.erase(key);
+    eraseParam(COOKIE, key);
 }
 
 bool HttpRequest::hasHeader(const std::string& key, std::string* val) {
@@ -155,28 +236,31 @@ bool HttpRequest::hasHeader(const std::string& key, std::string* val) {
 }
 
 bool HttpRequest::hasParam(const std::string& key, std::string* val) {
-    initQueryParam();
-    initBodyParam();
     auto it = m_params.find(key);
-    if(it == m_params.end()) {
-        return false;
+    if(it != m_params.end()) {
+        if(val) {
+            *val = it->second;
+        }
+        return true;
     }
-    if(val) {
-        *val = it->second;
+    initQueryParam();
+    if (findParam(QUERY, key, val)) {
+        return true;
     }
-    return true;
+    initBodyParam();
+    return findParam(BODY, key, val);
 }
 
 bool HttpRequest::hasCookie(const std::string& key, std::string* val) {
-    initCookies();
     auto it = m_cookies.find(key);
-    if (it == m_cookies.end()) {
-        return false;
-    }
-    if(val) {
-        *val = it->second;
+    if (it != m_cookies.end()) {
+        if(val) {
+            *val = it->second;
+        }
+        return true;
     }
-    return true;
+    initCookies();
+    return findParam(COOKIE, key, val);
 }
 
 std::string HttpRequest::toString() const {
@@ -204,10 +288,10 @@ std::ostream& HttpRequest::dump(std::ostream& os) const {
         os << "connection: " << (m_close ? "close" : "keep-alive") << "\r\n";
     }
     for (auto& i : m_headers) {
-        if (!m_websocket && strcasecmp(i.first.c_str(), "connection") == 0) {
+        if (!m_websocket && i.id == HttpHeaderId::CONNECTION) {
             continue;
         }
-        if(!strcasecmp(i.first.c_str(), "content-length")) {
+        if(i.id == HttpHeaderId::CONTENT_LENGTH) {
             continue;
         }
         os << i.first << ": " << i.second << "\r\n";
@@ -224,14 +308,25 @@ std::ostream& HttpRequest::dump(std::ostream& os) const {
 }
 
 void HttpRequest::init() {
-    std::string conn = getHeader("connection");
-    if (!conn.empty()) {
-        if(strcasecmp(conn.c_str(), "keep-alive") == 0) {
-            m_close = false;
-        } else {
-            m_close = true;
+    auto it = m_headers.find(HttpHeaderId::CONNECTION);
+    if (it != m_headers.end() && !it->second.empty()) {
+        m_close = !(it->second.size() == 10
+                    && strncasecmp(it->second.data(), "keep-alive", 10) == 0);
+    }
+}
+
+std::string_view HttpRequest::getRouteParam(std::string_view key, std::string_view def) const {
+    for (size_t i = 0; i < m_routeParamCount; ++i) {
+        if (m_routeParams[i].first == key) {
+            return m_routeParams[i].second;
         }
     }
+    return def;
+}
+
+void HttpRequest::setRouteParams(const RouteParam* params, size_t count) {
+    m_routeParamCount = std::min(count, MAX_ROUTE_PARAMS);
+    std::copy(params, params + m_routeParamCount, m_routeParams);
 }
 
 void HttpRequest::initParam() {
@@ -240,30 +335,108 @@ void HttpRequest::initParam() {
     initCookies();
 }
 
-#define PARSE_PARAM(str, m, flag, trim) \
-    size_t pos = 0; \
-    do { \
-        size_t last = pos; \
-        pos = str.find('=', pos); \
-        if(pos == std::string::npos) { \
-            break; \
-        } \
-        size_t key = pos; \
-        pos = str.find(flag, pos); \
-        m.insert(std::make_pair(trim(str.substr(last, key - last)), \
-                    chat::StringUtil::UrlDecode(str.substr(key + 1, pos - key - 1)))); \
-        if(pos == std::string::npos) { \
-            break; \
-        } \
-        ++pos; \
-    } while(true);
+std::string_view HttpRequest::getParamSource(int src) const {
+    if (src == QUERY) {
+        return m_query;
+    }
+    if (src == BODY) {
+        return getBody();
+    }
+    auto it = m_headers.find(HttpHeaderId::COOKIE);
+    return it == m_headers.end() ? std::string_view() : it->second;
+}
+
+void HttpRequest::indexParams(int src, char sep, bool trim) {
+    std::string_view str = getParamSource(src);
+    auto& spans = m_paramSpans[src];
+    size_t pos = 0;
+    while (pos < str.size()) {
+        size_t end = str.find(sep, pos);
+        if (end == std::string_view::npos) {
+            end = str.size();
+        }
+        size_t eq = str.find('=', pos);
+        if (eq < end) {
+            size_t k = pos;
+            size_t kend = eq;
+            if (trim) {
+                while (k < kend && isspace((unsigned char)str[k])) {
+                    ++k;
+                }
+                while (kend > k && isspace((unsigned char)str[kend - 1])) {
+                    --kend;
+                }
+            }
+            if (spans.empty()) {
+                spans.reserve(8);
+            }
+            spans.push_back({(uint32_t)k, (uint32_t)(kend - k)
+                            , (uint32_t)(eq + 1), (uint32_t)(end - eq - 1)});
+        }
+        pos = end + 1;
+    }
+}
+
+static inline bool ParamKeyEqual(std::string_view a, const std::string& b) {
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+static inline void DecodeParam(std::string_view raw, std::string& out) {
+    if (raw.find_first_of("%+") == std::string_view::npos) {
+        out.assign(raw.data(), raw.size());
+    } else {
+        out = chat::StringUtil::UrlDecode(std::string(raw));
+    }
+}
+
+//同名参数取第一个
+bool HttpRequest::findParam(int src, const std::string& key, std::string* val) const {
+    std::string_view str = getParamSource(src);
+    for (auto& i : m_paramSpans[src]) {
+        if (ParamKeyEqual(str.substr(i.key, i.key_len), key)) {
+            if (val) {
+                DecodeParam(str.substr(i.val, i.val_len), *val);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void HttpRequest::eraseParam(int src, const std::string& key) {
+    std::string_view str = getParamSource(src);
+    auto& spans = m_paramSpans[src];
+    for (auto it = spans.begin(); it != spans.end();) {
+        if (ParamKeyEqual(str.substr(it->key, it->key_len), key)) {
+            it = spans.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+//展开进map后清空索引, map中已有的key不覆盖
+void HttpRequest::expandParams(int src, MapType& m) {
+    std::string_view str = getParamSource(src);
+    auto& spans = m_paramSpans[src];
+    for (auto& i : spans) {
+        std::string val;
+        DecodeParam(str.substr(i.val, i.val_len), val);
+        m.insert(std::make_pair(std::string(str.substr(i.key, i.key_len)), std::move(val)));
+    }
+    spans.clear();
+}
+
+void HttpRequest::resetParams(int src) {
+    m_paramSpans[src].clear();
+    m_parserParamFlag &= ~(1 << src);
+}
 
 void HttpRequest::initQueryParam() {
     if (m_parserParamFlag & 0x1) {
         return;
     }
-
-    PARSE_PARAM(m_query, m_params, '&', );
+    indexParams(QUERY, '&', false);
     m_parserParamFlag |= 0x1;
 }
 
@@ -271,25 +444,26 @@ void HttpRequest::initBodyParam() {
     if(m_parserParamFlag & 0x2) {
         return;
     }
-    std::string content_type = getHeader("content-type");
-    if(strcasestr(content_type.c_str(), "application/x-www-form-urlencoded") == nullptr) {
-        m_parserParamFlag |= 0x2;
+    m_parserParamFlag |= 0x2;
+    static const std::string_view s_form = "application/x-www-form-urlencoded";
+    auto it = m_headers.find(HttpHeaderId::CONTENT_TYPE);
+    if (it == m_headers.end() || it->second.size() < s_form.size()
+            || strncasecmp(it->second.data(), s_form.data(), s_form.size()) != 0) {
         return;
     }
-    PARSE_PARAM(m_body, m_params, '&',);
-    m_parserParamFlag |= 0x2;
+    indexParams(BODY, '&', false);
 }
 
 void HttpRequest::initCookies() {
-    if(m_parserParamFlag & 0x4) {
-        return;
-    }
-    std::string cookie = getHeader("cookie");
-    if(cookie.empty()) {
-        m_parserParamFlag |= 0x4;
+    //Cookie头可能通过getHeaders()被直接修改, 视图变了就重新索引
+    std::string_view cookie = getParamSource(COOKIE);
+    if((m_parserParamFlag & 0x4) && cookie.data() == m_cookieView.data()
+            && cookie.size() == m_cookieView.size()) {
         return;
     }
-    PARSE_PARAM(cookie, m_cookies, ';', chat::StringUtil::Trim);
+    m_paramSpans[COOKIE].clear();
+    m_cookieView = cookie;
+    indexParams(COOKIE, ';', true);
     m_parserParamFlag |= 0x4;
 }
 
@@ -302,11 +476,11 @@ HttpResponse::HttpResponse(uint8_t version, bool close)
 
 std::string HttpResponse::getHeader(const std::string& key, const std::string& def) const {
     auto it = m_headers.find(key);
-    return it == m_headers.end() ? def : it->second;
+    return it == m_headers.end() ? def : std::string(it->second);
 }
 
 void HttpResponse::setHeader(const std::string& key, const std::string& val) {
-    m_headers[key] = val;
+    m_headers.set(key, val);
 }
 
 void HttpResponse::delHeader(const std::string& key) {
@@ -340,12 +514,12 @@ void HttpResponse::setCookie(const std::string& key, const std::string& val,
 
 void HttpResponse::initConnection() {
     std::string conn = getHeader("connection");
-    if(!conn.empty()) {
-        if(strcasecmp(conn.c_str(), "keep-alive") == 0) {
-            m_close = false;
-        } else {
-            m_close = m_version == 0x10;
-        }
+    if(strcasecmp(conn.c_str(), "keep-alive") == 0) {
+        m_close = false;
+    } else if(strcasecmp(conn.c_str(), "close") == 0) {
+        m_close = true;
+    } else {
+        m_close = m_version == 0x10;
     }
 }
 
@@ -368,10 +542,10 @@ std::ostream& HttpResponse::dump(std::ostream& os) const {
 
     bool has_content_length = false;
     for (auto& i : m_headers) {
-        if(!m_websocket && strcasecmp(i.first.c_str(), "connection") == 0) {
+        if(!m_websocket && i.id == HttpHeaderId::CONNECTION) {
             continue;
         }
-        if(!has_content_length && strcasecmp(i.first.c_str(), "content-length") == 0) {
+        if(i.id == HttpHeaderId::CONTENT_LENGTH) {
             has_content_length = true;
         }
         os << i.first << ": " << i.second << "\r\n";
@@ -382,7 +556,13 @@ std::ostream& HttpResponse::dump(std::ostream& os) const {
     if (!m_websocket) {
         os << "connection: " << (m_close ? "close" : "keep-alive") << "\r\n";
     }
-    if (!m_body.empty()) {
+    if (m_fileBody) {
+        //文件内容由HttpSession在头部之后发送
+        if(!has_content_length) {
+            os << "content-length: " << m_fileBody->length << "\r\n";
+        }
+        os << "\r\n";
+    } else if (!m_body.empty()) {
         if(!has_content_length) {
             os << "content-length: " << m_body.size() << "\r\n\r\n" << m_body;
         } else {
@@ -394,6 +574,113 @@ std::ostream& HttpResponse::dump(std::ostream& os) const {
     return os;
 }
 
+//状态行按版本和状态码缓存
+static const std::string& GetStatusLine(uint8_t version, HttpStatus status) {
+    static const std::vector<std::string> s_lines[2] = {
+        [](){
+            std::vector<std::string> v(600);
+#define XX(code, name, msg) \
+            v[code] = "HTTP/1.0 " #code " " #msg "\r\n";
+            HTTP_STATUS_MAP(XX);
+#undef XX
+            return v;
+        }(),
+        [](){
+            std::vector<std::string> v(600);
+#define XX(code, name, msg) \
+            v[code] = "HTTP/1.1 " #code " " #msg "\r\n";
+            HTTP_STATUS_MAP(XX);
+#undef XX
+            return v;
+        }()
+    };
+    static const std::string s_empty;
+    uint32_t code = (uint32_t)status;
+    if ((version != 0x10 && version != 0x11) || code >= 600) {
+        return s_empty;
+    }
+    return s_lines[version & 0x01][code];
+}
+
+//Date头每秒格式化一次, 每个线程一份
+static const std::string& GetDateLine() {
+    static thread_local uint64_t s_sec = 0;
+    static thread_local std::string s_line;
+    uint64_t now = chat::Clock::CachedSec();
+    if (now != s_sec) {
+        time_t t = now;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        char buf[64];
+        size_t n = strftime(buf, sizeof(buf), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+        s_line.assign(buf, n);
+        s_sec = now;
+    }
+    return s_line;
+}
+
+void HttpResponse::dumpHeader(std::string& out) const {
+    const std::string* status_line = m_reason.empty() ? &GetStatusLine(m_version, m_status) : nullptr;
+    if (status_line && !status_line->empty()) {
+        out.append(*status_line);
+    } else {
+        out.append("HTTP/");
+        out.append(std::to_string(m_version >> 4));
+        out.append(".");
+        out.append(std::to_string(m_version & 0x0F));
+        out.append(" ");
+        out.append(std::to_string((uint32_t)m_status));
+        out.append(" ");
+        out.append(m_reason.empty() ? HttpStatusToString(m_status) : m_reason);
+        out.append("\r\n");
+    }
+
+    bool has_content_length = false;
+    bool has_date = false;
+    for (auto& i : m_headers) {
+        if(!m_websocket && i.id == HttpHeaderId::CONNECTION) {
+            continue;
+        }
+        if(i.id == HttpHeaderId::CONTENT_LENGTH) {
+            has_content_length = true;
+        }
+        if(i.id == HttpHeaderId::DATE) {
+            has_date = true;
+        }
+        out.append(i.first);
+        out.append(": ");
+        out.append(i.second);
+        out.append("\r\n");
+    }
+    for (auto& i : m_cookies) {
+        out.append("Set-Cookie: ");
+        out.append(i);
+        out.append("\r\n");
+    }
+    if (!has_date) {
+        out.append(GetDateLine());
+    }
+    if (!m_websocket) {
+        out.append(m_close ? "connection: close\r\n" : "connection: keep-alive\r\n");
+    }
+    if(!has_content_length) {
+        if (m_streamBody) {
+            if (m_version >= 0x11) {
+                out.append("transfer-encoding: chunked\r\n");
+            }
+        } else if (m_fileBody) {
+            out.append("content-length: ");
+            out.append(std::to_string(m_fileBody->length));
+            out.append("\r\n");
+        } else if (!m_body.empty()) {
+            out.append("content-length: ");
+            out.append(std::to_string(m_body.size()));
+            out.append("\r\n");
+        }
+    }
+    out.append("\r\n");
+}
+
 std::ostream& operator<<(std::ostream& os, const HttpRequest& req) {
     return req.dump(os);
 }
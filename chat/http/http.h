@@ -6,7 +6,10 @@
 #include <map>
 #include <iostream>
 #include <sstream>
+#include <functional>
 #include <boost/lexical_cast.hpp>
+#include "http_headers.h"
+#include "chat/stream.h"
 
 
 namespace chat{
@@ -140,6 +143,8 @@ enum class HttpStatus {
 
 HttpMethod StringToHttpMethod(const std::string& m);
 HttpMethod CharsToHttpMethod(const char* m);
+//按完整token匹配, 不要求以'\0'结尾
+HttpMethod CharsToHttpMethod(const char* m, size_t len);
 const char* HttpMethodToString(const HttpMethod& m);
 const char* HttpStatusToString(const HttpStatus& s);
 
@@ -166,6 +171,18 @@ bool checkGetAs(const MapType& m, const std::string& key, T& val, const T& def =
     return false;
 }
 
+//字符串转成对应类型,返回是否成功
+template<class T>
+bool checkCastAs(const std::string& str, T& val, const T& def = T()) {
+    try {
+        val = boost::lexical_cast<T>(str);
+        return true;
+    } catch (...) {
+        val = def;
+    }
+    return false;
+}
+
 //获取Map中的key值,并转成对应类型
 template<class MapType, class T>
 T getAs(const MapType& m, const std::string& key, const T& def = T()) {
@@ -186,6 +203,9 @@ class HttpRequest {
 public:
     typedef std::shared_ptr<HttpRequest> ptr;
     typedef std::map<std::string, std::string, CaseInsensitiveLess> MapType;
+    //路由捕获的参数: 名称指向路由树节点, 值指向m_path, 不额外分配内存
+    typedef std::pair<std::string_view, std::string_view> RouteParam;
+    static constexpr size_t MAX_ROUTE_PARAMS = 8;
 
     HttpRequest(uint8_t version = 0x11, bool close = true);
 
@@ -198,10 +218,17 @@ public:
     uint8_t getVersion() const { return m_version;}
     const std::string& getPath() const { return m_path;}
     const std::string& getQuery() const { return m_query;}
-    const std::string& getBody() const { return m_body;}
-    const MapType& getHeaders() const { return m_headers;}
-    const MapType& getParams() const { return m_params;}
-    const MapType& getCookies() const { return m_cookies;}
+    //有流式请求体时, 首次调用把流中剩余的数据全部读入
+    const std::string& getBody() const;
+    //流式请求体, 由HttpSession在请求头解析完后设置, 读到0表示结束
+    //直接读它可以边收边处理, 不整体缓存
+    Stream::ptr getBodyStream() const { return m_bodyStream;}
+    void setBodyStream(Stream::ptr v) { m_bodyStream = v;}
+    const HttpHeaders& getHeaders() const { return m_headers;}
+    HttpHeaders& getHeaders() { return m_headers;}
+    //返回全部参数/Cookie, 会把懒解析的索引展开进map
+    const MapType& getParams();
+    const MapType& getCookies();
     const std::string& getFragment() const { return m_fragment;}
     
     void paramToQuery();
@@ -209,9 +236,9 @@ public:
     void setMethod(HttpMethod v) { m_method = v;}
     void setVersion(uint8_t v) { m_version = v;}
     void setPath(const std::string& v) { m_path = v;}
-    void setQuery(const std::string& v) { m_query = v;}
+    void setQuery(const std::string& v);
     void setFragment(const std::string& v) { m_fragment = v;}
-    void setBody(const std::string& v) { m_body = v;}
+    void setBody(const std::string& v);
 
     bool isClose() const { return m_close;}
     void setClose(bool v) { m_close = v;}
@@ -222,7 +249,7 @@ public:
     uint32_t getStreamId() const { return m_streamId;}
     void setStreamId(uint32_t v) { m_streamId = v;}
 
-    void setHeaders(const MapType& v) { m_headers = v;}
+    void setHeaders(const HttpHeaders& v) { m_headers = v;}
     void setParams(const MapType& v) { m_params = v;}
     void setCookies(const MapType& v) { m_cookies = v;}
 
@@ -242,6 +269,12 @@ public:
     bool hasParam(const std::string& key, std::string* val = nullptr);
     bool hasCookie(const std::string& key, std::string* val = nullptr);
 
+    //路由参数, 在setPath之前有效
+    std::string_view getRouteParam(std::string_view key, std::string_view def = "") const;
+    const RouteParam* getRouteParams() const { return m_routeParams;}
+    size_t getRouteParamCount() const { return m_routeParamCount;}
+    void setRouteParams(const RouteParam* params, size_t count);
+
     //检查并获取HTTP请求的头部参数
     template<class T>
     bool checkGetHeaderAs(const std::string& key, T& val, const T& def = T()) {
@@ -257,31 +290,39 @@ public:
     //检查并获取HTTP请求的请求参数
     template<class T>
     bool checkGetParamAs(const std::string& key, T& val, const T& def = T()) {
-        initQueryParam();
-        initBodyParam();
-        return checkGetAs(m_params, key, val, def);
+        std::string str;
+        if (!hasParam(key, &str)) {
+            val = def;
+            return false;
+        }
+        return checkCastAs(str, val, def);
     }
 
     //获取HTTP请求的请求参数
     template<class T>
     T getParamAs(const std::string& key, const T& def = T()) {
-        initQueryParam();
-        initBodyParam();
-        return getAs(m_params, key, def);
+        T val;
+        checkGetParamAs(key, val, def);
+        return val;
     }
 
     //检查并获取HTTP请求的Cookie参数
     template<class T>
     bool checkGetCookieAs(const std::string& key, T& val, const T& def = T()) {
-        initCookies();
-        return checkGetAs(m_cookies, key, val, def);
+        std::string str;
+        if (!hasCookie(key, &str)) {
+            val = def;
+            return false;
+        }
+        return checkCastAs(str, val, def);
     }
 
     //获取HTTP请求的Cookie参数
     template<class T>
     T getCookieAs(const std::string& key, const T& def = T()) {
-        initCookies();
-        return getAs(m_cookies, key, def);
+        T val;
+        checkGetCookieAs(key, val, def);
+        return val;
     }
 
     std::ostream& dump(std::ostream& os) const;
@@ -289,11 +330,31 @@ public:
     std::string toString() const;
 
     void init();
+    //只切分并记录偏移, 不做UrlDecode, 各自只执行一次
     void initParam();
     void initQueryParam();
     void initBodyParam();
     void initCookies();
 
+private:
+    //懒解析的参数: key/value在源串(query/body/Cookie头)中的偏移, 取值时才UrlDecode
+    struct ParamSpan {
+        uint32_t key;
+        uint32_t key_len;
+        uint32_t val;
+        uint32_t val_len;
+    };
+    enum ParamSource {
+        QUERY = 0,
+        BODY = 1,
+        COOKIE = 2
+    };
+    std::string_view getParamSource(int src) const;
+    void indexParams(int src, char sep, bool trim);
+    bool findParam(int src, const std::string& key, std::string* val) const;
+    void eraseParam(int src, const std::string& key);
+    void expandParams(int src, MapType& m);
+    void resetParams(int src);
 private:
     HttpMethod m_method;
     uint8_t m_version;
@@ -303,14 +364,21 @@ private:
     bool m_websocket;
 
     uint8_t m_parserParamFlag;
+    uint8_t m_routeParamCount;
     uint32_t m_streamId;
     std::string m_path;
     std::string m_query;
     std::string m_fragment;
-    std::string m_body;
-    MapType m_headers;
+    mutable std::string m_body;
+    mutable Stream::ptr m_bodyStream;
+    HttpHeaders m_headers;
+    //setParam/setCookie设置的值与展开后的值, 优先于索引
     MapType m_params;
     MapType m_cookies;
+    std::vector<ParamSpan> m_paramSpans[3];
+    //建立Cookie索引时Cookie头的值
+    std::string_view m_cookieView;
+    RouteParam m_routeParams[MAX_ROUTE_PARAMS];
 
 };
 
@@ -319,19 +387,37 @@ public:
     typedef std::shared_ptr<HttpResponse> ptr;
     typedef std::map<std::string, std::string, CaseInsensitiveLess> MapType;
 
+    //文件响应体: 由HttpSession用sendfile/writev直接发出, 不拷贝进m_body
+    struct FileBody {
+        typedef std::shared_ptr<FileBody> ptr;
+        int fd = -1;
+        const char* data = nullptr;  //整个文件内容的内存地址, 可为空; fd为-1时是内存中的响应体
+        uint64_t offset = 0;
+        uint64_t length = 0;
+        std::shared_ptr<void> holder;  //发送期间保持fd/data有效
+    };
+
+    //流式响应体: HttpSession发出头部后调用, 写入out的数据按chunked编码发送
+    //(设置了Content-Length时原样发送, HTTP/1.0时原样发送并关闭连接)
+    //out的写操作在socket可写之前挂起当前协程, 生产速度受对端接收速度约束
+    //返回小于0表示中止, 连接会被关闭
+    typedef std::function<int32_t (Stream::ptr out)> StreamCallback;
+
     HttpResponse(uint8_t version = 0x11, bool close = true);
 
     HttpStatus getStatus() const { return m_status;}
     uint8_t getVersion() const { return m_version;}
     const std::string& getBody() const { return m_body;}
     const std::string& getReason() const { return m_reason;}
-    const MapType& getHeaders() const { return m_headers;}
+    const HttpHeaders& getHeaders() const { return m_headers;}
+    HttpHeaders& getHeaders() { return m_headers;}
 
     void setStatus(HttpStatus v) { m_status = v;}
     void setVersion(uint8_t v) { m_version = v;}
     void setBody(const std::string& v) { m_body = v;}
+    void setBody(std::string&& v) { m_body = std::move(v);}
     void setReason(const std::string& v) { m_reason = v;}
-    void setHeaders(const MapType& v) { m_headers = v;}
+    void setHeaders(const HttpHeaders& v) { m_headers = v;}
 
     bool isClose() const { return m_close;}
     void setClose(bool v) { m_close = v;}
@@ -339,6 +425,12 @@ public:
     bool isWebsocket() const { return m_websocket;}
     void setWebsocket(bool v) { m_websocket = v;}
 
+    FileBody::ptr getFileBody() const { return m_fileBody;}
+    void setFileBody(FileBody::ptr v) { m_fileBody = v;}
+
+    const StreamCallback& getStreamBody() const { return m_streamBody;}
+    void setStreamBody(StreamCallback v) { m_streamBody = v;}
+
     std::string getHeader(const std::string& key, const std::string& def = "") const;
     void setHeader(const std::string& key, const std::string& val);
     void delHeader(const std::string& key);
@@ -356,6 +448,8 @@ public:
     }
 
     std::ostream& dump(std::ostream& os) const;
+    //只序列化状态行和头部(含Date与结尾空行)并追加到out, 响应体由调用方另行发送
+    void dumpHeader(std::string& out) const;
 
     std::string toString() const;
 
@@ -363,6 +457,8 @@ public:
     void setCookie(const std::string& key, const std::string& val,
                    time_t expired = 0, const std::string& path = "",
                    const std::string& domain = "", bool secure = false);
+    //setCookie生成的Set-Cookie值
+    const std::vector<std::string>& getCookies() const { return m_cookies;}
     void initConnection();
 private:
     HttpStatus m_status;
@@ -371,9 +467,11 @@ private:
     bool m_websocket;
     std::string m_body;
     std::string m_reason;
-    MapType m_headers;
+    HttpHeaders m_headers;
 
     std::vector<std::string> m_cookies;
+    FileBody::ptr m_fileBody;
+    StreamCallback m_streamBody;
 };
 
 //流式输出HttpRequest
@@ -0,0 +1,263 @@
+#include "http_compress.h"
+#include "chat/config.h"
+#include "chat/log.h"
+#include "chat/util.h"
+#include <string.h>
+#include <strings.h>
+
+namespace chat {
+namespace http {
+
+static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
+
+static chat::ConfigVar<int>::ptr g_http_compress_level =
+    chat::Config::Lookup("http.compress.level", (int)6, "http response compress level 1-9");
+static chat::ConfigVar<uint32_t>::ptr g_http_compress_min_size =
+    chat::Config::Lookup("http.compress.min_size", (uint32_t)1024, "http response compress min body size");
+static chat::ConfigVar<uint64_t>::ptr g_http_compress_cache_size =
+    chat::Config::Lookup("http.compress.cache_size", (uint64_t)(16 * 1024 * 1024), "http compressed body cache max bytes");
+static chat::ConfigVar<uint32_t>::ptr g_http_compress_buffer_size =
+    chat::Config::Lookup("http.compress.buffer_size", (uint32_t)(16 * 1024), "http compress output buffer size");
+static chat::ConfigVar<std::vector<std::string> >::ptr g_http_compress_types =
+    chat::Config::Lookup("http.compress.types", std::vector<std::string>{"text/"
+            , "application/json", "application/javascript", "application/xml"
+            , "application/x-javascript", "image/svg+xml"}, "http compressible content-type prefixes");
+
+//每个线程按(编码, 级别)保留少量压缩器, 用完reset后放回
+static const size_t s_pool_max = 4;
+
+static std::vector<ZlibStream::ptr>& GetStreamPool(ZlibStream::Type type, int level) {
+    static thread_local std::vector<ZlibStream::ptr> t_pools[2][10];
+    return t_pools[type == ZlibStream::GZIP][level];
+}
+
+static int NormalizeLevel(int level) {
+    if (level < 0 || level > 9) {
+        return 6;
+    }
+    return level;
+}
+
+HttpCompressor::HttpCompressor()
+    :m_level(g_http_compress_level->getValue())
+    ,m_minSize(g_http_compress_min_size->getValue())
+    ,m_cacheMax(g_http_compress_cache_size->getValue())
+    ,m_types(g_http_compress_types->getValue()) {
+}
+
+bool HttpCompressor::encode(const char* data, size_t len, ZlibStream::Type type, std::string& out) {
+    int level = NormalizeLevel(m_level);
+    auto& pool = GetStreamPool(type, level);
+    ZlibStream::ptr zs;
+    if (!pool.empty()) {
+        zs = pool.back();
+        pool.pop_back();
+    } else {
+        zs = ZlibStream::Create(true, g_http_compress_buffer_size->getValue(), type, level);
+        if (!zs) {
+            return false;
+        }
+    }
+    bool ok = zs->write(data, len) == Z_OK && zs->flush() == Z_OK;
+    if (ok) {
+        out.clear();
+        out.reserve(len / 2);
+        for (auto& i : zs->getBuffers()) {
+            out.append((const char*)i.iov_base, i.iov_len);
+        }
+    }
+    if (zs->reset() == Z_OK && pool.size() < s_pool_max) {
+        pool.push_back(zs);
+    }
+    return ok;
+}
+
+int HttpCompressor::ChooseEncoding(const std::string& accept_encoding) {
+    int rt = -1;
+    double best = 0;
+    for (auto& i : split(accept_encoding, ',')) {
+        auto items = split(i, ';');
+        std::string name = StringUtil::Trim(items[0]);
+        double q = 1;
+        if (items.size() > 1) {
+            std::string v = StringUtil::Trim(items[1]);
+            if (v.compare(0, 2, "q=") == 0) {
+                q = atof(v.c_str() + 2);
+            }
+        }
+        int type = -1;
+        if (strcasecmp(name.c_str(), "gzip") == 0 || name == "*") {
+            type = ZlibStream::GZIP;
+        } else if (strcasecmp(name.c_str(), "deflate") == 0) {
+            type = ZlibStream::DEFLATE;
+        }
+        //同样的q优先gzip
+        if (type >= 0 && q > 0 && (q > best || (q == best && type == ZlibStream::GZIP))) {
+            rt = type;
+            best = q;
+        }
+    }
+    return rt;
+}
+
+bool HttpCompressor::isCompressible(const std::string& content_type) const {
+    for (auto& i : m_types) {
+        if (strncasecmp(content_type.c_str(), i.c_str(), i.size()) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HttpCompressor::compress(HttpRequest::ptr request, HttpResponse::ptr response) {
+    if (request->getMethod() == HttpMethod::HEAD || response->getStreamBody()
+            || response->isWebsocket()) {
+        return false;
+    }
+    int status = (int)response->getStatus();
+    if (status < 200 || status == 204 || status == 206 || status == 304) {
+        return false;
+    }
+    //响应体可能在m_body, 也可能是带内存地址的FileBody(内存中的小文件/缓存的响应)
+    const char* data = response->getBody().data();
+    size_t len = response->getBody().size();
+    auto fbody = response->getFileBody();
+    if (fbody) {
+        if (!fbody->data) {
+            return false;
+        }
+        data = fbody->data + fbody->offset;
+        len = fbody->length;
+    }
+    if (len < m_minSize) {
+        return false;
+    }
+    auto& headers = response->getHeaders();
+    auto it = headers.find(HttpHeaderId::CONTENT_ENCODING);
+    if (it != headers.end()) {
+        return false;
+    }
+    it = headers.find(HttpHeaderId::CONTENT_TYPE);
+    if (it == headers.end() || !isCompressible(std::string(it->second))) {
+        return false;
+    }
+    bool cacheable = true;
+    it = headers.find(HttpHeaderId::CACHE_CONTROL);
+    if (it != headers.end()) {
+        std::string cc(it->second);
+        if (strcasestr(cc.c_str(), "no-transform")) {
+            return false;
+        }
+        cacheable = !strcasestr(cc.c_str(), "no-store") && !strcasestr(cc.c_str(), "private");
+    }
+
+    //可压缩的响应都带Vary, 不论本次是否压缩, 让下游缓存区分
+    it = headers.find(HttpHeaderId::VARY);
+    if (it == headers.end()) {
+        headers.set("Vary", "Accept-Encoding");
+    } else if (!strcasestr(std::string(it->second).c_str(), "accept-encoding")) {
+        headers.set("Vary", std::string(it->second) + ", Accept-Encoding");
+    }
+
+    int type = ChooseEncoding(request->getHeader("Accept-Encoding"));
+    if (type < 0) {
+        return false;
+    }
+
+    std::string key;
+    std::shared_ptr<std::string> out;
+    it = headers.find(HttpHeaderId::ETAG);
+    std::string etag = it != headers.end() ? std::string(it->second) : "";
+    if (cacheable && !etag.empty() && m_cacheMax > 0) {
+        //ETag只在同一URL下有意义, 查询串不同就是不同的资源; 长度防止同ETag不同体
+        key = request->getHeader("Host") + request->getPath() + "?" + request->getQuery()
+            + "\n" + etag + "\n" + std::to_string(len)
+            + (type == ZlibStream::GZIP ? "\ngzip" : "\ndeflate");
+        out = getCache(key);
+    }
+    if (out) {
+        ++m_cacheHits;
+    } else {
+        out = std::make_shared<std::string>();
+        if (!encode(data, len, (ZlibStream::Type)type, *out)) {
+            CHAT_LOG_WARN(g_logger) << "compress response fail, path=" << request->getPath()
+                << " len=" << len;
+            return false;
+        }
+        ++m_compressed;
+        m_bytesIn += len;
+        m_bytesOut += out->size();
+        if (!key.empty()) {
+            putCache(key, out);
+        }
+    }
+
+    headers.set("Content-Encoding", type == ZlibStream::GZIP ? "gzip" : "deflate");
+    headers.erase("Content-Length");
+    //编码后的表示不再与原ETag逐字节一致, 降为弱校验
+    if (!etag.empty() && etag.compare(0, 2, "W/") != 0) {
+        headers.set("ETag", "W/" + etag);
+    }
+    response->setBody(std::string());
+    HttpResponse::FileBody::ptr body = std::make_shared<HttpResponse::FileBody>();
+    body->data = out->data();
+    body->length = out->size();
+    body->holder = out;
+    response->setFileBody(body);
+    return true;
+}
+
+std::shared_ptr<std::string> HttpCompressor::getCache(const std::string& key) {
+    MutexType::Lock lock(m_mutex);
+    auto it = m_cache.find(key);
+    if (it == m_cache.end()) {
+        return nullptr;
+    }
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    return it->second->second;
+}
+
+void HttpCompressor::putCache(const std::string& key, std::shared_ptr<std::string> data) {
+    size_t bytes = key.size() + data->size();
+    if (bytes > m_cacheMax / 4) {
+        return;
+    }
+    MutexType::Lock lock(m_mutex);
+    auto it = m_cache.find(key);
+    if (it != m_cache.end()) {
+        m_cacheBytes -= it->first.size() + it->second->second->size();
+        m_lru.erase(it->second);
+        m_cache.erase(it);
+    }
+    while (m_cacheBytes + bytes > m_cacheMax && !m_lru.empty()) {
+        auto& i = m_lru.back();
+        m_cacheBytes -= i.first.size() + i.second->size();
+        m_cache.erase(i.first);
+        m_lru.pop_back();
+    }
+    m_lru.emplace_front(key, data);
+    m_cache[key] = m_lru.begin();
+    m_cacheBytes += bytes;
+}
+
+HttpCompressor::Stats HttpCompressor::getStats() {
+    Stats st;
+    st.compressed = m_compressed;
+    st.cacheHits = m_cacheHits;
+    st.bytesIn = m_bytesIn;
+    st.bytesOut = m_bytesOut;
+    MutexType::Lock lock(m_mutex);
+    st.entries = m_cache.size();
+    st.cacheBytes = m_cacheBytes;
+    return st;
+}
+
+void HttpCompressor::clearCache() {
+    MutexType::Lock lock(m_mutex);
+    m_lru.clear();
+    m_cache.clear();
+    m_cacheBytes = 0;
+}
+
+}
+}
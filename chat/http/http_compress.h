@@ -0,0 +1,82 @@
+#ifndef __CHAT_HTTP_COMPRESS_H__
+#define __CHAT_HTTP_COMPRESS_H__
+
+#include <memory>
+#include <string>
+#include <list>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+#include "http.h"
+#include "chat/mutex.h"
+#include "chat/streams/zlib_stream.h"
+
+namespace chat {
+namespace http {
+
+//响应压缩: HttpServer在Servlet处理完后调用, 按Accept-Encoding选择gzip/deflate
+//只压缩超过最小长度且Content-Type可压缩的响应, 已有Content-Encoding/no-transform的跳过
+//z_stream按线程池化, 用deflateReset复用, 不为每个响应deflateInit
+//带ETag且可缓存的响应, 压缩结果按 Host+path+ETag+编码 缓存, 命中时不再压缩
+class HttpCompressor {
+public:
+    typedef std::shared_ptr<HttpCompressor> ptr;
+    typedef Mutex MutexType;
+
+    struct Stats {
+        uint64_t compressed = 0;
+        uint64_t cacheHits = 0;
+        uint64_t bytesIn = 0;
+        uint64_t bytesOut = 0;
+        uint64_t entries = 0;
+        uint64_t cacheBytes = 0;
+    };
+
+    //参数默认取配置http.compress.*
+    HttpCompressor();
+
+    //压缩了响应返回true
+    bool compress(HttpRequest::ptr request, HttpResponse::ptr response);
+
+    //压缩一段数据, 使用池化的z_stream
+    bool encode(const char* data, size_t len, ZlibStream::Type type, std::string& out);
+
+    //根据Accept-Encoding选择编码, 不接受压缩返回-1
+    static int ChooseEncoding(const std::string& accept_encoding);
+
+    void setLevel(int v) { m_level = v;}
+    int getLevel() const { return m_level;}
+    void setMinSize(uint32_t v) { m_minSize = v;}
+    uint32_t getMinSize() const { return m_minSize;}
+    void setCacheSize(uint64_t v) { m_cacheMax = v;}
+    //可压缩的Content-Type前缀, 如 "text/", "application/json"
+    void setTypes(const std::vector<std::string>& v) { m_types = v;}
+    bool isCompressible(const std::string& content_type) const;
+
+    Stats getStats();
+    void clearCache();
+private:
+    std::shared_ptr<std::string> getCache(const std::string& key);
+    void putCache(const std::string& key, std::shared_ptr<std::string> data);
+private:
+    int m_level;
+    uint32_t m_minSize;
+    uint64_t m_cacheMax;
+    std::vector<std::string> m_types;
+
+    MutexType m_mutex;
+    typedef std::pair<std::string, std::shared_ptr<std::string> > Item;
+    std::list<Item> m_lru;
+    std::unordered_map<std::string, std::list<Item>::iterator> m_cache;
+    uint64_t m_cacheBytes = 0;
+
+    std::atomic<uint64_t> m_compressed = {0};
+    std::atomic<uint64_t> m_cacheHits = {0};
+    std::atomic<uint64_t> m_bytesIn = {0};
+    std::atomic<uint64_t> m_bytesOut = {0};
+};
+
+}
+}
+
+#endif
@@ -2,6 +2,9 @@
 #include "http_parser.h"
 #include "chat/log.h"
 #include "chat/util.h"
+#include "chat/clock.h"
+#include "chat/config.h"
+#include "chat/iomanager.h"
 #include "chat/streams/zlib_stream.h"
 
 namespace chat {
@@ -9,6 +12,22 @@ namespace http {
 
 static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
 
+static chat::ConfigVar<uint32_t>::ptr g_pool_shards =
+    chat::Config::Lookup("http.connection_pool.shards", (uint32_t)8, "http connection pool idle shards");
+static chat::ConfigVar<uint32_t>::ptr g_pool_min_size =
+    chat::Config::Lookup("http.connection_pool.min_size", (uint32_t)0, "http connection pool prewarm connections");
+static chat::ConfigVar<uint32_t>::ptr g_pool_max_idle_time =
+    chat::Config::Lookup("http.connection_pool.max_idle_time", (uint32_t)(30 * 1000), "http connection pool max idle time in ms");
+static chat::ConfigVar<uint32_t>::ptr g_pool_validate_idle_time =
+    chat::Config::Lookup("http.connection_pool.validate_idle_time", (uint32_t)1000
+            , "http connection pool checks socket state on checkout after idle ms");
+static chat::ConfigVar<uint32_t>::ptr g_pool_check_interval =
+    chat::Config::Lookup("http.connection_pool.check_interval", (uint32_t)1000, "http connection pool eviction timer interval in ms");
+static chat::ConfigVar<uint32_t>::ptr g_pool_connect_timeout =
+    chat::Config::Lookup("http.connection_pool.connect_timeout", (uint32_t)3000, "http connection pool prewarm connect timeout in ms");
+static chat::ConfigVar<uint32_t>::ptr g_pool_dns_refresh =
+    chat::Config::Lookup("http.connection_pool.dns_refresh", (uint32_t)(30 * 1000), "http connection pool address refresh interval in ms");
+
 std::string HttpResult::toString() const {
     std::stringstream ss;
     ss << "[HttpResult result=" << result
@@ -53,7 +72,7 @@ HttpResponse::ptr HttpConnection::recvResponse() {
         }
     } while(true);
 
-    auto client_parser = parser->getParser();
+    auto& client_parser = parser->getParser();
     std::string body;
     if (client_parser.chunked) {  //分段
         int len = offset;  //剩余data
@@ -152,6 +171,48 @@ HttpResponse::ptr HttpConnection::recvResponse() {
     return parser->getData();
 }
 
+HttpResponse::ptr HttpConnection::recvResponseHeader(std::string& body_prefix) {
+    HttpResponseParser::ptr parser = std::make_shared<HttpResponseParser>();
+    uint64_t buff_size = HttpResponseParser::GetHttpResponseBufferSize();
+    std::unique_ptr<char[]> buffer(new char[buff_size + 1]);
+    char* data = buffer.get();
+    if (body_prefix.size() >= buff_size) {
+        close();
+        return nullptr;
+    }
+    //先解析上次多读的数据
+    size_t offset = body_prefix.size();
+    memcpy(data, body_prefix.c_str(), offset);
+    body_prefix.clear();
+    bool pending = offset > 0;
+    do {
+        if (!pending) {
+            int len = read(data + offset, buff_size - offset);
+            if (len <= 0) {
+                close();
+                return nullptr;
+            }
+            offset += len;
+        }
+        pending = false;
+        data[offset] = '\0';
+        size_t nparse = parser->execute(data, offset, false);
+        if (parser->hasError()) {
+            close();
+            return nullptr;
+        }
+        offset -= nparse;
+        if (offset == buff_size) {
+            close();
+            return nullptr;
+        }
+    } while (!parser->isFinished());
+    //execute已把未解析的数据移到缓冲头部
+    body_prefix.assign(data, offset);
+    parser->getData()->initConnection();
+    return parser->getData();
+}
+
 int HttpConnection::sendRequest(HttpRequest::ptr rsp) {
     std::string data = rsp->toString();
     return writeFixSize(data.c_str(), data.size());
@@ -306,6 +367,7 @@ HttpConnectionPool::ptr HttpConnectionPool::Create(const std::string& uri
     Uri::ptr turi = Uri::Create(uri);
     if (!turi) {
         CHAT_LOG_ERROR(g_logger) << "invalid uri=" << uri;
+        return nullptr;
     }
     return std::make_shared<HttpConnectionPool>(turi->getHost()
             , vhost, turi->getPort(), turi->getScheme() == "https"
@@ -322,76 +384,269 @@ HttpConnectionPool::HttpConnectionPool(const std::string& host
     :m_host(host)
     ,m_vhost(vhost)
     ,m_port(port ? port : (is_https ? 443 : 80))
-    ,m_maxSize(max_size)
+    ,m_maxSize(max_size ? max_size : 1)
     ,m_maxAliveTime(max_alive_time)
     ,m_maxRequest(max_request)
+    ,m_minSize(std::min(g_pool_min_size->getValue(), m_maxSize))
+    ,m_maxIdleTime(g_pool_max_idle_time->getValue())
+    ,m_validateIdleTime(g_pool_validate_idle_time->getValue())
     ,m_isHttps(is_https) {
-    m_service = m_host + ":" + std::to_string(m_port); // for dns, TODO
+    m_service = m_host + ":" + std::to_string(m_port);
+    m_shardCount = std::max(1u, std::min(g_pool_shards->getValue(), m_maxSize));
+    m_shardSize = (m_maxSize + m_shardCount - 1) / m_shardCount;
+    m_slots.reset(new Slot[m_shardCount * m_shardSize]);
 }
 
-HttpConnection::ptr HttpConnectionPool::getConnection(uint64_t& timeout_ms) {
-    uint64_t now_ms = chat::GetCurrentMs();
-    std::vector<HttpConnection*> invalid_conns;
-    HttpConnection* ptr = nullptr;
-    MutexType::Lock lock(m_mutex);
-    while (!m_conns.empty()) {
-        auto conn = *m_conns.begin();
-        m_conns.pop_front();
-        if ((conn->m_createTime + m_maxAliveTime) > now_ms) {
-            invalid_conns.push_back(conn);
-            continue;
+HttpConnectionPool::~HttpConnectionPool() {
+    stop();
+    uint32_t size = m_shardCount * m_shardSize;
+    for (uint32_t i = 0; i < size; ++i) {
+        HttpConnection* conn = m_slots[i].conn.exchange(nullptr);
+        if (conn) {
+            delete conn;
         }
-        if(!conn->checkConnected()) {
-            invalid_conns.push_back(conn);
+    }
+}
+
+void HttpConnectionPool::start(IOManager* iom) {
+    if (m_started.exchange(true)) {
+        return;
+    }
+    if (!iom) {
+        iom = IOManager::GetThis();
+    }
+    std::weak_ptr<HttpConnectionPool> weak = weak_from_this();
+    if (!iom || weak.expired()) {
+        CHAT_LOG_WARN(g_logger) << "HttpConnectionPool " << m_service
+            << " start without IOManager or shared_ptr owner, background timer disabled";
+        return;
+    }
+    m_timer = iom->addConditionTimer(g_pool_check_interval->getValue()
+            , std::bind(&HttpConnectionPool::onTimer, this), weak, true);
+    //立即预热一次, 不等第一个周期
+    if (m_minSize > 0) {
+        iom->schedule(std::bind(&HttpConnectionPool::onTimer, shared_from_this()));
+    }
+}
+
+void HttpConnectionPool::stop() {
+    if (m_timer) {
+        m_timer->cancel();
+        m_timer = nullptr;
+    }
+}
+
+HttpConnectionPool::Stats HttpConnectionPool::getStats() const {
+    Stats st;
+    st.created = m_created;
+    st.reused = m_reused;
+    st.evicted = m_evicted;
+    st.failed = m_failed;
+    st.waits = m_waits;
+    st.wait_us = m_waitUs;
+    st.max_wait_us = m_maxWaitUs;
+    st.coalesced = m_flight.getCoalescedCount();
+    st.total = m_total;
+    st.idle = m_idle;
+    return st;
+}
+
+uint32_t HttpConnectionPool::getShard() const {
+    static thread_local uint32_t t_tid = (uint32_t)chat::GetThreadId();
+    return t_tid % m_shardCount;
+}
+
+HttpConnection* HttpConnectionPool::popIdle() {
+    uint32_t size = m_shardCount * m_shardSize;
+    uint32_t begin = getShard() * m_shardSize;
+    for (uint32_t i = 0; i < size; ++i) {
+        Slot& slot = m_slots[(begin + i) % size];
+        if (!slot.conn.load(std::memory_order_relaxed)) {
             continue;
         }
-        ptr = conn;
-        break;
-    }
-    lock.unlock();
-    for(auto i : invalid_conns) {
-        delete i;
+        HttpConnection* conn = slot.conn.exchange(nullptr, std::memory_order_acquire);
+        if (conn) {
+            --m_idle;
+            return conn;
+        }
     }
-    m_total -= invalid_conns.size();
+    return nullptr;
+}
 
-    if (!ptr) {
-        IPAddress::ptr addr = Address::LookupAnyIPAddress(m_host);
-        if (!addr) {
-            CHAT_LOG_ERROR(g_logger) << "get addr fail: " << m_host;
-            return nullptr;
+bool HttpConnectionPool::pushIdle(HttpConnection* conn) {
+    conn->m_lastActive = Clock::CoarseMs();
+    uint32_t size = m_shardCount * m_shardSize;
+    uint32_t begin = getShard() * m_shardSize;
+    for (uint32_t i = 0; i < size; ++i) {
+        Slot& slot = m_slots[(begin + i) % size];
+        HttpConnection* expected = nullptr;
+        if (!slot.conn.load(std::memory_order_relaxed)
+                && slot.conn.compare_exchange_strong(expected, conn
+                    , std::memory_order_release, std::memory_order_relaxed)) {
+            ++m_idle;
+            return true;
         }
-        addr->setPort(m_port);
-        Socket::ptr sock = m_isHttps ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
-        if (!sock) {
-            CHAT_LOG_ERROR(g_logger) << "create sock fail: " << addr->toString();
-            return nullptr;
+    }
+    return false;
+}
+
+void HttpConnectionPool::destroy(HttpConnection* conn) {
+    delete conn;
+    --m_total;
+}
+
+IPAddress::ptr HttpConnectionPool::getAddress() {
+    {
+        RWMutexType::ReadLock lock(m_addrMutex);
+        if (m_addr) {
+            return m_addr;
         }
-        uint64_t ts1 = chat::GetCurrentMs();
-        if(!sock->connect(addr, timeout_ms)) {
-            CHAT_LOG_ERROR(g_logger) << "sock connect fail: " << addr->toString();
-            return nullptr;
+    }
+    return resolve();
+}
+
+IPAddress::ptr HttpConnectionPool::resolve() {
+    IPAddress::ptr addr = Address::LookupAnyIPAddress(m_host);
+    if (!addr) {
+        //解析失败时继续使用旧地址
+        CHAT_LOG_ERROR(g_logger) << "get addr fail: " << m_host;
+        RWMutexType::ReadLock lock(m_addrMutex);
+        return m_addr;
+    }
+    addr->setPort(m_port);
+    RWMutexType::WriteLock lock(m_addrMutex);
+    m_addr = addr;
+    m_addrExpire = Clock::CoarseMs() + g_pool_dns_refresh->getValue();
+    return addr;
+}
+
+HttpConnection* HttpConnectionPool::create(uint64_t& timeout_ms) {
+    IPAddress::ptr addr = getAddress();
+    if (!addr) {
+        return nullptr;
+    }
+    Socket::ptr sock = m_isHttps ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
+    if (!sock) {
+        CHAT_LOG_ERROR(g_logger) << "create sock fail: " << addr->toString();
+        return nullptr;
+    }
+    uint64_t ts1 = chat::GetCurrentMs();
+    if (!sock->connect(addr, timeout_ms)) {
+        CHAT_LOG_ERROR(g_logger) << "sock connect fail: " << addr->toString();
+        return nullptr;
+    }
+    timeout_ms -= std::min(timeout_ms, chat::GetCurrentMs() - ts1);
+
+    HttpConnection* conn = new HttpConnection(sock);
+    conn->m_createTime = Clock::CoarseMs();
+    ++m_total;
+    ++m_created;
+    return conn;
+}
+
+HttpConnection::ptr HttpConnectionPool::getConnection(uint64_t& timeout_ms) {
+    if (!m_started) {
+        start();
+    }
+    uint64_t begin = Clock::NowUs();
+    uint64_t now_ms = Clock::CoarseMs();
+    HttpConnection* ptr = nullptr;
+    while ((ptr = popIdle())) {
+        //刚归还的连接不再查询socket状态, 空闲较久的才检查一次
+        if (ptr->m_createTime + m_maxAliveTime > now_ms
+                && (ptr->m_lastActive + m_validateIdleTime > now_ms
+                    || ptr->checkConnected())) {
+            ++m_reused;
+            break;
         }
-        timeout_ms -= chat::GetCurrentMs() - ts1;
+        destroy(ptr);
+        ++m_evicted;
+        ptr = nullptr;
+    }
+    if (!ptr) {
+        ptr = create(timeout_ms);
+    }
+
+    uint64_t used = Clock::NowUs() - begin;
+    ++m_waits;
+    m_waitUs += used;
+    uint64_t old = m_maxWaitUs;
+    while (used > old && !m_maxWaitUs.compare_exchange_weak(old, used));
 
-        ptr = new HttpConnection(sock);
-        ++m_total;
+    if (!ptr) {
+        ++m_failed;
+        return nullptr;
     }
     return HttpConnection::ptr(ptr, std::bind(&HttpConnectionPool::ReleasePtr, std::placeholders::_1, this));
 }
 
 void HttpConnectionPool::ReleasePtr(HttpConnection* ptr, HttpConnectionPool* pool) {
     ++ptr->m_request;
-    if(pool->m_total >= (int32_t)pool->m_maxSize
-        || !ptr->isConnected()
+    if (!ptr->isConnected()
         || (ptr->m_request >= pool->m_maxRequest)
-        || ((ptr->m_createTime + pool->m_maxAliveTime) >= chat::GetCurrentMs())
-        || !ptr->checkConnected()) {
-        delete ptr;
-        --pool->m_total;
+        || ((ptr->m_createTime + pool->m_maxAliveTime) <= Clock::CoarseMs())
+        || !pool->pushIdle(ptr)) {
+        pool->destroy(ptr);
+    }
+}
+
+void HttpConnectionPool::onTimer() {
+    //预热建连可能跨越多个周期, 不重入
+    if (m_timerRunning.test_and_set()) {
         return;
     }
-    MutexType::Lock lock(pool->m_mutex);
-    pool->m_conns.push_back(ptr);
+    uint64_t now_ms = Clock::CoarseMs();
+    bool expired = false;
+    {
+        RWMutexType::ReadLock lock(m_addrMutex);
+        expired = m_addr && m_addrExpire <= now_ms;
+    }
+    if (expired) {
+        resolve();
+    }
+
+    uint32_t size = m_shardCount * m_shardSize;
+    for (uint32_t i = 0; i < size; ++i) {
+        Slot& slot = m_slots[i];
+        if (!slot.conn.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        HttpConnection* conn = slot.conn.exchange(nullptr, std::memory_order_acquire);
+        if (!conn) {
+            continue;
+        }
+        if (conn->m_lastActive + m_maxIdleTime > now_ms
+                && conn->m_createTime + m_maxAliveTime > now_ms
+                && conn->checkConnected()) {
+            HttpConnection* expected = nullptr;
+            if (slot.conn.compare_exchange_strong(expected, conn
+                        , std::memory_order_release, std::memory_order_relaxed)) {
+                continue;
+            }
+            //槽位已被归还的连接占用, 换一个空槽位
+            --m_idle;
+            if (pushIdle(conn)) {
+                continue;
+            }
+            ++m_idle;
+        }
+        --m_idle;
+        destroy(conn);
+        ++m_evicted;
+    }
+
+    while (m_total < (int32_t)m_minSize) {
+        uint64_t timeout_ms = g_pool_connect_timeout->getValue();
+        HttpConnection* conn = create(timeout_ms);
+        if (!conn) {
+            break;
+        }
+        if (!pushIdle(conn)) {
+            destroy(conn);
+            break;
+        }
+    }
+    m_timerRunning.clear();
 }
 
 HttpResult::ptr HttpConnectionPool::doGet(const std::string& url
@@ -483,8 +738,42 @@ HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method
     return doRequest(method, ss.str(), timeout_ms, headers, body);
 }
 
+std::string HttpConnectionPool::SingleFlightKey(HttpRequest::ptr req) {
+    //凭证和会改变响应内容的头部原样放进key, 不能用哈希, 碰撞时会把别人的响应给出去
+    static const char* s_vary[] = {"Authorization", "Cookie", "Range", "If-Range"
+        , "Accept", "Accept-Encoding", "Accept-Language"};
+    std::string key = HttpMethodToString(req->getMethod());
+    key.append(" ").append(req->getPath());
+    if (!req->getQuery().empty()) {
+        key.append("?").append(req->getQuery());
+    }
+    //头部的值不含换行
+    for (auto name : s_vary) {
+        key.append("\n").append(name).append(": ").append(req->getHeader(name));
+    }
+    const std::string& body = req->getBody();
+    key.append("\n").append(std::to_string(body.size())).append("\n").append(body);
+    return key;
+}
+
 HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr req
                                         , uint64_t timeout_ms) {
+    if (m_singleFlight && (req->getMethod() == HttpMethod::GET
+                || req->getMethod() == HttpMethod::HEAD)) {
+        return doRequestShared("", req, timeout_ms);
+    }
+    return innerRequest(req, timeout_ms);
+}
+
+HttpResult::ptr HttpConnectionPool::doRequestShared(const std::string& key
+                                        , HttpRequest::ptr req
+                                        , uint64_t timeout_ms) {
+    return m_flight.call(key.empty() ? SingleFlightKey(req) : key
+            , std::bind(&HttpConnectionPool::innerRequest, this, req, timeout_ms));
+}
+
+HttpResult::ptr HttpConnectionPool::innerRequest(HttpRequest::ptr req
+                                        , uint64_t timeout_ms) {
     auto conn = getConnection(timeout_ms);
     if (!conn) {
         return std::make_shared<HttpResult>((int)HttpResult::Error::POOL_GET_CONNECTION
@@ -512,6 +801,10 @@ HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr req
                     , nullptr, "recv response timeout: " + sock->getRemoteAddress()->toString()
                     + " timeout_ms:" + std::to_string(timeout_ms));
     }
+    if (rsp->isClose()) {
+        //服务端要求关闭, 不放回连接池
+        conn->close();
+    }
     return std::make_shared<HttpResult>((int)HttpResult::Error::OK, rsp, "ok");
 }
 
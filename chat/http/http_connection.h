@@ -4,8 +4,12 @@
 #include "chat/streams/socket_stream.h"
 #include "http.h"
 #include "chat/uri.h"
+#include "chat/mutex.h"
+#include "chat/iomanager.h"
+#include "chat/singleflight.h"
 #include <vector>
 #include <list>
+#include <atomic>
 
 namespace chat{
 namespace http{
@@ -91,16 +95,39 @@ public:
     HttpConnection(Socket::ptr sock, bool owner = true);
 
     HttpResponse::ptr recvResponse();
+    //只接收并解析响应头, 随头部一起读到的响应体数据放入body_prefix
+    //剩余响应体由调用方按Content-Length/chunked继续从连接读取
+    //传入的body_prefix不为空时先解析它, 用于读完1xx响应后继续读最终响应
+    HttpResponse::ptr recvResponseHeader(std::string& body_prefix);
     int sendRequest(HttpRequest::ptr rsp);
 private:
     uint64_t m_createTime = 0;
+    uint64_t m_lastActive = 0;  //最近一次归还连接池的时间
     uint64_t m_request = 0;
 };
 
-class HttpConnectionPool {
+//HTTP连接池
+//空闲连接按线程分片存放在定长的原子槽位中, 取/还只做exchange/CAS, 不加锁
+//本线程分片没有空闲连接时再扫描其它分片
+//空闲超时/最大存活时间/连接状态的检查由定时器完成, 取连接时只对空闲较久的连接做一次检查
+//定时器同时把连接数预热到最小值, 并刷新缓存的服务端地址
+class HttpConnectionPool: public std::enable_shared_from_this<HttpConnectionPool> {
 public:
     typedef std::shared_ptr<HttpConnectionPool> ptr;
-    typedef Mutex MutexType;
+    typedef RWMutex RWMutexType;
+
+    struct Stats {
+        uint64_t created = 0;       //新建连接数
+        uint64_t reused = 0;        //复用空闲连接数
+        uint64_t evicted = 0;       //定时器淘汰的空闲连接数
+        uint64_t failed = 0;        //获取连接失败数
+        uint64_t waits = 0;         //getConnection调用次数
+        uint64_t wait_us = 0;       //getConnection累计耗时
+        uint64_t max_wait_us = 0;   //getConnection最大耗时
+        uint64_t coalesced = 0;     //合并到其他协程请求上的请求数
+        int32_t total = 0;          //当前连接数(空闲+使用中)
+        int32_t idle = 0;           //当前空闲连接数
+    };
 
     static HttpConnectionPool::ptr Create(const std::string& uri
                                    ,const std::string& vhost
@@ -115,6 +142,30 @@ public:
                        ,uint32_t max_size
                        ,uint32_t max_alive_time
                        ,uint32_t max_request);
+    ~HttpConnectionPool();
+
+    //启动后台定时器, 需要由shared_ptr持有; iom为空时取当前IOManager
+    //未显式调用时在第一次getConnection时启动
+    void start(IOManager* iom = nullptr);
+    void stop();
+
+    //预热的最小连接数
+    void setMinSize(uint32_t v) { m_minSize = v;}
+    uint32_t getMinSize() const { return m_minSize;}
+    //空闲超过该时间的连接被淘汰(ms)
+    void setMaxIdleTime(uint32_t v) { m_maxIdleTime = v;}
+    uint32_t getMaxIdleTime() const { return m_maxIdleTime;}
+
+    //开启后并发的相同GET/HEAD请求合并为一次上游请求
+    //按method+url+body以及Authorization/Cookie判断相同
+    void setSingleFlight(bool v) { m_singleFlight = v;}
+    bool isSingleFlight() const { return m_singleFlight;}
+
+    Stats getStats() const;
+
+    const std::string& getHost() const { return m_host;}
+    uint32_t getPort() const { return m_port;}
+    bool isHttps() const { return m_isHttps;}
 
     HttpConnection::ptr getConnection(uint64_t& timeout_ms);
 
@@ -148,9 +199,30 @@ public:
                             , const std::string& body = "");
     HttpResult::ptr doRequest(HttpRequest::ptr req
                             , uint64_t timeout_ms);
+    //按key合并并发的相同请求, 不受setSingleFlight影响, 任意method都可用
+    //key为空时与setSingleFlight的规则相同
+    HttpResult::ptr doRequestShared(const std::string& key
+                            , HttpRequest::ptr req
+                            , uint64_t timeout_ms);
 
 private:
     static void ReleasePtr(HttpConnection* ptr, HttpConnectionPool* pool);
+    static std::string SingleFlightKey(HttpRequest::ptr req);
+    HttpResult::ptr innerRequest(HttpRequest::ptr req, uint64_t timeout_ms);
+
+    //独占一个cache line, 避免不同线程的槽位伪共享
+    struct alignas(64) Slot {
+        std::atomic<HttpConnection*> conn = {nullptr};
+    };
+
+    uint32_t getShard() const;
+    HttpConnection* popIdle();
+    bool pushIdle(HttpConnection* conn);
+    HttpConnection* create(uint64_t& timeout_ms);
+    void destroy(HttpConnection* conn);
+    IPAddress::ptr getAddress();
+    IPAddress::ptr resolve();
+    void onTimer();
 
 private:
     std::string m_host;
@@ -159,12 +231,36 @@ private:
     uint32_t m_maxSize;
     uint32_t m_maxAliveTime;
     uint32_t m_maxRequest;
+    uint32_t m_minSize;
+    uint32_t m_maxIdleTime;
+    uint32_t m_validateIdleTime;
     bool m_isHttps;
     std::string m_service;
 
-    MutexType m_mutex;
-    std::list<HttpConnection*> m_conns;
+    uint32_t m_shardCount;
+    uint32_t m_shardSize;
+    std::unique_ptr<Slot[]> m_slots;
     std::atomic<int32_t> m_total = {0};
+    std::atomic<int32_t> m_idle = {0};
+
+    RWMutexType m_addrMutex;
+    IPAddress::ptr m_addr;
+    uint64_t m_addrExpire = 0;
+
+    Timer::ptr m_timer;
+    std::atomic<bool> m_started = {false};
+    std::atomic_flag m_timerRunning = ATOMIC_FLAG_INIT;
+
+    std::atomic<uint64_t> m_created = {0};
+    std::atomic<uint64_t> m_reused = {0};
+    std::atomic<uint64_t> m_evicted = {0};
+    std::atomic<uint64_t> m_failed = {0};
+    std::atomic<uint64_t> m_waits = {0};
+    std::atomic<uint64_t> m_waitUs = {0};
+    std::atomic<uint64_t> m_maxWaitUs = {0};
+
+    bool m_singleFlight = false;
+    SingleFlight<HttpResult::ptr> m_flight;
 };
 
 }
@@ -0,0 +1,213 @@
+#include "http_headers.h"
+#include <string.h>
+#include <strings.h>
+
+namespace chat {
+namespace http {
+
+//arena块大小, 一个普通请求的头部一块放得下
+static const size_t s_block_size = 1024;
+
+struct KnownHeader {
+    std::string_view name;
+    uint32_t hash;
+};
+
+//常用名称表, 附带按hash开放寻址的索引
+struct KnownHeaders {
+    static const size_t SLOTS = 256;
+    std::vector<KnownHeader> headers;
+    int16_t slots[SLOTS];
+
+    KnownHeaders() {
+#define XX(name, str) headers.push_back({str, HttpHeaders::Hash(str)});
+        HTTP_HEADER_MAP(XX);
+#undef XX
+        memset(slots, -1, sizeof(slots));
+        for (size_t i = 0; i < headers.size(); ++i) {
+            size_t idx = headers[i].hash % SLOTS;
+            while (slots[idx] >= 0) {
+                idx = (idx + 1) % SLOTS;
+            }
+            slots[idx] = i;
+        }
+    }
+};
+
+static const KnownHeaders& GetKnownHeaders() {
+    static const KnownHeaders s_known;
+    return s_known;
+}
+
+static inline bool NameEqual(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+uint32_t HttpHeaders::Hash(std::string_view name) {
+    uint32_t h = 2166136261u;
+    for (unsigned char c : name) {
+        if (c >= 'A' && c <= 'Z') {
+            c |= 0x20;
+        }
+        h ^= c;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+HttpHeaderId HttpHeaders::LookupId(std::string_view name, uint32_t hash) {
+    auto& known = GetKnownHeaders();
+    size_t idx = hash % KnownHeaders::SLOTS;
+    while (known.slots[idx] >= 0) {
+        auto& h = known.headers[known.slots[idx]];
+        if (h.hash == hash && NameEqual(h.name, name)) {
+            return (HttpHeaderId)known.slots[idx];
+        }
+        idx = (idx + 1) % KnownHeaders::SLOTS;
+    }
+    return HttpHeaderId::OTHER;
+}
+
+std::string_view HttpHeaders::IdToName(HttpHeaderId id) {
+    auto& known = GetKnownHeaders();
+    size_t idx = (size_t)id;
+    return idx < known.headers.size() ? known.headers[idx].name : std::string_view();
+}
+
+HttpHeaders::HttpHeaders(const HttpHeaders& o) {
+    *this = o;
+}
+
+HttpHeaders& HttpHeaders::operator=(const HttpHeaders& o) {
+    if (this != &o) {
+        clear();
+        m_fields.reserve(o.m_fields.size());
+        for (auto& i : o.m_fields) {
+            Field f = i;
+            if (f.id == HttpHeaderId::OTHER) {
+                f.first = copy(i.first);
+            }
+            f.second = copy(i.second);
+            m_fields.push_back(f);
+        }
+    }
+    return *this;
+}
+
+HttpHeaders::HttpHeaders(HttpHeaders&& o)
+    :m_fields(std::move(o.m_fields))
+    ,m_blocks(std::move(o.m_blocks))
+    ,m_cur(o.m_cur)
+    ,m_left(o.m_left) {
+    o.m_cur = nullptr;
+    o.m_left = 0;
+}
+
+HttpHeaders& HttpHeaders::operator=(HttpHeaders&& o) {
+    if (this != &o) {
+        m_fields = std::move(o.m_fields);
+        m_blocks = std::move(o.m_blocks);
+        m_cur = o.m_cur;
+        m_left = o.m_left;
+        o.m_fields.clear();
+        o.m_blocks.clear();
+        o.m_cur = nullptr;
+        o.m_left = 0;
+    }
+    return *this;
+}
+
+HttpHeaders::const_iterator HttpHeaders::find(std::string_view key) const {
+    uint32_t hash = Hash(key);
+    for (auto it = m_fields.begin(); it != m_fields.end(); ++it) {
+        if (it->hash == hash && NameEqual(it->first, key)) {
+            return it;
+        }
+    }
+    return m_fields.end();
+}
+
+HttpHeaders::const_iterator HttpHeaders::find(HttpHeaderId id) const {
+    for (auto it = m_fields.begin(); it != m_fields.end(); ++it) {
+        if (it->id == id) {
+            return it;
+        }
+    }
+    return m_fields.end();
+}
+
+std::string_view HttpHeaders::copy(std::string_view v) {
+    if (v.empty()) {
+        return std::string_view();
+    }
+    if (v.size() > m_left) {
+        if (v.size() > s_block_size / 4) {
+            //大字段单独一块, 不浪费当前块的剩余空间
+            m_blocks.emplace_back(new char[v.size()]);
+            memcpy(m_blocks.back().get(), v.data(), v.size());
+            return std::string_view(m_blocks.back().get(), v.size());
+        }
+        m_blocks.emplace_back(new char[s_block_size]);
+        m_cur = m_blocks.back().get();
+        m_left = s_block_size;
+    }
+    memcpy(m_cur, v.data(), v.size());
+    std::string_view rt(m_cur, v.size());
+    m_cur += v.size();
+    m_left -= v.size();
+    return rt;
+}
+
+HttpHeaders::Field HttpHeaders::makeField(std::string_view key, std::string_view val, uint32_t hash) {
+    Field f;
+    f.hash = hash;
+    f.id = LookupId(key, f.hash);
+    f.first = f.id == HttpHeaderId::OTHER ? copy(key) : IdToName(f.id);
+    f.second = copy(val);
+    return f;
+}
+
+void HttpHeaders::set(std::string_view key, std::string_view val) {
+    uint32_t hash = Hash(key);
+    for (auto& i : m_fields) {
+        if (i.hash == hash && NameEqual(i.first, key)) {
+            //旧值占用的arena空间在clear时一起释放
+            i.second = copy(val);
+            return;
+        }
+    }
+    if (m_fields.empty()) {
+        m_fields.reserve(16);
+    }
+    m_fields.push_back(makeField(key, val, hash));
+}
+
+void HttpHeaders::add(std::string_view key, std::string_view val) {
+    if (m_fields.empty()) {
+        m_fields.reserve(16);
+    }
+    m_fields.push_back(makeField(key, val, Hash(key)));
+}
+
+size_t HttpHeaders::erase(std::string_view key) {
+    uint32_t hash = Hash(key);
+    size_t old = m_fields.size();
+    for (auto it = m_fields.begin(); it != m_fields.end();) {
+        if (it->hash == hash && NameEqual(it->first, key)) {
+            it = m_fields.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return old - m_fields.size();
+}
+
+void HttpHeaders::clear() {
+    m_fields.clear();
+    m_blocks.clear();
+    m_cur = nullptr;
+    m_left = 0;
+}
+
+}
+}
@@ -0,0 +1,119 @@
+#ifndef __CHAT_HTTP_HEADERS_H__
+#define __CHAT_HTTP_HEADERS_H__
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdint.h>
+
+namespace chat {
+namespace http {
+
+/* 预先intern的常用头部名称 */
+#define HTTP_HEADER_MAP(XX)                                 \
+  XX(HOST,                  "Host")                         \
+  XX(CONTENT_LENGTH,        "Content-Length")               \
+  XX(CONTENT_TYPE,          "Content-Type")                 \
+  XX(CONNECTION,            "Connection")                   \
+  XX(KEEP_ALIVE,            "Keep-Alive")                   \
+  XX(ACCEPT,                "Accept")                       \
+  XX(ACCEPT_ENCODING,       "Accept-Encoding")              \
+  XX(ACCEPT_LANGUAGE,       "Accept-Language")              \
+  XX(USER_AGENT,            "User-Agent")                   \
+  XX(COOKIE,                "Cookie")                       \
+  XX(SET_COOKIE,            "Set-Cookie")                   \
+  XX(DATE,                  "Date")                         \
+  XX(SERVER,                "Server")                       \
+  XX(TRANSFER_ENCODING,     "Transfer-Encoding")            \
+  XX(CONTENT_ENCODING,      "Content-Encoding")             \
+  XX(EXPECT,                "Expect")                       \
+  XX(UPGRADE,               "Upgrade")                      \
+  XX(CACHE_CONTROL,         "Cache-Control")                \
+  XX(PRAGMA,                "Pragma")                       \
+  XX(ETAG,                  "ETag")                         \
+  XX(LAST_MODIFIED,         "Last-Modified")                \
+  XX(IF_NONE_MATCH,         "If-None-Match")                \
+  XX(IF_MODIFIED_SINCE,     "If-Modified-Since")            \
+  XX(RANGE,                 "Range")                        \
+  XX(IF_RANGE,              "If-Range")                     \
+  XX(ACCEPT_RANGES,         "Accept-Ranges")                \
+  XX(CONTENT_RANGE,         "Content-Range")                \
+  XX(LOCATION,              "Location")                     \
+  XX(REFERER,               "Referer")                      \
+  XX(ORIGIN,                "Origin")                       \
+  XX(AUTHORIZATION,         "Authorization")                \
+  XX(VARY,                  "Vary")                         \
+  XX(TRAILER,               "Trailer")                      \
+  XX(TE,                    "TE")                           \
+  XX(X_FORWARDED_FOR,       "X-Forwarded-For")              \
+  XX(X_REAL_IP,             "X-Real-IP")                    \
+  XX(SEC_WEBSOCKET_KEY,     "Sec-WebSocket-Key")            \
+  XX(SEC_WEBSOCKET_VERSION, "Sec-WebSocket-Version")        \
+  XX(SEC_WEBSOCKET_ACCEPT,  "Sec-WebSocket-Accept")         \
+  XX(SEC_WEBSOCKET_EXTENSIONS, "Sec-WebSocket-Extensions")  \
+
+enum class HttpHeaderId : int16_t {
+#define XX(name, str) name,
+    HTTP_HEADER_MAP(XX)
+#undef XX
+    OTHER
+};
+
+//HTTP头部容器: 字段按插入顺序平铺在vector中, 名称/值拷贝进按块分配的arena
+//每个字段保存小写名称的hash, 查找时先比hash再忽略大小写比较
+//常用名称直接指向静态表, 不拷贝
+//遍历得到的Field成员名与std::map的value_type一致(first/second), 可直接替换原来的map
+//first/second在容器clear或析构前有效
+class HttpHeaders {
+public:
+    struct Field {
+        std::string_view first;
+        std::string_view second;
+        uint32_t hash;
+        HttpHeaderId id;
+    };
+    typedef std::vector<Field>::const_iterator const_iterator;
+    typedef const_iterator iterator;
+
+    HttpHeaders() {}
+    HttpHeaders(const HttpHeaders& o);
+    HttpHeaders& operator=(const HttpHeaders& o);
+    HttpHeaders(HttpHeaders&& o);
+    HttpHeaders& operator=(HttpHeaders&& o);
+
+    const_iterator begin() const { return m_fields.begin();}
+    const_iterator end() const { return m_fields.end();}
+    size_t size() const { return m_fields.size();}
+    bool empty() const { return m_fields.empty();}
+
+    const_iterator find(std::string_view key) const;
+    const_iterator find(HttpHeaderId id) const;
+
+    //存在同名字段时覆盖第一个
+    void set(std::string_view key, std::string_view val);
+    //总是追加, 允许同名字段
+    void add(std::string_view key, std::string_view val);
+    //删除所有同名字段, 返回删除个数
+    size_t erase(std::string_view key);
+    void clear();
+
+    //小写名称的FNV-1a hash
+    static uint32_t Hash(std::string_view name);
+    //查找intern的名称, 不存在返回OTHER
+    static HttpHeaderId LookupId(std::string_view name, uint32_t hash);
+    static std::string_view IdToName(HttpHeaderId id);
+private:
+    Field makeField(std::string_view key, std::string_view val, uint32_t hash);
+    std::string_view copy(std::string_view v);
+private:
+    std::vector<Field> m_fields;
+    std::vector<std::unique_ptr<char[]> > m_blocks;
+    char* m_cur = nullptr;
+    size_t m_left = 0;
+};
+
+}
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "http_parser.h"
+#include "http_simd.h"
 #include "chat/log.h"
 #include "chat/config.h"
 
@@ -24,10 +25,25 @@ static chat::ConfigVar<uint64_t>::ptr g_http_response_max_body_size =
     chat::Config::Lookup("http.response.max_body_size"
                 ,(uint64_t)(64 * 1024 * 1024), "http response max body size");
 
+static chat::ConfigVar<std::string>::ptr g_http_request_parser =
+    chat::Config::Lookup("http.request.parser"
+                ,std::string("ragel"), "http request parser engine: ragel, simd");
+
 static uint64_t s_http_request_buffer_size = 0;
 static uint64_t s_http_request_max_body_size = 0;
 static uint64_t s_http_response_buffer_size = 0;
 static uint64_t s_http_response_max_body_size = 0;
+static HttpRequestParser::Engine s_http_request_parser = HttpRequestParser::RAGEL;
+
+static HttpRequestParser::Engine StringToEngine(const std::string& v) {
+    if (strcasecmp(v.c_str(), "simd") == 0) {
+        return HttpRequestParser::SIMD;
+    }
+    if (strcasecmp(v.c_str(), "ragel") != 0) {
+        CHAT_LOG_WARN(g_logger) << "invalid http.request.parser: " << v << ", use ragel";
+    }
+    return HttpRequestParser::RAGEL;
+}
 
 uint64_t HttpRequestParser::GetHttpRequestBufferSize() {
     return s_http_request_buffer_size;
@@ -37,6 +53,10 @@ uint64_t HttpRequestParser::GetHttpRequestMaxBodySize() {
     return s_http_request_max_body_size;
 }
 
+HttpRequestParser::Engine HttpRequestParser::GetDefaultEngine() {
+    return s_http_request_parser;
+}
+
 uint64_t HttpResponseParser::GetHttpResponseBufferSize() {
     return s_http_response_buffer_size;
 }
@@ -53,6 +73,7 @@ struct _RequestSizeIniter {
         s_http_request_max_body_size = g_http_request_max_body_size->getValue();
         s_http_response_buffer_size = g_http_response_buffer_size->getValue();
         s_http_response_max_body_size = g_http_response_max_body_size->getValue();
+        s_http_request_parser = StringToEngine(g_http_request_parser->getValue());
 
         g_http_request_buffer_size->addListener(
                 [](const uint64_t& ov, const uint64_t& nv){
@@ -73,6 +94,11 @@ struct _RequestSizeIniter {
                 [](const uint64_t& ov, const uint64_t& nv){
                 s_http_response_max_body_size = nv;
         });
+
+        g_http_request_parser->addListener(
+                [](const std::string& ov, const std::string& nv){
+                s_http_request_parser = StringToEngine(nv);
+        });
     }
 };
 static _RequestSizeIniter _init;
@@ -137,12 +163,26 @@ void on_request_http_field(void *data, const char *field, size_t flen
         //parser->setError(1002);
         return;
     }
-    parser->getData()->setHeader(std::string(field, flen)
-                                ,std::string(value, vlen));
+    //直接写入头部容器, 不构造临时string
+    parser->getData()->getHeaders().set(std::string_view(field, flen)
+                                        ,std::string_view(value, vlen));
 }
 
 HttpRequestParser::HttpRequestParser()
-    :m_error(0) {
+    :m_error(0)
+    ,m_engine(s_http_request_parser) {
+    init();
+}
+
+HttpRequestParser::HttpRequestParser(Engine engine)
+    :m_error(0)
+    ,m_engine(engine) {
+    init();
+}
+
+void HttpRequestParser::init() {
+    m_finished = false;
+    m_scanned = 0;
     m_data = std::make_shared<chat::http::HttpRequest>();
     http_parser_init(&m_parser);
     m_parser.request_method = on_request_method;
@@ -163,18 +203,198 @@ uint64_t HttpRequestParser::getContentLength() {
 //1: 成功
 //-1: 有错误
 //>0: 已处理的字节数，且data有效数据为len - v
+void HttpRequestParser::reset() {
+    m_error = 0;
+    m_finished = false;
+    m_scanned = 0;
+    m_data = std::make_shared<chat::http::HttpRequest>();
+    http_parser_init(&m_parser);
+}
+
 size_t HttpRequestParser::execute(char* data, size_t len) {
-    size_t v = http_parser_execute(&m_parser, data, len, 0);
+    size_t v = m_engine == SIMD ? executeSimd(data, len)
+                                : http_parser_execute(&m_parser, data, len, 0);
     memmove(data, data + v, (len - v));
     return v;
 }
 
 int HttpRequestParser::isFinished() {
+    if (m_engine == SIMD) {
+        return m_finished;
+    }
     return http_parser_finish(&m_parser);
 }
 
 int HttpRequestParser::hasError() {
-    return m_error || http_parser_has_error(&m_parser);
+    return m_error || (m_engine == RAGEL && http_parser_has_error(&m_parser));
+}
+
+//RFC 7230 tchar
+struct TokenCharMap {
+    bool map[256];
+
+    TokenCharMap() {
+        memset(map, 0, sizeof(map));
+        for (int c = '0'; c <= '9'; ++c) {
+            map[c] = true;
+        }
+        for (int c = 'a'; c <= 'z'; ++c) {
+            map[c] = true;
+            map[c - 'a' + 'A'] = true;
+        }
+        for (const char* p = "!#$%&'*+-.^_`|~"; *p; ++p) {
+            map[(unsigned char)*p] = true;
+        }
+    }
+};
+static const TokenCharMap s_token_chars;
+
+static inline const char* SkipToken(const char* p) {
+    while (s_token_chars.map[(unsigned char)*p]) {
+        ++p;
+    }
+    return p;
+}
+
+//查找空行, 返回头部结束(空行之后)的位置, 没找到返回nullptr
+static const char* FindHeaderEnd(const char* p, const char* end) {
+    while (p < end) {
+        const char* lf = (const char*)memchr(p, '\n', end - p);
+        if (!lf || lf + 1 >= end) {
+            return nullptr;
+        }
+        if (lf[1] == '\n') {
+            return lf + 2;
+        }
+        if (lf[1] == '\r') {
+            if (lf + 2 >= end) {
+                return nullptr;
+            }
+            if (lf[2] == '\n') {
+                return lf + 3;
+            }
+        }
+        p = lf + 1;
+    }
+    return nullptr;
+}
+
+//吃掉行尾的CRLF或LF, 格式不对返回nullptr
+static inline const char* SkipEol(const char* p) {
+    if (*p == '\r') {
+        ++p;
+    }
+    return *p == '\n' ? p + 1 : nullptr;
+}
+
+size_t HttpRequestParser::executeSimd(char* data, size_t len) {
+    if (m_finished || m_error) {
+        return 0;
+    }
+    const char* begin = data;
+    const char* end = data + len;
+    const char* p = begin;
+    //忽略请求行之前的空行
+    while (p < end && (*p == '\r' || *p == '\n')) {
+        ++p;
+    }
+    //头部不完整时不解析, 下次从上次扫描过的位置继续找空行
+    size_t from = std::max(m_scanned, (size_t)(p - begin) + 3) - 3;
+    const char* hend = FindHeaderEnd(begin + from, end);
+    if (!hend) {
+        m_scanned = len;
+        return 0;
+    }
+
+    //method SP request-target SP HTTP-version CRLF
+    const char* q = SkipToken(p);
+    if (q == p || *q != ' ') {
+        setError(1003);
+        return 0;
+    }
+    HttpMethod method = CharsToHttpMethod(p, q - p);
+    if (method == HttpMethod::INVALID_METHOD) {
+        CHAT_LOG_WARN(g_logger) << "invalid http request method: "
+            << std::string(p, q - p);
+        setError(1000);
+        return 0;
+    }
+    m_data->setMethod(method);
+
+    p = q + 1;
+    q = FindHttpStop(p, hend, true);
+    if (q == p || *q != ' ') {
+        setError(1003);
+        return 0;
+    }
+    const char* uri = p;
+    const char* uri_end = q;
+    if (*uri != '/' && !(uri_end - uri == 1 && *uri == '*')) {
+        //absolute-form: 跳过scheme://authority
+        const char* s = (const char*)memmem(uri, uri_end - uri, "://", 3);
+        if (s) {
+            const char* slash = (const char*)memchr(s + 3, '/', uri_end - s - 3);
+            uri = slash ? slash : uri_end;
+        }
+    }
+    const char* fragment = (const char*)memchr(uri, '#', uri_end - uri);
+    const char* path_end = fragment ? fragment : uri_end;
+    const char* query = (const char*)memchr(uri, '?', path_end - uri);
+    if (fragment) {
+        m_data->setFragment(std::string(fragment + 1, uri_end - fragment - 1));
+    }
+    if (query) {
+        m_data->setQuery(std::string(query + 1, path_end - query - 1));
+        path_end = query;
+    }
+    if (path_end != uri) {
+        m_data->setPath(std::string(uri, path_end - uri));
+    }
+
+    p = q + 1;
+    if (hend - p < 9 || memcmp(p, "HTTP/1.", 7) != 0
+            || (p[7] != '0' && p[7] != '1')) {
+        CHAT_LOG_WARN(g_logger) << "invalid http request version: "
+            << std::string(p, std::min<size_t>(hend - p, 8));
+        setError(1001);
+        return 0;
+    }
+    m_data->setVersion(p[7] == '1' ? 0x11 : 0x10);
+    p = SkipEol(p + 8);
+    if (!p) {
+        setError(1003);
+        return 0;
+    }
+
+    //field-name ":" OWS field-value OWS CRLF
+    while (*p != '\r' && *p != '\n') {
+        q = SkipToken(p);
+        if (q == p || *q != ':') {
+            CHAT_LOG_WARN(g_logger) << "invalid http request field: "
+                << std::string(p, FindHttpStop(p, hend, false) - p);
+            setError(1002);
+            return 0;
+        }
+        std::string_view name(p, q - p);
+        const char* v = q + 1;
+        while (*v == ' ' || *v == '\t') {
+            ++v;
+        }
+        const char* ve = FindHttpStop(v, hend, false);
+        p = SkipEol(ve);
+        if (!p) {
+            //值中含有控制字符
+            setError(1002);
+            return 0;
+        }
+        while (ve > v && (ve[-1] == ' ' || ve[-1] == '\t')) {
+            --ve;
+        }
+        m_data->getHeaders().set(name, std::string_view(v, ve - v));
+    }
+    p = SkipEol(p);
+    m_finished = true;
+    return p - begin;
 }
 
 
@@ -227,8 +447,9 @@ void on_response_http_field(void *data, const char *field, size_t flen
         //parser->setError(1002);
         return;
     }
-    parser->getData()->setHeader(std::string(field, flen)
-                                ,std::string(value, vlen));
+    //直接写入头部容器, 不构造临时string
+    parser->getData()->getHeaders().set(std::string_view(field, flen)
+                                        ,std::string_view(value, vlen));
 }
 
 HttpResponseParser::HttpResponseParser()
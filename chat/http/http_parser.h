@@ -13,10 +13,24 @@ class HttpRequestParser {
 public:
     typedef std::shared_ptr<HttpRequestParser> ptr;
 
+    //解析引擎
+    enum Engine {
+        //ragel状态机, 逐字节解析
+        RAGEL = 0,
+        //向量化扫描分隔符并校验字符, 头部完整后一次解析(picohttpparser的方式)
+        SIMD = 1
+    };
+
+    //使用配置http.request.parser指定的引擎
     HttpRequestParser();
+    HttpRequestParser(Engine engine);
 
     //解析协议
+    //两种引擎返回值含义相同: 已处理的字节数, 已处理的数据被移出data
+    //SIMD引擎在头部不完整时返回0, 等待更多数据
     size_t execute(char* data, size_t len);
+    //复用解析器解析下一个请求
+    void reset();
 
     int isFinished();
     int hasError(); 
@@ -24,9 +38,14 @@ public:
     void setError(int v) { m_error = v;}
     uint64_t getContentLength();
     const http_parser& getParser() const { return m_parser;}
+    Engine getEngine() const { return m_engine;}
 public:
     static uint64_t GetHttpRequestBufferSize();
     static uint64_t GetHttpRequestMaxBodySize();
+    static Engine GetDefaultEngine();
+private:
+    void init();
+    size_t executeSimd(char* data, size_t len);
 private:
     http_parser m_parser;
     HttpRequest::ptr m_data;
@@ -34,7 +53,13 @@ private:
     // 1000: invalid method
     // 1001: invalid version
     // 1002: invalid field
+    // 1003: invalid request line
     int m_error;
+    Engine m_engine;
+    //SIMD: 头部已解析完
+    bool m_finished;
+    //SIMD: 上次查找头部结束位置时扫描过的长度
+    size_t m_scanned;
 };
 
 
@@ -1,11 +1,35 @@
 #include "http_server.h"
+#include "chat/config.h"
 #include "chat/log.h"
+#include <sys/socket.h>
 
 namespace chat {
 namespace http {
 
 static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
 
+static chat::ConfigVar<uint64_t>::ptr g_http_server_drain_max =
+    chat::Config::Lookup("http.server.drain_max", (uint64_t)(64 * 1024)
+            , "unread request body bytes discarded to keep the connection alive, more closes it");
+
+//先回了响应再关闭的连接, 关闭前读掉客户端还在发的请求体, 避免直接close回RST让客户端丢掉响应
+static const int64_t s_linger_timeout = 1000;
+static const uint64_t s_linger_max = 1024 * 1024;
+
+static void LingeringClose(Socket::ptr client) {
+    ::shutdown(client->getSocket(), SHUT_WR);
+    client->setRecvTimeout(s_linger_timeout);
+    char buf[4096];
+    uint64_t total = 0;
+    while (total < s_linger_max) {
+        int rt = client->recv(buf, sizeof(buf));
+        if (rt <= 0) {
+            break;
+        }
+        total += rt;
+    }
+}
+
 HttpServer::HttpServer(bool keepalive
                ,chat::IOManager* worker
                ,chat::IOManager* io_worker
@@ -38,13 +62,40 @@ void HttpServer::handleClient(Socket::ptr client) {
         rsp->setBody("hello");
         rsp->setHeader("Server", getName());
         rsp->setHeader("Content-Type", "application/json;charset=utf8");
-        {
+        //业务可能只读了部分请求体, 也可能用setBody替换掉, 这里单独持有
+        auto body = std::dynamic_pointer_cast<HttpBodyStream>(req->getBodyStream());
+        if (!body || !body->isTooLarge()) {
             chat::SchedulerSwitcher sw(m_worker);
             m_dispatch->handle(req, rsp, session);
+            if (m_compressor) {
+                m_compressor->compress(req, rsp);
+            }
         }
-        session->sendResponse(rsp);
-
-        if (!m_isKeepalive || req->isClose()) {
+        if (body && body->isTooLarge()) {
+            //超限的请求体不交给业务(或业务读到一半超限), 整个请求按413拒绝
+            CHAT_LOG_WARN(g_logger) << "http request body too large, path=" << req->getPath()
+                << " read=" << body->getReadSize() << " max="
+                << HttpRequestParser::GetHttpRequestMaxBodySize() << " client=" << client->toString();
+            rsp = std::make_shared<HttpResponse>(req->getVersion(), true);
+            rsp->setStatus(HttpStatus::PAYLOAD_TOO_LARGE);
+            rsp->setHeader("Server", getName());
+            rsp->setHeader("Content-Length", "0");
+        }
+        //没读完的请求体剩余不多时读掉以保持连接, 否则先回响应再关闭, 不让客户端等着上传完
+        bool linger = false;
+        if (body && !body->isFinished()
+                && (body->isTooLarge() || !body->drain(g_http_server_drain_max->getValue()))) {
+            rsp->setClose(true);
+            linger = true;
+        }
+        if (!m_isKeepalive || req->isClose() || rsp->isClose()) {
+            if (session->sendResponse(rsp) > 0 && linger) {
+                LingeringClose(client);
+            }
+            break;
+        }
+        //流水线: 缓冲中还有后续请求时先攒响应, 按请求顺序合并写出
+        if (session->sendResponse(rsp, !session->hasPending()) <= 0 || rsp->isClose()) {
             break;
         }
     } while(true);
@@ -4,6 +4,7 @@
 #include "chat/tcp_server.h"
 #include "http_session.h"
 #include "servlet.h"
+#include "http_compress.h"
 
 namespace chat{
 namespace http{
@@ -20,6 +21,10 @@ public:
     ServletDispatch::ptr getServletDispatch() const { return m_dispatch;}
     void setServletDispatch(ServletDispatch::ptr v) { m_dispatch = v;}
 
+    //响应压缩, 为空时不压缩
+    HttpCompressor::ptr getCompressor() const { return m_compressor;}
+    void setCompressor(HttpCompressor::ptr v) { m_compressor = v;}
+
     virtual void setName(const std::string& v) override;
 
 protected:
@@ -30,6 +35,8 @@ private:
     bool m_isKeepalive;
     //Servlet分发器
     ServletDispatch::ptr m_dispatch;
+    //响应压缩
+    HttpCompressor::ptr m_compressor;
 };
 
 }
@@ -1,6 +1,9 @@
 #include "http_session.h"
 #include "http_parser.h"
+#include "chat/file_io.h"
+#include "chat/socket.h"
 #include <string.h>
+#include <sys/sendfile.h>
 
 namespace chat {
 namespace http {
@@ -10,74 +13,490 @@ HttpSession::HttpSession(Socket::ptr sock, bool owner)
 }
 
 HttpRequest::ptr HttpSession::recvRequest() {
-    HttpRequestParser::ptr parser = std::make_shared<HttpRequestParser>();
-    uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();
-    std::shared_ptr<char> buffer(new char[buff_size], [](char* ptr){
-        delete[] ptr;
-    });
-    char* data = buffer.get();
-    int offset = 0;
+    if (!m_buffer) {
+        m_bufferSize = HttpRequestParser::GetHttpRequestBufferSize();
+        m_buffer.reset(new char[m_bufferSize]);
+        m_parser = std::make_shared<HttpRequestParser>();
+    } else {
+        m_parser->reset();
+    }
+    char* data = m_buffer.get();
+    //上个请求留下的数据先解析, 不够再读
+    bool need_read = m_offset == 0;
     do {
-        int len = read(data + offset, buff_size - offset);
-        if (len <= 0) {
+        if (need_read) {
+            //阻塞读之前先把攒着的流水线响应发出去
+            if (!m_sendBuf.empty() && flush() <= 0) {
+                close();
+                return nullptr;
+            }
+            int len = SocketStream::read(data + m_offset, m_bufferSize - m_offset);
+            if (len <= 0) {
+                close();
+                return nullptr;
+            }
+            m_offset += len;
+        }
+        need_read = true;
+        size_t nparse = m_parser->execute(data, m_offset);  //已处理的数据会被移出缓冲
+        if (m_parser->hasError()) {
             close();
             return nullptr;
         }
-        len += offset;  //data总长
-        size_t nparse = parser->execute(data, len);  //已处理长
-        if (parser->hasError()) {
+        m_offset -= nparse;
+        if (m_parser->isFinished()) {
+            break;
+        }
+        if (m_offset == m_bufferSize) {
             close();
             return nullptr;
         }
-        offset = len - nparse;
-        if (offset == (int)buff_size) {
+    } while(true);
+
+    auto req = m_parser->getData();
+    bool chunked = false;
+    auto te = req->getHeaders().find(HttpHeaderId::TRANSFER_ENCODING);
+    if (te != req->getHeaders().end()) {
+        //chunked必须是最后一个编码, 否则无法确定请求体的边界
+        std::string_view v = te->second;
+        while (!v.empty() && (v.back() == ' ' || v.back() == '\t')) {
+            v.remove_suffix(1);
+        }
+        chunked = v.size() >= 7 && strncasecmp(v.data() + v.size() - 7, "chunked", 7) == 0
+            && (v.size() == 7 || v[v.size() - 8] == ',' || v[v.size() - 8] == ' ');
+        if (!chunked) {
             close();
             return nullptr;
         }
-        if (parser->isFinished()) {
-            break;
+        req->delHeader("Content-Length");
+    }
+    int64_t length = chunked ? -1 : (int64_t)m_parser->getContentLength();
+    if (chunked || length > 0) {
+        auto v = req->getHeader("Expect");
+        bool expect = strcasecmp(v.c_str(), "100-continue") == 0;
+        if (expect) {
+            req->delHeader("Expect");
         }
-    } while(true);
+        req->setBodyStream(std::make_shared<HttpBodyStream>(shared_from_this(), length, expect));
+    }
 
-    int64_t length = parser->getContentLength();
+    req->init();
+    return req;
+}
 
-    auto v = parser->getData()->getHeader("Expect");
-    if(strcasecmp(v.c_str(), "100-continue") == 0) {
-        static const std::string s_data = "HTTP/1.1 100 Continue\r\n\r\n";
-        writeFixSize(s_data.c_str(), s_data.size());
-        parser->getData()->delHeader("Expect");
+int HttpSession::fillBuffer() {
+    if (m_offset == m_bufferSize) {
+        return -1;
+    }
+    int len = SocketStream::read(m_buffer.get() + m_offset, m_bufferSize - m_offset);
+    if (len > 0) {
+        m_offset += len;
+    }
+    return len;
+}
+
+void HttpSession::consumeBuffer(size_t n) {
+    m_offset -= n;
+    memmove(m_buffer.get(), m_buffer.get() + n, m_offset);
+}
+
+int HttpSession::read(void* buffer, size_t length) {
+    if (m_offset == 0) {
+        return SocketStream::read(buffer, length);
+    }
+    size_t n = std::min(length, m_offset);
+    memcpy(buffer, m_buffer.get(), n);
+    m_offset -= n;
+    memmove(m_buffer.get(), m_buffer.get() + n, m_offset);
+    return n;
+}
+
+int HttpSession::flush() {
+    if (m_sendBuf.empty()) {
+        return 1;
     }
+    int rt = writeFixSize(m_sendBuf.c_str(), m_sendBuf.size());
+    m_sendBuf.clear();
+    return rt;
+}
 
-    if (length > 0) {
-        std::string body;
-        body.resize(length);
+//内存中的文件内容不超过该值时与响应头一起writev, 省去一次sendfile系统调用
+static const uint64_t s_writev_max = 64 * 1024;
+static const uint64_t s_sendfile_chunk = 1024 * 1024;
 
-        int len = 0;
-        if (length >= offset) {
-            memcpy(&body[0], data, offset);
-            len = offset;
-        } else {
-            memcpy(&body[0], data, length);
-            len = length;
+int HttpSession::writevFixSize(iovec* iov, size_t cnt) {
+    while (cnt > 0) {
+        int rt = m_socket->send(iov, cnt);
+        if (rt <= 0) {
+            return rt;
         }
-        length -= offset;
-        if (length > 0) {
-            if (readFixSize(&body[len], length) <= 0) {
-                close();
-                return nullptr;
+        size_t n = rt;
+        while (cnt > 0 && n >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --cnt;
+        }
+        if (cnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 1;
+}
+
+int HttpSession::sendStreamResponse(HttpResponse::ptr rsp) {
+    bool chunked = false;
+    if (rsp->getHeaders().find(HttpHeaderId::CONTENT_LENGTH) == rsp->getHeaders().end()) {
+        chunked = rsp->getVersion() >= 0x11;
+        if (!chunked) {
+            //HTTP/1.0没有chunked, 以关闭连接表示响应结束
+            rsp->setClose(true);
+        }
+    }
+    m_headerBuf.clear();
+    rsp->dumpHeader(m_headerBuf);
+    iovec iovs[2];
+    size_t cnt = 0;
+    if (!m_sendBuf.empty()) {
+        iovs[cnt].iov_base = &m_sendBuf[0];
+        iovs[cnt++].iov_len = m_sendBuf.size();
+    }
+    iovs[cnt].iov_base = &m_headerBuf[0];
+    iovs[cnt++].iov_len = m_headerBuf.size();
+    int rt = writevFixSize(iovs, cnt);
+    m_sendBuf.clear();
+    if (rt <= 0) {
+        return rt;
+    }
+    auto writer = std::make_shared<HttpBodyWriter>(this, chunked);
+    if (rsp->getStreamBody()(writer) < 0) {
+        return -1;
+    }
+    return writer->finish();
+}
+
+int HttpSession::sendResponse(HttpResponse::ptr rsp, bool flush) {
+    if (rsp->getStreamBody()) {
+        return sendStreamResponse(rsp);
+    }
+    HttpResponse::FileBody::ptr body = rsp->getFileBody();
+    const std::string& content = rsp->getBody();
+    if (!body && !flush && m_sendBuf.size() + content.size() < s_writev_max) {
+        rsp->dumpHeader(m_sendBuf);
+        m_sendBuf.append(content);
+        return 1;
+    }
+
+    //头部写入按连接复用的m_headerBuf, 响应体直接作为iovec发送, 不拷贝
+    m_headerBuf.clear();
+    rsp->dumpHeader(m_headerBuf);
+    iovec iovs[3];
+    size_t cnt = 0;
+    if (!m_sendBuf.empty()) {
+        iovs[cnt].iov_base = &m_sendBuf[0];
+        iovs[cnt++].iov_len = m_sendBuf.size();
+    }
+    iovs[cnt].iov_base = &m_headerBuf[0];
+    iovs[cnt++].iov_len = m_headerBuf.size();
+    if (!body) {
+        if (!content.empty()) {
+            iovs[cnt].iov_base = (void*)content.data();
+            iovs[cnt++].iov_len = content.size();
+        }
+        int rt = writevFixSize(iovs, cnt);
+        m_sendBuf.clear();
+        return rt;
+    }
+
+    SSLSocket::ptr ssl = std::dynamic_pointer_cast<SSLSocket>(m_socket);
+    bool ktls = ssl && ssl->isKtlsSend();
+    if (body->data && (body->fd < 0 || body->length <= s_writev_max || (ssl && !ktls))) {
+        //头和内存中的文件内容(或响应体)一起writev
+        iovs[cnt].iov_base = (void*)(body->data + body->offset);
+        iovs[cnt++].iov_len = body->length;
+        int rt = writevFixSize(iovs, cnt);
+        m_sendBuf.clear();
+        return rt;
+    }
+    if (!m_sendBuf.empty() && this->flush() <= 0) {
+        return -1;
+    }
+    const std::string& data = m_headerBuf;
+
+    if (!ssl) {
+        //明文: 头部MSG_MORE与随后的sendfile合并成段
+        size_t off = 0;
+        while (off < data.size()) {
+            int rt = m_socket->send(data.c_str() + off, data.size() - off, MSG_MORE);
+            if (rt <= 0) {
+                return rt;
             }
+            off += rt;
         }
-        parser->getData()->setBody(body);
+        off_t foff = body->offset;
+        uint64_t left = body->length;
+        while (left > 0) {
+            ssize_t rt = ::sendfile(m_socket->getSocket(), body->fd, &foff
+                    , std::min(left, s_sendfile_chunk));
+            if (rt <= 0) {
+                return rt;
+            }
+            left -= rt;
+        }
+        return 1;
     }
 
-    parser->getData()->init();
-    return parser->getData();
+    if (writeFixSize(data.c_str(), data.size()) <= 0) {
+        return -1;
+    }
+#ifdef SSL_OP_ENABLE_KTLS
+    if (ktls) {
+        //kTLS: 加密在内核完成, 文件页无需拷贝到用户态
+        off_t foff = body->offset;
+        uint64_t left = body->length;
+        while (left > 0) {
+            ossl_ssize_t rt = SSL_sendfile(ssl->getSSL(), body->fd, foff
+                    , std::min(left, s_sendfile_chunk), 0);
+            if (rt <= 0) {
+                return -1;
+            }
+            foff += rt;
+            left -= rt;
+        }
+        return 1;
+    }
+#endif
+    //TLS且文件内容不在内存: 分块pread(由文件IO线程池执行)后写出
+    std::string buf;
+    buf.resize(std::min(body->length, s_sendfile_chunk));
+    uint64_t off = body->offset;
+    uint64_t left = body->length;
+    while (left > 0) {
+        ssize_t rt = FileIOMgr::GetInstance()->pread(body->fd, &buf[0]
+                , std::min(left, (uint64_t)buf.size()), off);
+        if (rt <= 0) {
+            return -1;
+        }
+        if (writeFixSize(&buf[0], rt) <= 0) {
+            return -1;
+        }
+        off += rt;
+        left -= rt;
+    }
+    return 1;
+}
+
+HttpBodyStream::HttpBodyStream(HttpSession::ptr session, int64_t content_length, bool expect_continue)
+    :m_session(session)
+    ,m_state(content_length < 0 ? CHUNK_SIZE : BODY)
+    ,m_left(content_length < 0 ? 0 : content_length)
+    ,m_continue(expect_continue) {
+    if (content_length == 0) {
+        m_state = DONE;
+    } else if (content_length > 0
+            && (uint64_t)content_length > HttpRequestParser::GetHttpRequestMaxBodySize()) {
+        m_state = ERROR;
+        m_tooLarge = true;
+    }
+}
+
+bool HttpBodyStream::readLine(std::string& line) {
+    while (true) {
+        char* data = m_session->m_buffer.get();
+        char* lf = (char*)memchr(data, '\n', m_session->m_offset);
+        if (lf) {
+            size_t len = lf - data;
+            line.assign(data, len > 0 && lf[-1] == '\r' ? len - 1 : len);
+            m_session->consumeBuffer(len + 1);
+            return true;
+        }
+        if (m_session->fillBuffer() <= 0) {
+            return false;
+        }
+    }
 }
 
-int HttpSession::sendResponse(HttpResponse::ptr rsp) {
-    std::string data = rsp->toString();
-    return writeFixSize(data.c_str(), data.size());
+int HttpBodyStream::read(void* buffer, size_t length) {
+    if (m_continue) {
+        //业务开始读请求体时才让客户端发送
+        static const std::string s_data = "HTTP/1.1 100 Continue\r\n\r\n";
+        m_continue = false;
+        if (m_session->flush() <= 0
+                || m_session->writeFixSize(s_data.c_str(), s_data.size()) <= 0) {
+            m_state = ERROR;
+        }
+    }
+    while (true) {
+        switch (m_state) {
+            case DONE:
+                return 0;
+            case ERROR:
+                return -1;
+            case BODY:
+            case CHUNK_DATA: {
+                int rt = m_session->read(buffer, std::min((uint64_t)length, m_left));
+                if (rt <= 0) {
+                    m_state = ERROR;
+                    return -1;
+                }
+                m_left -= rt;
+                m_readSize += rt;
+                if (m_left == 0) {
+                    m_state = m_state == BODY ? DONE : CHUNK_END;
+                }
+                return rt;
+            }
+            case CHUNK_SIZE: {
+                //chunk-size [; chunk-ext] CRLF
+                std::string line;
+                if (!readLine(line)) {
+                    m_state = ERROR;
+                    break;
+                }
+                char* end = nullptr;
+                errno = 0;
+                m_left = strtoull(line.c_str(), &end, 16);
+                if (end == line.c_str() || errno == ERANGE
+                        || (*end && *end != ';' && *end != ' ' && *end != '\t')) {
+                    m_state = ERROR;
+                } else if (m_readSize + m_left > HttpRequestParser::GetHttpRequestMaxBodySize()) {
+                    m_state = ERROR;
+                    m_tooLarge = true;
+                } else {
+                    m_state = m_left == 0 ? TRAILER : CHUNK_DATA;
+                }
+                break;
+            }
+            case CHUNK_END: {
+                std::string line;
+                m_state = readLine(line) && line.empty() ? CHUNK_SIZE : ERROR;
+                break;
+            }
+            case TRAILER: {
+                //trailer字段直接丢弃, 读到空行结束
+                std::string line;
+                if (!readLine(line)) {
+                    m_state = ERROR;
+                } else if (line.empty()) {
+                    m_state = DONE;
+                }
+                break;
+            }
+        }
+    }
 }
 
+int HttpBodyStream::read(ByteArray::ptr ba, size_t length) {
+    std::vector<iovec> iovs;
+    ba->getWriteBuffers(iovs, length);
+    int rt = read(iovs[0].iov_base, iovs[0].iov_len);
+    if (rt > 0) {
+        ba->setPosition(ba->getPosition() + rt);
+    }
+    return rt;
+}
+
+uint64_t HttpBodyStream::getRawLeft() const {
+    if (m_state != BODY || m_continue || m_session->m_offset > 0) {
+        return 0;
+    }
+    return m_left;
+}
+
+void HttpBodyStream::consumeRaw(uint64_t n) {
+    n = std::min(n, m_left);
+    m_left -= n;
+    m_readSize += n;
+    if (m_left == 0) {
+        m_state = DONE;
+    }
+}
+
+bool HttpBodyStream::drain(uint64_t max) {
+    if (m_continue) {
+        //还没让客户端发送请求体, 无法判断它是否会发, 只能关闭连接
+        return false;
+    }
+    if (m_state == BODY && m_left > max) {
+        return false;
+    }
+    char buf[4096];
+    uint64_t total = 0;
+    while (total <= max) {
+        int rt = read(buf, sizeof(buf));
+        if (rt <= 0) {
+            return rt == 0;
+        }
+        total += rt;
+    }
+    return false;
+}
+
+HttpBodyWriter::HttpBodyWriter(HttpSession* session, bool chunked)
+    :m_session(session)
+    ,m_chunked(chunked) {
+}
+
+int HttpBodyWriter::write(const void* buffer, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
+    if (!m_chunked) {
+        int rt = m_session->writeFixSize(buffer, length);
+        if (rt <= 0) {
+            return rt;
+        }
+    } else {
+        char head[24];
+        iovec iovs[3];
+        iovs[0].iov_base = head;
+        iovs[0].iov_len = snprintf(head, sizeof(head), "%zx\r\n", length);
+        iovs[1].iov_base = (void*)buffer;
+        iovs[1].iov_len = length;
+        iovs[2].iov_base = (void*)"\r\n";
+        iovs[2].iov_len = 2;
+        int rt = m_session->writevFixSize(iovs, 3);
+        if (rt <= 0) {
+            return rt;
+        }
+    }
+    m_writeSize += length;
+    return length;
+}
+
+int HttpBodyWriter::write(ByteArray::ptr ba, size_t length) {
+    std::vector<iovec> iovs;
+    ba->getReadBuffers(iovs, length);
+    if (iovs.empty()) {
+        return 0;
+    }
+    char head[24];
+    if (m_chunked) {
+        iovec h;
+        h.iov_base = head;
+        h.iov_len = snprintf(head, sizeof(head), "%zx\r\n", length);
+        iovs.insert(iovs.begin(), h);
+        iovec t;
+        t.iov_base = (void*)"\r\n";
+        t.iov_len = 2;
+        iovs.push_back(t);
+    }
+    int rt = m_session->writevFixSize(&iovs[0], iovs.size());
+    if (rt <= 0) {
+        return rt;
+    }
+    ba->setPosition(ba->getPosition() + length);
+    m_writeSize += length;
+    return length;
+}
+
+int HttpBodyWriter::finish() {
+    if (!m_chunked) {
+        return 1;
+    }
+    static const char s_last[] = "0\r\n\r\n";
+    return m_session->writeFixSize(s_last, sizeof(s_last) - 1);
+}
+
+}
 }
-}
\ No newline at end of file
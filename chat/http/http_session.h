@@ -3,19 +3,122 @@
 
 #include "../streams/socket_stream.h"
 #include "http.h"
+#include "http_parser.h"
 
 namespace chat{
 namespace http{
 
-class HttpSession: public SocketStream{
+class HttpSession: public SocketStream, public std::enable_shared_from_this<HttpSession> {
 public:
     typedef std::shared_ptr<HttpSession> ptr;
 
     HttpSession(Socket::ptr sock, bool owner = true);
 
+    //读缓冲按连接复用, 流水线请求中多读的字节留给下一个请求
+    //请求体不在这里读取, 而是作为HttpBodyStream挂在请求上, 由业务按需读取
     HttpRequest::ptr recvRequest();
-    int sendResponse(HttpResponse::ptr rsp);
+    //flush为false时响应先追加到发送缓冲, 下次flush或需要阻塞读时一起发出
+    int sendResponse(HttpResponse::ptr rsp, bool flush = true);
+    int flush();
 
+    //读缓冲中是否还有未处理的数据(流水线的后续请求)
+    bool hasPending() const { return m_offset > 0;}
+
+    using SocketStream::read;
+    //优先返回读缓冲中剩余的数据
+    virtual int read(void* buffer, size_t length) override;
+private:
+    friend class HttpBodyStream;
+    friend class HttpBodyWriter;
+    //处理部分写, 直到全部发出
+    int writevFixSize(iovec* iov, size_t cnt);
+    //从socket读一次追加到读缓冲, 缓冲已满返回-1
+    int fillBuffer();
+    //丢弃读缓冲头部n字节
+    void consumeBuffer(size_t n);
+    int sendStreamResponse(HttpResponse::ptr rsp);
+private:
+    std::unique_ptr<char[]> m_buffer;
+    size_t m_bufferSize = 0;
+    size_t m_offset = 0;
+    HttpRequestParser::ptr m_parser;
+    std::string m_sendBuf;
+    std::string m_headerBuf;
+};
+
+//请求体流: 按Content-Length或chunked编码从连接读出请求体, 读到结尾为止,
+//不会读到流水线中的下一个请求; 读缓冲中已有的数据优先消费
+class HttpBodyStream : public Stream {
+public:
+    typedef std::shared_ptr<HttpBodyStream> ptr;
+
+    //content_length小于0表示chunked编码
+    //expect_continue为true时在第一次read前回复100 Continue
+    HttpBodyStream(HttpSession::ptr session, int64_t content_length, bool expect_continue);
+
+    //返回0表示请求体已读完, 小于0表示出错或超过http.request.max_body_size
+    virtual int read(void* buffer, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+    virtual int write(const void* buffer, size_t length) override { return -1;}
+    virtual int write(ByteArray::ptr ba, size_t length) override { return -1;}
+    virtual void close() override {}
+
+    bool isFinished() const { return m_state == DONE;}
+    //Content-Length或已读的chunked数据超过了http.request.max_body_size
+    bool isTooLarge() const { return m_tooLarge;}
+    uint64_t getReadSize() const { return m_readSize;}
+
+    //Content-Length请求体且读缓冲已空时, 剩余字节都还在socket上, 返回其长度, 否则返回0
+    //调用方可直接从socket搬运(如splice), 之后用consumeRaw告知搬运的字节数
+    uint64_t getRawLeft() const;
+    void consumeRaw(uint64_t n);
+
+    //丢弃剩余请求体使连接能继续处理下一个请求, 剩余超过max或出错返回false
+    //Content-Length已知剩余超过max时不读直接返回false
+    bool drain(uint64_t max);
+private:
+    //读一行(不含CRLF), 行过长或连接出错返回false
+    bool readLine(std::string& line);
+private:
+    enum State {
+        BODY,
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_END,
+        TRAILER,
+        DONE,
+        ERROR
+    };
+    HttpSession::ptr m_session;
+    State m_state;
+    //整个请求体或当前块剩余的字节数
+    uint64_t m_left;
+    uint64_t m_readSize = 0;
+    bool m_continue;
+    bool m_tooLarge = false;
+};
+
+//流式响应体的写出端, 只在StreamCallback执行期间有效
+//chunked时每次write作为一个块, 块头/数据/块尾一起writev
+class HttpBodyWriter : public Stream {
+public:
+    typedef std::shared_ptr<HttpBodyWriter> ptr;
+
+    HttpBodyWriter(HttpSession* session, bool chunked);
+
+    virtual int read(void* buffer, size_t length) override { return -1;}
+    virtual int read(ByteArray::ptr ba, size_t length) override { return -1;}
+    virtual int write(const void* buffer, size_t length) override;
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+    virtual void close() override {}
+
+    //chunked时写出结尾的0长度块
+    int finish();
+    uint64_t getWriteSize() const { return m_writeSize;}
+private:
+    HttpSession* m_session;
+    bool m_chunked;
+    uint64_t m_writeSize = 0;
 };
 
 }
@@ -23,4 +126,4 @@ public:
 
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,207 @@
+#include "http_simd.h"
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHAT_HTTP_X86 1
+#endif
+
+namespace chat {
+namespace http {
+
+static inline bool IsStop(unsigned char c, bool stop_space) {
+    return (c < 0x20 && c != '\t') || c == 0x7f || (stop_space && c == ' ');
+}
+
+static const char* FindHttpStopScalar(const char* p, const char* end, bool stop_space) {
+    for (; p < end; ++p) {
+        if (IsStop(*p, stop_space)) {
+            return p;
+        }
+    }
+    return p;
+}
+
+#ifdef CHAT_HTTP_X86
+//与picohttpparser的findchar_fast相同: pcmpestri按字符区间查找, 每次16字节
+__attribute__((target("sse4.2")))
+static const char* FindHttpStopSSE42(const char* p, const char* end, bool stop_space) {
+    //区间[\0,\10], [\12,\37], [\177,\177], 需要时加上[ , ]
+    alignas(16) static const char s_ranges[16] = "\000\010\012\037\177\177\040\040";
+    __m128i ranges = _mm_load_si128((const __m128i*)s_ranges);
+    int ranges_len = stop_space ? 8 : 6;
+    while (end - p >= 16) {
+        __m128i b = _mm_loadu_si128((const __m128i*)p);
+        int r = _mm_cmpestri(ranges, ranges_len, b, 16
+                    , _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_POSITIVE_POLARITY);
+        if (r != 16) {
+            return p + r;
+        }
+        p += 16;
+    }
+    return FindHttpStopScalar(p, end, stop_space);
+}
+
+//每次32字节: c <= 0x1f 且 c != HT, 或 c == DEL, 或(可选) c == ' '
+__attribute__((target("avx2")))
+static const char* FindHttpStopAVX2(const char* p, const char* end, bool stop_space) {
+    const __m256i ctl = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    const __m256i space = stop_space ? _mm256_set1_epi8(' ') : del;
+    while (end - p >= 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i*)p);
+        __m256i is_ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(b, ctl), b);
+        is_ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(b, tab), is_ctl);
+        __m256i stop = _mm256_or_si256(is_ctl, _mm256_or_si256(_mm256_cmpeq_epi8(b, del)
+                                                               , _mm256_cmpeq_epi8(b, space)));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(stop);
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return FindHttpStopScalar(p, end, stop_space);
+}
+#endif
+
+//8字节一组异或, 每组长度是4的倍数, 掩码的相位不变
+static void WSMaskScalar(char* dst, const char* src, size_t len, const char* mask) {
+    uint32_t m32;
+    memcpy(&m32, mask, 4);
+    uint64_t m64 = ((uint64_t)m32 << 32) | m32;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, src + i, 8);
+        v ^= m64;
+        memcpy(dst + i, &v, 8);
+    }
+    for (; i < len; ++i) {
+        dst[i] = src[i] ^ mask[i % 4];
+    }
+}
+
+#ifdef CHAT_HTTP_X86
+__attribute__((target("sse2")))
+static void WSMaskSSE2(char* dst, const char* src, size_t len, const char* mask) {
+    int32_t m32;
+    memcpy(&m32, mask, 4);
+    const __m128i m = _mm_set1_epi32(m32);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*)(src + i + 48));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(a, m));
+        _mm_storeu_si128((__m128i*)(dst + i + 16), _mm_xor_si128(b, m));
+        _mm_storeu_si128((__m128i*)(dst + i + 32), _mm_xor_si128(c, m));
+        _mm_storeu_si128((__m128i*)(dst + i + 48), _mm_xor_si128(d, m));
+    }
+    for (; i + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(a, m));
+    }
+    WSMaskScalar(dst + i, src + i, len - i, mask);
+}
+
+__attribute__((target("avx2")))
+static void WSMaskAVX2(char* dst, const char* src, size_t len, const char* mask) {
+    int32_t m32;
+    memcpy(&m32, mask, 4);
+    const __m256i m = _mm256_set1_epi32(m32);
+    size_t i = 0;
+    for (; i + 128 <= len; i += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + i + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i*)(src + i + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(src + i + 96));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(a, m));
+        _mm256_storeu_si256((__m256i*)(dst + i + 32), _mm256_xor_si256(b, m));
+        _mm256_storeu_si256((__m256i*)(dst + i + 64), _mm256_xor_si256(c, m));
+        _mm256_storeu_si256((__m256i*)(dst + i + 96), _mm256_xor_si256(d, m));
+    }
+    for (; i + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(a, m));
+    }
+    //尾部在本函数内用VEX编码的128位指令处理, 不调用SSE2版本, 避免AVX/SSE切换的开销
+    if (i + 16 <= len) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(a, _mm256_castsi256_si128(m)));
+        i += 16;
+    }
+    _mm256_zeroupper();
+    WSMaskScalar(dst + i, src + i, len - i, mask);
+}
+#endif
+
+typedef const char* (*FindHttpStopFunc)(const char*, const char*, bool);
+
+struct HttpSimdDispatch {
+    FindHttpStopFunc find = FindHttpStopScalar;
+    const char* level = "scalar";
+    WSMaskFunc mask = WSMaskScalar;
+    const char* maskLevel = "scalar";
+
+    HttpSimdDispatch() {
+#ifdef CHAT_HTTP_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            find = FindHttpStopAVX2;
+            level = "avx2";
+        } else if (__builtin_cpu_supports("sse4.2")) {
+            find = FindHttpStopSSE42;
+            level = "sse4.2";
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            mask = WSMaskAVX2;
+            maskLevel = "avx2";
+        } else if (__builtin_cpu_supports("sse2")) {
+            mask = WSMaskSSE2;
+            maskLevel = "sse2";
+        }
+#endif
+    }
+};
+
+static const HttpSimdDispatch& GetDispatch() {
+    static const HttpSimdDispatch s_dispatch;
+    return s_dispatch;
+}
+
+const char* FindHttpStop(const char* p, const char* end, bool stop_space) {
+    return GetDispatch().find(p, end, stop_space);
+}
+
+const char* GetHttpSimdLevel() {
+    return GetDispatch().level;
+}
+
+void WSMask(char* dst, const char* src, size_t len, const char* mask) {
+    GetDispatch().mask(dst, src, len, mask);
+}
+
+WSMaskFunc GetWSMaskFunc(const char* level) {
+    if (!strcmp(level, "scalar")) {
+        return WSMaskScalar;
+    }
+#ifdef CHAT_HTTP_X86
+    __builtin_cpu_init();
+    if (!strcmp(level, "sse2") && __builtin_cpu_supports("sse2")) {
+        return WSMaskSSE2;
+    }
+    if (!strcmp(level, "avx2") && __builtin_cpu_supports("avx2")) {
+        return WSMaskAVX2;
+    }
+#endif
+    return nullptr;
+}
+
+const char* GetWSMaskLevel() {
+    return GetDispatch().maskLevel;
+}
+
+}
+}
@@ -0,0 +1,33 @@
+#ifndef __CHAT_HTTP_SIMD_H__
+#define __CHAT_HTTP_SIMD_H__
+
+#include <stddef.h>
+
+namespace chat {
+namespace http {
+
+//HTTP报文扫描的向量化原语, 启动时按CPU选择AVX2/SSE4.2/标量实现
+//编译不依赖-mavx2, 各实现用target属性单独编译
+
+//返回[p, end)中第一个非法字符的位置: 除HT外的控制字符与DEL,
+//stop_space时空格也算(用于URI); CR/LF也属于控制字符, 所以行尾会在这里停下
+//全部合法时返回end
+const char* FindHttpStop(const char* p, const char* end, bool stop_space);
+
+//当前使用的实现: "avx2", "sse4.2", "scalar"
+const char* GetHttpSimdLevel();
+
+//WebSocket掩码: dst[i] = src[i] ^ mask[i % 4], dst可以等于src(原地处理)
+//启动时按CPU选择AVX2/SSE2/64位标量实现
+void WSMask(char* dst, const char* src, size_t len, const char* mask);
+
+typedef void (*WSMaskFunc)(char* dst, const char* src, size_t len, const char* mask);
+//按名字取实现("avx2", "sse2", "scalar"), 名字未知或CPU不支持返回nullptr, 用于测试和压测对比
+WSMaskFunc GetWSMaskFunc(const char* level);
+//当前使用的掩码实现
+const char* GetWSMaskLevel();
+
+}
+}
+
+#endif
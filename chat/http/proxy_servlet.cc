@@ -0,0 +1,698 @@
+#include "proxy_servlet.h"
+#include "http_session.h"
+#include "async_http_client.h"
+#include "chat/config.h"
+#include "chat/log.h"
+#include "chat/iomanager.h"
+#include "chat/worker.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+
+namespace chat {
+namespace http {
+
+static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
+
+static chat::ConfigVar<uint64_t>::ptr g_proxy_timeout =
+    chat::Config::Lookup("http.proxy.timeout", (uint64_t)5000, "http proxy upstream read/write timeout in ms");
+static chat::ConfigVar<uint32_t>::ptr g_proxy_pool_size =
+    chat::Config::Lookup("http.proxy.pool_size", (uint32_t)128, "http proxy connections per upstream");
+static chat::ConfigVar<uint32_t>::ptr g_proxy_max_alive_time =
+    chat::Config::Lookup("http.proxy.max_alive_time", (uint32_t)(120 * 1000), "http proxy upstream connection max alive time in ms");
+static chat::ConfigVar<uint32_t>::ptr g_proxy_max_request =
+    chat::Config::Lookup("http.proxy.max_request", (uint32_t)10000, "http proxy requests per upstream connection");
+static chat::ConfigVar<bool>::ptr g_proxy_splice =
+    chat::Config::Lookup("http.proxy.splice", true, "http proxy forwards plain tcp bodies with splice");
+static chat::ConfigVar<uint32_t>::ptr g_proxy_pipe_size =
+    chat::Config::Lookup("http.proxy.pipe_size", (uint32_t)(256 * 1024), "http proxy splice pipe size");
+
+static const size_t s_copy_size = 64 * 1024;
+static const size_t s_pipe_cache = 16;
+
+//等待fd可读/可写, 超时或被取消返回false
+static bool WaitEvent(int fd, IOManager::Event event, uint64_t timeout_ms) {
+    IOManager* iom = IOManager::GetThis();
+    if (!iom) {
+        return false;
+    }
+    std::shared_ptr<int> cancelled = std::make_shared<int>(0);
+    std::weak_ptr<int> winfo(cancelled);
+    Timer::ptr timer;
+    if (timeout_ms != (uint64_t)-1) {
+        timer = iom->addConditionTimer(timeout_ms, [winfo, fd, iom, event]() {
+            auto t = winfo.lock();
+            if (!t || *t) {
+                return;
+            }
+            *t = ETIMEDOUT;
+            iom->cancelEvent(fd, event);
+        }, winfo);
+    }
+    if (iom->addEvent(fd, event)) {
+        if (timer) {
+            timer->cancel();
+        }
+        return false;
+    }
+    Fiber::YieldToHold();
+    if (timer) {
+        timer->cancel();
+    }
+    if (*cancelled) {
+        errno = *cancelled;
+        return false;
+    }
+    return true;
+}
+
+//splice用的管道按线程缓存, 只有排空的管道才放回
+static thread_local std::vector<std::pair<int, int> > t_pipes;
+
+static bool AcquirePipe(int fds[2]) {
+    if (!t_pipes.empty()) {
+        fds[0] = t_pipes.back().first;
+        fds[1] = t_pipes.back().second;
+        t_pipes.pop_back();
+        return true;
+    }
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC)) {
+        CHAT_LOG_ERROR(g_logger) << "pipe2 fail errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    fcntl(fds[1], F_SETPIPE_SZ, (int)g_proxy_pipe_size->getValue());
+    return true;
+}
+
+static void ReleasePipe(int fds[2], bool clean) {
+    if (clean && t_pipes.size() < s_pipe_cache) {
+        t_pipes.push_back(std::make_pair(fds[0], fds[1]));
+        return;
+    }
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+//经管道把from上的len字节搬到to, 数据不进入用户态
+//返回搬运的字节数, 对端提前关闭时小于len, 出错返回-1
+static int64_t Splice(int from, int to, uint64_t len, uint64_t recv_timeout, uint64_t send_timeout) {
+    int fds[2];
+    if (!AcquirePipe(fds)) {
+        return -1;
+    }
+    size_t pipe_size = g_proxy_pipe_size->getValue();
+    uint64_t moved = 0;
+    size_t inpipe = 0;
+    bool ok = true;
+    while (ok && moved < len) {
+        ssize_t n = splice(from, nullptr, fds[1], nullptr, std::min(len - moved, (uint64_t)pipe_size)
+                           , SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR || (errno == EAGAIN && WaitEvent(from, IOManager::READ, recv_timeout))) {
+                continue;
+            }
+            ok = false;
+            break;
+        }
+        inpipe = n;
+        moved += n;
+        while (inpipe > 0) {
+            n = splice(fds[0], nullptr, to, nullptr, inpipe, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                inpipe -= n;
+            } else if (n < 0 && (errno == EINTR
+                        || (errno == EAGAIN && WaitEvent(to, IOManager::WRITE, send_timeout)))) {
+                continue;
+            } else {
+                ok = false;
+                break;
+            }
+        }
+    }
+    ReleasePipe(fds, ok && inpipe == 0);
+    return ok ? (int64_t)moved : -1;
+}
+
+static bool IsPlainSocket(Socket::ptr sock) {
+    return sock && !std::dynamic_pointer_cast<SSLSocket>(sock);
+}
+
+static bool IsHopHeader(std::string_view name, const std::vector<std::string>& extra) {
+    static const std::vector<std::string> s_hops = {"Connection", "Keep-Alive", "Proxy-Connection"
+        , "Proxy-Authenticate", "Proxy-Authorization", "TE", "Trailer", "Transfer-Encoding", "Upgrade"};
+    for (auto* v : {&s_hops, &extra}) {
+        for (auto& i : *v) {
+            if (i.size() == name.size() && strncasecmp(i.c_str(), name.data(), name.size()) == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//Connection头部列出的字段同样是逐跳的
+static std::vector<std::string> ConnectionTokens(const HttpHeaders& headers) {
+    std::vector<std::string> rt;
+    auto it = headers.find(HttpHeaderId::CONNECTION);
+    if (it != headers.end()) {
+        for (auto& i : split(std::string(it->second), ',')) {
+            std::string v = StringUtil::Trim(i);
+            if (!v.empty()) {
+                rt.push_back(v);
+            }
+        }
+    }
+    return rt;
+}
+
+static bool HeaderContains(const HttpHeaders& headers, HttpHeaderId id, const char* token) {
+    auto it = headers.find(id);
+    return it != headers.end() && strcasestr(std::string(it->second).c_str(), token);
+}
+
+//上游响应体读取: 先消费随响应头读到的数据, 再从连接读
+class UpstreamReader {
+public:
+    UpstreamReader(HttpConnection::ptr conn, std::string&& prefix)
+        :m_conn(conn)
+        ,m_buf(std::move(prefix)) {
+    }
+
+    int read(void* buffer, size_t length) {
+        if (m_pos < m_buf.size()) {
+            size_t n = std::min(length, m_buf.size() - m_pos);
+            memcpy(buffer, &m_buf[m_pos], n);
+            m_pos += n;
+            return n;
+        }
+        return m_conn->read(buffer, length);
+    }
+
+    int readFix(void* buffer, size_t length) {
+        size_t offset = 0;
+        while (offset < length) {
+            int rt = read((char*)buffer + offset, length - offset);
+            if (rt <= 0) {
+                return rt;
+            }
+            offset += rt;
+        }
+        return length;
+    }
+
+    bool readLine(std::string& line) {
+        while (true) {
+            size_t pos = m_buf.find('\n', m_pos);
+            if (pos != std::string::npos) {
+                size_t end = pos > m_pos && m_buf[pos - 1] == '\r' ? pos - 1 : pos;
+                line.assign(m_buf, m_pos, end - m_pos);
+                m_pos = pos + 1;
+                return true;
+            }
+            if (m_buf.size() - m_pos > 4096) {
+                return false;
+            }
+            m_buf.erase(0, m_pos);
+            m_pos = 0;
+            //协程栈较小, 直接读进缓冲尾部
+            size_t size = m_buf.size();
+            m_buf.resize(size + 4096);
+            int rt = m_conn->read(&m_buf[size], 4096);
+            m_buf.resize(size + std::max(rt, 0));
+            if (rt <= 0) {
+                return false;
+            }
+        }
+    }
+
+    size_t buffered() const { return m_buf.size() - m_pos;}
+private:
+    HttpConnection::ptr m_conn;
+    std::string m_buf;
+    size_t m_pos = 0;
+};
+
+ProxyServlet::ProxyServlet(const std::vector<std::string>& upstreams)
+    :Servlet("ProxyServlet")
+    ,m_upstreams(upstreams)
+    ,m_timeout(g_proxy_timeout->getValue())
+    ,m_splice(g_proxy_splice->getValue()) {
+}
+
+ProxyServlet::ProxyServlet(SDLoadBalance::ptr lb, const std::string& domain, const std::string& service)
+    :Servlet("ProxyServlet")
+    ,m_lb(lb)
+    ,m_domain(domain)
+    ,m_service(service)
+    ,m_timeout(g_proxy_timeout->getValue())
+    ,m_splice(g_proxy_splice->getValue()) {
+    if (m_lb && !m_lb->getCb()) {
+        m_lb->setCb(CreateUpstreamStream);
+    }
+}
+
+SocketStream::ptr ProxyServlet::CreateUpstreamStream(const std::string& domain
+                    , const std::string& service, ServiceItemInfo::ptr info) {
+    IPAddress::ptr addr = Address::LookupAnyIPAddress(info->getIp());
+    if (!addr) {
+        CHAT_LOG_ERROR(g_logger) << "invalid service info: " << info->toString();
+        return nullptr;
+    }
+    addr->setPort(info->getPort());
+    AsyncHttpConnection::ptr conn = std::make_shared<AsyncHttpConnection>();
+    WorkerMgr::GetInstance()->schedule("service_io", [conn, addr]() {
+        conn->connect(addr);
+        conn->start();
+    });
+    return conn;
+}
+
+ProxyServlet::Stats ProxyServlet::getStats() const {
+    Stats st;
+    st.requests = m_requests;
+    st.errors = m_errors;
+    st.splicedBytes = m_splicedBytes;
+    st.copiedBytes = m_copiedBytes;
+    return st;
+}
+
+HttpConnectionPool::ptr ProxyServlet::getPool(const std::string& uri) {
+    {
+        RWMutexType::ReadLock lock(m_mutex);
+        auto it = m_pools.find(uri);
+        if (it != m_pools.end()) {
+            return it->second;
+        }
+    }
+    RWMutexType::WriteLock lock(m_mutex);
+    auto& pool = m_pools[uri];
+    if (!pool) {
+        pool = HttpConnectionPool::Create(uri, "", g_proxy_pool_size->getValue()
+                , g_proxy_max_alive_time->getValue(), g_proxy_max_request->getValue());
+    }
+    return pool;
+}
+
+HttpConnectionPool::ptr ProxyServlet::choose(uint32_t idx) {
+    if (m_lb) {
+        auto lb = m_lb->get(m_domain, m_service);
+        auto item = lb ? lb->get(idx) : nullptr;
+        auto stream = item ? item->getStream() : nullptr;
+        auto addr = stream ? stream->getRemoteAddress() : nullptr;
+        if (!addr) {
+            return nullptr;
+        }
+        return getPool("http://" + addr->toString());
+    }
+    if (m_upstreams.empty()) {
+        return nullptr;
+    }
+    return getPool(m_upstreams[idx % m_upstreams.size()]);
+}
+
+std::string ProxyServlet::buildHead(HttpRequest::ptr request, SocketStream::ptr session
+                          , HttpConnectionPool::ptr pool, bool& chunked, int64_t& length) {
+    auto& headers = request->getHeaders();
+    std::string head = HttpMethodToString(request->getMethod());
+    head.append(" ");
+    head.append(request->getPath().empty() ? "/" : request->getPath());
+    if (!request->getQuery().empty()) {
+        head.append("?");
+        head.append(request->getQuery());
+    }
+    head.append(" HTTP/1.1\r\n");
+
+    std::vector<std::string> tokens = ConnectionTokens(headers);
+    std::string host;
+    std::string xff;
+    bool has_real_ip = false;
+    for (auto& i : headers) {
+        if (IsHopHeader(i.first, tokens)) {
+            continue;
+        }
+        switch (i.id) {
+            case HttpHeaderId::HOST:
+                host = std::string(i.second);
+                continue;
+            case HttpHeaderId::X_FORWARDED_FOR:
+                xff = std::string(i.second);
+                continue;
+            case HttpHeaderId::CONTENT_LENGTH:
+            case HttpHeaderId::EXPECT:
+                continue;
+            case HttpHeaderId::X_REAL_IP:
+                has_real_ip = true;
+                break;
+            default:
+                break;
+        }
+        head.append(i.first);
+        head.append(": ");
+        head.append(i.second);
+        head.append("\r\n");
+    }
+    if (!m_preserveHost || host.empty()) {
+        host = pool->getHost();
+        if (pool->getPort() != (pool->isHttps() ? 443u : 80u)) {
+            host += ":" + std::to_string(pool->getPort());
+        }
+    }
+    head.append("Host: " + host + "\r\n");
+
+    Socket::ptr sock = session ? session->getSocket() : nullptr;
+    Address::ptr remote = sock ? sock->getRemoteAddress() : nullptr;
+    if (remote) {
+        std::string ip = remote->toString();
+        size_t pos = ip.rfind(':');
+        if (pos != std::string::npos) {
+            ip.resize(pos);
+        }
+        head.append("X-Forwarded-For: " + (xff.empty() ? ip : xff + ", " + ip) + "\r\n");
+        if (!has_real_ip) {
+            head.append("X-Real-IP: " + ip + "\r\n");
+        }
+    }
+    head.append(IsPlainSocket(sock) ? "X-Forwarded-Proto: http\r\n" : "X-Forwarded-Proto: https\r\n");
+
+    chunked = false;
+    length = 0;
+    if (request->getBodyStream()) {
+        if (HeaderContains(headers, HttpHeaderId::TRANSFER_ENCODING, "chunked")) {
+            chunked = true;
+        } else {
+            length = request->getHeaderAs<int64_t>("Content-Length", 0);
+        }
+    } else {
+        length = request->getBody().size();
+    }
+    if (chunked) {
+        head.append("Transfer-Encoding: chunked\r\n");
+    } else if (length > 0 || request->getMethod() == HttpMethod::POST
+            || request->getMethod() == HttpMethod::PUT) {
+        head.append("Content-Length: " + std::to_string(length) + "\r\n");
+    }
+    head.append("Connection: keep-alive\r\n\r\n");
+    return head;
+}
+
+bool ProxyServlet::sendBody(HttpRequest::ptr request, SocketStream::ptr session
+                  , HttpConnection::ptr conn, bool chunked) {
+    Stream::ptr stream = request->getBodyStream();
+    if (!stream) {
+        const std::string& body = request->getBody();
+        if (!body.empty() && conn->writeFixSize(body.c_str(), body.size()) <= 0) {
+            return false;
+        }
+        m_copiedBytes += body.size();
+        return true;
+    }
+    auto body = std::dynamic_pointer_cast<HttpBodyStream>(stream);
+    Socket::ptr client = session ? session->getSocket() : nullptr;
+    Socket::ptr upstream = conn->getSocket();
+    bool splice_ok = m_splice && body && !chunked && IsPlainSocket(client) && IsPlainSocket(upstream);
+
+    std::unique_ptr<char[]> buf(new char[s_copy_size]);
+    while (!body || !body->isFinished()) {
+        uint64_t raw = splice_ok ? body->getRawLeft() : 0;
+        if (raw > 0) {
+            int64_t n = Splice(client->getSocket(), upstream->getSocket(), raw
+                               , client->getRecvTimeout(), m_timeout);
+            if (n < 0) {
+                return false;
+            }
+            body->consumeRaw(n);
+            m_splicedBytes += n;
+            if ((uint64_t)n < raw) {
+                return false;
+            }
+            continue;
+        }
+        int rt = stream->read(buf.get(), s_copy_size);
+        if (rt < 0) {
+            return false;
+        }
+        if (rt == 0) {
+            break;
+        }
+        if (chunked) {
+            char hex[32];
+            int len = snprintf(hex, sizeof(hex), "%x\r\n", rt);
+            if (conn->writeFixSize(hex, len) <= 0
+                    || conn->writeFixSize(buf.get(), rt) <= 0
+                    || conn->writeFixSize("\r\n", 2) <= 0) {
+                return false;
+            }
+        } else if (conn->writeFixSize(buf.get(), rt) <= 0) {
+            return false;
+        }
+        m_copiedBytes += rt;
+    }
+    if (chunked && conn->writeFixSize("0\r\n\r\n", 5) <= 0) {
+        return false;
+    }
+    return true;
+}
+
+//RFC 9110 9.2.2
+static bool IsIdempotent(HttpMethod method) {
+    switch (method) {
+        case HttpMethod::GET:
+        case HttpMethod::HEAD:
+        case HttpMethod::OPTIONS:
+        case HttpMethod::TRACE:
+        case HttpMethod::PUT:
+        case HttpMethod::DELETE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+int32_t ProxyServlet::handle(chat::http::HttpRequest::ptr request
+                   , chat::http::HttpResponse::ptr response
+                   , chat::SocketStream::ptr session) {
+    ++m_requests;
+    bool chunked = false;
+    int64_t length = 0;
+    bool has_body = false;
+    HttpConnection::ptr conn;
+    HttpResponse::ptr ursp;
+    std::string prefix;
+    bool timeout = false;
+
+    //请求头发送失败可以换一个上游重试; 读响应失败时只重试没有请求体的幂等请求
+    uint32_t base = m_index++;
+    uint32_t attempts = m_lb ? 2 : std::max((size_t)1, m_upstreams.size());
+    for (uint32_t i = 0; i < attempts; ++i) {
+        HttpConnectionPool::ptr pool = choose(base + i);
+        if (!pool) {
+            break;
+        }
+        uint64_t to = m_timeout;
+        conn = pool->getConnection(to);
+        if (!conn) {
+            continue;
+        }
+        conn->getSocket()->setRecvTimeout(m_timeout);
+        conn->getSocket()->setSendTimeout(m_timeout);
+        std::string head = buildHead(request, session, pool, chunked, length);
+        has_body = chunked || length > 0;
+        if (conn->writeFixSize(head.c_str(), head.size()) <= 0) {
+            conn->close();
+            conn = nullptr;
+            continue;
+        }
+        if (has_body && !sendBody(request, session, conn, chunked)) {
+            conn->close();
+            conn = nullptr;
+            break;
+        }
+        prefix.clear();
+        //上游关闭时read返回0不设置errno, 不能残留等待时的EAGAIN
+        errno = 0;
+        ursp = conn->recvResponseHeader(prefix);
+        //丢弃100 Continue/103 Early Hints等中间响应, 继续读最终响应
+        while (ursp && (int)ursp->getStatus() < 200
+                && ursp->getStatus() != HttpStatus::SWITCHING_PROTOCOLS) {
+            ursp = conn->recvResponseHeader(prefix);
+        }
+        if (ursp) {
+            break;
+        }
+        timeout = errno == ETIMEDOUT;
+        conn->close();
+        conn = nullptr;
+        //请求可能已经被上游执行, 只重放没有请求体的幂等请求
+        if (has_body || !IsIdempotent(request->getMethod())) {
+            break;
+        }
+    }
+    if (!ursp) {
+        ++m_errors;
+        response->setStatus(timeout ? HttpStatus::GATEWAY_TIMEOUT : HttpStatus::BAD_GATEWAY);
+        response->setBody(std::string());
+        //没有实体也要带长度, 否则keep-alive的客户端无法判断响应结束
+        response->setHeader("Content-Length", "0");
+        CHAT_LOG_WARN(g_logger) << "proxy " << request->getPath() << " fail, timeout=" << timeout;
+        return 0;
+    }
+
+    response->setStatus(ursp->getStatus());
+    response->setReason(ursp->getReason());
+    response->setBody(std::string());
+    auto& uheaders = ursp->getHeaders();
+    std::vector<std::string> tokens = ConnectionTokens(uheaders);
+    auto& headers = response->getHeaders();
+    headers.clear();
+    for (auto& i : uheaders) {
+        if (!IsHopHeader(i.first, tokens)) {
+            headers.add(i.first, i.second);
+        }
+    }
+
+    int status = (int)ursp->getStatus();
+    bool upstream_close = ursp->isClose();
+    if (request->getMethod() == HttpMethod::HEAD || status < 200 || status == 204 || status == 304) {
+        //101之后连接已切换协议, 不能再放回连接池
+        if (upstream_close || status < 200) {
+            conn->close();
+        }
+        return 0;
+    }
+
+    Socket::ptr client = session ? session->getSocket() : nullptr;
+    bool splice_ok = m_splice && IsPlainSocket(client) && IsPlainSocket(conn->getSocket());
+    uint64_t timeout_ms = m_timeout;
+    ProxyServlet* self = this;
+
+    if (HeaderContains(uheaders, HttpHeaderId::TRANSFER_ENCODING, "chunked")) {
+        //上游chunked: 解码后交给响应的writer, 由它按客户端版本重新编码
+        headers.erase("Content-Length");
+        auto reader = std::make_shared<UpstreamReader>(conn, std::move(prefix));
+        response->setStreamBody([self, conn, reader, upstream_close](Stream::ptr out) -> int32_t {
+            std::unique_ptr<char[]> buf(new char[s_copy_size]);
+            std::string line;
+            while (true) {
+                if (!reader->readLine(line)) {
+                    conn->close();
+                    return -1;
+                }
+                char* end = nullptr;
+                uint64_t size = strtoull(line.c_str(), &end, 16);
+                if (end == line.c_str()) {
+                    conn->close();
+                    return -1;
+                }
+                if (size == 0) {
+                    break;
+                }
+                //按上游的块凑满后再写, 不把一次read的碎片变成很小的块
+                while (size > 0) {
+                    size_t len = std::min(size, (uint64_t)s_copy_size);
+                    if (reader->readFix(buf.get(), len) <= 0 || out->writeFixSize(buf.get(), len) <= 0) {
+                        conn->close();
+                        return -1;
+                    }
+                    size -= len;
+                    self->m_copiedBytes += len;
+                }
+                if (!reader->readLine(line) || !line.empty()) {
+                    conn->close();
+                    return -1;
+                }
+            }
+            //丢弃trailer
+            do {
+                if (!reader->readLine(line)) {
+                    conn->close();
+                    return -1;
+                }
+            } while (!line.empty());
+            if (upstream_close || reader->buffered() > 0) {
+                conn->close();
+            }
+            return 0;
+        });
+        return 0;
+    }
+
+    auto it = uheaders.find(HttpHeaderId::CONTENT_LENGTH);
+    if (it == uheaders.end()) {
+        //没有长度: 读到上游关闭为止
+        auto reader = std::make_shared<UpstreamReader>(conn, std::move(prefix));
+        response->setStreamBody([self, conn, reader](Stream::ptr out) -> int32_t {
+            std::unique_ptr<char[]> buf(new char[s_copy_size]);
+            int rt = 0;
+            while ((rt = reader->read(buf.get(), s_copy_size)) > 0) {
+                if (out->writeFixSize(buf.get(), rt) <= 0) {
+                    break;
+                }
+                self->m_copiedBytes += rt;
+            }
+            conn->close();
+            return rt < 0 ? -1 : 0;
+        });
+        return 0;
+    }
+
+    uint64_t length_left = strtoull(std::string(it->second).c_str(), nullptr, 10);
+    if (prefix.size() > length_left) {
+        //多出的数据不属于这个响应, 连接不可复用
+        prefix.resize(length_left);
+        upstream_close = true;
+    }
+    if (length_left == 0) {
+        if (upstream_close) {
+            conn->close();
+        }
+        return 0;
+    }
+    auto data = std::make_shared<std::string>(std::move(prefix));
+    response->setStreamBody([self, conn, data, length_left, splice_ok, client
+                            , timeout_ms, upstream_close](Stream::ptr out) -> int32_t {
+        uint64_t left = length_left;
+        if (!data->empty()) {
+            if (out->writeFixSize(data->c_str(), data->size()) <= 0) {
+                conn->close();
+                return -1;
+            }
+            left -= data->size();
+            self->m_copiedBytes += data->size();
+        }
+        if (left > 0 && splice_ok) {
+            int64_t n = Splice(conn->getSocket()->getSocket(), client->getSocket(), left
+                               , timeout_ms, client->getSendTimeout());
+            if (n < 0 || (uint64_t)n != left) {
+                conn->close();
+                return -1;
+            }
+            self->m_splicedBytes += n;
+            left = 0;
+        }
+        std::unique_ptr<char[]> buf;
+        while (left > 0) {
+            if (!buf) {
+                buf.reset(new char[s_copy_size]);
+            }
+            int rt = conn->read(buf.get(), std::min(left, (uint64_t)s_copy_size));
+            if (rt <= 0 || out->writeFixSize(buf.get(), rt) <= 0) {
+                conn->close();
+                return -1;
+            }
+            left -= rt;
+            self->m_copiedBytes += rt;
+        }
+        if (upstream_close) {
+            conn->close();
+        }
+        return 0;
+    });
+    return 0;
+}
+
+}
+}
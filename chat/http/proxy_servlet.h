@@ -0,0 +1,88 @@
+#ifndef __CHAT_HTTP_PROXY_SERVLET_H__
+#define __CHAT_HTTP_PROXY_SERVLET_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+#include "servlet.h"
+#include "http_connection.h"
+#include "chat/mutex.h"
+#include "chat/streams/load_balance.h"
+
+namespace chat {
+namespace http {
+
+//反向代理Servlet: 把请求转发给上游, 上游连接来自按地址缓存的HttpConnectionPool
+//上游可以是固定的地址列表(轮询, 连接失败时换下一个), 也可以经SDLoadBalance按domain/service选择
+//请求体和响应体都边收边转发, 不整体缓存; Content-Length的部分在两端都是明文TCP时
+//用splice经管道在socket之间搬运, 不拷贝到用户态
+//逐跳头部(Connection/Keep-Alive/Transfer-Encoding/Upgrade/Proxy-*等)不转发, 追加X-Forwarded-For/X-Real-IP
+class ProxyServlet : public Servlet {
+public:
+    typedef std::shared_ptr<ProxyServlet> ptr;
+    typedef RWMutex RWMutexType;
+
+    struct Stats {
+        uint64_t requests = 0;
+        uint64_t errors = 0;            //返回502/504的请求数
+        uint64_t splicedBytes = 0;      //splice搬运的字节数(两个方向)
+        uint64_t copiedBytes = 0;       //经用户态缓冲转发的字节数(两个方向)
+    };
+
+    //upstreams: 上游地址, 如 "http://127.0.0.1:8080"
+    ProxyServlet(const std::vector<std::string>& upstreams);
+    //经服务发现选择上游; lb未设置stream_callback时设置为CreateUpstreamStream
+    ProxyServlet(SDLoadBalance::ptr lb, const std::string& domain, const std::string& service);
+
+    virtual int32_t handle(chat::http::HttpRequest::ptr request
+                   , chat::http::HttpResponse::ptr response
+                   , chat::SocketStream::ptr session) override;
+
+    //上游读写超时(ms)
+    void setTimeout(uint64_t v) { m_timeout = v;}
+    uint64_t getTimeout() const { return m_timeout;}
+    //是否允许splice, 关闭时总是经用户态缓冲转发
+    void setSplice(bool v) { m_splice = v;}
+    bool isSplice() const { return m_splice;}
+    //为true时转发客户端的Host, 否则使用上游地址
+    void setPreserveHost(bool v) { m_preserveHost = v;}
+
+    Stats getStats() const;
+
+    //SDLoadBalance的stream_callback: 为每个服务实例维持一条自动重连的连接, 用于判断实例是否可用
+    static SocketStream::ptr CreateUpstreamStream(const std::string& domain
+                    , const std::string& service, ServiceItemInfo::ptr info);
+private:
+    //选择上游, 依次返回不同的连接池, 没有可用上游返回nullptr
+    HttpConnectionPool::ptr choose(uint32_t attempt);
+    HttpConnectionPool::ptr getPool(const std::string& uri);
+    std::string buildHead(HttpRequest::ptr request, SocketStream::ptr session
+                          , HttpConnectionPool::ptr pool, bool& chunked, int64_t& length);
+    bool sendBody(HttpRequest::ptr request, SocketStream::ptr session
+                  , HttpConnection::ptr conn, bool chunked);
+private:
+    std::vector<std::string> m_upstreams;
+    std::atomic<uint32_t> m_index = {0};
+    SDLoadBalance::ptr m_lb;
+    std::string m_domain;
+    std::string m_service;
+
+    RWMutexType m_mutex;
+    std::unordered_map<std::string, HttpConnectionPool::ptr> m_pools;
+
+    uint64_t m_timeout;
+    bool m_splice;
+    bool m_preserveHost = true;
+
+    std::atomic<uint64_t> m_requests = {0};
+    std::atomic<uint64_t> m_errors = {0};
+    std::atomic<uint64_t> m_splicedBytes = {0};
+    std::atomic<uint64_t> m_copiedBytes = {0};
+};
+
+}
+}
+
+#endif
@@ -24,11 +24,21 @@ ServletDispatch::ServletDispatch()
 int32_t ServletDispatch::handle(chat::http::HttpRequest::ptr request
                , chat::http::HttpResponse::ptr response
                , chat::SocketStream::ptr session) {
-    auto slt = getMatchedServlet(request->getPath());
+    bool method_not_allowed = false;
+    std::string allow;
+    auto slt = getMatchedServlet(request, &method_not_allowed, &allow);
     if (slt) {
         return slt->handle(request, response, session);
     }
-    return 0;
+    if (method_not_allowed) {
+        response->setStatus(chat::http::HttpStatus::METHOD_NOT_ALLOWED);
+        response->setHeader("Server", "chat/1.0.0");
+        response->setHeader("Allow", allow);
+        response->setHeader("Content-Length", "0");
+        response->setBody("");
+        return 0;
+    }
+    return m_default ? m_default->handle(request, response, session) : 0;
 }
 
 void ServletDispatch::addServlet(const std::string& uri, Servlet::ptr slt) {
@@ -41,16 +51,78 @@ void ServletDispatch::addServletCreator(const std::string& uri, IServletCreator:
     m_datas[uri] = creator;
 }
 
-void ServletDispatch::addGlobServletCreator(const std::string& uri, IServletCreator::ptr creator) {
-    RWMutexType::WriteLock lock(m_mutex);
-    for(auto it = m_globs.begin();
-            it != m_globs.end(); ++it) {
-        if(it->first == uri) {
+//glob中第一个通配符之前的字面前缀, 能匹配的路径都以它开头
+static std::string GlobLiteralPrefix(const std::string& glob) {
+    return glob.substr(0, glob.find_first_of("*?[\\"));
+}
+
+static bool IsPrefixOf(const std::string& prefix, const std::string& str) {
+    return str.compare(0, prefix.size(), prefix) == 0;
+}
+
+void ServletDispatch::addGlob(const std::string& uri, IServletCreator::ptr creator) {
+    unplaceGlobs();
+    for (auto it = m_globs.begin(); it != m_globs.end(); ++it) {
+        if (it->first == uri) {
             m_globs.erase(it);
             break;
         }
     }
     m_globs.push_back(std::make_pair(uri, creator));
+    placeGlobs();
+}
+
+void ServletDispatch::unplaceGlobs() {
+    for (auto& i : m_globs) {
+        if (isTreePlaced(i.first)) {
+            m_router.del(HttpMethod::INVALID_METHOD, i.first);
+        }
+    }
+    m_fnmatchGlobs.clear();
+}
+
+bool ServletDispatch::isTreePlaced(const std::string& uri) const {
+    if (!ServletRouter::IsTreeGlob(uri)) {
+        return false;
+    }
+    for (auto& i : m_fnmatchGlobs) {
+        if (i.first == uri) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//路由树按具体程度而不是添加顺序匹配, glob前面有可能与它重叠、按顺序应当先匹配的glob时,
+//放进fnmatch列表; 因此路由树里的glob与所有先添加的glob都不重叠, 先查路由树不会改变匹配结果
+void ServletDispatch::placeGlobs() {
+    std::vector<bool> in_tree(m_globs.size(), false);
+    for (size_t i = 0; i < m_globs.size(); ++i) {
+        const std::string& uri = m_globs[i].first;
+        bool tree = ServletRouter::IsTreeGlob(uri);
+        std::string p = GlobLiteralPrefix(uri);
+        for (size_t j = 0; j < i && tree; ++j) {
+            const std::string& e = m_globs[j].first;
+            std::string q = GlobLiteralPrefix(e);
+            if (in_tree[j]) {
+                //更具体的在路由树里本来就先匹配, 只有更宽的通配glob会被树的顺序越过
+                tree = !(e.back() == '*' && IsPrefixOf(q, p));
+            } else {
+                tree = !IsPrefixOf(q, p) && !IsPrefixOf(p, q);
+            }
+        }
+        in_tree[i] = tree;
+        if (tree) {
+            m_router.add(HttpMethod::INVALID_METHOD, uri, m_globs[i].second);
+        } else {
+            m_fnmatchGlobs.push_back(m_globs[i]);
+        }
+    }
+}
+
+void ServletDispatch::addGlobServletCreator(const std::string& uri, IServletCreator::ptr creator) {
+    RWMutexType::WriteLock lock(m_mutex);
+    addGlob(uri, creator);
 }
 
 void ServletDispatch::addServlet(const std::string& uri, FunctionServlet::callback cb) {
@@ -60,19 +132,27 @@ void ServletDispatch::addServlet(const std::string& uri, FunctionServlet::callba
 
 void ServletDispatch::addGlobServlet(const std::string& uri, Servlet::ptr slt) {
     RWMutexType::WriteLock lock(m_mutex);
-    for(auto it = m_globs.begin(); it != m_globs.end(); ++it) {
-        if (it->first == uri) {
-            m_globs.erase(it);
-            break;
-        }
-    }
-    m_globs.push_back(std::make_pair(uri, std::make_shared<HoldServletCreator>(slt)));
+    addGlob(uri, std::make_shared<HoldServletCreator>(slt));
 }
 
 void ServletDispatch::addGlobServlet(const std::string& uri, FunctionServlet::callback cb) {
     return addGlobServlet(uri, std::make_shared<FunctionServlet>(cb));
 }
 
+bool ServletDispatch::addRoute(const std::string& pattern, Servlet::ptr slt, HttpMethod method) {
+    return addRouteCreator(pattern, std::make_shared<HoldServletCreator>(slt), method);
+}
+
+bool ServletDispatch::addRoute(const std::string& pattern, FunctionServlet::callback cb, HttpMethod method) {
+    return addRoute(pattern, std::make_shared<FunctionServlet>(cb), method);
+}
+
+bool ServletDispatch::addRouteCreator(const std::string& pattern, IServletCreator::ptr creator
+                                      , HttpMethod method) {
+    RWMutexType::WriteLock lock(m_mutex);
+    return m_router.add(method, pattern, creator);
+}
+
 void ServletDispatch::delServlet(const std::string& uri) {
     RWMutexType::WriteLock lock(m_mutex);
     m_datas.erase(uri);
@@ -80,13 +160,19 @@ void ServletDispatch::delServlet(const std::string& uri) {
 
 void ServletDispatch::delGlobServlet(const std::string& uri) {
     RWMutexType::WriteLock lock(m_mutex);
-    for(auto it = m_globs.begin();
-            it != m_globs.end(); ++it) {
+    unplaceGlobs();
+    for (auto it = m_globs.begin(); it != m_globs.end(); ++it) {
         if (it->first == uri) {
             m_globs.erase(it);
             break;
         }
     }
+    placeGlobs();
+}
+
+void ServletDispatch::delRoute(const std::string& pattern, HttpMethod method) {
+    RWMutexType::WriteLock lock(m_mutex);
+    m_router.del(method, pattern);
 }
 
 Servlet::ptr ServletDispatch::getServlet(const std::string& uri) {
@@ -97,8 +183,7 @@ Servlet::ptr ServletDispatch::getServlet(const std::string& uri) {
 
 Servlet::ptr ServletDispatch::getGlobServlet(const std::string& uri) {
     RWMutexType::ReadLock lock(m_mutex);
-    for(auto it = m_globs.begin();
-            it != m_globs.end(); ++it) {
+    for (auto it = m_globs.begin(); it != m_globs.end(); ++it) {
         if (it->first == uri) {
             return it->second->get();
         }
@@ -106,18 +191,36 @@ Servlet::ptr ServletDispatch::getGlobServlet(const std::string& uri) {
     return nullptr;
 }
 
-Servlet::ptr ServletDispatch::getMatchedServlet(const std::string& uri) {
+Servlet::ptr ServletDispatch::match(HttpMethod method, const std::string& path
+                                    , HttpRequest* request, bool* method_not_allowed, std::string* allow) {
     RWMutexType::ReadLock lock(m_mutex);
-    auto mit = m_datas.find(uri);
+    auto mit = m_datas.find(path);
     if (mit != m_datas.end()) {
         return mit->second->get();
     }
-    for (auto it = m_globs.begin(); it != m_globs.end(); ++it) {
-        if (!fnmatch(it->first.c_str(), uri.c_str(), 0)) {
+    auto creator = m_router.match(method, path, request, method_not_allowed, allow);
+    if (creator) {
+        return creator->get();
+    }
+    for (auto it = m_fnmatchGlobs.begin(); it != m_fnmatchGlobs.end(); ++it) {
+        if (!fnmatch(it->first.c_str(), path.c_str(), 0)) {
+            if (method_not_allowed) {
+                *method_not_allowed = false;
+            }
             return it->second->get();
         }
     }
-    return m_default;
+    return nullptr;
+}
+
+Servlet::ptr ServletDispatch::getMatchedServlet(const std::string& uri) {
+    auto slt = match(HttpMethod::INVALID_METHOD, uri, nullptr, nullptr);
+    return slt ? slt : m_default;
+}
+
+Servlet::ptr ServletDispatch::getMatchedServlet(HttpRequest::ptr request, bool* method_not_allowed
+                                                , std::string* allow) {
+    return match(request->getMethod(), request->getPath(), request.get(), method_not_allowed, allow);
 }
 
 void ServletDispatch::listAllServletCreator(std::map<std::string, IServletCreator::ptr>& infos) {
@@ -134,6 +237,11 @@ void ServletDispatch::listAllGlobServletCreator(std::map<std::string, IServletCr
     }
 }
 
+void ServletDispatch::listAllRouteCreator(std::map<std::string, IServletCreator::ptr>& infos) {
+    RWMutexType::ReadLock lock(m_mutex);
+    m_router.listAll(infos);
+}
+
 NotFoundServlet::NotFoundServlet(const std::string& name)
     :Servlet("NotFoundServlet")
     ,m_name(name) {
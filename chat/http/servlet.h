@@ -8,6 +8,7 @@
 #include <unordered_map>
 #include "http.h"
 #include "http_session.h"
+#include "servlet_router.h"
 #include "chat/thread.h"
 #include "chat/util.h"
 
@@ -107,9 +108,20 @@ public:
     void addServlet(const std::string& uri, FunctionServlet::callback cb);
 
     //添加模糊匹配servlet
+    //按添加顺序先匹配先生效; 只在末尾有一个'*'的模式(如/static/*)且前面没有可能与之重叠的glob时放进路由树,
+    //其余按添加顺序用fnmatch匹配
     void addGlobServlet(const std::string& uri, Servlet::ptr slt);
     void addGlobServlet(const std::string& uri, FunctionServlet::callback cb);
 
+    //添加路由树servlet, 支持:param与末尾*wildcard, 语法见ServletRouter
+    //method为INVALID_METHOD表示任意方法
+    bool addRoute(const std::string& pattern, Servlet::ptr slt
+                  , HttpMethod method = HttpMethod::INVALID_METHOD);
+    bool addRoute(const std::string& pattern, FunctionServlet::callback cb
+                  , HttpMethod method = HttpMethod::INVALID_METHOD);
+    bool addRouteCreator(const std::string& pattern, IServletCreator::ptr creator
+                         , HttpMethod method = HttpMethod::INVALID_METHOD);
+
     void addServletCreator(const std::string& uri, IServletCreator::ptr creator);
     void addGlobServletCreator(const std::string& uri, IServletCreator::ptr creator);
 
@@ -124,6 +136,7 @@ public:
 
     void delServlet(const std::string& uri);
     void delGlobServlet(const std::string& uri);
+    void delRoute(const std::string& pattern, HttpMethod method = HttpMethod::INVALID_METHOD);
 
     Servlet::ptr getDefault() const { return m_default;}
     void setDefault(Servlet::ptr v) { m_default = v;}
@@ -131,17 +144,36 @@ public:
     Servlet::ptr getServlet(const std::string& uri);
     Servlet::ptr getGlobServlet(const std::string& uri);
 
-    //优先精准匹配,其次模糊匹配,最后返回默认
+    //优先精准匹配,其次路由树,再次fnmatch模糊匹配,最后返回默认
+    //只匹配不限方法的路由
     Servlet::ptr getMatchedServlet(const std::string& uri);
+    //按请求方法匹配, 路由参数写入request
+    //路径存在但方法不匹配时返回空, 并置method_not_allowed为true, allow(可为空)写入允许的方法
+    Servlet::ptr getMatchedServlet(HttpRequest::ptr request, bool* method_not_allowed = nullptr
+                                   , std::string* allow = nullptr);
 
     void listAllServletCreator(std::map<std::string, IServletCreator::ptr>& infos);
     void listAllGlobServletCreator(std::map<std::string, IServletCreator::ptr>& infos);
+    //路由树中的路由(含转换进来的glob), 限定方法的以"METHOD pattern"为key
+    void listAllRouteCreator(std::map<std::string, IServletCreator::ptr>& infos);
+private:
+    void addGlob(const std::string& uri, IServletCreator::ptr creator);
+    //m_globs变化前后调用, 重新决定每个glob放进路由树还是fnmatch列表
+    void unplaceGlobs();
+    void placeGlobs();
+    bool isTreePlaced(const std::string& uri) const;
+    Servlet::ptr match(HttpMethod method, const std::string& path
+                       , HttpRequest* request, bool* method_not_allowed, std::string* allow = nullptr);
 private:
     RWMutexType m_mutex;
     //精准匹配servlet MAP
     std::unordered_map<std::string, IServletCreator::ptr> m_datas;
     //模糊匹配servlet 数组
     std::vector<std::pair<std::string, IServletCreator::ptr> > m_globs;
+    //m_globs中路由树无法表达或会被先添加的glob重叠的部分, 按顺序fnmatch
+    std::vector<std::pair<std::string, IServletCreator::ptr> > m_fnmatchGlobs;
+    //路由树: addRoute的路由与末尾'*'的glob
+    ServletRouter m_router;
     //默认servlet，所有路径都没匹配到时使用
     Servlet::ptr m_default;
 };
@@ -0,0 +1,318 @@
+#include "servlet_router.h"
+#include "servlet.h"
+#include "chat/log.h"
+
+namespace chat {
+namespace http {
+
+static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
+
+struct ServletRouter::Node {
+    enum Type {
+        STATIC,
+        PARAM,
+        WILDCARD
+    };
+    Type type = STATIC;
+    //STATIC为本节点的静态前缀, PARAM/WILDCARD为参数名
+    std::string prefix;
+    //静态子节点前缀的首字符, 与children一一对应
+    std::string indices;
+    std::vector<std::unique_ptr<Node> > children;
+    std::unique_ptr<Node> param;
+    std::unique_ptr<Node> wildcard;
+    //INVALID_METHOD表示任意方法
+    std::vector<std::pair<HttpMethod, CreatorPtr> > handlers;
+};
+
+struct ServletRouter::MatchState {
+    HttpMethod method;
+    HttpRequest::RouteParam params[HttpRequest::MAX_ROUTE_PARAMS];
+    size_t count = 0;
+    bool method_not_allowed = false;
+    std::string* allow = nullptr;
+    CreatorPtr result;
+};
+
+ServletRouter::ServletRouter()
+    :m_root(new Node) {
+}
+
+ServletRouter::~ServletRouter() {
+}
+
+bool ServletRouter::IsTreeGlob(const std::string& glob) {
+    if (glob.empty() || glob[0] != '/') {
+        return false;
+    }
+    size_t pos = glob.find_first_of("*?[\\:");
+    return pos == std::string::npos
+        || (pos == glob.size() - 1 && glob[pos] == '*');
+}
+
+ServletRouter::Node* ServletRouter::insertStatic(Node* n, std::string_view seg) {
+    while (!seg.empty()) {
+        size_t idx = n->indices.find(seg[0]);
+        if (idx == std::string::npos) {
+            Node* c = new Node;
+            c->prefix = std::string(seg);
+            n->indices.push_back(seg[0]);
+            n->children.emplace_back(c);
+            return c;
+        }
+        Node* c = n->children[idx].get();
+        size_t common = 0;
+        size_t max = std::min(c->prefix.size(), seg.size());
+        while (common < max && c->prefix[common] == seg[common]) {
+            ++common;
+        }
+        if (common < c->prefix.size()) {
+            //分裂: 公共前缀作为新的中间节点, 原节点保留剩余部分
+            Node* mid = new Node;
+            mid->prefix = c->prefix.substr(0, common);
+            c->prefix.erase(0, common);
+            mid->indices.push_back(c->prefix[0]);
+            mid->children.emplace_back(n->children[idx].release());
+            n->children[idx].reset(mid);
+            c = mid;
+        }
+        seg.remove_prefix(common);
+        n = c;
+    }
+    return n;
+}
+
+bool ServletRouter::add(HttpMethod method, const std::string& pattern, CreatorPtr creator) {
+    if (pattern.empty() || pattern[0] != '/') {
+        CHAT_LOG_ERROR(g_logger) << "invalid route pattern: " << pattern;
+        return false;
+    }
+    size_t params = 0;
+    Node* n = m_root.get();
+    size_t i = 0;
+    while (i < pattern.size()) {
+        char c = pattern[i];
+        if (c == ':' || c == '*') {
+            size_t end = pattern.find('/', i);
+            if (end == std::string::npos) {
+                end = pattern.size();
+            }
+            std::string name = pattern.substr(i + 1, end - i - 1);
+            if ((c == ':' && name.empty())
+                    || (c == '*' && end != pattern.size())
+                    || name.find_first_of(":*") != std::string::npos) {
+                CHAT_LOG_ERROR(g_logger) << "invalid route pattern: " << pattern;
+                return false;
+            }
+            if (!name.empty() && ++params > HttpRequest::MAX_ROUTE_PARAMS) {
+                CHAT_LOG_ERROR(g_logger) << "too many params in route: " << pattern;
+                return false;
+            }
+            std::unique_ptr<Node>& child = c == ':' ? n->param : n->wildcard;
+            if (!child) {
+                child.reset(new Node);
+                child->type = c == ':' ? Node::PARAM : Node::WILDCARD;
+                child->prefix = name;
+            } else if (child->prefix != name) {
+                CHAT_LOG_ERROR(g_logger) << "route " << pattern << " conflicts with param name "
+                    << child->prefix;
+                return false;
+            }
+            n = child.get();
+            i = end;
+            continue;
+        }
+        size_t end = pattern.find_first_of(":*", i);
+        if (end == std::string::npos) {
+            end = pattern.size();
+        }
+        n = insertStatic(n, std::string_view(pattern).substr(i, end - i));
+        i = end;
+    }
+    for (auto& h : n->handlers) {
+        if (h.first == method) {
+            h.second = creator;
+            return true;
+        }
+    }
+    n->handlers.emplace_back(method, creator);
+    return true;
+}
+
+ServletRouter::Node* ServletRouter::find(const std::string& pattern) const {
+    Node* n = m_root.get();
+    size_t i = 0;
+    while (n && i < pattern.size()) {
+        char c = pattern[i];
+        if (c == ':' || c == '*') {
+            size_t end = pattern.find('/', i);
+            if (end == std::string::npos) {
+                end = pattern.size();
+            }
+            n = c == ':' ? n->param.get() : n->wildcard.get();
+            if (n && pattern.compare(i + 1, end - i - 1, n->prefix) != 0) {
+                return nullptr;
+            }
+            i = end;
+            continue;
+        }
+        size_t end = pattern.find_first_of(":*", i);
+        if (end == std::string::npos) {
+            end = pattern.size();
+        }
+        std::string_view seg = std::string_view(pattern).substr(i, end - i);
+        while (n && !seg.empty()) {
+            size_t idx = n->indices.find(seg[0]);
+            if (idx == std::string::npos) {
+                return nullptr;
+            }
+            n = n->children[idx].get();
+            if (seg.compare(0, n->prefix.size(), n->prefix) != 0) {
+                return nullptr;
+            }
+            seg.remove_prefix(n->prefix.size());
+        }
+        i = end;
+    }
+    return n;
+}
+
+bool ServletRouter::del(HttpMethod method, const std::string& pattern) {
+    Node* n = find(pattern);
+    if (!n) {
+        return false;
+    }
+    for (auto it = n->handlers.begin(); it != n->handlers.end(); ++it) {
+        if (it->first == method) {
+            n->handlers.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool MatchHandler(const std::vector<std::pair<HttpMethod, ServletRouter::CreatorPtr> >& handlers
+                         , HttpMethod method, bool& method_not_allowed, std::string* allow
+                         , ServletRouter::CreatorPtr& result) {
+    const ServletRouter::CreatorPtr* any = nullptr;
+    for (auto& h : handlers) {
+        if (h.first == method) {
+            result = h.second;
+            return true;
+        }
+        if (h.first == HttpMethod::INVALID_METHOD) {
+            any = &h.second;
+        }
+    }
+    if (any) {
+        result = *any;
+        return true;
+    }
+    if (!handlers.empty()) {
+        method_not_allowed = true;
+    }
+    if (allow) {
+        //回溯会经过所有匹配该路径的节点, 汇总它们的方法
+        for (auto& h : handlers) {
+            std::string m = HttpMethodToString(h.first);
+            if ((", " + *allow + ", ").find(", " + m + ", ") == std::string::npos) {
+                allow->append(allow->empty() ? m : ", " + m);
+            }
+        }
+    }
+    return false;
+}
+
+bool ServletRouter::match(const Node* n, std::string_view path, MatchState& st) const {
+    if (path.empty()) {
+        if (MatchHandler(n->handlers, st.method, st.method_not_allowed, st.allow, st.result)) {
+            return true;
+        }
+    } else {
+        size_t idx = n->indices.find(path[0]);
+        if (idx != std::string::npos) {
+            const Node* c = n->children[idx].get();
+            if (path.compare(0, c->prefix.size(), c->prefix) == 0
+                    && match(c, path.substr(c->prefix.size()), st)) {
+                return true;
+            }
+        }
+        if (n->param) {
+            size_t end = path.find('/');
+            if (end == std::string_view::npos) {
+                end = path.size();
+            }
+            if (end > 0) {
+                st.params[st.count++] = std::make_pair(std::string_view(n->param->prefix)
+                                                       , path.substr(0, end));
+                if (match(n->param.get(), path.substr(end), st)) {
+                    return true;
+                }
+                --st.count;
+            }
+        }
+    }
+    if (n->wildcard) {
+        const Node* w = n->wildcard.get();
+        if (!w->prefix.empty()) {
+            st.params[st.count++] = std::make_pair(std::string_view(w->prefix), path);
+        }
+        if (MatchHandler(w->handlers, st.method, st.method_not_allowed, st.allow, st.result)) {
+            return true;
+        }
+        if (!w->prefix.empty()) {
+            --st.count;
+        }
+    }
+    return false;
+}
+
+ServletRouter::CreatorPtr ServletRouter::match(HttpMethod method, std::string_view path
+        , HttpRequest* req, bool* method_not_allowed, std::string* allow) const {
+    MatchState st;
+    st.method = method;
+    st.allow = allow;
+    if (match(m_root.get(), path, st)) {
+        if (req) {
+            req->setRouteParams(st.params, st.count);
+        }
+        return st.result;
+    }
+    if (method_not_allowed) {
+        *method_not_allowed = st.method_not_allowed;
+    }
+    return nullptr;
+}
+
+void ServletRouter::listAll(const Node* n, const std::string& prefix
+        , std::map<std::string, CreatorPtr>& infos) const {
+    std::string path = prefix;
+    if (n->type == Node::STATIC) {
+        path += n->prefix;
+    } else {
+        path += (n->type == Node::PARAM ? ":" : "*") + n->prefix;
+    }
+    for (auto& h : n->handlers) {
+        if (h.first == HttpMethod::INVALID_METHOD) {
+            infos[path] = h.second;
+        } else {
+            infos[std::string(HttpMethodToString(h.first)) + " " + path] = h.second;
+        }
+    }
+    for (auto& c : n->children) {
+        listAll(c.get(), path, infos);
+    }
+    if (n->param) {
+        listAll(n->param.get(), path, infos);
+    }
+    if (n->wildcard) {
+        listAll(n->wildcard.get(), path, infos);
+    }
+}
+
+void ServletRouter::listAll(std::map<std::string, CreatorPtr>& infos) const {
+    listAll(m_root.get(), "", infos);
+}
+
+}
+}
@@ -0,0 +1,61 @@
+#ifndef __CHAT_HTTP_SERVLET_ROUTER_H__
+#define __CHAT_HTTP_SERVLET_ROUTER_H__
+
+#include <memory>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "http.h"
+
+namespace chat {
+namespace http {
+
+class IServletCreator;
+
+//压缩前缀树(radix tree)路由, 匹配代价与路径长度成正比
+//路由语法:
+//  /users/list          静态段
+//  /users/:id/posts     :name 捕获到下一个'/'之前的非空内容
+//  /static/*path        *name 捕获剩余全部内容(可为空), 只能出现在末尾; 只写'*'则不捕获
+//匹配优先级: 静态 > 参数 > 通配, 失败时回溯
+//节点只增不删, 删除路由只清空处理器, 保证捕获参数的名称在请求处理期间一直有效
+//非线程安全, 由ServletDispatch加锁
+class ServletRouter {
+public:
+    typedef std::shared_ptr<ServletRouter> ptr;
+    typedef std::shared_ptr<IServletCreator> CreatorPtr;
+
+    ServletRouter();
+    ~ServletRouter();
+
+    //method为INVALID_METHOD表示匹配任意方法, 语法错误或参数名冲突返回false
+    bool add(HttpMethod method, const std::string& pattern, CreatorPtr creator);
+    bool del(HttpMethod method, const std::string& pattern);
+
+    //匹配成功时把捕获参数写入req(可为空)
+    //路径存在但方法不匹配时返回空, 并置method_not_allowed为true, allow(可为空)追加该路径注册的方法
+    CreatorPtr match(HttpMethod method, std::string_view path
+                     , HttpRequest* req = nullptr, bool* method_not_allowed = nullptr
+                     , std::string* allow = nullptr) const;
+
+    void listAll(std::map<std::string, CreatorPtr>& infos) const;
+
+    //模式是否能由路由树表达, 用于判断glob能否转换
+    static bool IsTreeGlob(const std::string& glob);
+private:
+    struct Node;
+    struct MatchState;
+    Node* insertStatic(Node* n, std::string_view seg);
+    Node* find(const std::string& pattern) const;
+    bool match(const Node* n, std::string_view path, MatchState& st) const;
+    void listAll(const Node* n, const std::string& prefix
+                 , std::map<std::string, CreatorPtr>& infos) const;
+private:
+    std::unique_ptr<Node> m_root;
+};
+
+}
+}
+
+#endif
@@ -1,9 +1,20 @@
 #include "session_data.h"
+#include "chat/config.h"
+#include "chat/iomanager.h"
 #include "chat/util.h"
 
 namespace chat {
 namespace http {
 
+static chat::ConfigVar<uint32_t>::ptr g_session_shards =
+    chat::Config::Lookup("http.session.shards", (uint32_t)16, "http session manager shards");
+
+static chat::ConfigVar<uint32_t>::ptr g_session_wheel_slots =
+    chat::Config::Lookup("http.session.wheel_slots", (uint32_t)1024, "http session expiry timing wheel slots(1s per slot)");
+
+static chat::ConfigVar<uint64_t>::ptr g_session_timeout =
+    chat::Config::Lookup("http.session.timeout", (uint64_t)3600, "http session idle timeout in seconds");
+
 SessionData::SessionData(bool auto_gen)
     :m_lastAccessTime(time(0)) {
     if(auto_gen) {
@@ -14,50 +25,147 @@ SessionData::SessionData(bool auto_gen)
 }
 
 void SessionData::del(const std::string& key) {
-    chat::RWMutex::WriteLock lock(m_mutex);
-    m_datas.erase(key);
+    MutexType::Lock lock(m_mutex);
+    for (auto it = m_datas.begin(); it != m_datas.end(); ++it) {
+        if (it->first == key) {
+            m_datas.erase(it);
+            return;
+        }
+    }
 }
 
 bool SessionData::has(const std::string& key) {
-    chat::RWMutex::ReadLock lock(m_mutex);
-    auto it = m_datas.find(key);
-    return it != m_datas.end();
+    MutexType::Lock lock(m_mutex);
+    for (auto& i : m_datas) {
+        if (i.first == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+SessionDataManager::SessionDataManager()
+    :m_timeout(g_session_timeout->getValue()) {
+    uint32_t count = std::max(g_session_shards->getValue(), (uint32_t)1);
+    uint32_t slots = std::max(g_session_wheel_slots->getValue(), (uint32_t)2);
+    uint64_t now = time(0);
+    for (uint32_t i = 0; i < count; ++i) {
+        m_shards.emplace_back(new Shard);
+        m_shards.back()->wheel.resize(slots);
+        m_shards.back()->current = now;
+    }
+}
+
+SessionDataManager::~SessionDataManager() {
+    stop();
+}
+
+SessionDataManager::Shard& SessionDataManager::getShard(const std::string& id) {
+    return *m_shards[std::hash<std::string>()(id) % m_shards.size()];
 }
 
 void SessionDataManager::add(SessionData::ptr info) {
-    chat::RWMutex::WriteLock lock(m_mutex);
-    m_datas[info->getId()] = info;
+    uint64_t now = time(0);
+    info->setLastAccessTime(now);
+    Shard& shard = getShard(info->getId());
+    RWMutexType::WriteLock lock(shard.mutex);
+    shard.datas[info->getId()] = info;
+    shard.wheel[(now + m_timeout) % shard.wheel.size()].push_back(info);
 }
 
 SessionData::ptr SessionDataManager::get(const std::string& id) {
-    chat::RWMutex::ReadLock lock(m_mutex);
-    auto it = m_datas.find(id);
-    if(it != m_datas.end()) {
-        it->second->setLastAccessTime(time(0));
-        return it->second;
+    uint64_t now = time(0);
+    Shard& shard = getShard(id);
+    RWMutexType::ReadLock lock(shard.mutex);
+    auto it = shard.datas.find(id);
+    if(it == shard.datas.end()) {
+        return nullptr;
+    }
+    //时间轮还没转到, 但已经过期
+    if (it->second->getLastAccessTime() + m_timeout <= now) {
+        return nullptr;
     }
-    return nullptr;
+    it->second->setLastAccessTime(now);
+    return it->second;
+}
+
+void SessionDataManager::del(const std::string& id) {
+    //时间轮里的引用在转到该槽时丢弃
+    Shard& shard = getShard(id);
+    RWMutexType::WriteLock lock(shard.mutex);
+    shard.datas.erase(id);
+}
+
+size_t SessionDataManager::size() {
+    size_t rt = 0;
+    for (auto& i : m_shards) {
+        RWMutexType::ReadLock lock(i->mutex);
+        rt += i->datas.size();
+    }
+    return rt;
+}
+
+void SessionDataManager::advance(Shard& shard, uint64_t now) {
+    uint64_t slots = shard.wheel.size();
+    uint64_t timeout = m_timeout;
+    if (now <= shard.current) {
+        return;
+    }
+    //落后超过一圈时每个槽只需检查一次
+    uint64_t from = now - shard.current > slots ? now - slots + 1 : shard.current + 1;
+    std::vector<SessionData::ptr> bucket;
+    for (uint64_t t = from; t <= now; ++t) {
+        bucket.swap(shard.wheel[t % slots]);
+        for (auto& i : bucket) {
+            auto it = shard.datas.find(i->getId());
+            if (it == shard.datas.end() || it->second != i) {
+                continue;
+            }
+            uint64_t deadline = i->getLastAccessTime() + timeout;
+            if (deadline <= now) {
+                shard.datas.erase(it);
+                continue;
+            }
+            shard.wheel[deadline % slots].push_back(std::move(i));
+        }
+        bucket.clear();
+    }
+    shard.current = now;
 }
 
 void SessionDataManager::check(int64_t ts) {
-    uint64_t now = time(0) - ts;
-    std::vector<std::string> keys;
-    chat::RWMutex::ReadLock lock(m_mutex);
-    for(auto& i : m_datas) {
-        if(i.second->getLastAccessTime() < now) {
-            keys.push_back(i.first);
+    if (ts > 0 && (uint64_t)ts != m_timeout) {
+        m_timeout = ts;
+    }
+    uint64_t now = time(0);
+    for (auto& i : m_shards) {
+        //同一秒内重复调用不必抢写锁
+        if (i->current >= now) {
+            continue;
         }
+        RWMutexType::WriteLock lock(i->mutex);
+        advance(*i, now);
+    }
+}
+
+void SessionDataManager::start(IOManager* iom) {
+    if (!iom) {
+        iom = IOManager::GetThis();
     }
-    lock.unlock();
-    for(auto& i : keys) {
-        del(i);
+    if (!iom || m_timer) {
+        return;
     }
+    m_timer = iom->addTimer(1000, [this]() {
+        check();
+    }, true);
 }
 
-void SessionDataManager::del(const std::string& id) {
-    chat::RWMutex::WriteLock lock(m_mutex);
-    m_datas.erase(id);
+void SessionDataManager::stop() {
+    if (m_timer) {
+        m_timer->cancel();
+        m_timer = nullptr;
+    }
 }
 
 }
-}
\ No newline at end of file
+}
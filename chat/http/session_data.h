@@ -3,35 +3,52 @@
 
 #include "chat/mutex.h"
 #include "chat/singleton.h"
-#include <boost/any.hpp>
+#include "chat/timer.h"
+#include <any>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <variant>
+#include <vector>
 
 namespace chat {
+
+class IOManager;
+
 namespace http {
 
+//会话数据: 键值对放在一个小vector里, 值按类型存放
+//bool/整数/浮点/字符串直接存在variant中, 其他类型退化为std::any
 class SessionData {
 public:
     typedef std::shared_ptr<SessionData> ptr;
+    typedef Spinlock MutexType;
+    typedef std::variant<bool, int64_t, double, std::string, std::any> Value;
+
     SessionData(bool auto_gen = false);
 
     template<class T>
     void setData(const std::string& key, const T& v) {
-        chat::RWMutex::WriteLock lock(m_mutex);
-        m_datas[key] = v;
+        Value val = ToValue(v);
+        MutexType::Lock lock(m_mutex);
+        for (auto& i : m_datas) {
+            if (i.first == key) {
+                i.second = std::move(val);
+                return;
+            }
+        }
+        m_datas.emplace_back(key, std::move(val));
     }
 
     template<class T>
     T getData(const std::string& key, const T& def = T()) {
-        chat::RWMutex::ReadLock lock(m_mutex);
-        auto it = m_datas.find(key);
-        if(it == m_datas.end()) {
-            return def;
-        }
-        boost::any v = it->second;
-        lock.unlock();
-        try {
-            return boost::any_cast<T>(v);
-        } catch (...) {
+        MutexType::Lock lock(m_mutex);
+        for (auto& i : m_datas) {
+            if (i.first == key) {
+                return FromValue<T>(i.second, def);
+            }
         }
         return def;
     }
@@ -39,27 +56,94 @@ public:
     void del(const std::string& key);
 
     bool has(const std::string& key);
-    uint64_t getLastAccessTime() const { return m_lastAccessTime;}
-    void setLastAccessTime(uint64_t v) { m_lastAccessTime = v;}
+    uint64_t getLastAccessTime() const { return m_lastAccessTime.load(std::memory_order_relaxed);}
+    void setLastAccessTime(uint64_t v) { m_lastAccessTime.store(v, std::memory_order_relaxed);}
 
     const std::string& getId() const { return m_id;}
     void setId(const std::string& val) { m_id = val;}
 private:
-    chat::RWMutex m_mutex;
-    std::unordered_map<std::string, boost::any> m_datas;
-    uint64_t m_lastAccessTime;
+    template<class T>
+    static Value ToValue(const T& v) {
+        if constexpr (std::is_same_v<T, bool>) {
+            return Value(std::in_place_index<0>, v);
+        } else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+            return Value(std::in_place_index<1>, (int64_t)v);
+        } else if constexpr (std::is_floating_point_v<T>) {
+            return Value(std::in_place_index<2>, (double)v);
+        } else if constexpr (std::is_convertible_v<const T&, std::string>) {
+            return Value(std::in_place_index<3>, std::string(v));
+        } else {
+            return Value(std::in_place_index<4>, std::any(v));
+        }
+    }
+
+    //类型不匹配返回def
+    template<class T>
+    static T FromValue(const Value& v, const T& def) {
+        if constexpr (std::is_same_v<T, bool>) {
+            auto p = std::get_if<0>(&v);
+            return p ? *p : def;
+        } else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+            auto p = std::get_if<1>(&v);
+            return p ? (T)*p : def;
+        } else if constexpr (std::is_floating_point_v<T>) {
+            auto p = std::get_if<2>(&v);
+            return p ? (T)*p : def;
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            auto p = std::get_if<3>(&v);
+            return p ? *p : def;
+        } else {
+            auto p = std::get_if<4>(&v);
+            const T* rt = p ? std::any_cast<T>(p) : nullptr;
+            return rt ? *rt : def;
+        }
+    }
+private:
+    MutexType m_mutex;
+    std::vector<std::pair<std::string, Value> > m_datas;
+    std::atomic<uint64_t> m_lastAccessTime;
     std::string m_id;
 };
 
+//会话管理: 按id哈希分片, 每个分片一把读写锁
+//过期由时间轮驱动: 会话按 最后访问时间+超时 放进对应的槽, get只更新最后访问时间不移动槽位,
+//时间轮转到某个槽时再检查其中的会话, 已过期的删除, 期间被访问过的按新的到期时间放进后面的槽
+//每秒只检查一个槽, 不再扫描全部会话
 class SessionDataManager {
 public:
+    typedef RWMutex RWMutexType;
+
+    SessionDataManager();
+    ~SessionDataManager();
+
     void add(SessionData::ptr info);
     void del(const std::string& id);
     SessionData::ptr get(const std::string& id);
-    void check(int64_t ts = 3600);
+    //把时间轮推进到当前时间, 删除超过超时时间未访问的会话
+    //ts大于0时先把超时时间改为ts秒, 已在时间轮中的会话在转到所在槽时按新值判断
+    void check(int64_t ts = 0);
+
+    //在iom上启动每秒一次的定时器推进时间轮, 不启动时需要外部调用check
+    void start(IOManager* iom = nullptr);
+    void stop();
+
+    void setTimeout(uint64_t v) { m_timeout = v;}
+    uint64_t getTimeout() const { return m_timeout;}
+    size_t size();
+private:
+    struct Shard {
+        RWMutexType mutex;
+        std::unordered_map<std::string, SessionData::ptr> datas;
+        std::vector<std::vector<SessionData::ptr> > wheel;
+        std::atomic<uint64_t> current = {0};    //已经处理到的秒
+    };
+
+    Shard& getShard(const std::string& id);
+    void advance(Shard& shard, uint64_t now);
 private:
-    chat::RWMutex m_mutex;
-    std::unordered_map<std::string, SessionData::ptr> m_datas;
+    std::vector<std::unique_ptr<Shard> > m_shards;
+    std::atomic<uint64_t> m_timeout;
+    Timer::ptr m_timer;
 };
 
 typedef chat::Singleton<SessionDataManager> SessionDataMgr;
@@ -67,4 +151,4 @@ typedef chat::Singleton<SessionDataManager> SessionDataMgr;
 }
 }
 
-#endif
\ No newline at end of file
+#endif
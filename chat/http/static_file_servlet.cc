@@ -0,0 +1,395 @@
+#include "static_file_servlet.h"
+#include "chat/clock.h"
+#include "chat/config.h"
+#include "chat/log.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+namespace chat {
+namespace http {
+
+static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
+
+static chat::ConfigVar<uint32_t>::ptr g_static_file_check_interval =
+    chat::Config::Lookup("static_file.check_interval", (uint32_t)1000, "static file cache stat interval in ms");
+static chat::ConfigVar<uint32_t>::ptr g_static_file_cache_size =
+    chat::Config::Lookup("static_file.cache_size", (uint32_t)1024, "static file cache max entries");
+static chat::ConfigVar<uint32_t>::ptr g_static_file_memory_max =
+    chat::Config::Lookup("static_file.memory_max", (uint32_t)(64 * 1024), "static file max size kept in memory, larger ones use sendfile");
+
+static std::string HttpDate(time_t t) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[64];
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buf;
+}
+
+static bool ParseHttpDate(const std::string& v, time_t& t) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(v.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end) {
+        return false;
+    }
+    t = timegm(&tm);
+    return true;
+}
+
+StaticFile::ptr StaticFile::Open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    StaticFile::ptr file(new StaticFile);
+    file->m_fd = fd;
+    file->m_size = st.st_size;
+    file->m_ino = st.st_ino;
+    file->m_mtime = st.st_mtim;
+    if (file->m_size > 0 && file->m_size <= g_static_file_memory_max->getValue()) {
+        file->m_data.resize(file->m_size);
+        uint64_t off = 0;
+        while (off < file->m_size) {
+            ssize_t n = pread(fd, &file->m_data[off], file->m_size - off, off);
+            if (n <= 0) {
+                break;
+            }
+            off += n;
+        }
+        if (off != file->m_size) {
+            //读取期间被截断, 下次stat时会重新打开
+            CHAT_LOG_WARN(g_logger) << "read " << path << " got " << off << " of " << file->m_size
+                << " errno=" << errno << " errstr=" << strerror(errno);
+            file->m_data.clear();
+        }
+    }
+
+    char buf[64];
+    snprintf(buf, sizeof(buf), "\"%lx-%lx-%lx\"", (unsigned long)st.st_mtim.tv_sec
+            , (unsigned long)st.st_mtim.tv_nsec, (unsigned long)st.st_size);
+    file->m_etag = buf;
+    file->m_lastModified = HttpDate(st.st_mtim.tv_sec);
+    return file;
+}
+
+StaticFile::~StaticFile() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+bool StaticFile::isChanged(const struct stat& st) const {
+    return st.st_ino != m_ino
+        || (uint64_t)st.st_size != m_size
+        || st.st_mtim.tv_sec != m_mtime.tv_sec
+        || st.st_mtim.tv_nsec != m_mtime.tv_nsec;
+}
+
+StaticFile::ptr StaticFileCache::get(const std::string& path) {
+    uint64_t now = Clock::MonotonicCoarseMs();
+    StaticFile::ptr old;
+    {
+        MutexType::Lock lock(m_mutex);
+        auto it = m_datas.find(path);
+        if (it != m_datas.end()) {
+            it->second.accessTime = now;
+            if (now - it->second.checkTime < g_static_file_check_interval->getValue()) {
+                return it->second.file;
+            }
+            old = it->second.file;
+        }
+    }
+
+    StaticFile::ptr file;
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+        if (old && !old->isChanged(st)) {
+            file = old;
+        } else {
+            file = StaticFile::Open(path);
+        }
+    }
+
+    MutexType::Lock lock(m_mutex);
+    if (m_datas.size() >= g_static_file_cache_size->getValue()
+            && m_datas.find(path) == m_datas.end()) {
+        //淘汰最久未访问的
+        auto victim = m_datas.begin();
+        for (auto it = m_datas.begin(); it != m_datas.end(); ++it) {
+            if (it->second.accessTime < victim->second.accessTime) {
+                victim = it;
+            }
+        }
+        m_datas.erase(victim);
+    }
+    Item& item = m_datas[path];
+    item.file = file;
+    item.checkTime = now;
+    item.accessTime = now;
+    return file;
+}
+
+void StaticFileCache::clear() {
+    MutexType::Lock lock(m_mutex);
+    m_datas.clear();
+}
+
+size_t StaticFileCache::size() {
+    MutexType::Lock lock(m_mutex);
+    return m_datas.size();
+}
+
+//只支持单个区间; 返回1合法, 0忽略(语法错误或多区间, 按整个文件返回), -1不可满足
+static int ParseRange(const std::string& v, uint64_t size, uint64_t& start, uint64_t& len) {
+    if (strncasecmp(v.c_str(), "bytes=", 6) != 0) {
+        return 0;
+    }
+    std::string spec = StringUtil::Trim(v.substr(6));
+    if (spec.find(',') != std::string::npos) {
+        return 0;
+    }
+    size_t dash = spec.find('-');
+    if (dash == std::string::npos) {
+        return 0;
+    }
+    std::string a = StringUtil::Trim(spec.substr(0, dash));
+    std::string b = StringUtil::Trim(spec.substr(dash + 1));
+    auto is_num = [](const std::string& s) {
+        return !s.empty() && s.find_first_not_of("0123456789") == std::string::npos;
+    };
+
+    if (a.empty()) {
+        //bytes=-N 最后N字节
+        if (!is_num(b)) {
+            return 0;
+        }
+        uint64_t n = strtoull(b.c_str(), nullptr, 10);
+        if (n == 0 || size == 0) {
+            return -1;
+        }
+        n = std::min(n, size);
+        start = size - n;
+        len = n;
+        return 1;
+    }
+    if (!is_num(a) || (!b.empty() && !is_num(b))) {
+        return 0;
+    }
+    uint64_t s = strtoull(a.c_str(), nullptr, 10);
+    if (s >= size) {
+        return -1;
+    }
+    uint64_t e = b.empty() ? size - 1 : strtoull(b.c_str(), nullptr, 10);
+    if (e < s) {
+        return 0;
+    }
+    e = std::min(e, size - 1);
+    start = s;
+    len = e - s + 1;
+    return 1;
+}
+
+static bool EtagMatch(const std::string& header, const std::string& etag) {
+    if (StringUtil::Trim(header) == "*") {
+        return true;
+    }
+    for (auto& i : split(header, ',')) {
+        std::string tag = StringUtil::Trim(i);
+        if (tag.compare(0, 2, "W/") == 0) {
+            tag = tag.substr(2);
+        }
+        if (tag == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool AcceptGzip(const std::string& v) {
+    for (auto& i : split(v, ',')) {
+        auto items = split(i, ';');
+        if (strcasecmp(StringUtil::Trim(items[0]).c_str(), "gzip") != 0) {
+            continue;
+        }
+        if (items.size() > 1) {
+            std::string q = StringUtil::Trim(items[1]);
+            if (q.compare(0, 2, "q=") == 0 && atof(q.c_str() + 2) <= 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+std::string StaticFileServlet::GetMimeType(const std::string& path) {
+    static const std::unordered_map<std::string, std::string> s_types = {
+        {"html", "text/html;charset=utf-8"},
+        {"htm", "text/html;charset=utf-8"},
+        {"css", "text/css;charset=utf-8"},
+        {"js", "application/javascript;charset=utf-8"},
+        {"json", "application/json;charset=utf-8"},
+        {"txt", "text/plain;charset=utf-8"},
+        {"xml", "application/xml"},
+        {"png", "image/png"},
+        {"jpg", "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"gif", "image/gif"},
+        {"svg", "image/svg+xml"},
+        {"ico", "image/x-icon"},
+        {"webp", "image/webp"},
+        {"woff", "font/woff"},
+        {"woff2", "font/woff2"},
+        {"wasm", "application/wasm"},
+        {"pdf", "application/pdf"},
+        {"mp4", "video/mp4"},
+    };
+    size_t pos = path.rfind('.');
+    if (pos != std::string::npos && path.find('/', pos) == std::string::npos) {
+        auto it = s_types.find(ToLower(path.substr(pos + 1)));
+        if (it != s_types.end()) {
+            return it->second;
+        }
+    }
+    return "application/octet-stream";
+}
+
+StaticFileServlet::StaticFileServlet(const std::string& root, const std::string& prefix)
+    :Servlet("StaticFileServlet")
+    ,m_root(root)
+    ,m_prefix(prefix) {
+    while (!m_root.empty() && m_root.back() == '/') {
+        m_root.pop_back();
+    }
+}
+
+StaticFile::ptr StaticFileServlet::lookup(const std::string& path) {
+    if (path.back() == '/') {
+        return m_cache.get(path + m_index);
+    }
+    StaticFile::ptr file = m_cache.get(path);
+    if (!file && !m_index.empty()) {
+        file = m_cache.get(path + "/" + m_index);
+    }
+    return file;
+}
+
+//没有实体的错误响应, 显式带上Content-Length: 0, 客户端不必等连接关闭来判断结束
+static void SetEmptyStatus(HttpResponse::ptr response, HttpStatus status) {
+    response->setStatus(status);
+    response->setHeader("Content-Length", "0");
+}
+
+int32_t StaticFileServlet::handle(chat::http::HttpRequest::ptr request
+                   , chat::http::HttpResponse::ptr response
+                   , chat::SocketStream::ptr session) {
+    response->setBody("");
+    HttpMethod method = request->getMethod();
+    if (method != HttpMethod::GET && method != HttpMethod::HEAD) {
+        SetEmptyStatus(response, HttpStatus::METHOD_NOT_ALLOWED);
+        response->setHeader("Allow", "GET, HEAD");
+        return 0;
+    }
+
+    const std::string& path = request->getPath();
+    if (path.compare(0, m_prefix.size(), m_prefix) != 0) {
+        SetEmptyStatus(response, HttpStatus::NOT_FOUND);
+        return 0;
+    }
+    std::string rel = StringUtil::UrlDecode(path.substr(m_prefix.size()), false);
+    if (rel.find('\0') != std::string::npos) {
+        SetEmptyStatus(response, HttpStatus::BAD_REQUEST);
+        return 0;
+    }
+    for (auto& i : split(rel, '/')) {
+        if (i == "..") {  //禁止跳出root
+            SetEmptyStatus(response, HttpStatus::FORBIDDEN);
+            return 0;
+        }
+    }
+
+    std::string full = m_root + "/" + rel;
+    StaticFile::ptr file = lookup(full);
+    if (!file) {
+        SetEmptyStatus(response, HttpStatus::NOT_FOUND);
+        return 0;
+    }
+
+    response->setHeader("Content-Type", GetMimeType(full));
+    if (m_gzip) {
+        response->setHeader("Vary", "Accept-Encoding");
+        if (AcceptGzip(request->getHeader("Accept-Encoding"))) {
+            //同目录下存在预压缩的.gz文件时直接发送
+            StaticFile::ptr gz = m_cache.get(full + ".gz");
+            if (!gz && full.back() == '/') {
+                gz = m_cache.get(full + m_index + ".gz");
+            }
+            if (gz) {
+                file = gz;
+                response->setHeader("Content-Encoding", "gzip");
+            }
+        }
+    }
+
+    response->setHeader("ETag", file->getEtag());
+    response->setHeader("Last-Modified", file->getLastModified());
+    response->setHeader("Accept-Ranges", "bytes");
+    if (m_maxAge >= 0) {
+        response->setHeader("Cache-Control", "max-age=" + std::to_string(m_maxAge));
+    }
+
+    std::string inm = request->getHeader("If-None-Match");
+    std::string ims = request->getHeader("If-Modified-Since");
+    time_t since = 0;
+    if ((!inm.empty() && EtagMatch(inm, file->getEtag()))
+            || (inm.empty() && !ims.empty() && ParseHttpDate(ims, since)
+                && file->getMtime() <= since)) {
+        response->setStatus(HttpStatus::NOT_MODIFIED);
+        return 0;
+    }
+
+    uint64_t start = 0;
+    uint64_t len = file->getSize();
+    std::string range = request->getHeader("Range");
+    std::string if_range = request->getHeader("If-Range");
+    if (!range.empty() && method == HttpMethod::GET
+            && (if_range.empty() || if_range == file->getEtag()
+                || if_range == file->getLastModified())) {
+        int rt = ParseRange(range, file->getSize(), start, len);
+        if (rt < 0) {
+            SetEmptyStatus(response, HttpStatus::RANGE_NOT_SATISFIABLE);
+            response->setHeader("Content-Range", "bytes */" + std::to_string(file->getSize()));
+            return 0;
+        }
+        if (rt > 0) {
+            response->setStatus(HttpStatus::PARTIAL_CONTENT);
+            response->setHeader("Content-Range", "bytes " + std::to_string(start) + "-"
+                    + std::to_string(start + len - 1) + "/" + std::to_string(file->getSize()));
+        }
+    }
+
+    if (method == HttpMethod::HEAD || len == 0) {
+        response->setHeader("Content-Length", std::to_string(len));
+        return 0;
+    }
+
+    HttpResponse::FileBody::ptr body = std::make_shared<HttpResponse::FileBody>();
+    body->fd = file->getFd();
+    body->data = file->getData();
+    body->offset = start;
+    body->length = len;
+    body->holder = file;
+    response->setFileBody(body);
+    return 0;
+}
+
+}
+}
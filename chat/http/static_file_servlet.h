@@ -0,0 +1,99 @@
+#ifndef __CHAT_HTTP_STATIC_FILE_SERVLET_H__
+#define __CHAT_HTTP_STATIC_FILE_SERVLET_H__
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "servlet.h"
+#include "chat/mutex.h"
+
+namespace chat {
+namespace http {
+
+//打开的静态文件: fd + 小文件内容的内存副本, 析构时关闭fd
+//不用mmap: 文件被原地截断后访问映射页会SIGBUS, 大文件走sendfile只会读到短数据
+class StaticFile {
+public:
+    typedef std::shared_ptr<StaticFile> ptr;
+
+    //打开普通文件, 失败返回nullptr
+    static StaticFile::ptr Open(const std::string& path);
+    ~StaticFile();
+
+    int getFd() const { return m_fd;}
+    //超过static_file.memory_max的文件为空, 只能通过fd发送
+    const char* getData() const { return m_data.empty() ? nullptr : m_data.data();}
+    uint64_t getSize() const { return m_size;}
+    time_t getMtime() const { return m_mtime.tv_sec;}
+    const std::string& getEtag() const { return m_etag;}
+    const std::string& getLastModified() const { return m_lastModified;}
+
+    //与stat结果比较, 判断文件是否被替换或修改
+    bool isChanged(const struct stat& st) const;
+private:
+    StaticFile() {}
+private:
+    int m_fd = -1;
+    std::string m_data;
+    uint64_t m_size = 0;
+    ino_t m_ino = 0;
+    struct timespec m_mtime;
+    std::string m_etag;
+    std::string m_lastModified;
+};
+
+//路径 -> StaticFile 缓存, 超过检查间隔后重新stat, 变化则重新打开; 不存在的路径也缓存
+class StaticFileCache {
+public:
+    typedef Mutex MutexType;
+
+    StaticFile::ptr get(const std::string& path);
+    void clear();
+    size_t size();
+private:
+    struct Item {
+        StaticFile::ptr file;
+        uint64_t checkTime = 0;
+        uint64_t accessTime = 0;
+    };
+    MutexType m_mutex;
+    std::unordered_map<std::string, Item> m_datas;
+};
+
+//静态文件Servlet: 支持GET/HEAD, Range, If-None-Match/If-Modified-Since, 预压缩的.gz文件
+//响应体作为FileBody交给HttpSession用writev(内存副本)/sendfile发送
+class StaticFileServlet : public Servlet {
+public:
+    typedef std::shared_ptr<StaticFileServlet> ptr;
+
+    //root: 本地目录; prefix: 请求路径中需要剥离的前缀, 如 "/static/"
+    StaticFileServlet(const std::string& root, const std::string& prefix = "/");
+
+    virtual int32_t handle(chat::http::HttpRequest::ptr request
+                   , chat::http::HttpResponse::ptr response
+                   , chat::SocketStream::ptr session) override;
+
+    void setIndex(const std::string& v) { m_index = v;}
+    void setGzip(bool v) { m_gzip = v;}
+    //>=0时输出Cache-Control: max-age
+    void setMaxAge(int v) { m_maxAge = v;}
+
+    StaticFileCache& getCache() { return m_cache;}
+
+    static std::string GetMimeType(const std::string& path);
+private:
+    StaticFile::ptr lookup(const std::string& path);
+private:
+    std::string m_root;
+    std::string m_prefix;
+    std::string m_index = "index.html";
+    bool m_gzip = true;
+    int m_maxAge = -1;
+    StaticFileCache m_cache;
+};
+
+}
+}
+
+#endif
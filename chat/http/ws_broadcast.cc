@@ -0,0 +1,128 @@
+#include "ws_broadcast.h"
+#include "chat/iomanager.h"
+#include "chat/log.h"
+
+namespace chat {
+namespace http {
+
+static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
+
+WSBroadcaster::WSBroadcaster(SlowPolicy policy)
+    :m_policy(policy) {
+}
+
+bool WSBroadcaster::subscribe(WSSession::ptr session) {
+    if(!session || !session->getIOManager()) {
+        return false;
+    }
+    Key key(session->getIOManager(), session->getThreadId());
+    MutexType::Lock lock(m_mutex);
+    if(!m_index.emplace(session.get(), key).second) {
+        return false;
+    }
+    Group& group = m_groups[key];
+    group.sessions[session.get()] = session;
+    group.snapshot = nullptr;
+    return true;
+}
+
+bool WSBroadcaster::unsubscribe(WSSession::ptr session) {
+    MutexType::Lock lock(m_mutex);
+    auto it = m_index.find(session.get());
+    if(it == m_index.end()) {
+        return false;
+    }
+    auto git = m_groups.find(it->second);
+    m_index.erase(it);
+    if(git != m_groups.end()) {
+        git->second.sessions.erase(session.get());
+        git->second.snapshot = nullptr;
+        if(git->second.sessions.empty()) {
+            m_groups.erase(git);
+        }
+    }
+    return true;
+}
+
+size_t WSBroadcaster::size() {
+    MutexType::Lock lock(m_mutex);
+    return m_index.size();
+}
+
+size_t WSBroadcaster::broadcast(const std::string& data, int32_t opcode) {
+    return broadcast(WSEncodeFrame(data, opcode));
+}
+
+size_t WSBroadcaster::broadcast(WSFrameBuffer frame) {
+    std::vector<std::pair<Key, Snapshot> > tasks;
+    size_t total = 0;
+    {
+        MutexType::Lock lock(m_mutex);
+        tasks.reserve(m_groups.size());
+        for(auto& i : m_groups) {
+            if(!i.second.snapshot) {
+                auto snapshot = std::make_shared<std::vector<WSSession::ptr> >();
+                snapshot->reserve(i.second.sessions.size());
+                for(auto& s : i.second.sessions) {
+                    snapshot->push_back(s.second);
+                }
+                i.second.snapshot = snapshot;
+            }
+            total += i.second.snapshot->size();
+            tasks.emplace_back(i.first, i.second.snapshot);
+        }
+    }
+    ++m_broadcasts;
+    auto self = shared_from_this();
+    for(auto& i : tasks) {
+        Snapshot snapshot = i.second;
+        i.first.first->schedule([self, snapshot, frame]() {
+            self->deliver(*snapshot, frame);
+        }, i.first.second);
+    }
+    return total;
+}
+
+void WSBroadcaster::deliver(const std::vector<WSSession::ptr>& sessions, const WSFrameBuffer& frame) {
+    std::vector<WSSession::ptr> closed;
+    uint64_t delivered = 0;
+    uint64_t dropped = 0;
+    for(auto& i : sessions) {
+        if(!i->isConnected()) {
+            closed.push_back(i);
+            continue;
+        }
+        if(i->sendFrame(frame)) {
+            ++delivered;
+            continue;
+        }
+        if(!i->isConnected()) {
+            closed.push_back(i);
+        } else if(m_policy == DISCONNECT) {
+            CHAT_LOG_INFO(g_logger) << "WSBroadcaster disconnect slow consumer "
+                << i->getRemoteAddressString() << " queued=" << i->getQueuedBytes();
+            ++m_disconnected;
+            i->close();
+            closed.push_back(i);
+        } else {
+            ++dropped;
+        }
+    }
+    m_delivered += delivered;
+    m_dropped += dropped;
+    for(auto& i : closed) {
+        unsubscribe(i);
+    }
+}
+
+WSBroadcaster::Stats WSBroadcaster::getStats() const {
+    Stats st;
+    st.broadcasts = m_broadcasts;
+    st.delivered = m_delivered;
+    st.dropped = m_dropped;
+    st.disconnected = m_disconnected;
+    return st;
+}
+
+}
+}
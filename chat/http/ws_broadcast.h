@@ -0,0 +1,80 @@
+#ifndef __CHAT_HTTP_WS_BROADCAST_H__
+#define __CHAT_HTTP_WS_BROADCAST_H__
+
+#include "chat/http/ws_session.h"
+#include "chat/mutex.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace chat {
+namespace http {
+
+//WebSocket广播: 一条消息只编码一次成共享的帧, 按会话所在的IOManager线程分组,
+//每组调度一个任务到该线程上逐个WSSession::sendFrame, 调用方不等待写出
+//sendFrame不阻塞, 写不完的进会话自己的有界队列; 队列满的慢消费者按策略丢弃该消息或断开连接
+//帧不压缩, 协商了permessage-deflate的会话也收到未压缩的帧(RSV1=0)
+//需要用std::make_shared创建
+class WSBroadcaster : public std::enable_shared_from_this<WSBroadcaster> {
+public:
+    typedef std::shared_ptr<WSBroadcaster> ptr;
+    typedef Mutex MutexType;
+
+    //慢消费者的处理方式
+    enum SlowPolicy {
+        //丢弃发给该会话的这条消息
+        DROP = 0,
+        //关闭连接并取消订阅
+        DISCONNECT = 1
+    };
+
+    struct Stats {
+        uint64_t broadcasts = 0;    //广播次数
+        uint64_t delivered = 0;     //写出或进入发送队列的帧数
+        uint64_t dropped = 0;       //队列满丢弃的帧数
+        uint64_t disconnected = 0;  //因队列满断开的会话数
+    };
+
+    WSBroadcaster(SlowPolicy policy = DROP);
+
+    //通常在onConnect中订阅, onClose中取消; 已断开的会话在下次广播时自动取消
+    bool subscribe(WSSession::ptr session);
+    bool unsubscribe(WSSession::ptr session);
+    size_t size();
+
+    //返回这次广播要投递的会话数
+    size_t broadcast(const std::string& data, int32_t opcode = WSFrameHead::TEXT_FRAME);
+    size_t broadcast(WSFrameBuffer frame);
+
+    SlowPolicy getPolicy() const { return m_policy;}
+    void setPolicy(SlowPolicy v) { m_policy = v;}
+    Stats getStats() const;
+private:
+    typedef std::pair<IOManager*, pid_t> Key;
+    typedef std::shared_ptr<const std::vector<WSSession::ptr> > Snapshot;
+
+    struct Group {
+        std::unordered_map<WSSession*, WSSession::ptr> sessions;
+        //成员变化后置空, 下次广播时重建, 成员不变时广播不必复制会话列表
+        Snapshot snapshot;
+    };
+
+    //在会话所在线程上执行
+    void deliver(const std::vector<WSSession::ptr>& sessions, const WSFrameBuffer& frame);
+private:
+    MutexType m_mutex;
+    std::map<Key, Group> m_groups;
+    std::unordered_map<WSSession*, Key> m_index;
+    std::atomic<SlowPolicy> m_policy;
+    std::atomic<uint64_t> m_broadcasts = {0};
+    std::atomic<uint64_t> m_delivered = {0};
+    std::atomic<uint64_t> m_dropped = {0};
+    std::atomic<uint64_t> m_disconnected = {0};
+};
+
+}
+}
+
+#endif
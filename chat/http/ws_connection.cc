@@ -47,9 +47,12 @@ std::pair<HttpResult::ptr, WSConnection::ptr> WSConnection::Create(Uri::ptr uri
     req->setMethod(HttpMethod::GET);
     bool has_host = false;
     bool has_conn = false;
+    bool has_ext = false;
     for(auto& i : headers) {
         if(strcasecmp(i.first.c_str(), "connection") == 0) {
             has_conn = true;
+        } else if(strcasecmp(i.first.c_str(), "Sec-WebSocket-Extensions") == 0) {
+            has_ext = true;
         } else if(!has_host && strcasecmp(i.first.c_str(), "host") == 0) {
             has_host = !i.second.empty();
         }
@@ -66,6 +69,9 @@ std::pair<HttpResult::ptr, WSConnection::ptr> WSConnection::Create(Uri::ptr uri
     if(!has_host) {
         req->setHeader("Host", uri->getHost());
     }
+    if(!has_ext && WSDeflate::IsEnabled()) {
+        req->setHeader("Sec-WebSocket-Extensions", WSDeflate::ClientOffer());
+    }
 
    int rt = conn->sendRequest(req);
     if(rt == 0) {
@@ -88,20 +94,29 @@ std::pair<HttpResult::ptr, WSConnection::ptr> WSConnection::Create(Uri::ptr uri
         return std::make_pair(std::make_shared<HttpResult>(50
                     , rsp, "not websocket server " + addr->toString()), nullptr);
     }
+    std::string ext = rsp->getHeader("Sec-WebSocket-Extensions");
+    if(!ext.empty()) {
+        bool valid = true;
+        conn->m_deflate = WSDeflate::ClientAccept(ext, valid);
+        if(!valid) {
+            return std::make_pair(std::make_shared<HttpResult>(51
+                        , rsp, "invalid websocket extensions: " + ext), nullptr);
+        }
+    }
     return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::OK
                 , rsp, "ok"), conn);
 }
 
 WSFrameMessage::ptr WSConnection::recvMessage() {
-    return WSRecvMessage(this, true);
+    return WSRecvMessage(this, true, m_deflate.get());
 }
 
 int32_t WSConnection::sendMessage(WSFrameMessage::ptr msg, bool fin) {
-    return WSSendMessage(this, msg, true, fin);
+    return WSSendMessage(this, msg, true, fin, m_deflate.get());
 }
 
 int32_t WSConnection::sendMessage(const std::string& msg, int32_t opcode, bool fin) {
-    return WSSendMessage(this, std::make_shared<WSFrameMessage>(opcode, msg), true, fin);
+    return WSSendMessage(this, std::make_shared<WSFrameMessage>(opcode, msg), true, fin, m_deflate.get());
 }
 
 int32_t WSConnection::ping() {
@@ -22,6 +22,11 @@ public:
     int32_t sendMessage(const std::string& msg, int32_t opcode = WSFrameHead::TEXT_FRAME, bool fin = true);
     int32_t ping();
     int32_t pong();
+
+    //握手时协商了permessage-deflate才不为空
+    WSDeflate::ptr getDeflate() const { return m_deflate;}
+private:
+    WSDeflate::ptr m_deflate;
 };
 
 }
@@ -0,0 +1,508 @@
+#include "ws_deflate.h"
+#include "chat/config.h"
+#include "chat/log.h"
+#include "chat/util.h"
+#include <string.h>
+#include <strings.h>
+#include <unordered_map>
+#include <vector>
+
+namespace chat {
+namespace http {
+
+static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
+
+static chat::ConfigVar<bool>::ptr g_ws_deflate_enable =
+    chat::Config::Lookup("websocket.deflate.enable", true, "websocket permessage-deflate enable");
+static chat::ConfigVar<int>::ptr g_ws_deflate_level =
+    chat::Config::Lookup("websocket.deflate.level", (int)6, "websocket permessage-deflate compress level 1-9");
+static chat::ConfigVar<int>::ptr g_ws_deflate_mem_level =
+    chat::Config::Lookup("websocket.deflate.mem_level", (int)8, "websocket permessage-deflate zlib memLevel 1-9");
+static chat::ConfigVar<int>::ptr g_ws_deflate_server_max_window_bits =
+    chat::Config::Lookup("websocket.deflate.server_max_window_bits", (int)15, "websocket permessage-deflate server window bits 9-15");
+static chat::ConfigVar<int>::ptr g_ws_deflate_client_max_window_bits =
+    chat::Config::Lookup("websocket.deflate.client_max_window_bits", (int)15, "websocket permessage-deflate client window bits 9-15");
+static chat::ConfigVar<bool>::ptr g_ws_deflate_server_no_context_takeover =
+    chat::Config::Lookup("websocket.deflate.server_no_context_takeover", false, "websocket permessage-deflate server resets context per message");
+static chat::ConfigVar<bool>::ptr g_ws_deflate_client_no_context_takeover =
+    chat::Config::Lookup("websocket.deflate.client_no_context_takeover", false, "websocket permessage-deflate client resets context per message");
+static chat::ConfigVar<uint32_t>::ptr g_ws_deflate_memory_budget =
+    chat::Config::Lookup("websocket.deflate.memory_budget", (uint32_t)(256 * 1024)
+            , "websocket permessage-deflate per connection zlib memory budget, 0 means unlimited");
+static chat::ConfigVar<uint32_t>::ptr g_ws_deflate_min_size =
+    chat::Config::Lookup("websocket.deflate.min_size", (uint32_t)32, "websocket permessage-deflate min message size");
+
+static const char s_tail[] = {0x00, 0x00, (char)0xff, (char)0xff};
+//每个线程每种参数保留的z_stream个数
+static const size_t s_pool_max = 16;
+
+//按参数缓存已初始化的z_stream, 线程退出时释放
+struct ZStreamPool {
+    ZStreamPool(bool deflate)
+        :m_deflate(deflate) {
+    }
+    ~ZStreamPool() {
+        for (auto& i : m_streams) {
+            for (auto& zs : i.second) {
+                m_deflate ? deflateEnd(zs) : inflateEnd(zs);
+                delete zs;
+            }
+        }
+    }
+
+    z_stream* get(int key) {
+        auto it = m_streams.find(key);
+        if (it == m_streams.end() || it->second.empty()) {
+            return nullptr;
+        }
+        z_stream* zs = it->second.back();
+        it->second.pop_back();
+        return zs;
+    }
+
+    void put(int key, z_stream* zs) {
+        auto& v = m_streams[key];
+        if (v.size() < s_pool_max) {
+            v.push_back(zs);
+            return;
+        }
+        m_deflate ? deflateEnd(zs) : inflateEnd(zs);
+        delete zs;
+    }
+
+    bool m_deflate;
+    std::unordered_map<int, std::vector<z_stream*> > m_streams;
+};
+
+static thread_local ZStreamPool t_deflate_pool(true);
+static thread_local ZStreamPool t_inflate_pool(false);
+
+static int ClampBits(int bits) {
+    return std::max(9, std::min(15, bits));
+}
+
+struct ExtensionOffer {
+    std::string name;
+    std::vector<std::pair<std::string, std::string> > params;
+};
+
+//解析 "ext1; a; b=1, ext2; c=\"2\""
+static std::vector<ExtensionOffer> ParseExtensions(const std::string& header) {
+    std::vector<ExtensionOffer> rt;
+    for (auto& i : split(header, ',')) {
+        auto parts = split(i, ';');
+        ExtensionOffer offer;
+        offer.name = StringUtil::Trim(parts[0]);
+        if (offer.name.empty()) {
+            continue;
+        }
+        for (size_t n = 1; n < parts.size(); ++n) {
+            std::string p = StringUtil::Trim(parts[n]);
+            if (p.empty()) {
+                continue;
+            }
+            size_t pos = p.find('=');
+            if (pos == std::string::npos) {
+                offer.params.emplace_back(p, "");
+            } else {
+                offer.params.emplace_back(StringUtil::Trim(p.substr(0, pos))
+                        , StringUtil::Trim(p.substr(pos + 1), " \t\""));
+            }
+        }
+        rt.push_back(std::move(offer));
+    }
+    return rt;
+}
+
+//窗口参数取值8-15, 没有值时返回0
+static int ParseBits(const std::string& v) {
+    if (v.empty()) {
+        return 0;
+    }
+    for (auto c : v) {
+        if (!isdigit(c)) {
+            return -1;
+        }
+    }
+    int bits = atoi(v.c_str());
+    return bits >= 8 && bits <= 15 ? bits : -1;
+}
+
+std::string WSDeflateParams::toString() const {
+    std::stringstream ss;
+    ss << "permessage-deflate";
+    if (serverNoContextTakeover) {
+        ss << "; server_no_context_takeover";
+    }
+    if (clientNoContextTakeover) {
+        ss << "; client_no_context_takeover";
+    }
+    ss << "; server_max_window_bits=" << serverMaxWindowBits
+       << "; client_max_window_bits=" << clientMaxWindowBits;
+    return ss.str();
+}
+
+bool WSDeflate::IsEnabled() {
+    return g_ws_deflate_enable->getValue();
+}
+
+size_t WSDeflate::DeflateMemory(int window_bits, int mem_level) {
+    return (1 << (window_bits + 2)) + (1 << (mem_level + 9));
+}
+
+size_t WSDeflate::InflateMemory(int window_bits) {
+    return (1 << window_bits) + 7 * 1024;
+}
+
+WSDeflate::ptr WSDeflate::ServerNegotiate(const std::string& offers, std::string& response) {
+    if (!IsEnabled()) {
+        return nullptr;
+    }
+    for (auto& offer : ParseExtensions(offers)) {
+        if (strcasecmp(offer.name.c_str(), "permessage-deflate")) {
+            continue;
+        }
+        WSDeflateParams params;
+        bool valid = true;
+        int server_bits = 0;        //0表示提议中没有该参数
+        int client_bits = 0;        //-1表示有参数但没有值
+        for (auto& p : offer.params) {
+            if (p.first == "server_no_context_takeover" && p.second.empty()) {
+                params.serverNoContextTakeover = true;
+            } else if (p.first == "client_no_context_takeover" && p.second.empty()) {
+                params.clientNoContextTakeover = true;
+            } else if (p.first == "server_max_window_bits" && ParseBits(p.second) > 0) {
+                server_bits = ParseBits(p.second);
+            } else if (p.first == "client_max_window_bits" && ParseBits(p.second) >= 0) {
+                client_bits = p.second.empty() ? -1 : ParseBits(p.second);
+            } else {
+                valid = false;
+                break;
+            }
+        }
+        //zlib的raw deflate不支持8位窗口, 无法遵守时拒绝这个提议
+        if (!valid || server_bits == 8) {
+            continue;
+        }
+        params.serverNoContextTakeover |= g_ws_deflate_server_no_context_takeover->getValue();
+        params.clientNoContextTakeover |= g_ws_deflate_client_no_context_takeover->getValue();
+
+        int deflate_bits = ClampBits(g_ws_deflate_server_max_window_bits->getValue());
+        if (server_bits > 0) {
+            deflate_bits = std::min(deflate_bits, server_bits);
+        }
+        int inflate_bits = 15;
+        if (client_bits != 0) {
+            inflate_bits = ClampBits(g_ws_deflate_client_max_window_bits->getValue());
+            if (client_bits > 0) {
+                inflate_bits = std::min(inflate_bits, client_bits);
+            }
+        }
+        //按内存预算收缩, 不保留上下文的方向不计入
+        int mem_level = std::max(1, std::min(9, g_ws_deflate_mem_level->getValue()));
+        size_t budget = g_ws_deflate_memory_budget->getValue();
+        auto usage = [&]() {
+            return (params.serverNoContextTakeover ? 0 : DeflateMemory(deflate_bits, mem_level))
+                 + (params.clientNoContextTakeover ? 0 : InflateMemory(inflate_bits));
+        };
+        while (budget && usage() > budget) {
+            if (!params.serverNoContextTakeover && mem_level > 4) {
+                --mem_level;
+            } else if (!params.serverNoContextTakeover && deflate_bits > 9) {
+                --deflate_bits;
+            } else if (!params.clientNoContextTakeover && client_bits != 0 && inflate_bits > 9) {
+                --inflate_bits;
+            } else if (!params.serverNoContextTakeover && mem_level > 1) {
+                --mem_level;
+            } else {
+                break;
+            }
+        }
+        params.serverMaxWindowBits = deflate_bits;
+        params.clientMaxWindowBits = inflate_bits;
+
+        //服务端可以不声明直接使用更小的窗口, server_max_window_bits只在提议中有时回复
+        response = "permessage-deflate";
+        if (params.serverNoContextTakeover) {
+            response += "; server_no_context_takeover";
+        }
+        if (params.clientNoContextTakeover) {
+            response += "; client_no_context_takeover";
+        }
+        if (server_bits > 0) {
+            response += "; server_max_window_bits=" + std::to_string(deflate_bits);
+        }
+        if (client_bits != 0) {
+            response += "; client_max_window_bits=" + std::to_string(inflate_bits);
+        }
+        return std::make_shared<WSDeflate>(true, params, g_ws_deflate_level->getValue(), mem_level);
+    }
+    return nullptr;
+}
+
+std::string WSDeflate::ClientOffer() {
+    std::string rt = "permessage-deflate";
+    if (g_ws_deflate_client_no_context_takeover->getValue()) {
+        rt += "; client_no_context_takeover";
+    }
+    if (g_ws_deflate_server_no_context_takeover->getValue()) {
+        rt += "; server_no_context_takeover";
+    }
+    int server_bits = ClampBits(g_ws_deflate_server_max_window_bits->getValue());
+    if (server_bits < 15) {
+        rt += "; server_max_window_bits=" + std::to_string(server_bits);
+    }
+    rt += "; client_max_window_bits";
+    return rt;
+}
+
+WSDeflate::ptr WSDeflate::ClientAccept(const std::string& response, bool& valid) {
+    valid = true;
+    auto exts = ParseExtensions(response);
+    if (exts.empty()) {
+        return nullptr;
+    }
+    if (exts.size() != 1 || strcasecmp(exts[0].name.c_str(), "permessage-deflate")) {
+        valid = false;
+        return nullptr;
+    }
+    WSDeflateParams params;
+    int client_bits = 15;
+    for (auto& p : exts[0].params) {
+        if (p.first == "server_no_context_takeover" && p.second.empty()) {
+            params.serverNoContextTakeover = true;
+        } else if (p.first == "client_no_context_takeover" && p.second.empty()) {
+            params.clientNoContextTakeover = true;
+        } else if (p.first == "server_max_window_bits" && ParseBits(p.second) > 0) {
+            params.serverMaxWindowBits = ParseBits(p.second);
+        } else if (p.first == "client_max_window_bits" && ParseBits(p.second) > 8) {
+            client_bits = ParseBits(p.second);
+        } else {
+            valid = false;
+            return nullptr;
+        }
+    }
+    params.clientNoContextTakeover |= g_ws_deflate_client_no_context_takeover->getValue();
+    int deflate_bits = std::min(client_bits, ClampBits(g_ws_deflate_client_max_window_bits->getValue()));
+    int mem_level = std::max(1, std::min(9, g_ws_deflate_mem_level->getValue()));
+    size_t budget = g_ws_deflate_memory_budget->getValue();
+    size_t inflate_mem = params.serverNoContextTakeover ? 0 : InflateMemory(params.serverMaxWindowBits);
+    while (budget && !params.clientNoContextTakeover
+            && DeflateMemory(deflate_bits, mem_level) + inflate_mem > budget) {
+        if (mem_level > 4) {
+            --mem_level;
+        } else if (deflate_bits > 9) {
+            --deflate_bits;
+        } else if (mem_level > 1) {
+            --mem_level;
+        } else {
+            break;
+        }
+    }
+    params.clientMaxWindowBits = deflate_bits;
+    return std::make_shared<WSDeflate>(false, params, g_ws_deflate_level->getValue(), mem_level);
+}
+
+WSDeflate::WSDeflate(bool server, const WSDeflateParams& params, int level, int mem_level)
+    :m_server(server)
+    ,m_params(params)
+    ,m_level(level < 0 || level > 9 ? 6 : level)
+    ,m_memLevel(mem_level)
+    ,m_minSize(g_ws_deflate_min_size->getValue()) {
+    if (server) {
+        m_deflateBits = params.serverMaxWindowBits;
+        m_inflateBits = params.clientMaxWindowBits;
+        m_deflateTakeover = !params.serverNoContextTakeover;
+        m_inflateTakeover = !params.clientNoContextTakeover;
+    } else {
+        m_deflateBits = params.clientMaxWindowBits;
+        m_inflateBits = params.serverMaxWindowBits;
+        m_deflateTakeover = !params.clientNoContextTakeover;
+        m_inflateTakeover = !params.serverNoContextTakeover;
+    }
+    //协商结果可以是8, 但zlib压缩端会把8位窗口提升为9, 解压窗口不小于9才能还原对端的数据
+    m_deflateBits = ClampBits(m_deflateBits);
+    m_inflateBits = ClampBits(m_inflateBits);
+}
+
+WSDeflate::~WSDeflate() {
+    //连接独占的z_stream重置后还给当前线程的池
+    if (m_deflate) {
+        m_deflateTakeover = false;
+        releaseDeflate(m_deflate, true);
+    }
+    if (m_inflate) {
+        m_inflateTakeover = false;
+        releaseInflate(m_inflate, true);
+    }
+}
+
+size_t WSDeflate::getMemoryUsage() const {
+    return (m_deflateTakeover ? DeflateMemory(m_deflateBits, m_memLevel) : 0)
+         + (m_inflateTakeover ? InflateMemory(m_inflateBits) : 0);
+}
+
+z_stream* WSDeflate::acquireDeflate() {
+    if (m_deflateTakeover && m_deflate) {
+        return m_deflate;
+    }
+    z_stream* zs = t_deflate_pool.get(m_level << 8 | m_deflateBits << 4 | m_memLevel);
+    if (!zs) {
+        zs = new z_stream;
+        memset(zs, 0, sizeof(*zs));
+        if (deflateInit2(zs, m_level, Z_DEFLATED, -m_deflateBits, m_memLevel, Z_DEFAULT_STRATEGY) != Z_OK) {
+            CHAT_LOG_ERROR(g_logger) << "deflateInit2 fail window_bits=" << m_deflateBits
+                << " mem_level=" << m_memLevel;
+            delete zs;
+            return nullptr;
+        }
+    }
+    if (m_deflateTakeover) {
+        m_deflate = zs;
+    }
+    return zs;
+}
+
+void WSDeflate::releaseDeflate(z_stream* zs, bool reset) {
+    if (m_deflateTakeover) {
+        if (reset) {
+            deflateReset(zs);
+        }
+        return;
+    }
+    if (zs == m_deflate) {
+        m_deflate = nullptr;
+    }
+    deflateReset(zs);
+    t_deflate_pool.put(m_level << 8 | m_deflateBits << 4 | m_memLevel, zs);
+}
+
+z_stream* WSDeflate::acquireInflate() {
+    if (m_inflateTakeover && m_inflate) {
+        return m_inflate;
+    }
+    z_stream* zs = t_inflate_pool.get(m_inflateBits);
+    if (!zs) {
+        zs = new z_stream;
+        memset(zs, 0, sizeof(*zs));
+        if (inflateInit2(zs, -m_inflateBits) != Z_OK) {
+            CHAT_LOG_ERROR(g_logger) << "inflateInit2 fail window_bits=" << m_inflateBits;
+            delete zs;
+            return nullptr;
+        }
+    }
+    if (m_inflateTakeover) {
+        m_inflate = zs;
+    }
+    return zs;
+}
+
+void WSDeflate::releaseInflate(z_stream* zs, bool reset) {
+    if (m_inflateTakeover) {
+        if (reset) {
+            inflateReset(zs);
+        }
+        return;
+    }
+    if (zs == m_inflate) {
+        m_inflate = nullptr;
+    }
+    inflateReset(zs);
+    t_inflate_pool.put(m_inflateBits, zs);
+}
+
+bool WSDeflate::compress(const void* data, size_t len, std::string& out) {
+    out.clear();
+    if (len == 0) {
+        return false;
+    }
+    z_stream* zs = acquireDeflate();
+    if (!zs) {
+        return false;
+    }
+    out.resize(len + len / 1000 + 64);
+    size_t pos = 0;
+    bool ok = true;
+    zs->next_in = (Bytef*)data;
+    zs->avail_in = len;
+    do {
+        if (pos == out.size()) {
+            out.resize(out.size() * 2);
+        }
+        zs->next_out = (Bytef*)&out[pos];
+        zs->avail_out = out.size() - pos;
+        int rt = deflate(zs, Z_SYNC_FLUSH);
+        pos = out.size() - zs->avail_out;
+        if (rt != Z_OK && rt != Z_BUF_ERROR) {
+            ok = false;
+            break;
+        }
+    } while (zs->avail_out == 0);
+    if (ok && pos >= 4 && memcmp(&out[pos - 4], s_tail, 4) == 0) {
+        pos -= 4;
+    } else {
+        ok = false;
+    }
+    out.resize(pos);
+    //压缩后没有变小时发送原文; 发送方重置上下文后, 之后的消息不会引用对端没有见过的数据
+    if (ok && out.size() >= len) {
+        ok = false;
+    }
+    releaseDeflate(zs, !ok);
+    if (!ok) {
+        out.clear();
+        return false;
+    }
+    ++m_stats.messages;
+    m_stats.bytesIn += len;
+    m_stats.bytesOut += out.size();
+    return true;
+}
+
+bool WSDeflate::decompress(const void* data, size_t len, std::string& out, size_t max_size) {
+    out.clear();
+    z_stream* zs = acquireInflate();
+    if (!zs) {
+        return false;
+    }
+    size_t pos = 0;
+    out.resize(std::min(max_size, std::max(len * 4, (size_t)1024)));
+    auto run = [&](const void* in, size_t n) {
+        zs->next_in = (Bytef*)in;
+        zs->avail_in = n;
+        while (true) {
+            if (pos == out.size()) {
+                if (out.size() >= max_size) {
+                    return false;
+                }
+                out.resize(std::min(max_size, out.size() * 2));
+            }
+            zs->next_out = (Bytef*)&out[pos];
+            zs->avail_out = out.size() - pos;
+            int rt = inflate(zs, Z_SYNC_FLUSH);
+            pos = out.size() - zs->avail_out;
+            if (rt == Z_STREAM_END) {
+                //对端用了BFINAL结束, 之后的数据是新的deflate流
+                inflateReset(zs);
+            } else if (rt != Z_OK && rt != Z_BUF_ERROR) {
+                return false;
+            }
+            if (zs->avail_in == 0 && zs->avail_out != 0) {
+                return true;
+            }
+            if (rt == Z_BUF_ERROR && zs->avail_out != 0) {
+                return false;
+            }
+        }
+    };
+    bool ok = run(data, len) && run(s_tail, sizeof(s_tail));
+    out.resize(ok ? pos : 0);
+    releaseInflate(zs, !ok);
+    if (ok) {
+        ++m_stats.inflated;
+    }
+    return ok;
+}
+
+}
+}
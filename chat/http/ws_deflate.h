@@ -0,0 +1,94 @@
+#ifndef __CHAT_HTTP_WS_DEFLATE_H__
+#define __CHAT_HTTP_WS_DEFLATE_H__
+
+#include <memory>
+#include <string>
+#include <stdint.h>
+#include <zlib.h>
+
+namespace chat {
+namespace http {
+
+//permessage-deflate(RFC 7692)协商得到的参数
+struct WSDeflateParams {
+    bool serverNoContextTakeover = false;
+    bool clientNoContextTakeover = false;
+    int serverMaxWindowBits = 15;
+    int clientMaxWindowBits = 15;
+
+    std::string toString() const;
+};
+
+//WebSocket消息压缩: 每条消息用raw deflate压缩, 以Z_SYNC_FLUSH结束并去掉结尾的00 00 ff ff
+//保留上下文(context takeover)时连接独占z_stream, 跨消息共享滑动窗口, 压缩率更高;
+//不保留上下文的方向每条消息结束后reset, z_stream从线程内的池中借用, 空闲连接不占压缩内存
+//窗口大小和memLevel按websocket.deflate.memory_budget收缩, 限制每个连接的压缩内存
+class WSDeflate {
+public:
+    typedef std::shared_ptr<WSDeflate> ptr;
+
+    struct Stats {
+        uint64_t messages = 0;      //压缩的消息数
+        uint64_t bytesIn = 0;       //压缩前字节数
+        uint64_t bytesOut = 0;      //压缩后字节数
+        uint64_t inflated = 0;      //解压的消息数
+    };
+
+    //websocket.deflate.enable
+    static bool IsEnabled();
+
+    //服务端: 从Sec-WebSocket-Extensions中选第一个能接受的permessage-deflate提议
+    //接受时返回对象并把响应头的值写入response, 没有可接受的提议返回nullptr
+    static WSDeflate::ptr ServerNegotiate(const std::string& offers, std::string& response);
+
+    //客户端: 握手请求中Sec-WebSocket-Extensions的值
+    static std::string ClientOffer();
+    //客户端: 解析服务端的响应, 没有协商permessage-deflate返回nullptr
+    //响应中的参数无法遵守(如未知参数, 窗口小于9)时valid置为false, 应断开连接
+    static WSDeflate::ptr ClientAccept(const std::string& response, bool& valid);
+
+    WSDeflate(bool server, const WSDeflateParams& params, int level, int mem_level);
+    ~WSDeflate();
+
+    //压缩一条消息到out; 失败或压缩后没有变小时重置压缩上下文并返回false, 调用方发送原文
+    bool compress(const void* data, size_t len, std::string& out);
+    //解压一条消息到out, 解压后超过max_size返回false
+    bool decompress(const void* data, size_t len, std::string& out, size_t max_size);
+
+    bool isServer() const { return m_server;}
+    //小于该长度的消息不压缩
+    size_t getMinSize() const { return m_minSize;}
+    const WSDeflateParams& getParams() const { return m_params;}
+    int getDeflateWindowBits() const { return m_deflateBits;}
+    int getInflateWindowBits() const { return m_inflateBits;}
+    int getMemLevel() const { return m_memLevel;}
+    //保留上下文时连接独占的zlib内存估算
+    size_t getMemoryUsage() const;
+    const Stats& getStats() const { return m_stats;}
+
+    static size_t DeflateMemory(int window_bits, int mem_level);
+    static size_t InflateMemory(int window_bits);
+private:
+    z_stream* acquireDeflate();
+    void releaseDeflate(z_stream* zs, bool ok);
+    z_stream* acquireInflate();
+    void releaseInflate(z_stream* zs, bool ok);
+private:
+    bool m_server;
+    WSDeflateParams m_params;
+    int m_level;
+    int m_memLevel;
+    int m_deflateBits;
+    int m_inflateBits;
+    bool m_deflateTakeover;
+    bool m_inflateTakeover;
+    size_t m_minSize;
+    z_stream* m_deflate = nullptr;
+    z_stream* m_inflate = nullptr;
+    Stats m_stats;
+};
+
+}
+}
+
+#endif
@@ -3,6 +3,9 @@
 #include "chat/endian.h"
 #include <string.h>
 #include "chat/util.h"
+#include "http_simd.h"
+#include "chat/hook.h"
+#include "chat/iomanager.h"
 
 namespace chat {
 namespace http {
@@ -13,8 +16,35 @@ chat::ConfigVar<uint32_t>::ptr g_websocket_message_max_size
     = chat::Config::Lookup("websocket.message.max_size"
             ,(uint32_t) 1024 * 1024 * 32, "websocket message max size");
 
+static chat::ConfigVar<uint32_t>::ptr g_websocket_send_queue_max_frames
+    = chat::Config::Lookup("websocket.send_queue.max_frames"
+            ,(uint32_t) 1024, "websocket per session send queue max frames");
+
+static chat::ConfigVar<uint64_t>::ptr g_websocket_send_queue_max_bytes
+    = chat::Config::Lookup("websocket.send_queue.max_bytes"
+            ,(uint64_t) 4 * 1024 * 1024, "websocket per session send queue max bytes");
+
+namespace {
+
+struct WriteGuard {
+    WriteGuard(FiberSemaphore& sem)
+        :m_sem(sem) {
+        m_sem.wait();
+    }
+    ~WriteGuard() {
+        m_sem.notify();
+    }
+    FiberSemaphore& m_sem;
+};
+
+}
+
 WSSession::WSSession(Socket::ptr sock, bool owner)
-    :HttpSession(sock, owner) {
+    :HttpSession(sock, owner)
+    ,m_writeSem(1)
+    ,m_queuedBytes(0)
+    ,m_iom(IOManager::GetThis())
+    ,m_threadId(chat::GetThreadId()) {
 }
 
 HttpRequest::ptr WSSession::handleShake() {
@@ -54,6 +84,14 @@ HttpRequest::ptr WSSession::handleShake() {
         rsp->setHeader("Upgrade", "websocket");
         rsp->setHeader("Connection", "Upgrade");
         rsp->setHeader("Sec-WebSocket-Accept", v);
+        std::string ext = req->getHeader("Sec-WebSocket-Extensions");
+        if(!ext.empty()) {
+            std::string value;
+            m_deflate = WSDeflate::ServerNegotiate(ext, value);
+            if(m_deflate) {
+                rsp->setHeader("Sec-WebSocket-Extensions", value);
+            }
+        }
 
         sendResponse(rsp);
         CHAT_LOG_DEBUG(g_logger) << *req;
@@ -85,25 +123,123 @@ std::string WSFrameHead::toString() const {
 }
 
 WSFrameMessage::ptr WSSession::recvMessage() {
-    return WSRecvMessage(this, false);
+    return WSRecvMessage(this, false, m_deflate.get());
 }
 
 int32_t WSSession::sendMessage(WSFrameMessage::ptr msg, bool fin) {
-    return WSSendMessage(this, msg, false, fin);
+    WriteGuard guard(m_writeSem);
+    return WSSendMessage(this, msg, false, fin, m_deflate.get());
 }
 
 int32_t WSSession::sendMessage(const std::string& msg, int32_t opcode, bool fin) {
-    return WSSendMessage(this, std::make_shared<WSFrameMessage>(opcode, msg), false, fin);
+    WriteGuard guard(m_writeSem);
+    return WSSendMessage(this, std::make_shared<WSFrameMessage>(opcode, msg), false, fin, m_deflate.get());
 }
 
 int32_t WSSession::ping() {
+    WriteGuard guard(m_writeSem);
     return WSPing(this);
 }
 
-WSFrameMessage::ptr WSRecvMessage(Stream* stream, bool client) {
+bool WSSession::sendFrame(WSFrameBuffer frame) {
+    size_t size = frame->size();
+    if(!size) {
+        return true;
+    }
+    //写不完的部分要由写协程继续, 不在IOManager中创建的会话不支持
+    if(!m_iom) {
+        return false;
+    }
+    //SSL连接不能绕过Socket直接写fd, 只走写协程
+    bool direct = false;
+    {
+        MutexType::Lock lock(m_queueMutex);
+        if(!m_writing && m_queue.empty() && !dynamic_cast<SSLSocket*>(m_socket.get())
+                && m_writeSem.tryWait()) {
+            direct = true;
+        } else {
+            if(m_queue.size() >= g_websocket_send_queue_max_frames->getValue()
+                    || m_queuedBytes + size > g_websocket_send_queue_max_bytes->getValue()) {
+                return false;
+            }
+            m_queue.push_back({frame, 0});
+            m_queuedBytes += size;
+            if(m_writing) {
+                return true;
+            }
+        }
+        m_writing = true;
+    }
+
+    if(direct) {
+        //fd是非阻塞的, 用原始send写, 不会让出协程
+        ssize_t rt = send_f(m_socket->getSocket(), frame->c_str(), size, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if(rt < 0 && errno != EAGAIN && errno != EINTR) {
+            m_writeSem.notify();
+            MutexType::Lock lock(m_queueMutex);
+            m_writing = false;
+            lock.unlock();
+            close();
+            return false;
+        }
+        size_t written = rt > 0 ? rt : 0;
+        //只写出一部分时继续持有写锁, 由写协程写完剩下的部分再释放
+        if(written == 0 || written == size) {
+            m_writeSem.notify();
+        }
+        MutexType::Lock lock(m_queueMutex);
+        //没写完的部分排在直接写期间进队的帧前面
+        if(written < size) {
+            m_queue.push_front({frame, written});
+            m_queuedBytes += size - written;
+        }
+        if(m_queue.empty()) {
+            m_writing = false;
+            return true;
+        }
+    }
+    m_iom->schedule(std::bind(&WSSession::drain
+                , std::static_pointer_cast<WSSession>(shared_from_this())));
+    return true;
+}
+
+void WSSession::drain() {
+    while(true) {
+        QueuedFrame item;
+        {
+            MutexType::Lock lock(m_queueMutex);
+            if(m_queue.empty()) {
+                m_writing = false;
+                return;
+            }
+            item = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        size_t len = item.frame->size() - item.offset;
+        //offset不为0的是直接写剩下的部分, 写锁还没有释放
+        if(!item.offset) {
+            m_writeSem.wait();
+        }
+        int rt = writeFixSize(item.frame->c_str() + item.offset, len);
+        m_writeSem.notify();
+        m_queuedBytes -= len;
+        if(rt <= 0) {
+            MutexType::Lock lock(m_queueMutex);
+            m_queue.clear();
+            m_queuedBytes = 0;
+            m_writing = false;
+            lock.unlock();
+            close();
+            return;
+        }
+    }
+}
+
+WSFrameMessage::ptr WSRecvMessage(Stream* stream, bool client, WSDeflate* deflate) {
     int opcode = 0;
     std::string data;
     int cur_len = 0;
+    bool compressed = false;
     do {
         WSFrameHead ws_head;
         if(stream->readFixSize(&ws_head, sizeof(ws_head)) <= 0) {
@@ -113,7 +249,9 @@ WSFrameMessage::ptr WSRecvMessage(Stream* stream, bool client) {
 
         if(ws_head.opcode == WSFrameHead::PING) {
             CHAT_LOG_INFO(g_logger) << "PING";
-            if(WSPong(stream) <= 0) {
+            //服务端会话的pong要和发送队列的写出互斥
+            WSSession* session = client ? nullptr : dynamic_cast<WSSession*>(stream);
+            if((session ? session->pong() : WSPong(stream)) <= 0) {
                 break;
             }
         } else if(ws_head.opcode == WSFrameHead::PONG) {
@@ -124,6 +262,14 @@ WSFrameMessage::ptr WSRecvMessage(Stream* stream, bool client) {
                 CHAT_LOG_INFO(g_logger) << "WSFrameHead mask != 1, mask=" << ws_head.mask;
                 break;
             }
+            //RSV1只能出现在消息的第一帧, 且必须协商过permessage-deflate
+            if(ws_head.rsv1) {
+                if(!deflate || ws_head.opcode == WSFrameHead::CONTINUE) {
+                    CHAT_LOG_INFO(g_logger) << "unexpected rsv1 " << ws_head.toString();
+                    break;
+                }
+                compressed = true;
+            }
             uint64_t length = 0;
             if(ws_head.payload == 126) {
                 uint16_t len = 0;
@@ -159,9 +305,7 @@ WSFrameMessage::ptr WSRecvMessage(Stream* stream, bool client) {
                 break;
             }
             if(ws_head.mask) {
-                for(int i = 0; i < (int)length; ++i) {
-                    data[cur_len + i] ^= mask[i % 4];
-                }
+                WSMask(&data[cur_len], &data[cur_len], length, mask);
             }
             cur_len += length;
 
@@ -170,6 +314,15 @@ WSFrameMessage::ptr WSRecvMessage(Stream* stream, bool client) {
             }
 
             if(ws_head.fin) {
+                if(compressed) {
+                    std::string plain;
+                    if(!deflate->decompress(data.c_str(), data.size(), plain
+                                , g_websocket_message_max_size->getValue())) {
+                        CHAT_LOG_WARN(g_logger) << "WSFrameMessage inflate fail, size=" << data.size();
+                        break;
+                    }
+                    data.swap(plain);
+                }
                 CHAT_LOG_INFO(g_logger) << data;
                 return std::make_shared<WSFrameMessage>(opcode, std::move(data));
             }
@@ -181,52 +334,94 @@ WSFrameMessage::ptr WSRecvMessage(Stream* stream, bool client) {
     return nullptr;
 }
 
-int32_t WSSendMessage(Stream* stream, WSFrameMessage::ptr msg, bool client, bool fin) {
+//写入帧头和扩展长度, 返回长度; head至少要有sizeof(WSFrameHead) + 8字节
+static size_t WSEncodeHead(char* head, const WSFrameHead& ws_head, uint64_t size) {
+    size_t head_len = 0;
+    memcpy(head, &ws_head, sizeof(ws_head));
+    head_len += sizeof(ws_head);
+    if(ws_head.payload == 126) {
+        uint16_t len = size;
+        len = chat::byteswapOnLittleEndian(len);
+        memcpy(head + head_len, &len, sizeof(len));
+        head_len += sizeof(len);
+    } else if(ws_head.payload == 127) {
+        uint64_t len = chat::byteswapOnLittleEndian(size);
+        memcpy(head + head_len, &len, sizeof(len));
+        head_len += sizeof(len);
+    }
+    return head_len;
+}
+
+static void WSSetPayloadLen(WSFrameHead& ws_head, uint64_t size) {
+    if(size < 126) {
+        ws_head.payload = size;
+    } else if(size < 65536) {
+        ws_head.payload = 126;
+    } else {
+        ws_head.payload = 127;
+    }
+}
+
+WSFrameBuffer WSEncodeFrame(const std::string& data, int32_t opcode, bool fin) {
+    WSFrameHead ws_head;
+    memset(&ws_head, 0, sizeof(ws_head));
+    ws_head.fin = fin;
+    ws_head.opcode = opcode;
+    WSSetPayloadLen(ws_head, data.size());
+    char head[sizeof(ws_head) + 8];
+    size_t head_len = WSEncodeHead(head, ws_head, data.size());
+    auto frame = std::make_shared<std::string>();
+    frame->reserve(head_len + data.size());
+    frame->append(head, head_len);
+    frame->append(data);
+    return frame;
+}
+
+int32_t WSSendMessage(Stream* stream, WSFrameMessage::ptr msg, bool client, bool fin
+                      , WSDeflate* deflate) {
     do {
         WSFrameHead ws_head;
         memset(&ws_head, 0, sizeof(ws_head));
         ws_head.fin = fin;
         ws_head.opcode = msg->getOpcode();
         ws_head.mask = client;
-        uint64_t size = msg->getData().size();
-        if(size < 126) {
-            ws_head.payload = size;
-        } else if(size < 65536) {
-            ws_head.payload = 126;
-        } else {
-            ws_head.payload = 127;
-        }
-        
-        if(stream->writeFixSize(&ws_head, sizeof(ws_head)) <= 0) {
-            break;
-        }
-        if(ws_head.payload == 126) {
-            uint16_t len = size;
-            len = chat::byteswapOnLittleEndian(len);
-            if(stream->writeFixSize(&len, sizeof(len)) <= 0) {
-                break;
-            }
-        } else if(ws_head.payload == 127) {
-            uint64_t len = chat::byteswapOnLittleEndian(size);
-            if(stream->writeFixSize(&len, sizeof(len)) <= 0) {
-                break;
-            }
+        //只压缩不分片的文本/二进制消息
+        std::string* payload = &msg->getData();
+        std::string compressed;
+        if(deflate && fin && payload->size() >= deflate->getMinSize()
+                && (ws_head.opcode == WSFrameHead::TEXT_FRAME || ws_head.opcode == WSFrameHead::BIN_FRAME)
+                && deflate->compress(payload->c_str(), payload->size(), compressed)) {
+            payload = &compressed;
+            ws_head.rsv1 = 1;
         }
+        uint64_t size = payload->size();
+        WSSetPayloadLen(ws_head, size);
+
+        //帧头、扩展长度和掩码一起写出
+        char head[sizeof(ws_head) + 8 + 4];
+        size_t head_len = WSEncodeHead(head, ws_head, size);
         if(client) {
+            //掩码写到单独的缓冲区, 不修改调用方的消息
             char mask[4];
             uint32_t rand_value = rand();
             memcpy(mask, &rand_value, sizeof(mask));
-            std::string& data = msg->getData();
-            for(size_t i = 0; i < data.size(); ++i) {
-                data[i] ^= mask[i % 4];
-            }
+            memcpy(head + head_len, mask, sizeof(mask));
+            head_len += sizeof(mask);
 
-            if(stream->writeFixSize(mask, sizeof(mask)) <= 0) {
+            std::string frame;
+            frame.resize(head_len + size);
+            memcpy(&frame[0], head, head_len);
+            WSMask(&frame[head_len], payload->c_str(), size, mask);
+            if(stream->writeFixSize(frame.c_str(), frame.size()) <= 0) {
+                break;
+            }
+        } else {
+            if(stream->writeFixSize(head, head_len) <= 0) {
+                break;
+            }
+            if(stream->writeFixSize(payload->c_str(), size) <= 0) {
                 break;
             }
-        }
-        if(stream->writeFixSize(msg->getData().c_str(), size) <= 0) {
-            break;
         }
         return size + sizeof(ws_head);
     } while(0);
@@ -235,6 +430,7 @@ int32_t WSSendMessage(Stream* stream, WSFrameMessage::ptr msg, bool client, bool
 }
 
 int32_t WSSession::pong() {
+    WriteGuard guard(m_writeSem);
     return WSPong(this);
 }
 
@@ -3,9 +3,16 @@
 
 #include "chat/config.h"
 #include "chat/http/http_session.h"
+#include "chat/http/ws_deflate.h"
+#include "chat/mutex.h"
+#include <atomic>
+#include <deque>
 #include <stdint.h>
 
 namespace chat {
+
+class IOManager;
+
 namespace http {
 
 #pragma pack(1)
@@ -49,9 +56,13 @@ private:
     std::string m_data;
 };
 
+//编码好的整帧(WSEncodeFrame), 广播时所有会话共享同一份
+typedef std::shared_ptr<const std::string> WSFrameBuffer;
+
 class WSSession : public HttpSession {
 public:
     typedef std::shared_ptr<WSSession> ptr;
+    typedef Spinlock MutexType;
     WSSession(Socket::ptr sock, bool owner = true);
 
     HttpRequest::ptr handleShake();
@@ -61,14 +72,50 @@ public:
     int32_t sendMessage(const std::string& msg, int32_t opcode = WSFrameHead::TEXT_FRAME, bool fin = true);
     int32_t ping();
     int32_t pong();
+
+    //发送编码好的帧, 不阻塞调用方: 没有待发数据时直接非阻塞写,
+    //写不完的部分放进发送队列, 由会话所在IOManager上的写协程按序写出
+    //队列超过websocket.send_queue.max_frames或max_bytes时返回false, 该帧不发送
+    bool sendFrame(WSFrameBuffer frame);
+    //发送队列中未写出的字节数
+    size_t getQueuedBytes() const { return m_queuedBytes;}
+
+    //创建会话的协程所在的IOManager和线程, 广播按此分组
+    IOManager* getIOManager() const { return m_iom;}
+    pid_t getThreadId() const { return m_threadId;}
+
+    //握手时协商了permessage-deflate才不为空
+    WSDeflate::ptr getDeflate() const { return m_deflate;}
 private:
     bool handleServerShake();
     bool handleClientShake();
+    void drain();
+private:
+    struct QueuedFrame {
+        WSFrameBuffer frame;
+        size_t offset;
+    };
+
+    WSDeflate::ptr m_deflate;
+    //sendMessage/ping/pong与发送队列的写出互斥, 保证一帧的字节连续
+    FiberSemaphore m_writeSem;
+    MutexType m_queueMutex;
+    std::deque<QueuedFrame> m_queue;
+    std::atomic<size_t> m_queuedBytes;
+    //有写协程或直接写正在进行
+    bool m_writing = false;
+    IOManager* m_iom;
+    pid_t m_threadId;
 };
 
 extern chat::ConfigVar<uint32_t>::ptr g_websocket_message_max_size;
-WSFrameMessage::ptr WSRecvMessage(Stream* stream, bool client);
-int32_t WSSendMessage(Stream* stream, WSFrameMessage::ptr msg, bool client, bool fin);
+//deflate不为空时解压RSV1置位的消息, 发送时压缩完整的文本/二进制消息
+WSFrameMessage::ptr WSRecvMessage(Stream* stream, bool client, WSDeflate* deflate = nullptr);
+int32_t WSSendMessage(Stream* stream, WSFrameMessage::ptr msg, bool client, bool fin
+                      , WSDeflate* deflate = nullptr);
+//编码服务端发送的整帧(不带掩码, 不压缩)
+WSFrameBuffer WSEncodeFrame(const std::string& data, int32_t opcode = WSFrameHead::TEXT_FRAME
+                            , bool fin = true);
 int32_t WSPing(Stream* stream);
 int32_t WSPong(Stream* stream);
 
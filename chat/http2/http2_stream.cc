@@ -229,7 +229,7 @@ int32_t Http2Stream::sendRequest(chat::http::HttpRequest::ptr req, bool end_stre
 
     data->hpack = std::make_shared<HPack>(stream->m_sendTable);
     for(auto& i : m) {
-        data->kvs.emplace_back(chat::ToLower(i.first), i.second);
+        data->kvs.emplace_back(chat::ToLower(std::string(i.first)), i.second);
     }
     // debug stream_id
     data->kvs.push_back(std::make_pair("stream_id", std::to_string(m_id)));
@@ -270,7 +270,7 @@ int32_t Http2Stream::sendHeaders(const std::map<std::string, std::string>& m, bo
 
     data->hpack = std::make_shared<HPack>(stream->getSendTable());
     for(auto& i : m) {
-        data->kvs.emplace_back(chat::ToLower(i.first), i.second);
+        data->kvs.emplace_back(chat::ToLower(std::string(i.first)), i.second);
     }
     headers->data = data;
     int ok = stream->sendFrame(headers, async);
@@ -315,11 +315,11 @@ int32_t Http2Stream::sendResponse(http::HttpResponse::ptr rsp, bool end_stream,
 
     data->hpack = std::make_shared<HPack>(stream->getSendTable());
     for(auto& i : m) {
-        if(trailers.count(i.first)) {
+        if(trailers.count(std::string(i.first))) {
             continue;
         }
 
-        data->kvs.emplace_back(chat::ToLower(i.first), i.second);
+        data->kvs.emplace_back(chat::ToLower(std::string(i.first)), i.second);
     }
     headers->data = data;
     int ok = stream->sendFrame(headers, async);
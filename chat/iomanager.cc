@@ -1,8 +1,11 @@
 #include "iomanager.h"
 #include "macro.h"
 #include "log.h"
+#include "config.h"
+#include "clock.h"
 #include <unistd.h>
 #include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
@@ -11,6 +14,9 @@ namespace chat {
 
 static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
 
+static chat::ConfigVar<bool>::ptr g_iomanager_timerfd =
+    chat::Config::Lookup("iomanager.timerfd", false, "drive timers by timerfd instead of epoll_wait timeout");
+
 IOManager::FdContext::EventContext& IOManager::FdContext::getContext(IOManager::Event event) {
     switch (event) {
         case IOManager::READ:
@@ -49,8 +55,9 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event) {
     return;
 }
 
-IOManager::IOManager(size_t threads, bool use_caller, const std::string& name) 
-    :Scheduler(threads, use_caller, name) {
+IOManager::IOManager(size_t threads, bool use_caller, const std::string& name
+                     ,const std::vector<int>& cpus)
+    :Scheduler(threads, use_caller, name, cpus) {
     m_epfd = epoll_create(5000);
     CHAT_ASSERT(m_epfd > 0);
 
@@ -68,6 +75,17 @@ IOManager::IOManager(size_t threads, bool use_caller, const std::string& name)
     rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);
     CHAT_ASSERT(!rt);
 
+    if (g_iomanager_timerfd->getValue()) {
+        m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        CHAT_ASSERT(m_timerFd >= 0);
+
+        memset(&event, 0, sizeof(epoll_event));
+        event.events = EPOLLIN | EPOLLET;
+        event.data.fd = m_timerFd;
+        rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_timerFd, &event);
+        CHAT_ASSERT(!rt);
+    }
+
     contextResize(32);
 
     start();
@@ -78,6 +96,9 @@ IOManager::~IOManager() {
     close(m_epfd);
     close(m_tickleFds[0]);
     close(m_tickleFds[1]);
+    if (m_timerFd >= 0) {
+        close(m_timerFd);
+    }
 
     for (size_t i = 0; i < m_fdcontexts.size(); i++) {
         if (m_fdcontexts[i]) {
@@ -265,6 +286,24 @@ bool IOManager::stopping(uint64_t& timeout) {
     return timeout == ~0ull && m_pendingEventCount == 0 && Scheduler::stopping();
 }
 
+uint64_t IOManager::armTimerFd() {
+    Mutex::Lock lock(m_timerFdMutex);
+    uint64_t us = getNextTimerUs();
+    itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (us != ~0ull) {
+        uint64_t v = us ? us : 1;  //it_value全0表示取消
+        its.it_value.tv_sec = v / 1000000;
+        its.it_value.tv_nsec = v % 1000000 * 1000;
+    }
+    int rt = timerfd_settime(m_timerFd, 0, &its, nullptr);
+    if (rt) {
+        CHAT_LOG_ERROR(g_logger) << "timerfd_settime(" << m_timerFd << ", " << us << "):"
+            << rt << " (" << errno << ") (" << strerror(errno) << ")";
+    }
+    return us;
+}
+
 void IOManager::idle() {
     epoll_event* events = new epoll_event[64]();
     std::shared_ptr<epoll_event> shared_events(events, [](epoll_event* ptr){
@@ -281,10 +320,18 @@ void IOManager::idle() {
         do {
             static const int MAX_TIMEOUT = 5000;
             if (next_timeout != ~0ull) {
-                next_timeout = (int)next_timeout > MAX_TIMEOUT ? MAX_TIMEOUT : next_timeout;
+                next_timeout = next_timeout > (uint64_t)MAX_TIMEOUT ? MAX_TIMEOUT : next_timeout;
             } else {
                 next_timeout = MAX_TIMEOUT;
             }
+            if (m_timerFd >= 0 && next_timeout) {  //微秒精度由timerfd保证
+                uint64_t next_us = armTimerFd();
+                if (next_us == 0) {
+                    next_timeout = 0;
+                } else if (next_us < MAX_TIMEOUT * 1000ull) {
+                    next_timeout = MAX_TIMEOUT;
+                }
+            }
             rt = epoll_wait(m_epfd, events, 64, (int)next_timeout);
 
             if (rt < 0 && errno == EINTR) {
@@ -293,7 +340,8 @@ void IOManager::idle() {
                 break;
             }
         } while (true);
-        
+
+        chat::Clock::Refresh();  //本轮后续的定时器/日志/统计都读缓存时间
         std::vector<std::function<void()> > cbs;
         listExpiredCb(cbs);
         if (!cbs.empty()) {
@@ -308,6 +356,11 @@ void IOManager::idle() {
                 while (read(m_tickleFds[0], &dummy, 1) == 1);
                 continue;
             }
+            if (m_timerFd >= 0 && event.data.fd == m_timerFd) {
+                uint64_t expirations;
+                while (read(m_timerFd, &expirations, sizeof(expirations)) == sizeof(expirations));
+                continue;
+            }
 
             FdContext* fd_ctx = (FdContext*)event.data.ptr;
             FdContext::MutexType::Lock lock(fd_ctx->mutex);
@@ -357,6 +410,10 @@ void IOManager::idle() {
 }
 
 void IOManager::onTimerInsertedAtFront() {
+    if (m_timerFd >= 0) {
+        armTimerFd();  //直接重设timerfd, 不用唤醒idle线程
+        return;
+    }
     tickle();
 }
 
@@ -37,7 +37,8 @@ private:
         MutexType mutex;
     };
 public:
-    IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = "");
+    IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = ""
+              ,const std::vector<int>& cpus = {});
     ~IOManager();
 
     int addEvent(int fd, Event event, std::function<void()> cb = nullptr);
@@ -55,10 +56,14 @@ protected:
 
     void contextResize(size_t size);
     bool stopping(uint64_t& timeout);
+    //按当前最近的定时器重设timerfd, 返回距其触发的微秒数(~0ull表示没有定时器)
+    uint64_t armTimerFd();
 
 private:
     int m_epfd = 0;
     int m_tickleFds[2];
+    int m_timerFd = -1;  //iomanager.timerfd开启时用timerfd驱动定时器
+    Mutex m_timerFdMutex;  //取最近定时器和重设timerfd必须原子, 否则旧值会覆盖新值
 
     std::atomic<size_t> m_pendingEventCount = {0}; //等待执行的事件数量
     RWMutexType m_mutex;
@@ -17,6 +17,7 @@
 #include "util.h"
 #include "singleton.h"
 #include "thread.h"
+#include "clock.h"
 
 /**
  * @brief 使用流式方式将日志级别level的日志写入到logger
@@ -25,7 +26,7 @@
     if(logger->getLevel() <= level) \
         chat::LogEventWrap(std::make_shared<chat::LogEvent>(logger, level, \
                         __FILE__, __LINE__, 0, chat::GetThreadId(),\
-                chat::GetFiberId(), time(0), chat::Thread::GetName())).getSS()
+                chat::GetFiberId(), chat::Clock::CachedSec(), chat::Thread::GetName())).getSS()
 
 #define CHAT_LOG_DEBUG(logger) CHAT_LOG_LEVEL(logger, chat::LogLevel::DEBUG)
 #define CHAT_LOG_INFO(logger) CHAT_LOG_LEVEL(logger, chat::LogLevel::INFO)
@@ -37,7 +38,7 @@
     if(logger->getLevel() <= level) \
         chat::LogEventWrap(std::make_shared<chat::LogEvent>(logger, level, \
                         __FILE__, __LINE__, 0, chat::GetThreadId(),\
-                chat::GetFiberId(), time(0), chat::Thread::GetName())).getEvent()->format(fmt, __VA_ARGS__)
+                chat::GetFiberId(), chat::Clock::CachedSec(), chat::Thread::GetName())).getEvent()->format(fmt, __VA_ARGS__)
 
 #define CHAT_LOG_FMT_DEBUG(logger, fmt, ...) CHAT_LOG_FMT_LEVEL(logger, chat::LogLevel::DEBUG, fmt, __VA_ARGS__)
 #define CHAT_LOG_FMT_INFO(logger, fmt, ...)  CHAT_LOG_FMT_LEVEL(logger, chat::LogLevel::INFO, fmt, __VA_ARGS__)
@@ -2,6 +2,7 @@
 #include "log.h"
 #include "macro.h"
 #include "hook.h"
+#include "clock.h"
 
 namespace chat {
 
@@ -10,8 +11,10 @@ static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
 static thread_local Scheduler* t_scheduler = nullptr;
 static thread_local Fiber* t_scheduler_fiber = nullptr;
 
-Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name)
-    :m_name(name) {
+Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name
+                     ,const std::vector<int>& cpus)
+    :m_name(name)
+    ,m_cpus(cpus) {
     CHAT_ASSERT(threads > 0);
 
     if (use_caller) {
@@ -60,7 +63,11 @@ void Scheduler::start() {
 
     m_threads.resize(m_threadCount);
     for (size_t i = 0; i < m_threadCount; i++) {
-        m_threads[i] = std::make_shared<Thread>(std::bind(&Scheduler::run, this), m_name + "_" + std::to_string(i));
+        std::vector<int> cpus;
+        if (!m_cpus.empty()) {
+            cpus.push_back(m_cpus[i % m_cpus.size()]);  //线程先绑核再分配协程栈, 内存落在本地NUMA节点
+        }
+        m_threads[i] = std::make_shared<Thread>(std::bind(&Scheduler::run, this), m_name + "_" + std::to_string(i), cpus);
         m_threadIds.push_back(m_threads[i]->getId());
     }
     lock.unlock();
@@ -221,6 +228,8 @@ void Scheduler::run() {  // 新创建线程执行
             }
             if (idle_fiber->getState() == Fiber::State::TERM) {
                 CHAT_LOG_INFO(g_logger) << "idle fiber terminates";
+                //离开调度后不再刷新, 不能留下一个停住的缓存时间
+                chat::Clock::Invalidate();
                 break;
             }
 
@@ -267,8 +276,11 @@ std::ostream& Scheduler::dump(std::ostream& os) {
        << " size=" << m_threadCount
        << " active_count=" << m_activeThreadCount
        << " idle_count=" << m_idleThreadCount
-       << " stopping=" << m_stopping
-       << " ]" << std::endl << "    ";
+       << " stopping=" << m_stopping;
+    if (!m_cpus.empty()) {
+        os << " cpus=" << chat::Join(m_cpus.begin(), m_cpus.end(), ",");
+    }
+    os << " ]" << std::endl << "    ";
     for(size_t i = 0; i < m_threadIds.size(); ++i) {
         if (i) {
             os << ", ";
@@ -16,10 +16,15 @@ public:
     typedef std::shared_ptr<Scheduler> ptr;
     typedef RWSpinlock MutexType;
 
-    Scheduler(size_t threads = 1, bool use_caller = true, const std::string& name = "");
+    //cpus非空时, 第i个工作线程绑定到cpus[i % cpus.size()]
+    Scheduler(size_t threads = 1, bool use_caller = true, const std::string& name = ""
+              ,const std::vector<int>& cpus = {});
     virtual ~Scheduler();
 
     const std::string& getName() const { return m_name; }
+    const std::vector<int>& getCpus() const { return m_cpus; }
+    //工作线程数(含use_caller的主线程)
+    size_t getThreadCount() const { return m_threadIds.size(); }
 
     static Scheduler* GetThis();
     static Fiber* GetMainFiber();
@@ -122,6 +127,7 @@ private:
     std::vector<Thread::ptr> m_threads;
     std::list<FiberAndThread> m_fibers;
     std::string m_name;
+    std::vector<int> m_cpus;
     Fiber::ptr m_rootFiber;
 
 protected:
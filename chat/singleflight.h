@@ -0,0 +1,112 @@
+#ifndef __CHAT_SINGLEFLIGHT_H__
+#define __CHAT_SINGLEFLIGHT_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <unordered_map>
+#include "mutex.h"
+#include "scheduler.h"
+#include "hook.h"
+#include "util.h"
+
+namespace chat {
+
+//合并同一key上并发的相同调用: 第一个协程执行fn, 其余协程挂起等待并共享它的结果
+//不在协程中或未开启hook时直接执行fn, 不合并
+//结果被所有等待者共享, T为指针时调用方不应修改其内容
+//等待者跟随执行者的超时, 自身的超时不生效; 执行者抛出的异常在每个等待者中重新抛出
+template<class T>
+class SingleFlight {
+public:
+    typedef std::shared_ptr<SingleFlight> ptr;
+    typedef Mutex MutexType;
+
+    //shared不为空时返回结果是否来自其他协程的调用
+    T call(const std::string& key, const std::function<T()>& fn, bool* shared = nullptr) {
+        if (shared) {
+            *shared = false;
+        }
+        Scheduler* scheduler = Scheduler::GetThis();
+        if (!scheduler || !chat::is_hook_enable()) {
+            ++m_calls;
+            return fn();
+        }
+
+        typename Call::ptr c;
+        {
+            MutexType::Lock lock(m_mutex);
+            auto it = m_inflight.find(key);
+            if (it != m_inflight.end()) {
+                //回到本线程恢复, 保证切出后才被换入
+                c = it->second;
+                c->waiters.push_back(std::make_pair(scheduler
+                            , std::make_pair(Fiber::GetThis(), (int)chat::GetThreadId())));
+                lock.unlock();
+                ++m_coalesced;
+                Fiber::YieldToHold();
+                if (shared) {
+                    *shared = true;
+                }
+                if (c->error) {
+                    std::rethrow_exception(c->error);
+                }
+                return c->value;
+            }
+            c = std::make_shared<Call>();
+            m_inflight[key] = c;
+        }
+
+        ++m_calls;
+        try {
+            c->value = fn();
+        } catch (...) {
+            c->error = std::current_exception();
+            finish(key, c);
+            throw;
+        }
+        finish(key, c);
+        return c->value;
+    }
+
+    //实际执行fn的次数
+    uint64_t getCallCount() const { return m_calls;}
+    //被合并(没有执行fn)的调用次数
+    uint64_t getCoalescedCount() const { return m_coalesced;}
+    //正在执行的key数
+    size_t getInflightCount() {
+        MutexType::Lock lock(m_mutex);
+        return m_inflight.size();
+    }
+private:
+    struct Call {
+        typedef std::shared_ptr<Call> ptr;
+        std::vector<std::pair<Scheduler*, std::pair<Fiber::ptr, int> > > waiters;
+        T value = T();
+        std::exception_ptr error;
+    };
+
+    void finish(const std::string& key, typename Call::ptr c) {
+        decltype(c->waiters) waiters;
+        {
+            MutexType::Lock lock(m_mutex);
+            m_inflight.erase(key);
+            waiters.swap(c->waiters);
+        }
+        for (auto& i : waiters) {
+            i.first->schedule(i.second.first, i.second.second);
+        }
+    }
+private:
+    MutexType m_mutex;
+    std::unordered_map<std::string, typename Call::ptr> m_inflight;
+    std::atomic<uint64_t> m_calls = {0};
+    std::atomic<uint64_t> m_coalesced = {0};
+};
+
+}
+
+#endif
@@ -6,12 +6,16 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include "iomanager.h"
+#include "config.h"
 #include <netinet/tcp.h>
 
 namespace chat {
 
 static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
 
+static chat::ConfigVar<bool>::ptr g_ssl_ktls =
+    chat::Config::Lookup("ssl.ktls", false, "enable kernel tls offload for ssl server(needs tls kernel module)");
+
 Socket::ptr Socket::CreateTCP(chat::Address::ptr address) {
     Socket::ptr sock = std::make_shared<Socket>(address->getFamily(), TCP, 0);
     return sock;
@@ -632,9 +636,22 @@ bool SSLSocket::loadCertificates(const std::string& cert_file, const std::string
             << cert_file << " key_file=" << key_file;
         return false;
     }
+#ifdef SSL_OP_ENABLE_KTLS
+    if(g_ssl_ktls->getValue()) {
+        SSL_CTX_set_options(m_ctx.get(), SSL_OP_ENABLE_KTLS);
+    }
+#endif
     return true;
 }
 
+bool SSLSocket::isKtlsSend() const {
+#ifdef SSL_OP_ENABLE_KTLS
+    return m_ssl && BIO_get_ktls_send(SSL_get_wbio(m_ssl.get()));
+#else
+    return false;
+#endif
+}
+
 SSLSocket::ptr SSLSocket::CreateTCP(chat::Address::ptr address) {
     SSLSocket::ptr sock = std::make_shared<SSLSocket>(address->getFamily(), TCP, 0);
     return sock;
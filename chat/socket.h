@@ -137,6 +137,10 @@ public:
 
     bool loadCertificates(const std::string& cert_file, const std::string& key_file);
     virtual std::ostream& dump(std::ostream& os) const override;
+
+    SSL* getSSL() const { return m_ssl.get();}
+    //握手后是否启用了内核TLS发送, 启用时可用SSL_sendfile
+    bool isKtlsSend() const;
 protected:
     virtual bool init(int sock) override;
 private:
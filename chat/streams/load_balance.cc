@@ -129,10 +129,11 @@ std::string LoadBalance::statusString(const std::string& prefix) {
 }
 
 void LoadBalance::checkInit() {
-    uint64_t ts = chat::GetCurrentMs();
-    if(ts - m_lastInitTime > 500) {
+    uint64_t ts = chat::Clock::MonotonicCoarseMs();
+    if(ts - m_lastCheckTime > 500) {
         init();
-        m_lastInitTime = ts;
+        m_lastCheckTime = ts;
+        m_lastInitTime = chat::Clock::CachedMs();
     }
 }
 
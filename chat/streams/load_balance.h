@@ -4,6 +4,7 @@
 #include "chat/streams/socket_stream.h"
 #include "chat/mutex.h"
 #include "chat/util.h"
+#include "chat/clock.h"
 #include "chat/streams/service_discovery.h"
 #include <vector>
 #include <unordered_map>
@@ -46,9 +47,9 @@ private:
 class HolderStatsSet {
 public:
     HolderStatsSet(uint32_t size = 5);
-    HolderStats& get(const uint32_t& now = time(0));
+    HolderStats& get(const uint32_t& now = chat::Clock::CachedSec());
 
-    float getWeight(const uint32_t& now = time(0));
+    float getWeight(const uint32_t& now = chat::Clock::CachedSec());
 
     HolderStats getTotal();
 private:
@@ -69,7 +70,7 @@ public:
     void setId(uint64_t v) { m_id = v;}
     uint64_t getId() const { return m_id;}
 
-    HolderStats& get(const uint32_t& now = time(0));
+    HolderStats& get(const uint32_t& now = chat::Clock::CachedSec());
 
     template<class T>
     std::shared_ptr<T> getStreamAs() {
@@ -129,6 +130,7 @@ protected:
     RWMutexType m_mutex;
     std::unordered_map<uint64_t, LoadBalanceItem::ptr> m_datas;
     uint64_t m_lastInitTime = 0;
+    uint64_t m_lastCheckTime = 0;  //CLOCK_MONOTONIC_COARSE, 只用于checkInit限频
 };
 
 class RoundRobinLoadBalance : public LoadBalance {
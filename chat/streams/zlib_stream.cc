@@ -135,9 +135,6 @@ int ZlibStream::encode(const iovec* v, const uint64_t& size, bool finish) {
             ivc->iov_len = m_buffSize - m_zstream.avail_out;
         } while(m_zstream.avail_out == 0);
     }
-    if(flush == Z_FINISH) {
-        deflateEnd(&m_zstream);
-    }
     return Z_OK;
 }
 
@@ -172,10 +169,6 @@ int ZlibStream::decode(const iovec* v, const uint64_t& size, bool finish) {
             ivc->iov_len = m_buffSize - m_zstream.avail_out;
         } while(m_zstream.avail_out == 0);
     }
-
-    if(flush == Z_FINISH) {
-        inflateEnd(&m_zstream);
-    }
     return Z_OK;
 }
 
@@ -191,6 +184,20 @@ int ZlibStream::flush() {
     }
 }
 
+int ZlibStream::reset() {
+    if(m_free) {
+        for(auto& i : m_buffs) {
+            free(i.iov_base);
+        }
+    }
+    m_buffs.clear();
+    if(m_encode) {
+        return deflateReset(&m_zstream);
+    } else {
+        return inflateReset(&m_zstream);
+    }
+}
+
 std::string ZlibStream::getResult() const {
     std::string rt;
     for(auto& i : m_buffs) {
@@ -51,6 +51,9 @@ public:
     virtual void close() override;
 
     int flush();
+    //重置压缩状态并释放输出缓冲, 之后可以开始新的数据流
+    //复用已分配的z_stream, 避免每次deflateInit
+    int reset();
 
     bool isFree() const { return m_free;}
     void setFree(bool v) { m_free = v;}
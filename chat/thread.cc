@@ -1,4 +1,5 @@
 #include "thread.h"
+#include <sched.h>
 #include "log.h"
 #include "util.h"
 
@@ -26,9 +27,30 @@ void Thread::SetName(const std::string& name) {
     t_thread_name = name;
 }
 
-Thread::Thread(std::function<void()> cb, const std::string& name)
+bool Thread::SetAffinity(const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto& i : cpus) {
+        if (i >= 0 && i < CPU_SETSIZE) {
+            CPU_SET(i, &set);
+        }
+    }
+    int rt = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rt) {
+        CHAT_LOG_ERROR(g_logger) << "pthread_setaffinity_np fail, rt=" << rt
+            << " name=" << t_thread_name;
+        return false;
+    }
+    return true;
+}
+
+Thread::Thread(std::function<void()> cb, const std::string& name, const std::vector<int>& cpus)
     : m_cb(cb)
-    , m_name(name) {
+    , m_name(name)
+    , m_cpus(cpus) {
     if (name.empty()) {
         m_name = "UKNOWN";
     }
@@ -52,6 +74,9 @@ void* Thread::run(void* arg) {
     t_thread_name = thread->m_name;
     thread->m_id = chat::GetThreadId();
     pthread_setname_np(pthread_self(), thread->m_name.substr(0, 15).c_str());
+    if (!thread->m_cpus.empty()) {
+        SetAffinity(thread->m_cpus);
+    }
 
     std::function<void()> cb;
     cb.swap(thread->m_cb);
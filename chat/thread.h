@@ -1,6 +1,7 @@
 #ifndef __CHAT_THREAD_H__
 #define __CHAT_THREAD_H__
 
+#include <vector>
 #include "mutex.h"
 
 
@@ -9,16 +10,20 @@ namespace chat {
 class Thread {
 public:
     typedef std::shared_ptr<Thread> ptr;
-    Thread(std::function<void()> cb, const std::string& name);
+    //cpus非空时线程启动后先绑定到这些cpu上再执行cb
+    Thread(std::function<void()> cb, const std::string& name, const std::vector<int>& cpus = {});
     ~Thread();
 
     pid_t getId() const { return m_id; }
     const std::string& getName() const { return m_name; }
+    const std::vector<int>& getCpus() const { return m_cpus; }
 
     void join();
     static Thread* GetThis();
     static const std::string& GetName();
     static void SetName(const std::string& name);
+    //把当前线程绑定到cpus, 内存按first-touch落在对应NUMA节点
+    static bool SetAffinity(const std::vector<int>& cpus);
     static void* run(void* arg);
 
 private: //禁止拷贝
@@ -30,6 +35,7 @@ private:
     pthread_t m_thread = 0;
     std::function<void()> m_cb;
     std::string m_name;
+    std::vector<int> m_cpus;
 
     Semaphore m_semaphore;
 };
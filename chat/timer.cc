@@ -1,5 +1,6 @@
 #include "timer.h"
 #include "util.h"
+#include "clock.h"
 
 namespace chat {
 
@@ -12,9 +13,10 @@ bool Timer::Comparator::operator()(const Timer::ptr& lhs, const Timer::ptr& rhs)
     return lhs.get() < rhs.get();
 }
 
-Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager* manager)
-    :m_ms(ms), m_cb(cb), m_recurring(recurring), m_manager(manager) {
-    m_next = chat::GetCurrentMs() + m_ms;
+Timer::Timer(uint64_t us, std::function<void()> cb, bool recurring, TimerManager* manager, uint64_t slack)
+    :m_us(us), m_slack(slack), m_cb(cb), m_recurring(recurring), m_manager(manager) {
+    //截止时间从精确时间算起, 缓存时间可能落后于当前协程已运行的时长
+    m_next = chat::Clock::NowUs() + m_us;
 }
 
 Timer::Timer(uint64_t next) :m_next(next) {}
@@ -36,14 +38,18 @@ bool Timer::refresh() {
     auto it = m_manager->m_timers.find(shared_from_this());
     if (it == m_manager->m_timers.end()) return false;
     m_manager->m_timers.erase(it);
-    m_next = chat::GetCurrentMs() + m_ms;
+    m_next = chat::Clock::NowUs() + m_us;
     m_manager->m_timers.insert(shared_from_this());
     return true;
 }
 
 //from_now为true，立即强制改间隔时间
 bool Timer::reset(uint64_t ms, bool from_now) {
-    if (ms == m_ms && !from_now) return true;
+    return resetUs(ms * 1000, from_now);
+}
+
+bool Timer::resetUs(uint64_t us, bool from_now) {
+    if (us == m_us && !from_now) return true;
     TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
     if (!m_cb) return false;
     auto it = m_manager->m_timers.find(shared_from_this());
@@ -51,30 +57,47 @@ bool Timer::reset(uint64_t ms, bool from_now) {
     m_manager->m_timers.erase(it);
     uint64_t start = 0;
     if (from_now) {
-        start = chat::GetCurrentMs();
+        start = chat::Clock::NowUs();
     } else {
-        start = m_next - m_ms;
+        start = m_next - m_us;
     }
-    m_ms = ms;
-    m_next = start + m_ms;
+    m_us = us;
+    m_next = start + m_us;
     m_manager->addTimer(shared_from_this(), lock);
     return true;
 }
 
 TimerManager::TimerManager() {
-    m_previousTime = chat::GetCurrentMs();
+    m_previousTime = chat::Clock::NowUs();
 }
 TimerManager::~TimerManager() {
 
 }
 
 Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb, bool recurring) {
-    Timer::ptr timer = chat::protected_make_shared<Timer>(ms, cb, recurring, this);
+    return addTimerUs(ms * 1000, cb, recurring);
+}
+
+Timer::ptr TimerManager::addTimerUs(uint64_t us, std::function<void()> cb, bool recurring, uint64_t slack_us) {
+    Timer::ptr timer = chat::protected_make_shared<Timer>(us, cb, recurring, this, slack_us);
     RWMutexType::WriteLock lock(m_mutex);
     addTimer(timer, lock);
     return timer;
 }
 
+bool TimerManager::rearmTimerUs(Timer::ptr timer, uint64_t us, std::function<void()> cb) {
+    RWMutexType::WriteLock lock(m_mutex);
+    if (timer->m_cb) return false;  //仍在定时器集合中
+    timer->m_us = us;
+    timer->m_next = chat::Clock::NowUs() + us;
+    timer->m_slack = 0;
+    timer->m_cb.swap(cb);
+    timer->m_recurring = false;
+    timer->m_manager = this;
+    addTimer(timer, lock);
+    return true;
+}
+
 static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb) {
     std::shared_ptr<void> tmp = weak_cond.lock();  //s转换成shared_ptr, 检查被监视对象是否仍然存在
     if (tmp) {
@@ -86,19 +109,36 @@ Timer::ptr TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb
     return addTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring);
 }
 
+Timer::ptr TimerManager::addConditionTimerUs(uint64_t us, std::function<void()> cb, std::weak_ptr<void> weak_cond
+                                             ,bool recurring, uint64_t slack_us) {
+    return addTimerUs(us, std::bind(&OnTimer, weak_cond, cb), recurring, slack_us);
+}
+
 uint64_t TimerManager::getNextTimer() {
+    uint64_t us = getNextTimerUs();
+    if (us == ~0ull) return ~0ull;
+    return (us + 999) / 1000;  //向上取整, 避免不足1ms的定时器空转
+}
+
+uint64_t TimerManager::getNextTimerUs() {
     RWMutexType::ReadLock lock(m_mutex);
     m_tickled = false;
     if (m_timers.empty()) return ~0ull;  //返回最大值
 
-    const Timer::ptr& next = *m_timers.begin();
-    uint64_t now_ms = chat::GetCurrentMs();
-    if (now_ms >= next->m_next) return 0;
-    else return next->m_next - now_ms;  //下一次需要等待的时间
+    uint64_t now_us = chat::Clock::NowUs();  //马上要阻塞等待, 需要精确时间
+    auto it = m_timers.begin();
+    if (now_us >= (*it)->m_next) return 0;
+
+    //按m_next有序, m_next超过当前最早截止时间的定时器不可能更早
+    uint64_t deadline = (*it)->m_next + (*it)->m_slack;
+    for (++it; it != m_timers.end() && (*it)->m_next < deadline; ++it) {
+        deadline = std::min(deadline, (*it)->m_next + (*it)->m_slack);
+    }
+    return deadline - now_us;  //下一次需要等待的时间
 }
 
 void TimerManager::listExpiredCb(std::vector<std::function<void()> >& cbs) {
-    uint64_t now_ms = chat::GetCurrentMs();
+    uint64_t now_us = chat::Clock::CachedUs();  //idle每轮epoll_wait返回后已刷新
     std::vector<Timer::ptr> expired;
     {
         RWMutexType::ReadLock lock(m_mutex);
@@ -107,14 +147,14 @@ void TimerManager::listExpiredCb(std::vector<std::function<void()> >& cbs) {
     RWMutexType::WriteLock lock(m_mutex);
     if(m_timers.empty()) return;
 
-    bool rollover = detectClockRollover(now_ms);
-    if (!rollover && ((*m_timers.begin())->m_next > now_ms)) {
+    bool rollover = detectClockRollover(now_us);
+    if (!rollover && ((*m_timers.begin())->m_next > now_us)) {
         return;
     }
 
-    Timer::ptr now_timer = chat::protected_make_shared<Timer>(now_ms);
+    Timer::ptr now_timer = chat::protected_make_shared<Timer>(now_us);
     auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer);
-    while (it != m_timers.end() && (*it)->m_next == now_ms) {
+    while (it != m_timers.end() && (*it)->m_next == now_us) {
         ++it;
     }
     expired.insert(expired.begin(), m_timers.begin(), it);
@@ -124,7 +164,7 @@ void TimerManager::listExpiredCb(std::vector<std::function<void()> >& cbs) {
     for (auto& timer : expired) {
         cbs.push_back(timer->m_cb);
         if (timer->m_recurring) {
-            timer->m_next = now_ms + timer->m_ms;
+            timer->m_next = now_us + timer->m_us;
             m_timers.insert(timer);
         } else {
             timer->m_cb = nullptr;
@@ -151,12 +191,12 @@ void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock& lock) {
 }
 
 //检测服务器时间是否被调后
-bool TimerManager::detectClockRollover(uint64_t now_ms) {
+bool TimerManager::detectClockRollover(uint64_t now_us) {
     bool rollover = false;
-    if (now_ms < m_previousTime && now_ms < (m_previousTime - 60 * 60 * 1000)) {
+    if (now_us < m_previousTime && now_us < (m_previousTime - 60 * 60 * 1000 * 1000ull)) {
         rollover = true;
     }
-    m_previousTime = now_ms;
+    m_previousTime = now_us;
     return rollover;
 }
 
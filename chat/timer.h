@@ -16,13 +16,19 @@ public:
     bool cancel();
     bool refresh();
     bool reset(uint64_t ms, bool from_now);
+    bool resetUs(uint64_t us, bool from_now);
+
+    uint64_t getSlack() const { return m_slack; }
+    //允许延后执行的微秒数, 相近的定时器合并到一次唤醒中执行
+    void setSlack(uint64_t us) { m_slack = us; }
 protected:
-    Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager* manager);
+    Timer(uint64_t us, std::function<void()> cb, bool recurring, TimerManager* manager, uint64_t slack);
     Timer(uint64_t next);
 
 private:
-    uint64_t m_ms = 0;  //时间间隔
-    uint64_t m_next = 0;  //精确的执行时间
+    uint64_t m_us = 0;  //时间间隔(微秒)
+    uint64_t m_next = 0;  //精确的执行时间(微秒)
+    uint64_t m_slack = 0;  //可延后的时间(微秒)
     std::function<void()> m_cb;
     bool m_recurring = false;  //是否循环定时器
     TimerManager* m_manager = nullptr;
@@ -42,14 +48,23 @@ public:
 
     Timer::ptr addTimer(uint64_t ms, std::function<void()> cb, bool recurring = false);
     Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> weak_cond, bool recurring = false);
+    //微秒精度定时器, slack_us见Timer::setSlack
+    Timer::ptr addTimerUs(uint64_t us, std::function<void()> cb, bool recurring = false, uint64_t slack_us = 0);
+    Timer::ptr addConditionTimerUs(uint64_t us, std::function<void()> cb, std::weak_ptr<void> weak_cond
+                                   ,bool recurring = false, uint64_t slack_us = 0);
+    //复用已失效(已触发或已cancel)的timer对象重新挂入, 避免阻塞路径上的分配
+    bool rearmTimerUs(Timer::ptr timer, uint64_t us, std::function<void()> cb);
+    //距下一次需要唤醒的毫秒数(向上取整), 没有定时器返回~0ull
     uint64_t getNextTimer();
+    //距下一次需要唤醒的微秒数, 已考虑slack合并
+    uint64_t getNextTimerUs();
     void listExpiredCb(std::vector<std::function<void()> >& cbs);
     bool hasTimer();
 protected:
     virtual void onTimerInsertedAtFront() = 0;
     void addTimer(Timer::ptr val, RWMutexType::WriteLock& lock);
 private:
-    bool detectClockRollover(uint64_t now_ms);
+    bool detectClockRollover(uint64_t now_us);
 private:
     RWMutexType m_mutex;
     std::set<Timer::ptr, Timer::Comparator> m_timers;
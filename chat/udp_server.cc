@@ -0,0 +1,330 @@
+#include "udp_server.h"
+#include "config.h"
+#include "log.h"
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <string.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+namespace chat {
+
+static chat::ConfigVar<uint32_t>::ptr g_udp_server_batch =
+    chat::Config::Lookup("udp_server.batch", (uint32_t)32, "udp server recvmmsg/sendmmsg batch size");
+static chat::ConfigVar<uint32_t>::ptr g_udp_server_buffer_size =
+    chat::Config::Lookup("udp_server.buffer_size", (uint32_t)2048, "udp server per datagram buffer size");
+static chat::ConfigVar<bool>::ptr g_udp_server_gso =
+    chat::Config::Lookup("udp_server.gso", false, "udp server send with UDP_SEGMENT");
+static chat::ConfigVar<bool>::ptr g_udp_server_gro =
+    chat::Config::Lookup("udp_server.gro", false, "udp server receive with UDP_GRO");
+
+static chat::Logger::ptr g_logger = CHAT_LOG_NAME("system");
+
+//一次GSO发送的上限: 内核限制64个分段, 总长不超过一个IP包
+static const size_t s_gso_max_segments = 64;
+static const size_t s_gso_max_size = 65000;
+static const size_t s_gro_buffer_size = 65535;
+
+UdpServer::Batch::Batch(int fd, size_t batch, size_t buf_size, bool gro)
+    :m_fd(fd)
+    ,m_batch(batch ? batch : 1)
+    ,m_bufSize(gro ? std::max(buf_size, s_gro_buffer_size) : buf_size)
+    ,m_gro(gro) {
+    size_t rctrl_size = CMSG_SPACE(sizeof(int));
+    m_recvBuf.resize(m_batch * m_bufSize);
+    m_rmsgs.resize(m_batch);
+    m_riovs.resize(m_batch);
+    m_raddrs.resize(m_batch);
+    m_rctrls.resize(m_batch * rctrl_size);
+    m_packets.reserve(m_batch);
+    for (size_t i = 0; i < m_batch; ++i) {
+        m_riovs[i].iov_base = &m_recvBuf[i * m_bufSize];
+        m_riovs[i].iov_len = m_bufSize;
+        msghdr& h = m_rmsgs[i].msg_hdr;
+        memset(&h, 0, sizeof(h));
+        h.msg_name = &m_raddrs[i];
+        h.msg_iov = &m_riovs[i];
+        h.msg_iovlen = 1;
+        h.msg_control = m_gro ? &m_rctrls[i * rctrl_size] : nullptr;
+    }
+
+    //发送缓冲按普通数据报大小准备, GRO只影响收包
+    m_sendBuf.resize(m_batch * buf_size);
+    m_outs.reserve(m_batch);
+    m_smsgs.resize(m_batch);
+    m_siovs.reserve(m_batch);
+    m_sctrls.resize(m_batch * CMSG_SPACE(sizeof(uint16_t)));
+}
+
+int UdpServer::Batch::recv() {
+    m_packets.clear();
+    size_t rctrl_size = CMSG_SPACE(sizeof(int));
+    for (size_t i = 0; i < m_batch; ++i) {
+        msghdr& h = m_rmsgs[i].msg_hdr;
+        h.msg_namelen = sizeof(sockaddr_storage);
+        h.msg_controllen = m_gro ? rctrl_size : 0;
+        h.msg_flags = 0;
+    }
+
+    int n = ::recvmmsg(m_fd, &m_rmsgs[0], m_batch, 0, nullptr);
+    if (n <= 0) {
+        return n;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        msghdr& h = m_rmsgs[i].msg_hdr;
+        size_t len = m_rmsgs[i].msg_len;
+        const char* data = (const char*)m_riovs[i].iov_base;
+        size_t seg = 0;
+        if (m_gro) {
+            for (cmsghdr* c = CMSG_FIRSTHDR(&h); c; c = CMSG_NXTHDR(&h, c)) {
+                if (c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO) {
+                    int v = 0;
+                    memcpy(&v, CMSG_DATA(c), sizeof(v));
+                    seg = v;
+                }
+            }
+        }
+        if (seg == 0 || seg > len) {
+            seg = len;
+        }
+        size_t off = 0;
+        do {
+            m_packets.push_back(Packet{data + off, std::min(seg, len - off)
+                    , (const sockaddr*)&m_raddrs[i], h.msg_namelen});
+            off += seg;
+        } while (off < len);
+    }
+    return m_packets.size();
+}
+
+void UdpServer::Batch::reply(const Packet& to, const void* data, size_t len) {
+    sendTo(to.addr, to.addrlen, data, len);
+}
+
+void UdpServer::Batch::sendTo(const sockaddr* addr, socklen_t addrlen, const void* data, size_t len) {
+    size_t cap = m_sendBuf.size() / m_batch;
+    if (len > cap) {
+        ::sendto(m_fd, data, len, 0, addr, addrlen);  //超长应答不进批量缓冲
+        return;
+    }
+    if (m_outs.size() >= m_batch || m_sendUsed + len > m_sendBuf.size()) {
+        flush(false);
+    }
+    Out out;
+    out.offset = m_sendUsed;
+    out.len = len;
+    memcpy(&out.addr, addr, addrlen);
+    out.addrlen = addrlen;
+    memcpy(&m_sendBuf[m_sendUsed], data, len);
+    m_sendUsed += len;
+    m_outs.push_back(out);
+}
+
+static bool same_addr(const sockaddr_storage& a, socklen_t alen
+                      ,const sockaddr_storage& b, socklen_t blen) {
+    return alen == blen && memcmp(&a, &b, alen) == 0;
+}
+
+int UdpServer::Batch::flush(bool gso) {
+    if (m_outs.empty()) {
+        return 0;
+    }
+    size_t sctrl_size = CMSG_SPACE(sizeof(uint16_t));
+    size_t nmsg = 0;
+    m_siovs.clear();
+    for (size_t i = 0; i < m_outs.size();) {
+        //同一目的地连续等长的应答合并为一个GSO消息, 只有最后一段可以更短
+        size_t j = i + 1;
+        size_t seg = m_outs[i].len;
+        if (gso) {
+            size_t total = seg;
+            while (j < m_outs.size() && j - i < s_gso_max_segments
+                    && m_outs[j - 1].len == seg && m_outs[j].len <= seg
+                    && total + m_outs[j].len <= s_gso_max_size
+                    && same_addr(m_outs[i].addr, m_outs[i].addrlen, m_outs[j].addr, m_outs[j].addrlen)) {
+                total += m_outs[j].len;
+                ++j;
+            }
+        }
+
+        size_t iov_begin = m_siovs.size();
+        for (size_t k = i; k < j; ++k) {
+            iovec iov;
+            iov.iov_base = &m_sendBuf[m_outs[k].offset];
+            iov.iov_len = m_outs[k].len;
+            m_siovs.push_back(iov);
+        }
+
+        msghdr& h = m_smsgs[nmsg].msg_hdr;
+        memset(&h, 0, sizeof(h));
+        h.msg_name = &m_outs[i].addr;
+        h.msg_namelen = m_outs[i].addrlen;
+        h.msg_iov = &m_siovs[iov_begin];
+        h.msg_iovlen = j - i;
+        if (j - i > 1) {
+            h.msg_control = &m_sctrls[nmsg * sctrl_size];
+            h.msg_controllen = sctrl_size;
+            cmsghdr* c = CMSG_FIRSTHDR(&h);
+            c->cmsg_level = SOL_UDP;
+            c->cmsg_type = UDP_SEGMENT;
+            c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t v = seg;
+            memcpy(CMSG_DATA(c), &v, sizeof(v));
+        }
+        ++nmsg;
+        i = j;
+    }
+
+    size_t sent = 0;
+    while (sent < nmsg) {
+        int rt = ::sendmmsg(m_fd, &m_smsgs[sent], nmsg - sent, 0);
+        if (rt < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EBADF) {  //stop时socket已关闭
+                break;
+            }
+            CHAT_LOG_ERROR(g_logger) << "sendmmsg fd=" << m_fd << " errno=" << errno
+                << " errstr=" << strerror(errno);
+            break;
+        }
+        sent += rt;
+    }
+
+    int count = 0;
+    for (size_t i = 0; i < sent; ++i) {
+        count += m_smsgs[i].msg_hdr.msg_iovlen;
+    }
+    m_outs.clear();
+    m_sendUsed = 0;
+    return count;
+}
+
+UdpServer::UdpServer(IOManager* worker)
+    :m_worker(worker)
+    ,m_name("chat/1.0.0")
+    ,m_isStop(true)
+    ,m_batch(g_udp_server_batch->getValue())
+    ,m_bufSize(g_udp_server_buffer_size->getValue())
+    ,m_gso(g_udp_server_gso->getValue())
+    ,m_gro(g_udp_server_gro->getValue()) {
+}
+
+UdpServer::~UdpServer() {
+    for (auto& i : m_socks) {
+        i->close();
+    }
+    m_socks.clear();
+}
+
+bool UdpServer::bind(Address::ptr addr) {
+    size_t n = std::max(m_worker->getThreadCount(), (size_t)1);
+    for (size_t i = 0; i < n; ++i) {
+        Socket::ptr sock = Socket::CreateUDP(addr);
+        int val = 1;
+        sock->setOption(SOL_SOCKET, SO_REUSEPORT, val);
+        if (m_gro && !sock->setOption(SOL_UDP, UDP_GRO, val)) {
+            CHAT_LOG_WARN(g_logger) << "UDP_GRO not supported, disabled";
+            m_gro = false;
+        }
+        if (!sock->bind(addr)) {
+            CHAT_LOG_ERROR(g_logger) << "bind fail errno="
+                << errno << " errstr=" << strerror(errno)
+                << " addr=[" << addr->toString() << "]";
+            m_socks.clear();
+            return false;
+        }
+        if (i == 0) {
+            addr = sock->getLocalAddress();  //端口为0时其余socket复用内核分配的端口
+        }
+        m_socks.push_back(sock);
+    }
+
+    CHAT_LOG_INFO(g_logger) << "type=udp name=" << m_name
+        << " server bind success: " << addr->toString()
+        << " reuseport_socks=" << m_socks.size();
+    return true;
+}
+
+bool UdpServer::start() {
+    if (!m_isStop) {
+        return true;
+    }
+    m_isStop = false;
+    for (auto& sock : m_socks) {
+        m_worker->schedule(std::bind(&UdpServer::startRecv, shared_from_this(), sock));
+    }
+    return true;
+}
+
+void UdpServer::stop() {
+    m_isStop = true;
+    auto self = shared_from_this();
+    m_worker->schedule([this, self]() {
+        for (auto& sock : m_socks) {
+            sock->cancelAll();
+            sock->close();
+        }
+        m_socks.clear();
+    });
+}
+
+void UdpServer::startRecv(Socket::ptr sock) {
+    Batch batch(sock->getSocket(), m_batch, m_bufSize, m_gro);
+    while (!m_isStop) {
+        int n = batch.recv();
+        if (n <= 0) {
+            if (m_isStop || errno == EBADF) {
+                break;
+            }
+            if (n < 0 && errno != EAGAIN && errno != ETIMEDOUT) {
+                CHAT_LOG_ERROR(g_logger) << "recvmmsg errno=" << errno
+                    << " errstr=" << strerror(errno);
+            }
+            continue;
+        }
+        m_recvPackets += n;
+        handleBatch(batch);
+        m_sendPackets += batch.flush(m_gso);
+    }
+}
+
+void UdpServer::handleBatch(Batch& batch) {
+    for (size_t i = 0; i < batch.size(); ++i) {
+        handlePacket(batch, batch.get(i));
+    }
+}
+
+void UdpServer::handlePacket(Batch& batch, const Packet& pkt) {
+    CHAT_LOG_INFO(g_logger) << "handlePacket len=" << pkt.len
+        << " from: " << Address::Create(pkt.addr, pkt.addrlen)->toString();
+}
+
+std::string UdpServer::toString(const std::string& prefix) {
+    std::stringstream ss;
+    ss << prefix << "[type=udp name=" << m_name
+       << " worker=" << (m_worker ? m_worker->getName() : "")
+       << " batch=" << m_batch
+       << " buffer_size=" << m_bufSize
+       << " gso=" << m_gso
+       << " gro=" << m_gro
+       << " recv=" << m_recvPackets
+       << " send=" << m_sendPackets << "]" << std::endl;
+    std::string pfx = prefix.empty() ? "    " : prefix;
+    for (auto& i : m_socks) {
+        ss << pfx << pfx << i->toString() << std::endl;
+    }
+    return ss.str();
+}
+
+}
@@ -0,0 +1,117 @@
+#ifndef __CHAT_UDP_SERVER_H__
+#define __CHAT_UDP_SERVER_H__
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <sys/socket.h>
+#include "iomanager.h"
+#include "address.h"
+#include "socket.h"
+#include "noncopyable.h"
+
+namespace chat {
+
+//UDP服务器: 每个工作线程一个SO_REUSEPORT socket, recvmmsg批量收包, sendmmsg批量回包
+//可选UDP_GRO(内核合并收包)与UDP_SEGMENT(同一目的地的应答合并成一次GSO发送)
+class UdpServer : public std::enable_shared_from_this<UdpServer>, Noncopyable {
+public:
+    typedef std::shared_ptr<UdpServer> ptr;
+
+    struct Packet {
+        const char* data;
+        size_t len;
+        const sockaddr* addr;
+        socklen_t addrlen;
+    };
+
+    //一次recvmmsg收到的数据报和待发出的应答, 缓冲区在收包协程内循环复用
+    class Batch : Noncopyable {
+    public:
+        Batch(int fd, size_t batch, size_t buf_size, bool gro);
+
+        size_t size() const { return m_packets.size();}
+        const Packet& get(size_t i) const { return m_packets[i];}
+
+        //应答拷贝到发送缓冲, handleBatch返回后一次sendmmsg发出; 缓冲满时提前发送
+        void reply(const Packet& to, const void* data, size_t len);
+        void sendTo(const sockaddr* addr, socklen_t addrlen, const void* data, size_t len);
+
+        //返回收到的数据报数(GRO合并的已拆开), <0出错
+        int recv();
+        //返回发出的数据报数
+        int flush(bool gso);
+    private:
+        struct Out {
+            size_t offset;
+            size_t len;
+            sockaddr_storage addr;
+            socklen_t addrlen;
+        };
+    private:
+        int m_fd;
+        size_t m_batch;
+        size_t m_bufSize;
+        bool m_gro;
+
+        std::vector<char> m_recvBuf;
+        std::vector<mmsghdr> m_rmsgs;
+        std::vector<iovec> m_riovs;
+        std::vector<sockaddr_storage> m_raddrs;
+        std::vector<char> m_rctrls;
+        std::vector<Packet> m_packets;
+
+        std::vector<char> m_sendBuf;
+        size_t m_sendUsed = 0;
+        std::vector<Out> m_outs;
+        std::vector<mmsghdr> m_smsgs;
+        std::vector<iovec> m_siovs;
+        std::vector<char> m_sctrls;
+    };
+
+    UdpServer(IOManager* worker = IOManager::GetThis());
+    virtual ~UdpServer();
+
+    //每个工作线程创建一个SO_REUSEPORT socket绑定到addr
+    virtual bool bind(Address::ptr addr);
+    virtual bool start();
+    virtual void stop();
+
+    bool isStop() const { return m_isStop;}
+    std::string getName() const { return m_name;}
+    virtual void setName(const std::string& v) { m_name = v;}
+
+    void setBatch(size_t v) { m_batch = v;}
+    void setBufferSize(size_t v) { m_bufSize = v;}
+    void setGso(bool v) { m_gso = v;}
+    void setGro(bool v) { m_gro = v;}
+
+    uint64_t getRecvPackets() const { return m_recvPackets;}
+    uint64_t getSendPackets() const { return m_sendPackets;}
+
+    virtual std::string toString(const std::string& prefix = "");
+    std::vector<Socket::ptr> getSocks() const { return m_socks;}
+protected:
+    //默认逐个调用handlePacket
+    virtual void handleBatch(Batch& batch);
+    virtual void handlePacket(Batch& batch, const Packet& pkt);
+
+    virtual void startRecv(Socket::ptr sock);
+protected:
+    std::vector<Socket::ptr> m_socks;
+    IOManager* m_worker;
+    std::string m_name;
+    bool m_isStop;
+
+    size_t m_batch;
+    size_t m_bufSize;
+    bool m_gso;
+    bool m_gro;
+
+    std::atomic<uint64_t> m_recvPackets = {0};
+    std::atomic<uint64_t> m_sendPackets = {0};
+};
+
+}
+
+#endif
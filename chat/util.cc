@@ -10,6 +10,7 @@
 #include <openssl/md5.h>
 #include <openssl/sha.h>
 #include <signal.h>
+#include <sched.h>
 #include <google/protobuf/unknown_field_set.h>
 #include "log.h"
 #include "fiber.h"
@@ -1360,6 +1361,38 @@ std::vector<std::string> split(const std::string &str, const char *delims, size_
     return result;
 }
 
+//非负十进制整数, 非法返回-1
+static int64_t ParseCpuId(const std::string& str) {
+    if(str.empty() || str.size() > 18
+            || str.find_first_not_of("0123456789") != std::string::npos) {
+        return -1;
+    }
+    return TypeUtil::Atoi(str);
+}
+
+std::vector<int> ParseCpuList(const std::string& str) {
+    std::vector<int> cpus;
+    for(auto& i : split(str, ',')) {
+        std::string item = StringUtil::Trim(i);
+        if(item.empty()) {
+            continue;
+        }
+        auto pos = item.find('-');
+        int64_t begin = ParseCpuId(StringUtil::Trim(item.substr(0, pos)));
+        int64_t end = pos == std::string::npos ? begin
+                    : ParseCpuId(StringUtil::Trim(item.substr(pos + 1)));
+        if(begin < 0 || end < begin || begin >= CPU_SETSIZE) {
+            CHAT_LOG_WARN(g_logger) << "ParseCpuList invalid item=" << item << " in " << str;
+            continue;
+        }
+        end = std::min<int64_t>(end, CPU_SETSIZE - 1);
+        for(int64_t n = begin; n <= end; ++n) {
+            cpus.push_back(n);
+        }
+    }
+    return cpus;
+}
+
 std::string GetHostName() {
     std::shared_ptr<char> host(new char[512], chat::delete_array<char>);
     memset(host.get(), 0, 512);
@@ -356,6 +356,10 @@ std::string GetIPv4();
 std::vector<std::string> split(const std::string &str, char delim, size_t max = ~0);
 std::vector<std::string> split(const std::string &str, const char *delims, size_t max = ~0);
 
+//解析cpu列表, 格式如 "0-3,8,10-11"
+//非法项与反向区间跳过, 区间上界截断到CPU_SETSIZE-1
+std::vector<int> ParseCpuList(const std::string& str);
+
 //时间微秒
 class TimeCalc {
 public:
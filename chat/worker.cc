@@ -136,13 +136,19 @@ bool WorkerManager::init(const std::map<std::string, std::map<std::string, std::
         std::string name = i.first;
         int32_t thread_num = chat::GetParamValue(i.second, "thread_num", 1);
         int32_t worker_num = chat::GetParamValue(i.second, "worker_num", 1);
+        //cpus: "0-3,8" 每个线程按顺序绑定一个cpu, 同名的多个worker依次错开
+        std::vector<int> cpus = chat::ParseCpuList(chat::GetParamValue<std::string>(i.second, "cpus", ""));
 
         for(int32_t x = 0; x < worker_num; ++x) {
+            std::vector<int> worker_cpus;
+            for(size_t n = 0; n < cpus.size() && n < (size_t)thread_num; ++n) {
+                worker_cpus.push_back(cpus[(x * thread_num + n) % cpus.size()]);
+            }
             Scheduler::ptr s;
             if(!x) {
-                s = std::make_shared<IOManager>(thread_num, false, name);
+                s = std::make_shared<IOManager>(thread_num, false, name, worker_cpus);
             } else {
-                s = std::make_shared<IOManager>(thread_num, false, name + "-" + std::to_string(x));
+                s = std::make_shared<IOManager>(thread_num, false, name + "-" + std::to_string(x), worker_cpus);
             }
             add(name, s);
         }
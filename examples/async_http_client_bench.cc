@@ -0,0 +1,139 @@
+#include "chat/http/http_server.h"
+#include "chat/http/http_connection.h"
+#include "chat/http/async_http_client.h"
+#include "chat/log.h"
+#include "chat/iomanager.h"
+#include "chat/util.h"
+#include <atomic>
+#include <stdlib.h>
+#include <unistd.h>
+
+//客户端压测: 同样的并发协程数, 对比HttpConnectionPool(一请求一连接)与AsyncHttpClient(少量流水线连接)
+//用法: async_http_client_bench [-t server_threads] [-T client_threads] [-f fibers] [-c async_conns] [-s seconds]
+
+static chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static std::atomic<uint64_t> s_ops = {0};
+static std::atomic<uint64_t> s_fails = {0};
+static std::atomic<int> s_running = {0};
+static volatile bool s_stop = false;
+
+static void run_pool(chat::http::HttpConnectionPool::ptr pool) {
+    while (!s_stop) {
+        auto r = pool->doGet("/bench", 3000);
+        r->result == 0 ? ++s_ops : ++s_fails;
+    }
+    --s_running;
+}
+
+static void run_async(chat::http::AsyncHttpClient::ptr client) {
+    while (!s_stop) {
+        auto r = client->doGet("/bench", 3000);
+        r->result == 0 ? ++s_ops : ++s_fails;
+    }
+    --s_running;
+}
+
+static void report(const char* name, uint64_t used, int sockets) {
+    std::cout << name
+              << " sockets=" << sockets
+              << " requests=" << s_ops
+              << " fails=" << s_fails
+              << " rps=" << (s_ops * 1000000.0 / used)
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int server_threads = 2;
+    int client_threads = 2;
+    int fibers = 256;
+    int async_conns = 4;
+    int seconds = 3;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:T:f:c:s:")) != -1) {
+        switch (opt) {
+            case 't':
+                server_threads = atoi(optarg);
+                break;
+            case 'T':
+                client_threads = atoi(optarg);
+                break;
+            case 'f':
+                fibers = atoi(optarg);
+                break;
+            case 'c':
+                async_conns = atoi(optarg);
+                break;
+            case 's':
+                seconds = atoi(optarg);
+                break;
+            default:
+                CHAT_LOG_INFO(g_logger) << "use as[" << argv[0]
+                    << " -t server_threads -T client_threads -f fibers -c async_conns -s seconds]";
+                return 0;
+        }
+    }
+    g_logger->setLevel(chat::LogLevel::WARN);
+    CHAT_LOG_NAME("system")->setLevel(chat::LogLevel::ERROR);
+
+    chat::Address::ptr addr = chat::Address::LookupAny("127.0.0.1:8029");
+    chat::IOManager server_iom(server_threads, false, "server");
+    chat::IOManager client_iom(client_threads, false, "client");
+    chat::http::HttpServer::ptr server(new chat::http::HttpServer(true
+                , &server_iom, &server_iom, &server_iom));
+    server_iom.schedule([&]() {
+        while (!server->bind(addr)) {
+            sleep(2);
+        }
+        server->start();
+    });
+    sleep(1);
+
+    //HttpConnectionPool: 每个协程独占一个连接
+    chat::http::HttpConnectionPool::ptr pool(new chat::http::HttpConnectionPool(
+                "127.0.0.1", "", 8029, false, fibers, 60 * 1000, 1000000));
+    s_running = fibers;
+    for (int i = 0; i < fibers; ++i) {
+        client_iom.schedule(std::bind(run_pool, pool));
+    }
+    uint64_t begin = chat::GetCurrentUs();
+    sleep(seconds);
+    s_stop = true;
+    uint64_t used = chat::GetCurrentUs() - begin;
+    while (s_running > 0) {
+        usleep(10 * 1000);
+    }
+    report("HttpConnectionPool", used, pool->getStats().created);
+    pool->stop();
+
+    //AsyncHttpClient: 所有协程共享async_conns个流水线连接
+    s_ops = 0;
+    s_fails = 0;
+    s_stop = false;
+    chat::http::AsyncHttpClient::ptr client(new chat::http::AsyncHttpClient(
+                "127.0.0.1", "", 8029, false, async_conns));
+    client_iom.schedule([&]() {
+        client->start();
+        s_running = fibers;
+        for (int i = 0; i < fibers; ++i) {
+            client_iom.schedule(std::bind(run_async, client));
+        }
+    });
+    begin = chat::GetCurrentUs();
+    sleep(seconds);
+    s_stop = true;
+    used = chat::GetCurrentUs() - begin;
+    while (s_running > 0) {
+        usleep(10 * 1000);
+    }
+    report("AsyncHttpClient   ", used, async_conns);
+
+    client_iom.schedule([&]() {
+        client->stop();
+    });
+    server_iom.schedule([&]() {
+        server->stop();
+    });
+    return 0;
+}
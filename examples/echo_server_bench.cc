@@ -0,0 +1,150 @@
+#include "chat/tcp_server.h"
+#include "chat/log.h"
+#include "chat/iomanager.h"
+#include "chat/bytearray.h"
+#include "chat/address.h"
+#include "chat/util.h"
+#include <atomic>
+#include <stdlib.h>
+#include <unistd.h>
+
+//echo吞吐压测: 同一进程内起server/client两个IOManager, 对比绑核与不绑核
+//用法: echo_server_bench [-p cpus] [-t server_threads] [-T client_threads] [-c conns] [-s seconds] [-l msg_len]
+//例:   echo_server_bench -t 4 -c 64 -s 10
+//      echo_server_bench -t 4 -c 64 -s 10 -p 0-3
+
+static chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static std::atomic<uint64_t> s_ops = {0};
+static std::atomic<uint64_t> s_bytes = {0};
+static volatile bool s_stop = false;
+
+class EchoServer : public chat::TcpServer {
+public:
+    typedef std::shared_ptr<EchoServer> ptr;
+    EchoServer(chat::IOManager* iom)
+        :chat::TcpServer(iom, iom, iom) {
+    }
+
+    void handleClient(chat::Socket::ptr client) override {
+        //缓冲区在绑核后的工作线程上首次写入, 落在本地NUMA节点
+        chat::ByteArray::ptr ba(new chat::ByteArray);
+        while (true) {
+            ba->clear();
+            std::vector<iovec> iovs;
+            ba->getWriteBuffers(iovs, 4096);
+            int rt = client->recv(&iovs[0], iovs.size());
+            if (rt <= 0) {
+                break;
+            }
+            ba->setPosition(ba->getPosition() + rt);
+            ba->setPosition(0);
+            iovs.clear();
+            ba->getReadBuffers(iovs, rt);
+            if (client->send(&iovs[0], iovs.size()) != rt) {
+                break;
+            }
+        }
+        client->close();
+    }
+};
+
+void run_client(chat::Address::ptr addr, size_t len) {
+    chat::Socket::ptr sock = chat::Socket::CreateTCP(addr);
+    if (!sock->connect(addr)) {
+        CHAT_LOG_ERROR(g_logger) << "connect " << *addr << " fail errno=" << errno;
+        return;
+    }
+    std::string req(len, 'x');
+    std::string rsp(len, '\0');
+    while (!s_stop) {
+        if (sock->send(&req[0], req.size()) != (int)req.size()) {
+            break;
+        }
+        size_t offset = 0;
+        while (offset < len) {
+            int rt = sock->recv(&rsp[offset], len - offset);
+            if (rt <= 0) {
+                sock->close();
+                return;
+            }
+            offset += rt;
+        }
+        ++s_ops;
+        s_bytes += len;
+    }
+    sock->close();
+}
+
+int main(int argc, char** argv) {
+    std::vector<int> cpus;
+    int server_threads = 4;
+    int client_threads = 4;
+    int conns = 64;
+    int seconds = 10;
+    int len = 64;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:t:T:c:s:l:")) != -1) {
+        switch (opt) {
+            case 'p':
+                cpus = chat::ParseCpuList(optarg);
+                break;
+            case 't':
+                server_threads = atoi(optarg);
+                break;
+            case 'T':
+                client_threads = atoi(optarg);
+                break;
+            case 'c':
+                conns = atoi(optarg);
+                break;
+            case 's':
+                seconds = atoi(optarg);
+                break;
+            case 'l':
+                len = atoi(optarg);
+                break;
+            default:
+                CHAT_LOG_INFO(g_logger) << "use as[" << argv[0]
+                    << " -p cpus -t server_threads -T client_threads -c conns -s seconds -l msg_len]";
+                return 0;
+        }
+    }
+    g_logger->setLevel(chat::LogLevel::WARN);
+    CHAT_LOG_NAME("system")->setLevel(chat::LogLevel::WARN);
+
+    chat::Address::ptr addr = chat::Address::LookupAny("127.0.0.1:8021");
+    {
+        chat::IOManager server_iom(server_threads, false, "server", cpus);
+        chat::IOManager client_iom(client_threads, false, "client");
+
+        EchoServer::ptr es(new EchoServer(&server_iom));
+        while (!es->bind(addr)) {
+            sleep(2);
+        }
+        es->start();
+
+        for (int i = 0; i < conns; ++i) {
+            client_iom.schedule(std::bind(run_client, addr, (size_t)len));
+        }
+
+        uint64_t begin = chat::GetCurrentUs();
+        sleep(seconds);
+        s_stop = true;
+        uint64_t used = chat::GetCurrentUs() - begin;
+
+        std::cout << "server_threads=" << server_threads
+                  << " cpus=" << (cpus.empty() ? std::string("none")
+                        : chat::Join(cpus.begin(), cpus.end(), ","))
+                  << " conns=" << conns
+                  << " msg_len=" << len
+                  << " ops=" << s_ops
+                  << " qps=" << (s_ops * 1000000.0 / used)
+                  << " MB/s=" << (s_bytes * 1.0 / used)
+                  << std::endl;
+
+        es->stop();
+    }
+    return 0;
+}
@@ -0,0 +1,214 @@
+#include "chat/udp_server.h"
+#include "chat/socket.h"
+#include "chat/iomanager.h"
+#include "chat/log.h"
+#include "chat/util.h"
+#include <atomic>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+//udp echo pps压测: 同一进程内起server/client两个IOManager
+//-m legacy 为echo_server_udp.cc的逐包recvFrom/sendTo, -m batch 为UdpServer的recvmmsg/sendmmsg
+//用法: echo_server_udp_bench [-m batch|legacy] [-t server_threads] [-T client_threads] [-c socks]
+//                           [-w window] [-b batch] [-g] [-G] [-s seconds] [-l msg_len]
+//例:   echo_server_udp_bench -m legacy -t 2 -c 8
+//      echo_server_udp_bench -m batch -t 2 -c 8 -b 32 -g
+
+static chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static std::atomic<uint64_t> s_ops = {0};
+static volatile bool s_stop = false;
+
+class EchoUdpServer : public chat::UdpServer {
+public:
+    typedef std::shared_ptr<EchoUdpServer> ptr;
+    EchoUdpServer(chat::IOManager* iom)
+        :chat::UdpServer(iom) {
+    }
+protected:
+    void handlePacket(Batch& batch, const Packet& pkt) override {
+        batch.reply(pkt, pkt.data, pkt.len);
+    }
+};
+
+//逐包收发, 与echo_server_udp.cc一致
+void run_legacy(chat::Socket::ptr sock) {
+    char buff[2048];
+    while (!s_stop) {
+        chat::Address::ptr from(new chat::IPv4Address);
+        int len = sock->recvFrom(buff, sizeof(buff), from);
+        if (len > 0) {
+            sock->sendTo(buff, len, from);
+        }
+    }
+}
+
+//每个socket保持window个包在途, 收到多少补发多少
+void run_client(chat::Address::ptr addr, size_t window, size_t len) {
+    chat::Socket::ptr sock = chat::Socket::CreateUDP(addr);
+    sock->connect(addr);
+    sock->setRecvTimeout(200);
+    int fd = sock->getSocket();
+
+    std::string payload(len, 'x');
+    std::vector<char> rbuf(window * 2048);
+    std::vector<iovec> riovs(window);
+    std::vector<iovec> siovs(window);
+    std::vector<mmsghdr> rmsgs(window);
+    std::vector<mmsghdr> smsgs(window);
+    for (size_t i = 0; i < window; ++i) {
+        riovs[i].iov_base = &rbuf[i * 2048];
+        riovs[i].iov_len = 2048;
+        siovs[i].iov_base = &payload[0];
+        siovs[i].iov_len = len;
+        memset(&rmsgs[i], 0, sizeof(mmsghdr));
+        memset(&smsgs[i], 0, sizeof(mmsghdr));
+        rmsgs[i].msg_hdr.msg_iov = &riovs[i];
+        rmsgs[i].msg_hdr.msg_iovlen = 1;
+        smsgs[i].msg_hdr.msg_iov = &siovs[i];
+        smsgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int inflight = 0;
+    while (!s_stop) {
+        if (inflight == 0) {
+            int rt = sendmmsg(fd, &smsgs[0], window, 0);
+            if (rt <= 0) {
+                break;
+            }
+            inflight = rt;
+        }
+        int n = recvmmsg(fd, &rmsgs[0], window, 0, nullptr);
+        if (n <= 0) {
+            inflight = 0;  //超时视为丢包, 重新填满窗口
+            continue;
+        }
+        s_ops += n;
+        int rt = sendmmsg(fd, &smsgs[0], n, 0);
+        inflight += (rt > 0 ? rt : 0) - n;
+        if (inflight < 0) {
+            inflight = 0;
+        }
+    }
+    sock->close();
+}
+
+int main(int argc, char** argv) {
+    std::string mode = "batch";
+    int server_threads = 2;
+    int client_threads = 2;
+    int socks = 8;
+    int window = 32;
+    int batch = 32;
+    bool gso = false;
+    bool gro = false;
+    int seconds = 5;
+    int len = 64;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:t:T:c:w:b:gGs:l:")) != -1) {
+        switch (opt) {
+            case 'm':
+                mode = optarg;
+                break;
+            case 't':
+                server_threads = atoi(optarg);
+                break;
+            case 'T':
+                client_threads = atoi(optarg);
+                break;
+            case 'c':
+                socks = atoi(optarg);
+                break;
+            case 'w':
+                window = atoi(optarg);
+                break;
+            case 'b':
+                batch = atoi(optarg);
+                break;
+            case 'g':
+                gso = true;
+                break;
+            case 'G':
+                gro = true;
+                break;
+            case 's':
+                seconds = atoi(optarg);
+                break;
+            case 'l':
+                len = atoi(optarg);
+                break;
+            default:
+                CHAT_LOG_INFO(g_logger) << "use as[" << argv[0]
+                    << " -m batch|legacy -t server_threads -T client_threads -c socks"
+                    << " -w window -b batch -g(gso) -G(gro) -s seconds -l msg_len]";
+                return 0;
+        }
+    }
+    g_logger->setLevel(chat::LogLevel::WARN);
+    CHAT_LOG_NAME("system")->setLevel(chat::LogLevel::WARN);
+
+    chat::Address::ptr addr = chat::Address::LookupAny("127.0.0.1:8022");
+    {
+        chat::IOManager server_iom(server_threads, false, "server");
+        chat::IOManager client_iom(client_threads, false, "client");
+
+        EchoUdpServer::ptr us;
+        std::vector<chat::Socket::ptr> legacy_socks;
+        if (mode == "legacy") {
+            for (int i = 0; i < server_threads; ++i) {
+                chat::Socket::ptr sock = chat::Socket::CreateUDP(addr);
+                int val = 1;
+                sock->setOption(SOL_SOCKET, SO_REUSEPORT, val);
+                if (!sock->bind(addr)) {
+                    CHAT_LOG_ERROR(g_logger) << "bind " << *addr << " fail";
+                    return 1;
+                }
+                legacy_socks.push_back(sock);
+                server_iom.schedule(std::bind(run_legacy, sock));
+            }
+        } else {
+            us.reset(new EchoUdpServer(&server_iom));
+            us->setBatch(batch);
+            us->setGso(gso);
+            us->setGro(gro);
+            if (!us->bind(addr)) {
+                return 1;
+            }
+            us->start();
+        }
+
+        for (int i = 0; i < socks; ++i) {
+            client_iom.schedule(std::bind(run_client, addr, (size_t)window, (size_t)len));
+        }
+
+        uint64_t begin = chat::GetCurrentUs();
+        sleep(seconds);
+        s_stop = true;
+        uint64_t used = chat::GetCurrentUs() - begin;
+
+        std::cout << "mode=" << mode
+                  << " server_threads=" << server_threads
+                  << " socks=" << socks
+                  << " window=" << window
+                  << " batch=" << (mode == "legacy" ? 1 : batch)
+                  << " gso=" << gso
+                  << " gro=" << gro
+                  << " msg_len=" << len
+                  << " round_trips=" << s_ops
+                  << " pps=" << (s_ops * 1000000.0 / used)
+                  << std::endl;
+
+        if (us) {
+            us->stop();
+        }
+        for (auto& i : legacy_socks) {
+            server_iom.schedule([i](){
+                i->cancelAll();
+                i->close();
+            });
+        }
+    }
+    return 0;
+}
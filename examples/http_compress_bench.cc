@@ -0,0 +1,71 @@
+#include "chat/http/http_compress.h"
+#include "chat/log.h"
+#include "chat/util.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+
+//响应压缩压测: 不同压缩级别下每个响应的CPU耗时与压缩后字节数,
+//以及池化z_stream(deflateReset)与每个响应deflateInit的对比
+//用法: http_compress_bench [-s body_size] [-n loops]
+
+static chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+int main(int argc, char** argv) {
+    int size = 16 * 1024;
+    int loops = 2000;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:")) != -1) {
+        switch (opt) {
+            case 's':
+                size = atoi(optarg);
+                break;
+            case 'n':
+                loops = atoi(optarg);
+                break;
+            default:
+                CHAT_LOG_INFO(g_logger) << "use as[" << argv[0] << " -s body_size -n loops]";
+                return 0;
+        }
+    }
+
+    //接近真实接口的JSON列表
+    std::string body = "[";
+    for (int i = 0; (int)body.size() < size; ++i) {
+        body += "{\"id\":" + std::to_string(i * 7919 % 100003)
+              + ",\"name\":\"user_" + std::to_string(i) + "\",\"score\":"
+              + std::to_string(i * 31 % 1000) + ",\"tags\":[\"a\",\"b\"]},";
+    }
+    body.back() = ']';
+
+    chat::http::HttpCompressor compressor;
+    std::string out;
+    size_t total = 0;
+    printf("body=%zu loops=%d\n", body.size(), loops);
+    printf("level   pooled(us/op)   init(us/op)   MB/s      bytes   ratio\n");
+    for (int level = 1; level <= 9; ++level) {
+        compressor.setLevel(level);
+        uint64_t begin = chat::GetCurrentUs();
+        for (int i = 0; i < loops; ++i) {
+            compressor.encode(body.c_str(), body.size(), chat::ZlibStream::GZIP, out);
+            total += out.size();
+        }
+        uint64_t pooled = chat::GetCurrentUs() - begin;
+
+        begin = chat::GetCurrentUs();
+        for (int i = 0; i < loops; ++i) {
+            auto zs = chat::ZlibStream::Create(true, 16 * 1024, chat::ZlibStream::GZIP, level);
+            zs->write(body.c_str(), body.size());
+            zs->flush();
+            total += zs->getResult().size();
+        }
+        uint64_t init = chat::GetCurrentUs() - begin;
+
+        printf("%5d   %13.2f   %11.2f   %7.1f   %6zu   %5.2f\n", level
+               , pooled * 1.0 / loops, init * 1.0 / loops
+               , body.size() * 1.0 * loops / (pooled ? pooled : 1)
+               , out.size(), body.size() * 1.0 / out.size());
+    }
+    printf("total=%zu\n", total);
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "chat/http/http.h"
+#include "chat/http/http_parser.h"
+#include "chat/log.h"
+#include "chat/util.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+//请求参数压测: 典型接口请求带一串Cookie和较多query参数, servlet只取两个query参数
+//eager: getParams()/getCookies()把全部参数解码进map(原来首次访问时的做法)再查找
+//lazy:  只建偏移索引, 只解码用到的两个值
+//用法: http_param_bench [-n loops]
+
+static chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static const char* s_request =
+    "GET /api/v1/search?q=%E4%BD%A0%E5%A5%BD+world&page=2&size=20&sort=time&order=desc"
+    "&lang=zh-CN&client=web&ver=8.3.1&ts=1700000000&sign=5f1e2d3c4b5a6978 HTTP/1.1\r\n"
+    "Host: api.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: application/json, text/plain, */*\r\n"
+    "Cookie: sid=8f3c2a1b9d7e6f5a4c3b2a1908f7e6d5; theme=dark; lang=zh-CN; _ga=GA1.2.1283907421.1700000000;"
+    " _gid=GA1.2.188213.1700000000; csrftoken=Qm9ndXNDc3JmVG9rZW4; tz=Asia%2FShanghai; ab=exp_42%3Dvariant_b\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+int main(int argc, char** argv) {
+    int loops = 1000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                loops = atoi(optarg);
+                break;
+            default:
+                CHAT_LOG_INFO(g_logger) << "use as[" << argv[0] << " -n loops]";
+                return 0;
+        }
+    }
+
+    std::string buf = s_request;
+    chat::http::HttpRequestParser parser;
+    parser.execute(&buf[0], buf.size());
+    chat::http::HttpRequest::ptr tpl = parser.getData();
+
+    size_t sum = 0;
+    uint64_t begin = chat::GetCurrentUs();
+    for (int i = 0; i < loops; ++i) {
+        chat::http::HttpRequest req(*tpl);
+        auto& params = req.getParams();
+        req.getCookies();
+        sum += params.find("page")->second.size() + params.find("q")->second.size();
+    }
+    uint64_t eager_used = chat::GetCurrentUs() - begin;
+
+    begin = chat::GetCurrentUs();
+    for (int i = 0; i < loops; ++i) {
+        chat::http::HttpRequest req(*tpl);
+        sum += req.getParamAs<int>("page") + req.getParam("q").size();
+    }
+    uint64_t lazy_used = chat::GetCurrentUs() - begin;
+
+    begin = chat::GetCurrentUs();
+    for (int i = 0; i < loops; ++i) {
+        chat::http::HttpRequest req(*tpl);
+        sum += req.getQuery().size();
+    }
+    uint64_t copy_used = chat::GetCurrentUs() - begin;
+
+    std::cout << "loops=" << loops << " sum=" << sum << std::endl
+              << "request copy  " << (copy_used * 1000.0 / loops) << " ns/op" << std::endl
+              << "eager         " << ((eager_used - copy_used) * 1000.0 / loops) << " ns/op" << std::endl
+              << "lazy          " << ((lazy_used - copy_used) * 1000.0 / loops) << " ns/op" << std::endl;
+    return 0;
+}
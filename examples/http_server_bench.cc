@@ -0,0 +1,164 @@
+#include "chat/http/http_server.h"
+#include "chat/log.h"
+#include "chat/iomanager.h"
+#include "chat/address.h"
+#include "chat/util.h"
+#include <atomic>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+//http keep-alive压测(wrk --pipeline风格): 每个连接一次写入depth个GET, 再读回depth个响应
+//用法: http_server_bench [-t server_threads] [-T client_threads] [-c conns] [-d depth] [-s seconds] [-b body_size]
+//例:   http_server_bench -t 2 -c 64 -d 1
+//      http_server_bench -t 2 -c 64 -d 16
+//      http_server_bench -t 2 -c 16 -d 1 -b 4194304
+
+static chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static std::atomic<uint64_t> s_ops = {0};
+static std::atomic<uint64_t> s_bytes = {0};
+static volatile bool s_stop = false;
+
+//从buf中取出一个完整响应, 返回其长度, 不完整返回0
+static size_t parse_response(const std::string& buf, size_t offset) {
+    size_t pos = buf.find("\r\n\r\n", offset);
+    if (pos == std::string::npos) {
+        return 0;
+    }
+    size_t hlen = pos + 4 - offset;
+    size_t clen = 0;
+    std::string header = buf.substr(offset, hlen);
+    const char* p = strcasestr(header.c_str(), "content-length:");
+    if (p) {
+        clen = strtoull(p + 15, nullptr, 10);
+    }
+    if (buf.size() - offset < hlen + clen) {
+        return 0;
+    }
+    return hlen + clen;
+}
+
+void run_client(chat::Address::ptr addr, int depth) {
+    chat::Socket::ptr sock = chat::Socket::CreateTCP(addr);
+    if (!sock->connect(addr)) {
+        CHAT_LOG_ERROR(g_logger) << "connect " << *addr << " fail errno=" << errno;
+        return;
+    }
+    sock->setRecvTimeout(1000);
+    std::string req;
+    for (int i = 0; i < depth; ++i) {
+        req.append("GET /bench HTTP/1.1\r\nHost: 127.0.0.1\r\nUser-Agent: bench\r\nConnection: keep-alive\r\n\r\n");
+    }
+    std::string buf;
+    char tmp[16 * 1024];
+    while (!s_stop) {
+        if (sock->send(&req[0], req.size()) != (int)req.size()) {
+            break;
+        }
+        int got = 0;
+        size_t offset = 0;
+        while (got < depth) {
+            size_t n = parse_response(buf, offset);
+            if (n > 0) {
+                offset += n;
+                ++got;
+                continue;
+            }
+            int rt = sock->recv(tmp, sizeof(tmp));
+            if (rt <= 0) {
+                sock->close();
+                return;
+            }
+            buf.append(tmp, rt);
+            s_bytes += rt;
+        }
+        buf.erase(0, offset);
+        s_ops += depth;
+    }
+    sock->close();
+}
+
+int main(int argc, char** argv) {
+    int server_threads = 2;
+    int client_threads = 2;
+    int conns = 64;
+    int depth = 16;
+    int seconds = 5;
+    size_t body_size = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:T:c:d:s:b:")) != -1) {
+        switch (opt) {
+            case 't':
+                server_threads = atoi(optarg);
+                break;
+            case 'T':
+                client_threads = atoi(optarg);
+                break;
+            case 'c':
+                conns = atoi(optarg);
+                break;
+            case 'd':
+                depth = atoi(optarg);
+                break;
+            case 's':
+                seconds = atoi(optarg);
+                break;
+            case 'b':
+                body_size = atoll(optarg);
+                break;
+            default:
+                CHAT_LOG_INFO(g_logger) << "use as[" << argv[0]
+                    << " -t server_threads -T client_threads -c conns -d depth -s seconds -b body_size]";
+                return 0;
+        }
+    }
+    g_logger->setLevel(chat::LogLevel::WARN);
+    CHAT_LOG_NAME("system")->setLevel(chat::LogLevel::WARN);
+
+    chat::Address::ptr addr = chat::Address::LookupAny("127.0.0.1:8023");
+    {
+        chat::IOManager server_iom(server_threads, false, "server");
+        chat::IOManager client_iom(client_threads, false, "client");
+
+        chat::http::HttpServer::ptr server(new chat::http::HttpServer(true
+                    , &server_iom, &server_iom, &server_iom));
+        if (body_size > 0) {
+            std::string body(body_size, 'x');
+            server->getServletDispatch()->addServlet("/bench", [body](chat::http::HttpRequest::ptr req
+                    , chat::http::HttpResponse::ptr rsp
+                    , chat::SocketStream::ptr session) {
+                rsp->setBody(body);
+                return 0;
+            });
+        }
+        //监听socket在协程内创建才是非阻塞的, stop时accept能被取消
+        server_iom.schedule([&]() {
+            while (!server->bind(addr)) {
+                sleep(2);
+            }
+            server->start();
+            for (int i = 0; i < conns; ++i) {
+                client_iom.schedule(std::bind(run_client, addr, depth));
+            }
+        });
+
+        uint64_t begin = chat::GetCurrentUs();
+        sleep(seconds);
+        s_stop = true;
+        uint64_t used = chat::GetCurrentUs() - begin;
+
+        std::cout << "server_threads=" << server_threads
+                  << " conns=" << conns
+                  << " depth=" << depth
+                  << " requests=" << s_ops
+                  << " body_size=" << body_size
+                  << " rps=" << (s_ops * 1000000.0 / used)
+                  << " MB/s=" << (s_bytes * 1.0 / used)
+                  << std::endl;
+
+        server->stop();
+    }
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include "chat/http/http_server.h"
+#include "chat/http/http_connection.h"
+#include "chat/http/proxy_servlet.h"
+#include "chat/log.h"
+#include "chat/iomanager.h"
+#include "chat/mutex.h"
+#include "chat/util.h"
+#include <algorithm>
+#include <atomic>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+
+//反向代理压测: 本地上游直连, 经ProxyServlet(splice)转发, 经ProxyServlet(用户态拷贝)转发,
+//对比吞吐(rps, MB/s)与延迟(p50/p99)
+//用法: proxy_bench [-t server_threads] [-T client_threads] [-f fibers] [-b body_size] [-s seconds]
+
+static chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static std::atomic<uint64_t> s_ops = {0};
+static std::atomic<uint64_t> s_fails = {0};
+static std::atomic<int> s_running = {0};
+static volatile bool s_stop = false;
+static chat::Mutex s_mutex;
+static std::vector<uint32_t> s_latency;
+
+static void run_client(chat::http::HttpConnectionPool::ptr pool, size_t body_size) {
+    std::vector<uint32_t> latency;
+    while (!s_stop) {
+        uint64_t begin = chat::GetCurrentUs();
+        auto r = pool->doGet("/blob", 5000);
+        if (r->result == 0 && r->response->getBody().size() == body_size) {
+            latency.push_back(chat::GetCurrentUs() - begin);
+            ++s_ops;
+        } else {
+            ++s_fails;
+        }
+    }
+    chat::Mutex::Lock lock(s_mutex);
+    s_latency.insert(s_latency.end(), latency.begin(), latency.end());
+    --s_running;
+}
+
+static void bench(const char* name, chat::IOManager& iom, uint16_t port
+                  , int fibers, int seconds, size_t body_size) {
+    s_ops = 0;
+    s_fails = 0;
+    s_stop = false;
+    s_latency.clear();
+    chat::http::HttpConnectionPool::ptr pool(new chat::http::HttpConnectionPool(
+                "127.0.0.1", "", port, false, fibers, 60 * 1000, 1000000));
+    s_running = fibers;
+    for (int i = 0; i < fibers; ++i) {
+        iom.schedule(std::bind(run_client, pool, body_size));
+    }
+    uint64_t begin = chat::GetCurrentUs();
+    sleep(seconds);
+    s_stop = true;
+    uint64_t used = chat::GetCurrentUs() - begin;
+    while (s_running > 0) {
+        usleep(10 * 1000);
+    }
+    //空闲连接要在IO线程里关闭, 否则fd复用时残留的事件状态会影响下一轮
+    s_running = 1;
+    iom.schedule([&pool]() {
+        pool = nullptr;
+        --s_running;
+    });
+    while (s_running > 0) {
+        usleep(10 * 1000);
+    }
+
+    std::sort(s_latency.begin(), s_latency.end());
+    auto pct = [](double p) {
+        return s_latency.empty() ? 0 : s_latency[std::min(s_latency.size() - 1, (size_t)(s_latency.size() * p))];
+    };
+    printf("%-14s requests=%-8lu fails=%-4lu rps=%-10.1f MB/s=%-8.1f p50=%uus p99=%uus\n"
+           , name, (unsigned long)s_ops.load(), (unsigned long)s_fails.load()
+           , s_ops * 1000000.0 / used, s_ops * 1.0 * body_size / used
+           , pct(0.5), pct(0.99));
+}
+
+int main(int argc, char** argv) {
+    int server_threads = 2;
+    int client_threads = 2;
+    int fibers = 32;
+    int body_size = 256 * 1024;
+    int seconds = 3;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:T:f:b:s:")) != -1) {
+        switch (opt) {
+            case 't':
+                server_threads = atoi(optarg);
+                break;
+            case 'T':
+                client_threads = atoi(optarg);
+                break;
+            case 'f':
+                fibers = atoi(optarg);
+                break;
+            case 'b':
+                body_size = atoi(optarg);
+                break;
+            case 's':
+                seconds = atoi(optarg);
+                break;
+            default:
+                CHAT_LOG_INFO(g_logger) << "use as[" << argv[0]
+                    << " -t server_threads -T client_threads -f fibers -b body_size -s seconds]";
+                return 0;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+    g_logger->setLevel(chat::LogLevel::WARN);
+    CHAT_LOG_NAME("system")->setLevel(chat::LogLevel::ERROR);
+
+    chat::IOManager server_iom(server_threads, false, "server");
+    chat::IOManager client_iom(client_threads, false, "client");
+    std::string body(body_size, 'x');
+
+    //8040上游, 8041经splice转发, 8042经用户态拷贝转发
+    std::vector<chat::http::HttpServer::ptr> servers;
+    for (int i = 0; i < 3; ++i) {
+        servers.emplace_back(new chat::http::HttpServer(true, &server_iom, &server_iom, &server_iom));
+    }
+    servers[0]->getServletDispatch()->addServlet("/blob", [body](chat::http::HttpRequest::ptr req
+                , chat::http::HttpResponse::ptr rsp
+                , chat::SocketStream::ptr session) {
+        rsp->setBody(body);
+        return 0;
+    });
+    auto splice = std::make_shared<chat::http::ProxyServlet>(std::vector<std::string>{"http://127.0.0.1:8040"});
+    auto copy = std::make_shared<chat::http::ProxyServlet>(std::vector<std::string>{"http://127.0.0.1:8040"});
+    copy->setSplice(false);
+    servers[1]->getServletDispatch()->addGlobServlet("/*", splice);
+    servers[2]->getServletDispatch()->addGlobServlet("/*", copy);
+    server_iom.schedule([&]() {
+        for (size_t i = 0; i < servers.size(); ++i) {
+            auto addr = chat::Address::LookupAny("127.0.0.1:" + std::to_string(8040 + i));
+            while (!servers[i]->bind(addr)) {
+                sleep(2);
+            }
+            servers[i]->start();
+        }
+    });
+    sleep(1);
+
+    printf("body=%d fibers=%d seconds=%d\n", body_size, fibers, seconds);
+    bench("direct", client_iom, 8040, fibers, seconds, body_size);
+    bench("proxy(splice)", client_iom, 8041, fibers, seconds, body_size);
+    bench("proxy(copy)", client_iom, 8042, fibers, seconds, body_size);
+
+    auto st = splice->getStats();
+    auto ct = copy->getStats();
+    printf("splice: spliced=%lu copied=%lu  copy: spliced=%lu copied=%lu\n"
+           , (unsigned long)st.splicedBytes, (unsigned long)st.copiedBytes
+           , (unsigned long)ct.splicedBytes, (unsigned long)ct.copiedBytes);
+
+    server_iom.schedule([servers]() {
+        for (auto& i : servers) {
+            i->stop();
+        }
+    });
+    return 0;
+}
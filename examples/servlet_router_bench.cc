@@ -0,0 +1,78 @@
+#include "chat/http/servlet.h"
+#include "chat/log.h"
+#include "chat/util.h"
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+//路由分发压测: n组/api/v1/svcN/*形式的glob路由,
+//对比原来逐个fnmatch与路由树的单次匹配耗时
+//用法: servlet_router_bench [-r routes] [-n loops]
+
+static chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+int main(int argc, char** argv) {
+    int routes = 300;
+    int loops = 1000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:n:")) != -1) {
+        switch (opt) {
+            case 'r':
+                routes = atoi(optarg);
+                break;
+            case 'n':
+                loops = atoi(optarg);
+                break;
+            default:
+                CHAT_LOG_INFO(g_logger) << "use as[" << argv[0] << " -r routes -n loops]";
+                return 0;
+        }
+    }
+
+    std::vector<std::string> globs;
+    std::vector<std::string> paths;
+    chat::http::ServletDispatch dispatch;
+    auto slt = std::make_shared<chat::http::NotFoundServlet>("bench");
+    for (int i = 0; i < routes; ++i) {
+        globs.push_back("/api/v1/svc" + std::to_string(i) + "/*");
+        paths.push_back("/api/v1/svc" + std::to_string(i) + "/users/1024/profile");
+        dispatch.addGlobServlet(globs.back(), slt);
+    }
+    dispatch.addRoute("/api/v2/users/:id/posts/:pid", slt);
+
+    size_t found = 0;
+    uint64_t begin = chat::GetCurrentUs();
+    for (int i = 0; i < loops; ++i) {
+        auto& path = paths[i % routes];
+        for (auto& g : globs) {
+            if (!fnmatch(g.c_str(), path.c_str(), 0)) {
+                ++found;
+                break;
+            }
+        }
+    }
+    uint64_t fnmatch_used = chat::GetCurrentUs() - begin;
+
+    begin = chat::GetCurrentUs();
+    for (int i = 0; i < loops; ++i) {
+        found += dispatch.getMatchedServlet(paths[i % routes]) == slt;
+    }
+    uint64_t tree_used = chat::GetCurrentUs() - begin;
+
+    chat::http::HttpRequest::ptr req(new chat::http::HttpRequest);
+    req->setPath("/api/v2/users/1024/posts/7");
+    begin = chat::GetCurrentUs();
+    for (int i = 0; i < loops; ++i) {
+        found += dispatch.getMatchedServlet(req) == slt;
+    }
+    uint64_t param_used = chat::GetCurrentUs() - begin;
+
+    std::cout << "routes=" << routes
+              << " loops=" << loops
+              << " found=" << found
+              << std::endl
+              << "fnmatch      " << (fnmatch_used * 1000.0 / loops) << " ns/op" << std::endl
+              << "radix tree   " << (tree_used * 1000.0 / loops) << " ns/op" << std::endl
+              << "with params  " << (param_used * 1000.0 / loops) << " ns/op" << std::endl;
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "chat/http/session_data.h"
+#include "chat/log.h"
+#include "chat/thread.h"
+#include "chat/util.h"
+#include <atomic>
+#include <stdlib.h>
+#include <unistd.h>
+
+//会话管理压测: 大量会话下的add耗时、一次check(推进时间轮)耗时,
+//以及check与多线程get并发时get的吞吐
+//用法: session_data_bench [-n sessions] [-t threads] [-s seconds]
+
+static chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+int main(int argc, char** argv) {
+    int sessions = 1000000;
+    int threads = 4;
+    int seconds = 3;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:s:")) != -1) {
+        switch (opt) {
+            case 'n':
+                sessions = atoi(optarg);
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 's':
+                seconds = atoi(optarg);
+                break;
+            default:
+                CHAT_LOG_INFO(g_logger) << "use as[" << argv[0] << " -n sessions -t threads -s seconds]";
+                return 0;
+        }
+    }
+
+    chat::http::SessionDataManager mgr;
+    std::vector<std::string> ids;
+    ids.reserve(sessions);
+    uint64_t begin = chat::GetCurrentUs();
+    for (int i = 0; i < sessions; ++i) {
+        chat::http::SessionData::ptr data(new chat::http::SessionData(true));
+        data->setData("uid", i);
+        data->setData("name", std::string("user"));
+        ids.push_back(data->getId());
+        mgr.add(data);
+    }
+    uint64_t used = chat::GetCurrentUs() - begin;
+    printf("sessions=%zu add=%.1fns/op\n", mgr.size(), used * 1000.0 / sessions);
+
+    begin = chat::GetCurrentUs();
+    mgr.check();
+    printf("check=%luus\n", (unsigned long)(chat::GetCurrentUs() - begin));
+
+    std::atomic<uint64_t> ops = {0};
+    std::atomic<uint64_t> checks = {0};
+    std::atomic<uint64_t> check_max = {0};
+    volatile bool stop = false;
+    std::vector<chat::Thread::ptr> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back(new chat::Thread([&, i]() {
+            uint64_t n = 0;
+            uint32_t seed = i;
+            while (!stop) {
+                auto data = mgr.get(ids[rand_r(&seed) % ids.size()]);
+                n += data && data->getData<int>("uid") >= 0;
+            }
+            ops += n;
+        }, "get_" + std::to_string(i)));
+    }
+    workers.emplace_back(new chat::Thread([&]() {
+        while (!stop) {
+            uint64_t b = chat::GetCurrentUs();
+            mgr.check();
+            uint64_t u = chat::GetCurrentUs() - b;
+            check_max = std::max(check_max.load(), u);
+            ++checks;
+            usleep(1000);
+        }
+    }, "check"));
+    sleep(seconds);
+    stop = true;
+    for (auto& i : workers) {
+        i->join();
+    }
+    printf("threads=%d get=%.0f ops/s checks=%lu check_max=%luus\n", threads
+           , ops * 1.0 / seconds, (unsigned long)checks.load(), (unsigned long)check_max.load());
+    return 0;
+}
@@ -0,0 +1,276 @@
+#include "chat/http/ws_broadcast.h"
+#include "chat/http/ws_connection.h"
+#include "chat/http/ws_server.h"
+#include "chat/log.h"
+#include "chat/iomanager.h"
+#include "chat/mutex.h"
+#include "chat/util.h"
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//WebSocket广播压测: N个订阅者, 对比逐个sendMessage与WSBroadcaster编码一次后按线程扇出
+//服务端在父进程, 客户端在fork出的子进程(各自占N个fd)
+//每轮广播M条消息, 子进程统计每条投递的延迟(p50/p99)和收齐用时, 父进程统计发送方耗时和CPU
+//用法: ws_broadcast_bench [-c subscribers] [-n messages] [-b payload] [-i interval_us] [-t server_threads] [-T client_threads]
+
+static chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static const char* s_phases[] = {"sendMessage", "broadcast"};
+
+//子进程: 每轮收齐后往管道写一个字节
+static std::atomic<uint64_t> s_received[2];
+static chat::Spinlock s_mutex;
+static std::vector<uint32_t> s_latency[2];
+
+static void reader(chat::http::WSConnection::ptr conn, int messages) {
+    std::vector<uint32_t> latency[2];
+    int count[2] = {0, 0};
+    while (true) {
+        auto msg = conn->recvMessage();
+        if (!msg) {
+            break;
+        }
+        const std::string& data = msg->getData();
+        int phase = data[0] - '0';
+        if (phase != 0 && phase != 1) {
+            continue;
+        }
+        uint64_t ts = strtoull(data.c_str() + 2, nullptr, 10);
+        latency[phase].push_back(chat::GetCurrentUs() - ts);
+        //每64条或一轮收齐时合并
+        if (latency[phase].size() == 64 || ++count[phase] == messages) {
+            chat::Spinlock::Lock lock(s_mutex);
+            s_latency[phase].insert(s_latency[phase].end(), latency[phase].begin(), latency[phase].end());
+            latency[phase].clear();
+        }
+        ++s_received[phase];
+    }
+    chat::Spinlock::Lock lock(s_mutex);
+    for (int i = 0; i < 2; ++i) {
+        s_latency[i].insert(s_latency[i].end(), latency[i].begin(), latency[i].end());
+    }
+}
+
+static void run_clients(int subscribers, int messages, int threads, int notify_fd) {
+    chat::IOManager iom(threads, false, "client");
+    std::vector<chat::http::WSConnection::ptr> conns(subscribers);
+    std::atomic<int> connected = {0};
+    std::atomic<int> next = {0};
+    //并发建立连接
+    for (int f = 0; f < 64; ++f) {
+        iom.schedule([&]() {
+            int i;
+            while ((i = next++) < subscribers) {
+                auto c = chat::http::WSConnection::Create("http://127.0.0.1:8043/bench", 10000
+                        , {{"Sec-WebSocket-Extensions", "x-none"}}).second;
+                if (c) {
+                    conns[i] = c;
+                    iom.schedule(std::bind(reader, c, messages));
+                }
+                ++connected;
+            }
+        });
+    }
+    while (connected < subscribers) {
+        usleep(10 * 1000);
+    }
+    int ok = std::count_if(conns.begin(), conns.end(), [](auto& c) { return c != nullptr;});
+    printf("client: connected=%d/%d\n", ok, subscribers);
+    fflush(stdout);
+
+    uint64_t expect = (uint64_t)ok * messages;
+    for (int phase = 0; phase < 2; ++phase) {
+        uint64_t begin = 0;
+        uint64_t deadline = chat::GetCurrentUs() + 60 * 1000 * 1000;
+        while (s_received[phase] < expect && chat::GetCurrentUs() < deadline) {
+            if (!begin && s_received[phase] > 0) {
+                begin = chat::GetCurrentUs();
+            }
+            usleep(1000);
+        }
+        uint64_t used = begin ? chat::GetCurrentUs() - begin : 0;
+        std::vector<uint32_t> lat;
+        {
+            chat::Spinlock::Lock lock(s_mutex);
+            lat = s_latency[phase];
+        }
+        std::sort(lat.begin(), lat.end());
+        auto pct = [&lat](double p) {
+            return lat.empty() ? 0 : lat[std::min(lat.size() - 1, (size_t)(lat.size() * p))];
+        };
+        printf("client %-12s received=%lu/%lu recv_span=%.1fms frames/s=%.0f p50=%uus p99=%uus max=%uus\n"
+               , s_phases[phase], (unsigned long)s_received[phase].load(), (unsigned long)expect
+               , used / 1000.0, used ? s_received[phase] * 1000000.0 / used : 0
+               , pct(0.5), pct(0.99), lat.empty() ? 0 : lat.back());
+        fflush(stdout);
+        char c = phase;
+        if (write(notify_fd, &c, 1) != 1) {
+            break;
+        }
+    }
+    for (auto& c : conns) {
+        if (c) {
+            c->getSocket()->close();
+        }
+    }
+    _exit(0);
+}
+
+static uint64_t cpu_us() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec * 1000000ull + ru.ru_utime.tv_usec
+         + ru.ru_stime.tv_sec * 1000000ull + ru.ru_stime.tv_usec;
+}
+
+int main(int argc, char** argv) {
+    int subscribers = 10000;
+    int messages = 20;
+    int payload = 128;
+    int interval = 1000;
+    int server_threads = 4;
+    int client_threads = 4;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:n:b:i:t:T:")) != -1) {
+        switch (opt) {
+            case 'c':
+                subscribers = atoi(optarg);
+                break;
+            case 'n':
+                messages = atoi(optarg);
+                break;
+            case 'b':
+                payload = atoi(optarg);
+                break;
+            case 'i':
+                interval = atoi(optarg);
+                break;
+            case 't':
+                server_threads = atoi(optarg);
+                break;
+            case 'T':
+                client_threads = atoi(optarg);
+                break;
+            default:
+                CHAT_LOG_INFO(g_logger) << "use as[" << argv[0]
+                    << " -c subscribers -n messages -b payload -i interval_us -t server_threads -T client_threads]";
+                return 0;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+    g_logger->setLevel(chat::LogLevel::WARN);
+    //结束时每个连接关闭都会打一条读失败的错误日志
+    CHAT_LOG_NAME("system")->setLevel(chat::LogLevel::FATAL);
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    int fds[2];
+    if (pipe(fds)) {
+        return 1;
+    }
+    //在创建IOManager之前fork, 子进程里没有服务端的线程
+    auto room = std::make_shared<chat::http::WSBroadcaster>(chat::http::WSBroadcaster::DROP);
+    chat::Mutex mutex;
+    std::vector<chat::http::WSSession::ptr> sessions;
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        sleep(1);
+        run_clients(subscribers, messages, client_threads, fds[1]);
+    }
+    close(fds[1]);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    chat::IOManager iom(server_threads, false, "server");
+    chat::http::WSServer::ptr server(new chat::http::WSServer(&iom, &iom, &iom));
+    server->getWSServletDispatch()->addServlet("/bench", [](chat::http::HttpRequest::ptr header
+                , chat::http::WSFrameMessage::ptr msg
+                , chat::http::WSSession::ptr session) {
+        return 0;
+    }, [&](chat::http::HttpRequest::ptr header, chat::http::WSSession::ptr session) {
+        chat::Mutex::Lock lock(mutex);
+        sessions.push_back(session);
+        room->subscribe(session);
+        return 0;
+    }, [&](chat::http::HttpRequest::ptr header, chat::http::WSSession::ptr session) {
+        room->unsubscribe(session);
+        return 0;
+    });
+    iom.schedule([server]() {
+        auto addr = chat::Address::LookupAny("127.0.0.1:8043");
+        while (!server->bind(addr)) {
+            sleep(2);
+        }
+        server->start();
+    });
+
+    printf("subscribers=%d messages=%d payload=%d interval=%dus server_threads=%d\n"
+           , subscribers, messages, payload, interval, server_threads);
+    fflush(stdout);
+    std::atomic<bool> done = {false};
+    iom.schedule([&]() {
+        uint64_t deadline = chat::GetCurrentUs() + 120 * 1000 * 1000;
+        while (room->size() < (size_t)subscribers && chat::GetCurrentUs() < deadline) {
+            usleep(10 * 1000);
+        }
+        std::vector<chat::http::WSSession::ptr> list;
+        {
+            chat::Mutex::Lock lock(mutex);
+            list = sessions;
+        }
+        std::string text(payload, 'x');
+        for (int phase = 0; phase < 2; ++phase) {
+            uint64_t cpu = cpu_us();
+            uint64_t send_us = 0;
+            uint64_t begin = chat::GetCurrentUs();
+            for (int m = 0; m < messages; ++m) {
+                std::string data = std::to_string(phase) + "|" + std::to_string(chat::GetCurrentUs()) + "|";
+                data += text.substr(std::min(data.size(), text.size()));
+                uint64_t t0 = chat::GetCurrentUs();
+                if (phase == 0) {
+                    //原来的做法: 在当前协程里逐个编码并写出
+                    for (auto& s : list) {
+                        s->sendMessage(data, chat::http::WSFrameHead::TEXT_FRAME);
+                    }
+                } else {
+                    room->broadcast(data);
+                }
+                send_us += chat::GetCurrentUs() - t0;
+                if (interval > 0) {
+                    usleep(interval);
+                }
+            }
+            //等子进程收齐
+            char c;
+            while (read(fds[0], &c, 1) != 1) {
+                usleep(1000);
+            }
+            uint64_t used = chat::GetCurrentUs() - begin;
+            uint64_t frames = (uint64_t)list.size() * messages;
+            printf("server %-12s sender=%.2fms/msg cpu=%.2fus/frame wall=%.1fms\n"
+                   , s_phases[phase], send_us / 1000.0 / messages
+                   , frames ? (cpu_us() - cpu) * 1.0 / frames : 0, used / 1000.0);
+            fflush(stdout);
+        }
+        auto st = room->getStats();
+        printf("broadcaster: broadcasts=%lu delivered=%lu dropped=%lu disconnected=%lu\n"
+               , (unsigned long)st.broadcasts, (unsigned long)st.delivered
+               , (unsigned long)st.dropped, (unsigned long)st.disconnected);
+        fflush(stdout);
+        server->stop();
+        done = true;
+    });
+    while (!done) {
+        usleep(10 * 1000);
+    }
+    waitpid(pid, nullptr, 0);
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "chat/http/ws_deflate.h"
+#include "chat/log.h"
+#include "chat/util.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+//permessage-deflate压测: 用聊天JSON消息比较不压缩、保留上下文、不保留上下文、
+//不同窗口大小下每条消息的线上字节数和压缩/解压CPU耗时
+//用法: ws_deflate_bench [-n messages] [-l level]
+
+static chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static std::vector<std::string> make_messages(int n) {
+    static const char* words[] = {"hello", "anyone", "online", "tonight", "game", "lobby", "ready"
+        , "let's", "go", "ok", "brb", "lol", "nice", "thanks", "see", "you"};
+    std::vector<std::string> rt;
+    rt.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        std::string text;
+        int cnt = 3 + rand() % 12;
+        for (int j = 0; j < cnt; ++j) {
+            text += words[rand() % 16];
+            text += ' ';
+        }
+        rt.push_back("{\"type\":\"chat\",\"room\":\"room_" + std::to_string(rand() % 8)
+                + "\",\"from\":{\"uid\":" + std::to_string(10000 + rand() % 500)
+                + ",\"name\":\"user_" + std::to_string(rand() % 500) + "\"},\"seq\":"
+                + std::to_string(i) + ",\"time\":" + std::to_string(1700000000 + i)
+                + ",\"text\":\"" + text + "\"}");
+    }
+    return rt;
+}
+
+static void run(const char* name, const std::vector<std::string>& msgs
+        , bool takeover, int bits, int level, int mem_level) {
+    chat::http::WSDeflateParams params;
+    params.serverNoContextTakeover = !takeover;
+    params.clientNoContextTakeover = !takeover;
+    params.serverMaxWindowBits = bits;
+    params.clientMaxWindowBits = bits;
+    chat::http::WSDeflate server(true, params, level, mem_level);
+    chat::http::WSDeflate client(false, params, level, mem_level);
+
+    uint64_t raw = 0, wire = 0, comp_us = 0, decomp_us = 0;
+    std::string z, out;
+    bool ok = true;
+    for (auto& m : msgs) {
+        raw += m.size();
+        uint64_t t0 = chat::GetCurrentUs();
+        bool c = m.size() >= server.getMinSize() && server.compress(m.c_str(), m.size(), z);
+        uint64_t t1 = chat::GetCurrentUs();
+        comp_us += t1 - t0;
+        if (!c) {
+            wire += m.size();
+            continue;
+        }
+        wire += z.size();
+        ok = ok && client.decompress(z.c_str(), z.size(), out, 1 << 20) && out == m;
+        decomp_us += chat::GetCurrentUs() - t1;
+    }
+    size_t n = msgs.size();
+    printf("%-22s raw=%6.1fB/msg wire=%6.1fB/msg ratio=%5.1f%% deflate=%6.2fus/msg inflate=%6.2fus/msg"
+           " conn_mem=%zuKB %s\n"
+           , name, (double)raw / n, (double)wire / n, wire * 100.0 / raw
+           , (double)comp_us / n, (double)decomp_us / n
+           , (server.getMemoryUsage() + client.getMemoryUsage()) / 2 / 1024, ok ? "" : "MISMATCH");
+}
+
+int main(int argc, char** argv) {
+    int n = 100000;
+    int level = 6;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:l:")) != -1) {
+        switch (opt) {
+            case 'n':
+                n = atoi(optarg);
+                break;
+            case 'l':
+                level = atoi(optarg);
+                break;
+            default:
+                CHAT_LOG_INFO(g_logger) << "use as[" << argv[0] << " -n messages -l level]";
+                return 0;
+        }
+    }
+    srand(1);
+    auto msgs = make_messages(n);
+    uint64_t raw = 0;
+    for (auto& m : msgs) {
+        raw += m.size();
+    }
+    printf("messages=%d level=%d\n", n, level);
+    printf("%-22s raw=%6.1fB/msg wire=%6.1fB/msg ratio=100.0%%\n", "none"
+           , (double)raw / n, (double)raw / n);
+    run("takeover w15 m8", msgs, true, 15, level, 8);
+    run("takeover w12 m8", msgs, true, 12, level, 8);
+    run("takeover w10 m4", msgs, true, 10, level, 4);
+    run("no_takeover w15 m8", msgs, false, 15, level, 8);
+    run("no_takeover w10 m4", msgs, false, 10, level, 4);
+    return 0;
+}
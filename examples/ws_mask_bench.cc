@@ -0,0 +1,71 @@
+#include "chat/http/http_simd.h"
+#include "chat/log.h"
+#include "chat/util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+
+//WebSocket掩码压测: 64B到1MB的帧, 比较逐字节、64位标量、SSE2、AVX2的吞吐
+//用法: ws_mask_bench [-b total_mb]
+
+static chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+//原来的逐字节实现
+static void mask_bytewise(char* dst, const char* src, size_t len, const char* mask) {
+    for (size_t i = 0; i < len; ++i) {
+        dst[i] = src[i] ^ mask[i % 4];
+    }
+}
+
+int main(int argc, char** argv) {
+    int total_mb = 512;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:")) != -1) {
+        switch (opt) {
+            case 'b':
+                total_mb = atoi(optarg);
+                break;
+            default:
+                CHAT_LOG_INFO(g_logger) << "use as[" << argv[0] << " -b total_mb]";
+                return 0;
+        }
+    }
+
+    struct Impl {
+        const char* name;
+        chat::http::WSMaskFunc func;
+    } impls[] = {
+        {"bytewise", mask_bytewise},
+        {"scalar", chat::http::GetWSMaskFunc("scalar")},
+        {"sse2", chat::http::GetWSMaskFunc("sse2")},
+        {"avx2", chat::http::GetWSMaskFunc("avx2")},
+    };
+    const char mask[4] = {(char)0x12, (char)0x34, (char)0x56, (char)0x78};
+    std::string buf(1 << 20, 'x');
+    uint64_t total = (uint64_t)total_mb << 20;
+    printf("dispatch=%s total=%dMB per size, in place, MB/s\n", chat::http::GetWSMaskLevel(), total_mb);
+    printf("%8s", "size");
+    for (auto& i : impls) {
+        printf(" %10s", i.name);
+    }
+    printf("\n");
+    for (size_t size = 64; size <= (1 << 20); size *= 4) {
+        printf("%8zu", size);
+        for (auto& i : impls) {
+            if (!i.func) {
+                printf(" %10s", "-");
+                continue;
+            }
+            uint64_t loops = std::max<uint64_t>(total / size, 1);
+            uint64_t begin = chat::GetCurrentUs();
+            for (uint64_t n = 0; n < loops; ++n) {
+                i.func(&buf[0], buf.c_str(), size, mask);
+            }
+            uint64_t used = std::max<uint64_t>(chat::GetCurrentUs() - begin, 1);
+            printf(" %10.0f", (double)loops * size / used);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include "../chat/chat.h"
+
+//异步HTTP客户端: 流水线/FIFO匹配/超时/chunked/HEAD/服务端关闭后重连
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+//原始服务端(8046): 不带长度, 写出响应体后关闭连接
+static void close_delimited_server(chat::Socket::ptr listen, std::string body) {
+    auto sock = listen->accept();
+    listen->close();
+    if (!sock) {
+        return;
+    }
+    char buf[4096];
+    std::string req;
+    while (req.find("\r\n\r\n") == std::string::npos) {
+        int n = sock->recv(buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+        req.append(buf, n);
+    }
+    std::string rsp = "HTTP/1.1 200 OK\r\nConnection: close\r\n\r\n" + body;
+    sock->send(rsp.c_str(), rsp.size());
+    sock->close();
+}
+
+void test_close_delimited() {
+    chat::Address::ptr addr = chat::Address::LookupAnyIPAddress("127.0.0.1:8046");
+    chat::Socket::ptr listen = chat::Socket::CreateTCP(addr);
+    while (!listen->bind(addr) || !listen->listen()) {
+        sleep(2);
+    }
+    //远大于读缓冲, 不能被截断
+    std::string body(1024 * 1024, 0);
+    for (size_t i = 0; i < body.size(); ++i) {
+        body[i] = 'a' + i % 26;
+    }
+    chat::IOManager::GetThis()->schedule(std::bind(close_delimited_server, listen, body));
+    auto client = chat::http::AsyncHttpClient::Create("http://127.0.0.1:8046", "", 1);
+    client->start();
+    auto r = client->doGet("/big", 3000);
+    CHAT_ASSERT(r->result == 0 && r->response && r->response->getBody() == body);
+    client->stop();
+}
+
+void test_client(chat::http::HttpServer::ptr server) {
+    auto client = chat::http::AsyncHttpClient::Create("http://127.0.0.1:8028", "", 2);
+    CHAT_ASSERT(client->start() == 2);
+
+    auto r = client->doGet("/echo?v=1", 1000);
+    CHAT_ASSERT(r->result == 0 && r->response->getBody() == "/echo?v=1");
+
+    //并发请求共享2个连接, 响应按顺序对应
+    std::atomic<int> done = {0};
+    std::atomic<int> fails = {0};
+    for (int i = 0; i < 50; ++i) {
+        chat::IOManager::GetThis()->schedule([client, i, &done, &fails]() {
+            for (int j = 0; j < 20; ++j) {
+                std::string path = "/echo?v=" + std::to_string(i * 100 + j);
+                auto r = client->doGet(path, 3000);
+                if (r->result != 0 || r->response->getBody() != path) {
+                    ++fails;
+                }
+            }
+            ++done;
+        });
+    }
+    while (done < 50) {
+        usleep(10 * 1000);
+    }
+    CHAT_ASSERT(fails == 0);
+
+    r = client->doPost("/echo_body", 1000, {}, "post data");
+    CHAT_ASSERT(r->result == 0 && r->response->getBody() == "post data");
+
+    r = client->doGet("/chunked", 1000);
+    CHAT_ASSERT(r->result == 0 && r->response->getBody() == "chunk-0 chunk-1 chunk-2 ");
+
+    r = client->doRequest(chat::http::HttpMethod::HEAD, "/echo?v=head", 1000);
+    CHAT_ASSERT(r->result == 0 && r->response->getBody().empty());
+    r = client->doGet("/echo?v=after_head", 1000);
+    CHAT_ASSERT(r->result == 0 && r->response->getBody() == "/echo?v=after_head");
+
+    //超时的请求不影响后面请求的匹配
+    done = 0;
+    int slow_result = 0;
+    std::string fast_body;
+    chat::IOManager::GetThis()->schedule([client, &slow_result, &done]() {
+        slow_result = client->doGet("/slow", 100)->result;
+        ++done;
+    });
+    chat::IOManager::GetThis()->schedule([client, &fast_body, &done]() {
+        usleep(20 * 1000);
+        auto r = client->doGet("/echo?v=fast", 2000);
+        fast_body = r->response ? r->response->getBody() : "";
+        ++done;
+    });
+    while (done < 2) {
+        usleep(10 * 1000);
+    }
+    CHAT_ASSERT(slow_result == chat::AsyncSocketStream::TIMEOUT);
+    CHAT_ASSERT(fast_body == "/echo?v=fast");
+
+    //服务端关闭连接后自动重连
+    r = client->doGet("/close", 1000);
+    CHAT_ASSERT(r->result == 0 && r->response->getBody() == "bye");
+    usleep(200 * 1000);
+    int ok = 0;
+    for (int i = 0; i < 4; ++i) {
+        r = client->doGet("/echo?v=" + std::to_string(i), 1000);
+        ok += r->result == 0 && r->response->getBody() == "/echo?v=" + std::to_string(i);
+    }
+    CHAT_ASSERT(ok == 4);
+    client->stop();
+
+    test_close_delimited();
+    server->stop();
+}
+
+void run() {
+    chat::http::HttpServer::ptr server(new chat::http::HttpServer(true));
+    chat::Address::ptr addr = chat::Address::LookupAnyIPAddress("127.0.0.1:8028");
+    while (!server->bind(addr)) {
+        sleep(2);
+    }
+    auto sd = server->getServletDispatch();
+    sd->addServlet("/echo", [](chat::http::HttpRequest::ptr req
+            , chat::http::HttpResponse::ptr rsp
+            , chat::SocketStream::ptr session) {
+        std::string body = req->getPath() + "?" + req->getQuery();
+        if (req->getMethod() == chat::http::HttpMethod::HEAD) {
+            rsp->setHeader("Content-Length", std::to_string(body.size()));
+            rsp->setBody("");
+        } else {
+            rsp->setBody(body);
+        }
+        return 0;
+    });
+    sd->addServlet("/echo_body", [](chat::http::HttpRequest::ptr req
+            , chat::http::HttpResponse::ptr rsp
+            , chat::SocketStream::ptr session) {
+        rsp->setBody(req->getBody());
+        return 0;
+    });
+    sd->addServlet("/chunked", [](chat::http::HttpRequest::ptr req
+            , chat::http::HttpResponse::ptr rsp
+            , chat::SocketStream::ptr session) {
+        rsp->setStreamBody([](chat::Stream::ptr out) {
+            for (int i = 0; i < 3; ++i) {
+                std::string s = "chunk-" + std::to_string(i) + " ";
+                out->write(s.c_str(), s.size());
+            }
+            return 0;
+        });
+        return 0;
+    });
+    sd->addServlet("/slow", [](chat::http::HttpRequest::ptr req
+            , chat::http::HttpResponse::ptr rsp
+            , chat::SocketStream::ptr session) {
+        usleep(300 * 1000);
+        rsp->setBody("slow");
+        return 0;
+    });
+    sd->addServlet("/close", [](chat::http::HttpRequest::ptr req
+            , chat::http::HttpResponse::ptr rsp
+            , chat::SocketStream::ptr session) {
+        rsp->setClose(true);
+        rsp->setBody("bye");
+        return 0;
+    });
+    server->start();
+    chat::IOManager::GetThis()->schedule(std::bind(test_client, server));
+}
+
+int main(int argc, char** argv) {
+    chat::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include "../chat/chat.h"
+
+//响应缓存: TTL/Cache-Control、304、HEAD、stale-while-revalidate、TinyLFU准入
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static std::atomic<int> s_upstream = {0};
+static std::atomic<int> s_noSession = {0};
+static chat::Address::ptr s_addr;
+static const std::string s_base = "http://127.0.0.1:8031";
+
+static chat::http::HttpResult::ptr get(const std::string& path
+        , const std::map<std::string, std::string>& headers = {}) {
+    return chat::http::HttpConnection::DoGet(s_base + path, 2000, headers);
+}
+
+//发送原始请求, 读到服务端关闭连接为止
+static std::string raw_request(const std::string& data) {
+    chat::Socket::ptr sock = chat::Socket::CreateTCP(s_addr);
+    if (!sock->connect(s_addr)) {
+        return "";
+    }
+    sock->setRecvTimeout(3000);
+    sock->send(data.c_str(), data.size());
+    std::string out;
+    char buf[4096];
+    int n;
+    while ((n = sock->recv(buf, sizeof(buf))) > 0) {
+        out.append(buf, n);
+    }
+    return out;
+}
+
+void test_sketch() {
+    //单分片放得下两个条目: 频率低的新条目不能挤掉热点
+    chat::http::ResponseCache cache(4096, 1);
+    auto make = [](const std::string& key) {
+        auto e = std::make_shared<chat::http::CacheEntry>();
+        e->key = key;
+        e->hash = std::hash<std::string>()(key);
+        e->body.assign(1200, 'x');
+        e->createTime = 0;
+        e->expireTime = 1000000;
+        e->staleTime = 1000000;
+        return e;
+    };
+    auto hot = make("hot");
+    auto hot2 = make("hot2");
+    for (int i = 0; i < 5; ++i) {
+        cache.get(hot->key, hot->hash, 0);
+        cache.get(hot2->key, hot2->hash, 0);
+    }
+    CHAT_ASSERT(cache.put(hot) && cache.put(hot2));
+    auto cold = make("cold");
+    cache.get(cold->key, cold->hash, 0);
+    CHAT_ASSERT(!cache.put(cold));
+    CHAT_ASSERT(cache.get("hot", hot->hash, 0) == hot);
+
+    //访问次数超过热点后被接纳, 淘汰LRU尾部的hot2
+    auto warm = make("warm");
+    for (int i = 0; i < 10; ++i) {
+        cache.get(warm->key, warm->hash, 0);
+    }
+    CHAT_ASSERT(cache.put(warm));
+    auto st = cache.getStats();
+    CHAT_ASSERT(st.rejected == 1 && st.evictions == 1 && st.entries == 2);
+    CHAT_ASSERT(cache.get("hot2", hot2->hash, 0) == nullptr && cache.get("hot", hot->hash, 0) == hot);
+}
+
+void test_cache(chat::http::HttpServer::ptr server, chat::http::CacheServlet::ptr cache) {
+    //max-age: 第二次命中, 上游只执行一次
+    s_upstream = 0;
+    auto r1 = get("/api/a?cc=max-age%3D60");
+    auto r2 = get("/api/a?cc=max-age%3D60");
+    CHAT_ASSERT(r1->result == 0 && r2->result == 0 && s_upstream == 1);
+    CHAT_ASSERT(r1->response->getBody() == "v1" && r2->response->getBody() == "v1");
+    std::string etag = r2->response->getHeader("ETag");
+    CHAT_ASSERT(!etag.empty() && r2->response->getHeader("Age") == "0");
+
+    //If-None-Match命中返回304
+    auto r3 = get("/api/a?cc=max-age%3D60", {{"If-None-Match", "W/" + etag}});
+    CHAT_ASSERT(r3->response->getStatus() == chat::http::HttpStatus::NOT_MODIFIED && s_upstream == 1);
+
+    //HEAD从缓存返回头部, 不带body
+    std::string head = raw_request("HEAD /api/a?cc=max-age%3D60 HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                                   "Connection: close\r\n\r\n");
+    CHAT_ASSERT(head.find("200") != std::string::npos && head.find("Content-Length: 2") != std::string::npos
+          && head.substr(head.size() - 4) == "\r\n\r\n" && s_upstream == 1);
+
+    //no-store/无Cache-Control(默认TTL为0)不缓存
+    s_upstream = 0;
+    get("/api/b?cc=no-store");
+    get("/api/b?cc=no-store");
+    get("/api/c");
+    get("/api/c");
+    CHAT_ASSERT(s_upstream == 4);
+
+    //Authorization绕过缓存, 请求no-cache时回源并更新
+    s_upstream = 0;
+    get("/api/a?cc=max-age%3D60", {{"Authorization", "Bearer x"}});
+    auto r4 = get("/api/a?cc=max-age%3D60", {{"Cache-Control", "no-cache"}});
+    auto r5 = get("/api/a?cc=max-age%3D60");
+    CHAT_ASSERT(s_upstream == 2 && r4->response->getBody() == "v2" && r5->response->getBody() == "v2");
+
+    //带Cookie的请求不使用也不缓存非public的响应, public的照常缓存
+    s_upstream = 0;
+    auto c1 = get("/api/a?cc=max-age%3D60", {{"Cookie", "sid=1"}});
+    get("/api/f?cc=max-age%3D60", {{"Cookie", "sid=1"}});
+    get("/api/f?cc=max-age%3D60", {{"Cookie", "sid=1"}});
+    get("/api/g?cc=public,max-age%3D60", {{"Cookie", "sid=1"}});
+    auto c2 = get("/api/g?cc=public,max-age%3D60", {{"Cookie", "sid=2"}});
+    CHAT_ASSERT(c1->response->getBody() == "v1" && c2->response->getBody() == "v4" && s_upstream == 4);
+
+    //是否接受gzip分别缓存
+    s_upstream = 0;
+    get("/api/d?cc=max-age%3D60", {{"Accept-Encoding", "gzip"}});
+    get("/api/d?cc=max-age%3D60");
+    get("/api/d?cc=max-age%3D60", {{"Accept-Encoding", "gzip, deflate"}});
+    CHAT_ASSERT(s_upstream == 2);
+
+    //过期后在stale窗口内先返回旧响应, 后台刷新
+    s_upstream = 0;
+    auto s1 = get("/api/e?cc=max-age%3D1,stale-while-revalidate%3D10");
+    usleep(1100 * 1000);
+    auto s2 = get("/api/e?cc=max-age%3D1,stale-while-revalidate%3D10");
+    usleep(100 * 1000);
+    auto s3 = get("/api/e?cc=max-age%3D1,stale-while-revalidate%3D10");
+    CHAT_ASSERT(s1->response->getBody() == "v1" && s2->response->getBody() == "v1"
+          && s3->response->getBody() == "v2" && s_upstream == 2);
+    //后台刷新也拿到原连接
+    CHAT_ASSERT(s_noSession == 0);
+
+    auto st = cache->getStats();
+    CHAT_LOG_INFO(g_logger) << "hits=" << st.hits << " stale=" << st.staleHits
+        << " misses=" << st.misses << " 304=" << st.notModified << " stores=" << st.stores
+        << " refreshes=" << st.refreshes << " entries=" << st.entries << " bytes=" << st.bytes;
+    CHAT_ASSERT(st.staleHits == 1 && st.refreshes == 1 && st.notModified == 1 && st.entries == 5);
+
+    server->stop();
+}
+
+void run() {
+    test_sketch();
+
+    chat::http::HttpServer::ptr server(new chat::http::HttpServer(true));
+    s_addr = chat::Address::LookupAnyIPAddress("127.0.0.1:8031");
+    while (!server->bind(s_addr)) {
+        sleep(2);
+    }
+    auto upstream = std::make_shared<chat::http::FunctionServlet>([](chat::http::HttpRequest::ptr req
+            , chat::http::HttpResponse::ptr rsp
+            , chat::SocketStream::ptr session) {
+        int n = ++s_upstream;
+        s_noSession += session == nullptr;
+        std::string cc = req->getParam("cc");
+        if (!cc.empty()) {
+            rsp->setHeader("Cache-Control", cc);
+        }
+        rsp->setHeader("Vary", "Accept-Encoding");
+        rsp->setBody("v" + std::to_string(n));
+        return 0;
+    });
+    auto cache = std::make_shared<chat::http::CacheServlet>(upstream, 1024 * 1024);
+    server->getServletDispatch()->addGlobServlet("/api/*", cache);
+    server->start();
+    chat::IOManager::GetThis()->schedule(std::bind(test_cache, server, cache));
+}
+
+int main(int argc, char** argv) {
+    chat::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "../chat/chat.h"
+#include <x86intrin.h>
+
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static const int s_count = 1000000;
+
+//每次调用消耗的cpu周期
+template<class F>
+void bench(const std::string& name, F f) {
+    volatile uint64_t sink = 0;
+    uint64_t begin = __rdtsc();
+    for (int i = 0; i < s_count; ++i) {
+        sink = sink + f();
+    }
+    uint64_t cycles = __rdtsc() - begin;
+    CHAT_LOG_INFO(g_logger) << name << " cycles/call=" << (cycles * 1.0 / s_count);
+}
+
+void test_bench() {
+    bench("GetCurrentMs", [](){ return chat::GetCurrentMs(); });
+    bench("GetCurrentUs", [](){ return chat::GetCurrentUs(); });
+    bench("time(0)", [](){ return (uint64_t)time(0); });
+    bench("Clock::NowUs", [](){ return chat::Clock::NowUs(); });
+    bench("Clock::CoarseUs", [](){ return chat::Clock::CoarseUs(); });
+    bench("Clock::MonotonicCoarseMs", [](){ return chat::Clock::MonotonicCoarseMs(); });
+    chat::Clock::Refresh();
+    bench("Clock::CachedUs", [](){ return chat::Clock::CachedUs(); });
+    bench("Clock::CachedSec", [](){ return chat::Clock::CachedSec(); });
+}
+
+void test_cached() {
+    chat::IOManager iom(1);
+    iom.schedule([](){
+        uint64_t precise = chat::Clock::NowUs();
+        uint64_t cached = chat::Clock::CachedUs();
+        CHAT_LOG_INFO(g_logger) << "precise=" << precise << " cached=" << cached
+            << " lag_us=" << (int64_t)(precise - cached);
+        usleep(1000);
+        precise = chat::Clock::NowUs();
+        cached = chat::Clock::CachedUs();
+        CHAT_LOG_INFO(g_logger) << "after usleep precise=" << precise << " cached=" << cached
+            << " lag_us=" << (int64_t)(precise - cached);
+
+        //协程运行了一段时间后设的定时器不能因为缓存时间落后而提前触发
+        uint64_t spin = chat::Clock::NowUs();
+        while (chat::Clock::NowUs() - spin < 50 * 1000);
+        uint64_t armed = chat::Clock::NowUs();
+        static uint64_t s_armed;
+        s_armed = armed;
+        chat::IOManager::GetThis()->addTimer(20, [](){
+            uint64_t waited = chat::Clock::NowUs() - s_armed;
+            CHAT_LOG_INFO(g_logger) << "timer after busy fiber waited_us=" << waited;
+            CHAT_ASSERT(waited >= 20 * 1000);
+        });
+    });
+}
+
+//离开调度循环的线程不能保留停住的缓存时间
+void test_invalidate() {
+    uint64_t spin = chat::Clock::NowUs();
+    while (chat::Clock::NowUs() - spin < 30 * 1000);
+    int64_t lag = chat::Clock::NowUs() - chat::Clock::CachedUs();
+    CHAT_LOG_INFO(g_logger) << "after scheduler stop lag_us=" << lag;
+    CHAT_ASSERT(lag < 10 * 1000);
+}
+
+int main(int argc, char** argv) {
+    test_bench();
+    test_cached();
+    test_invalidate();
+    return 0;
+}
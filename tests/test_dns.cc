@@ -0,0 +1,248 @@
+#include "../chat/chat.h"
+#include "../chat/dns.h"
+#include <arpa/inet.h>
+#include <string.h>
+
+//本地起一个假DNS服务器(udp+tcp 127.0.0.1:15353), 验证缓存/TTL/负缓存/合并查询/TC回退
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static const char* s_server = "127.0.0.1:15353";
+static std::map<std::string, int> s_counts;
+
+static void put16(std::string& out, uint16_t v) {
+    out.push_back(v >> 8);
+    out.push_back(v & 0xff);
+}
+
+static void put32(std::string& out, uint32_t v) {
+    put16(out, v >> 16);
+    put16(out, v & 0xffff);
+}
+
+static void put_name(std::string& out, const std::string& name) {
+    for (auto& label : chat::split(name, '.')) {
+        out.push_back(label.size());
+        out.append(label);
+    }
+    out.push_back('\0');
+}
+
+//A记录owner之后的部分
+static void put_a(std::string& out, uint32_t ttl, uint32_t ip) {
+    put16(out, 1);
+    put16(out, 1);
+    put32(out, ttl);
+    put16(out, 4);
+    put32(out, ip);
+}
+
+//按qname构造应答, tcp为false且域名为big.test时只回TC
+static std::string make_response(const char* req, size_t len, bool tcp) {
+    std::string name;
+    size_t off = 12;
+    while (off < len && req[off]) {
+        if (!name.empty()) {
+            name.push_back('.');
+        }
+        name.append(req + off + 1, (uint8_t)req[off]);
+        off += 1 + (uint8_t)req[off];
+    }
+    off += 5;
+    ++s_counts[name];
+
+    std::vector<uint32_t> ips;
+    uint32_t ttl = 60;
+    int rcode = 0;
+    bool tc = false;
+    if (name == "a.test") {
+        ips = {0x0a000001, 0x0a000002};
+        ttl = 1;
+    } else if (name == "slow.test") {
+        usleep(100 * 1000);
+        ips = {0x0a000003};
+    } else if (name == "big.test") {
+        tc = !tcp;
+        if (tcp) {
+            ips = {0x0a000004};
+        }
+    } else if (name != "cname.test" && name != "poison.test" && name != "mismatch.test") {
+        rcode = 3;
+    }
+
+    std::string rsp(req, off);
+    if (name == "mismatch.test") {
+        rsp[13] = 'x';  //回显的问题与查询不符
+    }
+    rsp[2] = (char)(0x81 | (tc ? 0x02 : 0));
+    rsp[3] = (char)(0x80 | rcode);
+    rsp[6] = 0;
+    rsp[7] = ips.size();
+    rsp[8] = 0;
+    rsp[9] = rcode ? 1 : 0;
+    for (auto ip : ips) {
+        put16(rsp, 0xc00c);
+        put_a(rsp, ttl, ip);
+    }
+    if (name == "cname.test") {
+        //cname.test -> real.test
+        rsp[7] = 2;
+        put16(rsp, 0xc00c);
+        put16(rsp, 5);
+        put16(rsp, 1);
+        put32(rsp, 60);
+        put16(rsp, 11);
+        uint16_t target = rsp.size();
+        put_name(rsp, "real.test");
+        put16(rsp, 0xc000 | target);
+        put_a(rsp, 60, 0x0a000005);
+    }
+    if (name == "cname.test" || name == "poison.test") {
+        //与查询无关的owner, 不能被采用
+        ++rsp[7];
+        put_name(rsp, "evil.test");
+        put_a(rsp, 60, 0x0a000007);
+    } else if (name == "mismatch.test") {
+        rsp[7] = 1;
+        put16(rsp, 0xc00c);
+        put_a(rsp, 60, 0x0a000008);
+    }
+    if (rcode) {
+        //SOA, minimum=1s
+        put16(rsp, 0xc00c);
+        put16(rsp, 6);
+        put16(rsp, 1);
+        put32(rsp, 60);
+        put16(rsp, 2 + 2 + 20);
+        put16(rsp, 0xc00c);
+        put16(rsp, 0xc00c);
+        put32(rsp, 1);
+        put32(rsp, 60);
+        put32(rsp, 60);
+        put32(rsp, 60);
+        put32(rsp, 1);
+    }
+    return rsp;
+}
+
+void run_udp_server() {
+    chat::Address::ptr addr = chat::IPAddress::Create("127.0.0.1", 15353);
+    chat::Socket::ptr sock = chat::Socket::CreateUDP(addr);
+    CHAT_ASSERT(sock->bind(addr));
+    char buf[512];
+    while (true) {
+        chat::Address::ptr from(new chat::IPv4Address);
+        int len = sock->recvFrom(buf, sizeof(buf), from);
+        if (len <= 0) {
+            continue;
+        }
+        std::string rsp = make_response(buf, len, false);
+        sock->sendTo(rsp.c_str(), rsp.size(), from);
+    }
+}
+
+void run_tcp_server() {
+    chat::Address::ptr addr = chat::IPAddress::Create("127.0.0.1", 15353);
+    chat::Socket::ptr sock = chat::Socket::CreateTCP(addr);
+    CHAT_ASSERT(sock->bind(addr));
+    sock->listen();
+    while (true) {
+        chat::Socket::ptr client = sock->accept();
+        if (!client) {
+            continue;
+        }
+        char buf[514];
+        int len = client->recv(buf, sizeof(buf));
+        if (len <= 2) {
+            continue;
+        }
+        std::string rsp = make_response(buf + 2, len - 2, true);
+        std::string data;
+        put16(data, rsp.size());
+        data.append(rsp);
+        client->send(data.c_str(), data.size());
+        client->close();
+    }
+}
+
+static std::string to_string(const std::vector<chat::IPAddress::ptr>& addrs) {
+    std::stringstream ss;
+    for (auto& i : addrs) {
+        ss << *i << " ";
+    }
+    return ss.str();
+}
+
+void test_resolver() {
+    chat::DnsResolver::ptr resolver(new chat::DnsResolver);
+    resolver->setNameServers({chat::Address::LookupAny(s_server)});
+    resolver->setSearch({});
+    resolver->setTimeout(1000);
+
+    std::vector<chat::IPAddress::ptr> addrs;
+    CHAT_ASSERT(resolver->resolve(addrs, "a.test"));
+    CHAT_LOG_INFO(g_logger) << "a.test: " << to_string(addrs);
+    CHAT_ASSERT(addrs.size() == 2);
+    addrs.clear();
+    CHAT_ASSERT(resolver->resolve(addrs, "A.TEST."));  //命中缓存
+    CHAT_ASSERT(s_counts["a.test"] == 1);
+
+    usleep(1500 * 1000);  //ttl=1s过期后重新查询
+    addrs.clear();
+    CHAT_ASSERT(resolver->resolve(addrs, "a.test"));
+    CHAT_ASSERT(s_counts["a.test"] == 2);
+
+    addrs.clear();
+    CHAT_ASSERT(!resolver->resolve(addrs, "nx.test"));
+    CHAT_ASSERT(!resolver->resolve(addrs, "nx.test"));  //负缓存
+    CHAT_ASSERT(s_counts["nx.test"] == 1);
+
+    addrs.clear();
+    CHAT_ASSERT(resolver->resolve(addrs, "big.test"));  //TC后走tcp
+    CHAT_LOG_INFO(g_logger) << "big.test: " << to_string(addrs);
+    CHAT_ASSERT(s_counts["big.test"] == 2);
+
+    //只采用qname及其CNAME链上的记录, 问题不符的应答丢弃
+    addrs.clear();
+    CHAT_ASSERT(resolver->resolve(addrs, "cname.test"));
+    CHAT_ASSERT(to_string(addrs) == "10.0.0.5:0 ");
+    addrs.clear();
+    CHAT_ASSERT(!resolver->resolve(addrs, "poison.test"));
+    CHAT_ASSERT(!resolver->resolve(addrs, "mismatch.test"));
+
+    //并发查询同一域名只发一次
+    static int s_done = 0;
+    for (int i = 0; i < 50; ++i) {
+        chat::IOManager::GetThis()->schedule([resolver](){
+            std::vector<chat::IPAddress::ptr> addrs;
+            if (resolver->resolve(addrs, "slow.test") && addrs.size() == 1) {
+                ++s_done;
+            }
+        });
+    }
+    usleep(500 * 1000);
+    CHAT_LOG_INFO(g_logger) << "slow.test done=" << s_done << " server queries=" << s_counts["slow.test"];
+    CHAT_ASSERT(s_done == 50 && s_counts["slow.test"] == 1);
+
+    resolver->dump(std::cout) << std::endl;
+}
+
+void test_lookup() {
+    //协程内Address::Lookup走DnsMgr, localhost来自/etc/hosts
+    chat::Address::ptr addr = chat::Address::LookupAny("localhost:8080");
+    CHAT_LOG_INFO(g_logger) << "localhost:8080 -> " << (addr ? addr->toString() : "null");
+    addr = chat::Address::LookupAny("127.0.0.1:80");
+    CHAT_LOG_INFO(g_logger) << "127.0.0.1:80 -> " << (addr ? addr->toString() : "null");
+}
+
+int main(int argc, char** argv) {
+    chat::IOManager iom(1);
+    iom.schedule(run_udp_server);
+    iom.schedule(run_tcp_server);
+    iom.schedule([](){
+        test_resolver();
+        test_lookup();
+        CHAT_LOG_INFO(g_logger) << "test dns ok";
+        exit(0);
+    });
+    return 0;
+}
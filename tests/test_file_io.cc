@@ -0,0 +1,60 @@
+#include "../chat/chat.h"
+#include "../chat/file_io.h"
+#include <fcntl.h>
+#include <string.h>
+
+//文件IO卸载到线程池: 大文件读写期间同一IOManager线程上的定时器仍能按时触发
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static const std::string s_path = "/tmp/test_file_io.dat";
+
+void test_rw() {
+    chat::FileIOManager* fio = chat::FileIOMgr::GetInstance();
+    chat::ByteArray::ptr ba(new chat::ByteArray);
+    std::string data;
+    for (int i = 0; i < 64 * 1024 * 1024 / 16; ++i) {
+        data.append("0123456789abcdef");
+    }
+    ba->write(data.c_str(), data.size());
+    ba->setPosition(0);
+
+    uint64_t begin = chat::GetCurrentMs();
+    bool ok = fio->writeFile(s_path, ba, true);
+    CHAT_LOG_INFO(g_logger) << "writeFile ok=" << ok << " size=" << data.size()
+        << " used=" << (chat::GetCurrentMs() - begin) << "ms";
+
+    chat::ByteArray::ptr rba(new chat::ByteArray);
+    begin = chat::GetCurrentMs();
+    ok = fio->readFile(s_path, rba);
+    CHAT_LOG_INFO(g_logger) << "readFile ok=" << ok << " size=" << rba->getReadSize()
+        << " equal=" << (rba->toString() == data)
+        << " used=" << (chat::GetCurrentMs() - begin) << "ms";
+
+    int fd = fio->open(s_path.c_str(), O_RDWR);
+    char buf[16] = {0};
+    ssize_t rt = fio->pwrite(fd, "FEDCBA9876543210", 16, 16);
+    CHAT_LOG_INFO(g_logger) << "pwrite rt=" << rt;
+    rt = fio->pread(fd, buf, sizeof(buf), 16);
+    CHAT_LOG_INFO(g_logger) << "pread rt=" << rt << " data=" << std::string(buf, sizeof(buf));
+    CHAT_LOG_INFO(g_logger) << "fsync rt=" << fio->fsync(fd);
+    fio->close(fd);
+
+    rt = fio->pread(-1, buf, sizeof(buf), 0);
+    CHAT_LOG_INFO(g_logger) << "pread bad fd rt=" << rt << " errno=" << errno
+        << " errstr=" << strerror(errno);
+    unlink(s_path.c_str());
+}
+
+int main(int argc, char** argv) {
+    chat::IOManager iom(1);
+    static int s_ticks = 0;
+    chat::Timer::ptr timer = iom.addTimer(10, [](){
+        ++s_ticks;
+    }, true);
+    iom.schedule([timer](){
+        test_rw();
+        timer->cancel();
+        CHAT_LOG_INFO(g_logger) << "ticks during io=" << s_ticks;
+    });
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include "../chat/chat.h"
+#include <sys/socket.h>
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+//统计hook后read/write的堆分配次数: 数据已就绪的快速路径应为0
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static std::atomic<bool> s_counting = {false};
+static std::atomic<uint64_t> s_allocs = {0};
+
+void* operator new(size_t size) {
+    if (s_counting) {
+        ++s_allocs;
+    }
+    void* p = malloc(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static const int s_count = 100000;
+
+static void make_pair(int sv[2]) {
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    chat::FdMgr::GetInstance()->get(sv[0], true);  //socketpair未被hook, 手动登记
+    chat::FdMgr::GetInstance()->get(sv[1], true);
+    timeval tv {5, 0};
+    setsockopt(sv[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));  //走带超时的路径
+    setsockopt(sv[1], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+static void close_pair(int sv[2]) {
+    //先注销FdCtx, 否则fd号复用时会拿到旧的上下文(新fd未被设为非阻塞)
+    chat::FdMgr::GetInstance()->del(sv[0]);
+    chat::FdMgr::GetInstance()->del(sv[1]);
+    close(sv[0]);
+    close(sv[1]);
+}
+
+//写完立即读, 数据总是就绪
+void test_ready() {
+    int sv[2];
+    make_pair(sv);
+    char buf[64] = {0};
+    s_allocs = 0;
+    s_counting = true;
+    uint64_t begin = chat::GetCurrentUs();
+    for (int i = 0; i < s_count; ++i) {
+        write(sv[0], buf, sizeof(buf));
+        read(sv[1], buf, sizeof(buf));
+    }
+    uint64_t used = chat::GetCurrentUs() - begin;
+    s_counting = false;
+    CHAT_LOG_INFO(g_logger) << "ready path: ops=" << s_count * 2
+        << " allocs=" << s_allocs
+        << " allocs/op=" << (s_allocs * 1.0 / (s_count * 2))
+        << " ns/op=" << (used * 1000.0 / (s_count * 2));
+    close_pair(sv);
+}
+
+//两个协程乒乓, 每次read都会挂起等待
+void test_blocking() {
+    static int sv[2];
+    make_pair(sv);
+    s_allocs = 0;
+    s_counting = true;
+    uint64_t begin = chat::GetCurrentUs();
+    chat::IOManager::GetThis()->schedule([](){
+        char buf[64] = {0};
+        for (int i = 0; i < s_count; ++i) {
+            read(sv[1], buf, sizeof(buf));
+            write(sv[1], buf, sizeof(buf));
+        }
+    });
+    char buf[64] = {0};
+    for (int i = 0; i < s_count; ++i) {
+        write(sv[0], buf, sizeof(buf));
+        read(sv[0], buf, sizeof(buf));
+    }
+    uint64_t used = chat::GetCurrentUs() - begin;
+    s_counting = false;
+    CHAT_LOG_INFO(g_logger) << "blocking path: round_trips=" << s_count
+        << " allocs=" << s_allocs
+        << " allocs/round_trip=" << (s_allocs * 1.0 / s_count)
+        << " ns/round_trip=" << (used * 1000.0 / s_count);
+    close_pair(sv);
+}
+
+//超时返回ETIMEDOUT; 超时回调和IO唤醒同时发生时, 旧的回调不能取消后面的等待
+void test_timeout() {
+    int sv[2];
+    make_pair(sv);
+    timeval tv {0, 20 * 1000};
+    setsockopt(sv[1], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char buf[64] = {0};
+    uint64_t begin = chat::GetCurrentUs();
+    int rt = read(sv[1], buf, sizeof(buf));
+    int err = errno;
+    uint64_t used = chat::GetCurrentUs() - begin;
+    CHAT_LOG_INFO(g_logger) << "timeout: rt=" << rt << " errno=" << err << " used=" << used << "us";
+    CHAT_ASSERT(rt == -1 && err == ETIMEDOUT && used >= 15000);
+
+    //对端在超时前后写入, 每次读都应拿到数据而不是被残留的超时打断
+    static int s_fd;
+    s_fd = sv[0];
+    int ok = 0;
+    for (int i = 0; i < 50; ++i) {
+        chat::IOManager::GetThis()->addTimer(19 + i % 3, []() {
+            char c = 'x';
+            write(s_fd, &c, 1);
+        });
+        rt = read(sv[1], buf, 1);
+        if (rt == 1) {
+            ++ok;
+        } else {
+            //超时先到时, 数据会在下一次读取
+            rt = read(sv[1], buf, 1);
+            ok += rt == 1;
+        }
+    }
+    CHAT_LOG_INFO(g_logger) << "timeout race: ok=" << ok;
+    CHAT_ASSERT(ok == 50);
+    close_pair(sv);
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(chat::LogLevel::INFO);
+    CHAT_LOG_NAME("system")->setLevel(chat::LogLevel::WARN);
+    chat::IOManager iom(1);
+    iom.schedule(test_ready);
+    //和test_blocking交错执行会影响分配计数
+    iom.schedule([]() {
+        test_blocking();
+        test_timeout();
+    });
+    return 0;
+}
@@ -20,8 +20,43 @@ void test_res() {
     res->dump(std::cout) << std::endl;
 }
 
+//query/body/cookie懒解析
+void test_params() {
+    chat::http::HttpRequest::ptr req(new chat::http::HttpRequest);
+    req->setQuery("id=1024&name=a%20b+c&flag&id=1&empty=");
+    req->setHeader("Content-Type", "application/x-www-form-urlencoded; charset=utf-8");
+    req->setBody("page=3&name=body");
+    req->setHeader("Cookie", " sid = 8f3c ; theme=dark;lang=zh%2DCN");
+
+    CHAT_ASSERT(req->getParam("id") == "1024");
+    CHAT_ASSERT(req->getParam("NAME") == "a b c");
+    CHAT_ASSERT(req->getParamAs<int>("page") == 3);
+    CHAT_ASSERT(req->hasParam("empty") && !req->hasParam("flag"));
+    CHAT_ASSERT(req->getCookie("sid") == " 8f3c ");
+    CHAT_ASSERT(req->getCookie("lang") == "zh-CN" && req->getCookieAs<int>("theme", -1) == -1);
+
+    req->setParam("id", "7");
+    CHAT_ASSERT(req->getParamAs<int>("id") == 7);
+    req->delParam("page");
+    CHAT_ASSERT(!req->hasParam("page"));
+    req->delCookie("theme");
+    CHAT_ASSERT(!req->hasCookie("theme"));
+
+    req->setHeader("Cookie", "uid=42");
+    CHAT_ASSERT(req->getCookieAs<int>("uid") == 42 && !req->hasCookie("sid"));
+
+    auto& params = req->getParams();
+    CHAT_ASSERT(params.size() == 3 && params.at("name") == "a b c" && params.at("id") == "7");
+
+    req->setQuery("x=1");
+    CHAT_ASSERT(req->getParam("x") == "1");
+    req->paramToQuery();
+    CHAT_ASSERT(req->getQuery().find("x=1") != std::string::npos);
+}
+
 int main(int argc, char** argv) {
     test_req();
     test_res();
+    test_params();
     return 0;
 }
\ No newline at end of file
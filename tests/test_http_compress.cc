@@ -0,0 +1,138 @@
+#include "../chat/chat.h"
+
+//响应压缩: Accept-Encoding协商、阈值/类型过滤、池化z_stream、按ETag缓存压缩结果
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static const std::string s_base = "http://127.0.0.1:8032";
+static std::string s_text;
+
+static chat::http::HttpResult::ptr get(const std::string& path
+        , const std::map<std::string, std::string>& headers = {}) {
+    return chat::http::HttpConnection::DoGet(s_base + path, 2000, headers);
+}
+
+static std::string gunzip(const std::string& data) {
+    auto zs = chat::ZlibStream::CreateGzip(false);
+    zs->write(data.c_str(), data.size());
+    zs->flush();
+    return zs->getResult();
+}
+
+void test_encode() {
+    typedef chat::http::HttpCompressor C;
+    CHAT_ASSERT(C::ChooseEncoding("gzip, deflate") == chat::ZlibStream::GZIP);
+    CHAT_ASSERT(C::ChooseEncoding("deflate;q=0.9, gzip;q=0.5") == chat::ZlibStream::DEFLATE);
+    CHAT_ASSERT(C::ChooseEncoding("gzip;q=0, br") == -1 && C::ChooseEncoding("identity") == -1);
+    CHAT_ASSERT(C::ChooseEncoding("*") == chat::ZlibStream::GZIP);
+
+    //池化的压缩器reset后重复使用, 每次结果独立
+    C c;
+    std::string a, b;
+    bool ok = c.encode(s_text.c_str(), s_text.size(), chat::ZlibStream::GZIP, a)
+           && c.encode("hello", 5, chat::ZlibStream::GZIP, b);
+    CHAT_ASSERT(ok && gunzip(a) == s_text && gunzip(b) == "hello" && a.size() < s_text.size() / 4);
+}
+
+void test_compress(chat::http::HttpServer::ptr server) {
+    auto r1 = get("/text", {{"Accept-Encoding", "gzip, deflate"}});
+    CHAT_ASSERT(r1->result == 0 && r1->response->getHeader("Content-Encoding") == "gzip"
+          && r1->response->getBody() == s_text
+          && std::stoul(r1->response->getHeader("Content-Length")) < s_text.size() / 4);
+    CHAT_ASSERT(r1->response->getHeader("Vary") == "Accept-Encoding");
+
+    auto r2 = get("/text");
+    CHAT_ASSERT(r2->response->getHeader("Content-Encoding").empty() && r2->response->getBody() == s_text
+          && r2->response->getHeader("Vary") == "Accept-Encoding");
+
+    auto r3 = get("/text", {{"Accept-Encoding", "gzip;q=0, deflate"}});
+    CHAT_ASSERT(r3->response->getHeader("Content-Encoding") == "deflate" && r3->response->getBody() == s_text);
+
+    //太小/不可压缩的类型/no-transform不压缩
+    auto r4 = get("/small", {{"Accept-Encoding", "gzip"}});
+    auto r5 = get("/png", {{"Accept-Encoding", "gzip"}});
+    auto r6 = get("/nt", {{"Accept-Encoding", "gzip"}});
+    CHAT_ASSERT(r4->response->getHeader("Content-Encoding").empty()
+          && r5->response->getHeader("Content-Encoding").empty()
+          && r6->response->getHeader("Content-Encoding").empty()
+          && r6->response->getBody() == s_text);
+
+    //带ETag的响应压缩一次后命中缓存, ETag降为弱校验
+    auto c = server->getCompressor();
+    auto st0 = c->getStats();
+    auto e1 = get("/etag", {{"Accept-Encoding", "gzip"}});
+    auto e2 = get("/etag", {{"Accept-Encoding", "gzip"}});
+    auto st1 = c->getStats();
+    CHAT_ASSERT(e1->response->getBody() == s_text && e2->response->getBody() == s_text
+          && e2->response->getHeader("ETag") == "W/\"v1\"");
+    CHAT_ASSERT(st1.compressed == st0.compressed + 1 && st1.cacheHits == st0.cacheHits + 1);
+
+    //同路径同ETag但查询串不同, 不能互相命中
+    auto q1 = get("/page?n=1", {{"Accept-Encoding", "gzip"}});
+    auto q2 = get("/page?n=2", {{"Accept-Encoding", "gzip"}});
+    CHAT_ASSERT(q1->response->getBody() == s_text + "n=1" && q2->response->getBody() == s_text + "n=2");
+    st1 = c->getStats();
+
+    //与CacheServlet叠加: 缓存的响应体再压缩, 压缩结果同样被缓存
+    auto c1 = get("/cached", {{"Accept-Encoding", "gzip"}});
+    auto c2 = get("/cached", {{"Accept-Encoding", "gzip"}});
+    auto st2 = c->getStats();
+    CHAT_ASSERT(c1->response->getBody() == s_text && c2->response->getBody() == s_text
+          && c2->response->getHeader("Content-Encoding") == "gzip"
+          && st2.compressed == st1.compressed + 1 && st2.cacheHits == st1.cacheHits + 1);
+
+    CHAT_LOG_INFO(g_logger) << "compressed=" << st2.compressed << " hits=" << st2.cacheHits
+        << " in=" << st2.bytesIn << " out=" << st2.bytesOut << " entries=" << st2.entries;
+    server->stop();
+}
+
+void run() {
+    for (int i = 0; s_text.size() < 16 * 1024; ++i) {
+        s_text += "<li class=\"item\">row " + std::to_string(i) + " of the compressible listing</li>\n";
+    }
+    test_encode();
+
+    chat::http::HttpServer::ptr server(new chat::http::HttpServer(true));
+    chat::Address::ptr addr = chat::Address::LookupAnyIPAddress("127.0.0.1:8032");
+    while (!server->bind(addr)) {
+        sleep(2);
+    }
+    server->setCompressor(std::make_shared<chat::http::HttpCompressor>());
+    auto sd = server->getServletDispatch();
+    auto text = [](const std::string& type, const std::string& body
+                   , const std::map<std::string, std::string>& headers) {
+        return [type, body, headers](chat::http::HttpRequest::ptr req
+                , chat::http::HttpResponse::ptr rsp
+                , chat::SocketStream::ptr session) {
+            rsp->setHeader("Content-Type", type);
+            for (auto& i : headers) {
+                rsp->setHeader(i.first, i.second);
+            }
+            rsp->setBody(body);
+            return 0;
+        };
+    };
+    sd->addServlet("/text", text("text/html", s_text, {}));
+    sd->addServlet("/small", text("text/plain", "tiny", {}));
+    sd->addServlet("/png", text("image/png", s_text, {}));
+    sd->addServlet("/nt", text("text/html", s_text, {{"Cache-Control", "no-transform"}}));
+    sd->addServlet("/etag", text("text/html", s_text, {{"ETag", "\"v1\""}}));
+    sd->addServlet("/page", [](chat::http::HttpRequest::ptr req
+            , chat::http::HttpResponse::ptr rsp
+            , chat::SocketStream::ptr session) {
+        rsp->setHeader("Content-Type", "text/html");
+        rsp->setHeader("ETag", "\"p\"");
+        rsp->setBody(s_text + req->getQuery());
+        return 0;
+    });
+    sd->addServlet("/cached", std::make_shared<chat::http::CacheServlet>(
+                std::make_shared<chat::http::FunctionServlet>(
+                    text("application/json", s_text, {{"Cache-Control", "max-age=60"}}))));
+    server->start();
+    chat::IOManager::GetThis()->schedule(std::bind(test_compress, server));
+}
+
+int main(int argc, char** argv) {
+    chat::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include "../chat/chat.h"
+
+//连接池: 预热/复用/并发/服务端关闭/空闲淘汰/统计
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+void test_client(chat::http::HttpServer::ptr server) {
+    chat::http::HttpConnectionPool::ptr pool(new chat::http::HttpConnectionPool(
+                "127.0.0.1", "", 8027, false, 16, 30 * 1000, 1000));
+    pool->setMinSize(4);
+    pool->start();
+    sleep(1);
+    auto st = pool->getStats();
+    CHAT_ASSERT(st.total == 4 && st.idle == 4 && st.created == 4);
+
+    bool ok = true;
+    for (int i = 0; i < 20; ++i) {
+        auto r = pool->doGet("/hello", 1000);
+        ok = ok && r->result == 0 && r->response->getBody() == "hello";
+    }
+    st = pool->getStats();
+    CHAT_ASSERT(ok);
+    CHAT_ASSERT(st.created == 4 && st.reused == 20 && st.waits == 20 && st.failed == 0);
+
+    //并发请求, 连接数不超过上限
+    std::atomic<int> done = {0};
+    std::atomic<int> fails = {0};
+    for (int i = 0; i < 8; ++i) {
+        chat::IOManager::GetThis()->schedule([pool, &done, &fails]() {
+            for (int j = 0; j < 10; ++j) {
+                auto r = pool->doGet("/slow", 1000);
+                if (r->result != 0 || r->response->getBody() != "slow") {
+                    ++fails;
+                }
+            }
+            ++done;
+        });
+    }
+    while (done < 8) {
+        usleep(10 * 1000);
+    }
+    st = pool->getStats();
+    CHAT_ASSERT(fails == 0);
+    CHAT_ASSERT(st.created >= 8 && st.total <= 16 && st.idle == st.total);
+
+    //服务端要求关闭的连接不放回池中
+    int32_t total = st.total;
+    auto r = pool->doGet("/close", 1000);
+    st = pool->getStats();
+    CHAT_ASSERT(r->result == 0 && r->response->isClose());
+    CHAT_ASSERT(st.total == total - 1);
+
+    //空闲超时由定时器淘汰
+    pool->setMinSize(0);
+    pool->setMaxIdleTime(200);
+    sleep(1);
+    st = pool->getStats();
+    CHAT_ASSERT(st.total == 0 && st.idle == 0 && st.evicted >= (uint64_t)total - 1);
+
+    r = pool->doGet("/hello", 1000);
+    st = pool->getStats();
+    CHAT_ASSERT(r->result == 0 && st.total == 1 && st.max_wait_us > 0);
+
+    //连不上时统计失败
+    chat::http::HttpConnectionPool::ptr bad(new chat::http::HttpConnectionPool(
+                "127.0.0.1", "", 1, false, 4, 30 * 1000, 100));
+    r = bad->doGet("/", 200);
+    CHAT_ASSERT(r->result == (int)chat::http::HttpResult::Error::POOL_GET_CONNECTION
+            && bad->getStats().failed == 1);
+
+    pool->stop();
+    bad->stop();
+    server->stop();
+}
+
+void run() {
+    chat::Config::Lookup<uint32_t>("http.connection_pool.check_interval")->setValue(100);
+    chat::http::HttpServer::ptr server(new chat::http::HttpServer(true));
+    chat::Address::ptr addr = chat::Address::LookupAnyIPAddress("127.0.0.1:8027");
+    while (!server->bind(addr)) {
+        sleep(2);
+    }
+    auto sd = server->getServletDispatch();
+    sd->addServlet("/hello", [](chat::http::HttpRequest::ptr req
+            , chat::http::HttpResponse::ptr rsp
+            , chat::SocketStream::ptr session) {
+        rsp->setBody("hello");
+        return 0;
+    });
+    sd->addServlet("/slow", [](chat::http::HttpRequest::ptr req
+            , chat::http::HttpResponse::ptr rsp
+            , chat::SocketStream::ptr session) {
+        usleep(2 * 1000);
+        rsp->setBody("slow");
+        return 0;
+    });
+    sd->addServlet("/close", [](chat::http::HttpRequest::ptr req
+            , chat::http::HttpResponse::ptr rsp
+            , chat::SocketStream::ptr session) {
+        rsp->setClose(true);
+        rsp->setBody("bye");
+        return 0;
+    });
+    server->start();
+    chat::IOManager::GetThis()->schedule(std::bind(test_client, server));
+}
+
+int main(int argc, char** argv) {
+    chat::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
@@ -54,9 +54,67 @@ void test_res() {
     CHAT_LOG_INFO(g_logger) << tmp;
 }
 
+//两种引擎解析同一请求, 结果应一致; SIMD引擎逐字节喂入也要能解析
+void test_engines() {
+    const std::string data =
+        "POST /api/v1/users/1024?fields=name,avatar&x=1#top HTTP/1.1\r\n"
+        "Host: api.example.com\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)\r\n"
+        "Content-Type: application/json; charset=utf-8\r\n"
+        "Cookie: sid=8f3c2a1b9d7e6f5a4c3b2a1908f7e6d5; theme=dark\r\n"
+        "X-Empty:\r\n"
+        "Connection: keep-alive\r\n"
+        "Content-Length: 2\r\n\r\n{}";
+    std::string tmp = data;
+    chat::http::HttpRequestParser ragel(chat::http::HttpRequestParser::RAGEL);
+    size_t n1 = ragel.execute(&tmp[0], tmp.size());
+    tmp = data;
+    chat::http::HttpRequestParser simd(chat::http::HttpRequestParser::SIMD);
+    size_t n2 = simd.execute(&tmp[0], tmp.size());
+    CHAT_ASSERT(n1 == n2 && ragel.isFinished() && simd.isFinished());
+    CHAT_ASSERT(!simd.hasError() && tmp.substr(0, 2) == "{}");
+    auto r1 = ragel.getData();
+    auto r2 = simd.getData();
+    CHAT_ASSERT(r1->getMethod() == r2->getMethod() && r2->getMethod() == chat::http::HttpMethod::POST);
+    CHAT_ASSERT(r1->getPath() == r2->getPath() && r2->getPath() == "/api/v1/users/1024");
+    CHAT_ASSERT(r1->getQuery() == r2->getQuery() && r2->getQuery() == "fields=name,avatar&x=1");
+    CHAT_ASSERT(r1->getFragment() == r2->getFragment() && r2->getFragment() == "top");
+    CHAT_ASSERT(r1->getHeaders().size() == r2->getHeaders().size());
+    CHAT_ASSERT(r2->getHeader("content-type") == "application/json; charset=utf-8");
+    CHAT_ASSERT(r2->getHeader("x-empty", "none") == "" && simd.getContentLength() == 2);
+
+    std::string buf;
+    chat::http::HttpRequestParser inc(chat::http::HttpRequestParser::SIMD);
+    size_t total = 0;
+    for (size_t i = 0; i < data.size() && !inc.isFinished(); ++i) {
+        buf.push_back(data[i]);
+        size_t n = inc.execute(&buf[0], buf.size());
+        buf.erase(buf.size() - n);
+        total += n;
+    }
+    CHAT_ASSERT(inc.isFinished() && total == n2 && inc.getData()->getHeader("Host") == "api.example.com");
+
+    const char* bad[] = {
+        "GETX / HTTP/1.1\r\n\r\n",
+        "GET / HTTP/2.0\r\n\r\n",
+        "GET /a b HTTP/1.1\r\n\r\n",
+        "GET / HTTP/1.1\r\nBad Name: x\r\n\r\n",
+        "GET / HTTP/1.1\r\nX: a\x01b\r\n\r\n",
+        "GET / HTTP/1.1\r\nX: a\r\n folded\r\n\r\n",
+    };
+    for (auto b : bad) {
+        tmp = b;
+        chat::http::HttpRequestParser p(chat::http::HttpRequestParser::SIMD);
+        p.execute(&tmp[0], tmp.size());
+        CHAT_ASSERT(p.hasError());
+    }
+}
+
 int main(int argc, char** argv) {
     test_req();
     CHAT_LOG_INFO(g_logger) << "--------";
     test_res();
+    CHAT_LOG_INFO(g_logger) << "--------";
+    test_engines();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "../chat/chat.h"
+#include <numeric>
+
+//流式请求体(Content-Length/chunked/100-continue)与chunked流式响应
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static chat::Address::ptr s_addr;
+
+//发送原始请求, 读到服务端关闭连接为止
+static std::string raw_request(const std::string& data, bool wait_continue = false) {
+    chat::Socket::ptr sock = chat::Socket::CreateTCP(s_addr);
+    if (!sock->connect(s_addr)) {
+        return "";
+    }
+    sock->setRecvTimeout(3000);
+    std::string out;
+    char buf[4096];
+    int n;
+    if (wait_continue) {
+        size_t pos = data.find("\r\n\r\n") + 4;
+        sock->send(data.c_str(), pos);
+        n = sock->recv(buf, sizeof(buf));
+        if (n <= 0) {
+            return "";
+        }
+        out.append(buf, n);
+        sock->send(data.c_str() + pos, data.size() - pos);
+    } else {
+        sock->send(data.c_str(), data.size());
+    }
+    while ((n = sock->recv(buf, sizeof(buf))) > 0) {
+        out.append(buf, n);
+    }
+    return out;
+}
+
+static size_t count(const std::string& str, const std::string& sub) {
+    size_t n = 0;
+    for (size_t pos = str.find(sub); pos != std::string::npos; pos = str.find(sub, pos + 1)) {
+        ++n;
+    }
+    return n;
+}
+
+void test_client(chat::http::HttpServer::ptr server) {
+    std::string body(300000, 'a');
+    for (size_t i = 0; i < body.size(); i += 7) {
+        body[i] = 'a' + i % 26;
+    }
+    std::string rsp = raw_request("POST /upload HTTP/1.1\r\nHost: x\r\nConnection: close\r\n"
+            "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+    CHAT_ASSERT(rsp.find("size=" + std::to_string(body.size()) + " sum=" + std::to_string(
+                    std::accumulate(body.begin(), body.end(), 0ull))) != std::string::npos);
+
+    //chunked请求体, 带扩展与trailer
+    rsp = raw_request("POST /upload HTTP/1.1\r\nHost: x\r\nConnection: close\r\n"
+            "Transfer-Encoding: chunked\r\n\r\n"
+            "5;ext=1\r\nhello\r\n6\r\n world\r\n0\r\nX-Trailer: 1\r\n\r\n");
+    std::string hello = "hello world";
+    CHAT_ASSERT(rsp.find("size=11 sum=" + std::to_string(
+                    std::accumulate(hello.begin(), hello.end(), 0ull))) != std::string::npos);
+
+    rsp = raw_request("POST /echo HTTP/1.1\r\nHost: x\r\nConnection: close\r\n"
+            "Transfer-Encoding: gzip, chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\n");
+    CHAT_ASSERT(rsp.find("\r\n\r\nabc") != std::string::npos);
+
+    rsp = raw_request("POST /echo HTTP/1.1\r\nHost: x\r\nConnection: close\r\n"
+            "Expect: 100-continue\r\nContent-Length: 4\r\n\r\nping", true);
+    CHAT_ASSERT(rsp.find("HTTP/1.1 100 Continue") == 0 && rsp.find("\r\n\r\nping") != std::string::npos);
+
+    //业务没读请求体, 连接仍能处理流水线中的下一个请求
+    rsp = raw_request("POST /ignore HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n"
+            "Content-Length: 5\r\n\r\n12345"
+            "POST /ignore HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n"
+            "Transfer-Encoding: chunked\r\n\r\n2\r\nab\r\n0\r\n\r\n"
+            "GET /ignore HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+    CHAT_ASSERT(count(rsp, "ignored") == 3);
+
+    rsp = raw_request("POST /upload HTTP/1.1\r\nHost: x\r\nConnection: close\r\n"
+            "Transfer-Encoding: chunked\r\n\r\nzz\r\nhello\r\n0\r\n\r\n");
+    CHAT_ASSERT(rsp.find("size=-1") != std::string::npos);
+
+    //没读的请求体剩余超过http.server.drain_max, 先回响应并关闭连接, 不再处理后面的请求
+    rsp = raw_request("POST /ignore HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n"
+            "Content-Length: 200000\r\n\r\n" + std::string(200000, 'x')
+            + "GET /ignore HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+    CHAT_ASSERT(count(rsp, "ignored") == 1 && rsp.find("connection: close") != std::string::npos);
+
+    //超过http.request.max_body_size的请求体直接413, 不交给业务
+    rsp = raw_request("POST /upload HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n"
+            "Content-Length: 600000\r\n\r\nabc");
+    CHAT_ASSERT(rsp.find("HTTP/1.1 413") == 0 && rsp.find("size=") == std::string::npos);
+
+    rsp = raw_request("POST /upload HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n"
+            "Transfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n80000\r\nabc");
+    CHAT_ASSERT(rsp.find("HTTP/1.1 413") == 0 && rsp.find("size=") == std::string::npos);
+
+    //chunked响应, 客户端解码后与服务端生成的一致
+    auto r = chat::http::HttpConnection::DoGet("http://127.0.0.1:8026/stream", 3000);
+    std::string expect;
+    for (int i = 0; i < 100; ++i) {
+        expect += "line " + std::to_string(i) + "\n";
+    }
+    CHAT_ASSERT(r->response && r->response->getBody() == expect);
+
+    rsp = raw_request("GET /stream HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n");
+    CHAT_ASSERT(rsp.find("transfer-encoding: chunked") != std::string::npos
+            && rsp.find("7\r\nline 0\n\r\n") != std::string::npos
+            && rsp.find("0\r\n\r\n") == rsp.size() - 5);
+
+    rsp = raw_request("GET /stream HTTP/1.0\r\nHost: x\r\nConnection: keep-alive\r\n\r\n");
+    CHAT_ASSERT(rsp.find("transfer-encoding") == std::string::npos
+            && rsp.find("\r\n\r\n" + expect) != std::string::npos);
+
+    server->stop();
+}
+
+void run() {
+    chat::Config::Lookup<uint64_t>("http.request.max_body_size")->setValue(500000);
+    chat::http::HttpServer::ptr server(new chat::http::HttpServer(true));
+    s_addr = chat::Address::LookupAnyIPAddress("127.0.0.1:8026");
+    while (!server->bind(s_addr)) {
+        sleep(2);
+    }
+    auto sd = server->getServletDispatch();
+    sd->addServlet("/upload", [](chat::http::HttpRequest::ptr req
+            , chat::http::HttpResponse::ptr rsp
+            , chat::SocketStream::ptr session) {
+        auto stream = req->getBodyStream();
+        int64_t size = 0;
+        uint64_t sum = 0;
+        char buf[1000];
+        int n = 0;
+        while (stream && (n = stream->read(buf, sizeof(buf))) > 0) {
+            size += n;
+            sum = std::accumulate(buf, buf + n, sum);
+        }
+        rsp->setBody("size=" + std::to_string(n < 0 ? -1 : size) + " sum=" + std::to_string(sum));
+        return 0;
+    });
+    sd->addServlet("/echo", [](chat::http::HttpRequest::ptr req
+            , chat::http::HttpResponse::ptr rsp
+            , chat::SocketStream::ptr session) {
+        rsp->setBody(req->getBody());
+        return 0;
+    });
+    sd->addServlet("/ignore", [](chat::http::HttpRequest::ptr req
+            , chat::http::HttpResponse::ptr rsp
+            , chat::SocketStream::ptr session) {
+        rsp->setBody("ignored");
+        return 0;
+    });
+    sd->addServlet("/stream", [](chat::http::HttpRequest::ptr req
+            , chat::http::HttpResponse::ptr rsp
+            , chat::SocketStream::ptr session) {
+        rsp->setHeader("Content-Type", "text/plain");
+        rsp->setStreamBody([](chat::Stream::ptr out) {
+            for (int i = 0; i < 100; ++i) {
+                std::string line = "line " + std::to_string(i) + "\n";
+                if (out->write(line.c_str(), line.size()) <= 0) {
+                    return -1;
+                }
+            }
+            return 0;
+        });
+        return 0;
+    });
+    server->start();
+    chat::IOManager::GetThis()->schedule(std::bind(test_client, server));
+}
+
+int main(int argc, char** argv) {
+    chat::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <atomic>
 
 chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
 
@@ -65,9 +66,34 @@ void test_timer() {
     }, true);
 }
 
+//usleep精度: 对比epoll_wait超时和timerfd驱动, slack_us>0时相近定时器合并唤醒
+void test_usleep(bool use_timerfd, uint64_t slack_us) {
+    chat::Config::Lookup<bool>("iomanager.timerfd")->setValue(use_timerfd);
+    chat::Config::Lookup<uint64_t>("timer.sleep_slack_us")->setValue(slack_us);
+    static const int s_count = 1000;
+    std::atomic<uint64_t> total_delay = {0};
+    {
+        chat::IOManager iom(1, false);
+        for (int n = 0; n < 10; ++n) {
+            iom.schedule([&total_delay](){
+                for (int i = 0; i < s_count; ++i) {
+                    uint64_t begin = chat::GetCurrentUs();
+                    usleep(200);
+                    total_delay += chat::GetCurrentUs() - begin;
+                }
+            });
+        }
+    }
+    CHAT_LOG_INFO(g_logger) << "usleep(200) timerfd=" << use_timerfd
+        << " slack_us=" << slack_us
+        << " avg_us=" << total_delay / (s_count * 10);
+}
 
 int main(int argc, char** argv) {
     //test1();
     test_timer();
+    test_usleep(false, 0);
+    test_usleep(true, 0);
+    test_usleep(true, 100);
     return 0;
 }
\ No newline at end of file
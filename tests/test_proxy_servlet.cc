@@ -0,0 +1,235 @@
+#include "../chat/chat.h"
+
+//反向代理: 头部改写、Content-Length/chunked/读到关闭的响应体、流式请求体、splice与拷贝两种转发、故障转移
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static const std::string s_proxy = "http://127.0.0.1:8034";
+static chat::Address::ptr s_proxy_addr;
+
+static std::string make_blob(size_t size) {
+    std::string rt(size, 0);
+    for (size_t i = 0; i < size; ++i) {
+        rt[i] = 'a' + i % 23;
+    }
+    return rt;
+}
+
+//发送原始请求, 读到服务端关闭连接为止
+static std::string raw_request(const std::string& data) {
+    chat::Socket::ptr sock = chat::Socket::CreateTCP(s_proxy_addr);
+    if (!sock->connect(s_proxy_addr)) {
+        return "";
+    }
+    sock->setRecvTimeout(3000);
+    sock->send(data.c_str(), data.size());
+    std::string out;
+    char buf[4096];
+    int n;
+    while ((n = sock->recv(buf, sizeof(buf))) > 0) {
+        out.append(buf, n);
+    }
+    return out;
+}
+
+static int32_t upstream(chat::http::HttpRequest::ptr req
+        , chat::http::HttpResponse::ptr rsp
+        , chat::SocketStream::ptr session) {
+    std::string path = req->getPath();
+    path = path.substr(path.rfind('/'));
+    if (path == "/small") {
+        rsp->setHeader("X-Seen-XFF", req->getHeader("X-Forwarded-For"));
+        rsp->setHeader("X-Seen-Hop", req->getHeader("Proxy-Foo") + req->getHeader("Keep-Alive"));
+        rsp->setHeader("X-Seen-Host", req->getHeader("Host"));
+        rsp->setBody("hello proxy");
+    } else if (path == "/blob") {
+        rsp->setBody(make_blob(req->getParamAs<size_t>("size", 1024)));
+    } else if (path == "/chunked") {
+        rsp->setStreamBody([](chat::Stream::ptr out) {
+            std::string blob = make_blob(50 * 1024);
+            for (size_t i = 0; i < blob.size(); i += 10 * 1024) {
+                if (out->writeFixSize(&blob[i], 10 * 1024) <= 0) {
+                    return -1;
+                }
+            }
+            return 0;
+        });
+    } else if (path == "/echo") {
+        const std::string& body = req->getBody();
+        rsp->setBody(std::to_string(body.size()) + ":" + std::to_string(std::hash<std::string>()(body)));
+    } else {
+        rsp->setStatus(chat::http::HttpStatus::NOT_FOUND);
+        rsp->setBody("missing");
+    }
+    return 0;
+}
+
+//原始上游(8045): /raw/drop 收到请求后不响应直接断开, 其余路径先回103再回200
+static std::atomic<int> s_drops = {0};
+static chat::Socket::ptr s_raw_listen;
+
+static void raw_upstream(chat::Socket::ptr sock) {
+    std::string buf;
+    char tmp[4096];
+    while (true) {
+        size_t pos;
+        while ((pos = buf.find("\r\n\r\n")) == std::string::npos) {
+            int n = sock->recv(tmp, sizeof(tmp));
+            if (n <= 0) {
+                return;
+            }
+            buf.append(tmp, n);
+        }
+        std::string head = buf.substr(0, pos);
+        buf.erase(0, pos + 4);
+        size_t cl = head.find("Content-Length: ");
+        size_t len = cl == std::string::npos ? 0 : atoi(head.c_str() + cl + 16);
+        while (buf.size() < len) {
+            int n = sock->recv(tmp, sizeof(tmp));
+            if (n <= 0) {
+                return;
+            }
+            buf.append(tmp, n);
+        }
+        buf.erase(0, len);
+        if (head.find(" /raw/drop") != std::string::npos) {
+            ++s_drops;
+            sock->close();
+            return;
+        }
+        //中间响应和最终响应一次写出, 最终响应的头部随103一起被读到
+        std::string rsp = "HTTP/1.1 103 Early Hints\r\nLink: </a.css>; rel=preload\r\n\r\n"
+                          "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+        sock->send(rsp.c_str(), rsp.size());
+    }
+}
+
+static void raw_accept() {
+    while (auto c = s_raw_listen->accept()) {
+        chat::IOManager::GetThis()->schedule(std::bind(raw_upstream, c));
+    }
+}
+
+void test_raw() {
+    //1xx之后读最终响应, 连接复用时下一个请求不会读到残留的响应
+    bool ok = true;
+    for (int i = 0; i < 3; ++i) {
+        auto r = chat::http::HttpConnection::DoGet(s_proxy + "/raw/hints", 3000);
+        ok = ok && r->result == 0 && r->response->getStatus() == chat::http::HttpStatus::OK
+                && r->response->getBody() == "ok";
+    }
+    CHAT_ASSERT(ok);
+
+    //上游可能已执行, POST不重放; 幂等的GET换一个上游重试
+    s_drops = 0;
+    auto r1 = chat::http::HttpConnection::DoPost(s_proxy + "/raw/drop", 3000, {}, "x");
+    CHAT_ASSERT(r1->response && r1->response->getStatus() == chat::http::HttpStatus::BAD_GATEWAY && s_drops == 1);
+    s_drops = 0;
+    auto r2 = chat::http::HttpConnection::DoRequest(chat::http::HttpMethod::POST
+            , s_proxy + "/raw/drop", 3000);
+    CHAT_ASSERT(r2->response && r2->response->getStatus() == chat::http::HttpStatus::BAD_GATEWAY && s_drops == 1);
+    s_drops = 0;
+    auto r3 = chat::http::HttpConnection::DoGet(s_proxy + "/raw/drop", 3000);
+    CHAT_ASSERT(r3->response && r3->response->getStatus() == chat::http::HttpStatus::BAD_GATEWAY && s_drops == 2);
+    s_raw_listen->close();
+}
+
+void test_proxy(std::vector<chat::http::HttpServer::ptr> servers, chat::http::ProxyServlet::ptr proxy) {
+    //第一个上游不可用, 自动换到下一个
+    auto r1 = chat::http::HttpConnection::DoGet(s_proxy + "/api/small", 3000);
+    CHAT_ASSERT(r1->result == 0 && r1->response->getBody() == "hello proxy");
+    CHAT_ASSERT(r1->response->getHeader("X-Seen-XFF") == "127.0.0.1"
+          && r1->response->getHeader("X-Seen-Host") == "127.0.0.1:8033");
+
+    //Connection列出的字段和Keep-Alive不转发给上游
+    std::string hop = raw_request("GET /api/small HTTP/1.1\r\nHost: 127.0.0.1\r\nProxy-Foo: x\r\n"
+            "Keep-Alive: timeout=5\r\nConnection: close, Proxy-Foo\r\n\r\n");
+    CHAT_ASSERT(hop.find("hello proxy") != std::string::npos && hop.find("X-Seen-Hop: \r\n") != std::string::npos);
+
+    //Content-Length的大响应体走splice
+    std::string blob = make_blob(2 * 1024 * 1024);
+    auto r2 = chat::http::HttpConnection::DoGet(s_proxy + "/api/blob?size=2097152", 5000);
+    CHAT_ASSERT(r2->result == 0 && r2->response->getBody() == blob);
+    auto st = proxy->getStats();
+    CHAT_ASSERT(st.splicedBytes >= 2 * 1024 * 1024 - 64 * 1024);
+
+    //上游chunked响应解码后转发
+    auto r3 = chat::http::HttpConnection::DoGet(s_proxy + "/api/chunked", 3000);
+    CHAT_ASSERT(r3->result == 0 && r3->response && r3->response->getBody() == make_blob(50 * 1024));
+
+    //Content-Length请求体: 读缓冲之外的部分splice到上游
+    std::string post = make_blob(512 * 1024);
+    std::string expect = std::to_string(post.size()) + ":" + std::to_string(std::hash<std::string>()(post));
+    uint64_t spliced = proxy->getStats().splicedBytes;
+    auto r4 = chat::http::HttpConnection::DoPost(s_proxy + "/api/echo", 5000, {}, post);
+    CHAT_ASSERT(r4->result == 0 && r4->response->getBody() == expect
+          && proxy->getStats().splicedBytes > spliced);
+
+    //chunked请求体重新编码后转发
+    std::string raw = raw_request("POST /api/echo HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n"
+            "Transfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n");
+    std::string hello = "hello world";
+    CHAT_ASSERT(raw.find("11:" + std::to_string(std::hash<std::string>()(hello))) != std::string::npos);
+
+    //HEAD只返回头部, 状态码和原因短语原样返回
+    std::string head = raw_request("HEAD /api/blob?size=100 HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n");
+    CHAT_ASSERT(head.find("Content-Length: 100") != std::string::npos && head.substr(head.size() - 4) == "\r\n\r\n");
+    auto r5 = chat::http::HttpConnection::DoGet(s_proxy + "/api/none", 3000);
+    CHAT_ASSERT(r5->response->getStatus() == chat::http::HttpStatus::NOT_FOUND && r5->response->getBody() == "missing");
+
+    //关闭splice后经用户态缓冲转发
+    auto r6 = chat::http::HttpConnection::DoGet(s_proxy + "/copy/blob?size=2097152", 5000);
+    CHAT_ASSERT(r6->result == 0 && r6->response->getBody() == blob);
+
+    //所有上游都不可用
+    auto r7 = chat::http::HttpConnection::DoGet(s_proxy + "/dead/small", 3000);
+    CHAT_ASSERT(r7->response->getStatus() == chat::http::HttpStatus::BAD_GATEWAY
+            && r7->response->getHeader("Content-Length") == "0");
+
+    test_raw();
+
+    st = proxy->getStats();
+    CHAT_LOG_INFO(g_logger) << "requests=" << st.requests << " errors=" << st.errors
+        << " spliced=" << st.splicedBytes << " copied=" << st.copiedBytes;
+    for (auto& i : servers) {
+        i->stop();
+    }
+}
+
+void run() {
+    chat::http::HttpServer::ptr up(new chat::http::HttpServer(true));
+    chat::http::HttpServer::ptr gw(new chat::http::HttpServer(true));
+    chat::Address::ptr up_addr = chat::Address::LookupAnyIPAddress("127.0.0.1:8033");
+    s_proxy_addr = chat::Address::LookupAnyIPAddress("127.0.0.1:8034");
+    while (!up->bind(up_addr) || !gw->bind(s_proxy_addr)) {
+        sleep(2);
+    }
+    up->getServletDispatch()->addGlobServlet("/*", upstream);
+
+    auto proxy = std::make_shared<chat::http::ProxyServlet>(std::vector<std::string>{
+            "http://127.0.0.1:8039", "http://127.0.0.1:8033"});
+    proxy->setPreserveHost(false);
+    auto copy = std::make_shared<chat::http::ProxyServlet>(std::vector<std::string>{"http://127.0.0.1:8033"});
+    copy->setSplice(false);
+    gw->getServletDispatch()->addGlobServlet("/api/*", proxy);
+    gw->getServletDispatch()->addGlobServlet("/copy/*", copy);
+    gw->getServletDispatch()->addGlobServlet("/dead/*", std::make_shared<chat::http::ProxyServlet>(
+                std::vector<std::string>{"http://127.0.0.1:8039"}));
+    gw->getServletDispatch()->addGlobServlet("/raw/*", std::make_shared<chat::http::ProxyServlet>(
+                std::vector<std::string>{"http://127.0.0.1:8045", "http://127.0.0.1:8045"}));
+    chat::Address::ptr raw_addr = chat::Address::LookupAnyIPAddress("127.0.0.1:8045");
+    s_raw_listen = chat::Socket::CreateTCP(raw_addr);
+    while (!s_raw_listen->bind(raw_addr) || !s_raw_listen->listen()) {
+        sleep(2);
+    }
+    chat::IOManager::GetThis()->schedule(raw_accept);
+    up->start();
+    gw->start();
+    chat::IOManager::GetThis()->schedule(std::bind(test_proxy
+                , std::vector<chat::http::HttpServer::ptr>{up, gw}, proxy));
+}
+
+int main(int argc, char** argv) {
+    chat::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
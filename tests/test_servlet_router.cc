@@ -0,0 +1,120 @@
+#include "../chat/chat.h"
+
+//路由树: 静态/参数/通配/方法/回溯/glob兼容
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static chat::http::FunctionServlet::callback named(const std::string& name) {
+    return [name](chat::http::HttpRequest::ptr req
+            , chat::http::HttpResponse::ptr rsp
+            , chat::SocketStream::ptr session) {
+        std::string body = name;
+        for (size_t i = 0; i < req->getRouteParamCount(); ++i) {
+            auto& p = req->getRouteParams()[i];
+            body.append(" ").append(p.first).append("=").append(p.second);
+        }
+        rsp->setBody(body);
+        return 0;
+    };
+}
+
+static std::string dispatch(chat::http::ServletDispatch::ptr sd
+        , chat::http::HttpMethod method, const std::string& path, int* status = nullptr) {
+    chat::http::HttpRequest::ptr req(new chat::http::HttpRequest);
+    req->setMethod(method);
+    req->setPath(path);
+    chat::http::HttpResponse::ptr rsp = req->createResponse();
+    sd->handle(req, rsp, nullptr);
+    if (status) {
+        *status = (int)rsp->getStatus();
+    }
+    return rsp->getBody();
+}
+
+#define GET chat::http::HttpMethod::GET
+#define POST chat::http::HttpMethod::POST
+
+int main(int argc, char** argv) {
+    chat::http::ServletDispatch::ptr sd(new chat::http::ServletDispatch);
+    sd->addServlet("/users/me", named("me"));
+    sd->addRoute("/users", named("list"), GET);
+    sd->addRoute("/users", named("create"), POST);
+    sd->addRoute("/users/:id", named("user"), GET);
+    sd->addRoute("/users/:id/posts/:pid", named("post"));
+    sd->addRoute("/users/new", named("new"));
+    sd->addRoute("/useless", named("useless"));
+    sd->addRoute("/files/*path", named("files"));
+    sd->addRoute("/a/:x/c", named("axc"));
+    sd->addRoute("/a/b/d", named("abd"));
+    sd->addGlobServlet("/chat/*", named("glob"));
+    sd->addGlobServlet("/*.txt", named("fnmatch"));
+
+    CHAT_ASSERT(dispatch(sd, GET, "/users/me") == "me");
+    CHAT_ASSERT(dispatch(sd, GET, "/users") == "list");
+    CHAT_ASSERT(dispatch(sd, POST, "/users") == "create");
+    CHAT_ASSERT(dispatch(sd, GET, "/users/42") == "user id=42");
+    CHAT_ASSERT(dispatch(sd, GET, "/users/new") == "new");
+    CHAT_ASSERT(dispatch(sd, GET, "/useless") == "useless");
+    CHAT_ASSERT(dispatch(sd, POST, "/users/7/posts/99") == "post id=7 pid=99");
+    CHAT_ASSERT(dispatch(sd, GET, "/files/css/site.css") == "files path=css/site.css");
+    CHAT_ASSERT(dispatch(sd, GET, "/files/") == "files path=");
+    //静态/a/b没有后续c, 回溯到:x
+    CHAT_ASSERT(dispatch(sd, GET, "/a/b/c") == "axc x=b");
+    CHAT_ASSERT(dispatch(sd, GET, "/a/b/d") == "abd");
+    CHAT_ASSERT(dispatch(sd, GET, "/chat/room/1") == "glob");
+    CHAT_ASSERT(dispatch(sd, GET, "/readme.txt") == "fnmatch");
+
+    int status = 0;
+    dispatch(sd, chat::http::HttpMethod::DELETE, "/users/42", &status);
+    CHAT_ASSERT(status == 405);
+    //405带上该路径注册的方法和空响应体
+    chat::http::HttpRequest::ptr req(new chat::http::HttpRequest);
+    req->setMethod(chat::http::HttpMethod::DELETE);
+    req->setPath("/users");
+    chat::http::HttpResponse::ptr rsp = req->createResponse();
+    sd->handle(req, rsp, nullptr);
+    CHAT_ASSERT(rsp->getStatus() == chat::http::HttpStatus::METHOD_NOT_ALLOWED
+          && rsp->getHeader("Allow") == "GET, POST"
+          && rsp->getHeader("Content-Length") == "0" && rsp->getBody().empty());
+    dispatch(sd, GET, "/users/42/posts", &status);
+    CHAT_ASSERT(status == 404);
+    dispatch(sd, GET, "/users/", &status);
+    CHAT_ASSERT(status == 404);
+
+    CHAT_ASSERT(!sd->addRoute("/users/:uid/x", named("conflict")));
+    CHAT_ASSERT(!sd->addRoute("/files/*path/x", named("bad")));
+    CHAT_ASSERT(!sd->addRoute("no-slash", named("bad")));
+
+    sd->delRoute("/users/:id", GET);
+    dispatch(sd, GET, "/users/42", &status);
+    CHAT_ASSERT(status == 404);
+    sd->delGlobServlet("/chat/*");
+    dispatch(sd, GET, "/chat/room/1", &status);
+    CHAT_ASSERT(status == 404);
+
+    //glob按添加顺序先匹配先生效, 先添加的fnmatch/更宽的glob不会被路由树越过
+    chat::http::ServletDispatch::ptr gd(new chat::http::ServletDispatch);
+    gd->addGlobServlet("/img/*.png", named("png"));
+    gd->addGlobServlet("/img/*", named("img"));
+    gd->addGlobServlet("/doc/*", named("doc"));
+    gd->addGlobServlet("/doc/api/*", named("api"));
+    gd->addGlobServlet("/src/lib/*", named("lib"));
+    gd->addGlobServlet("/src/*", named("src"));
+    CHAT_ASSERT(dispatch(gd, GET, "/img/a.png") == "png");
+    CHAT_ASSERT(dispatch(gd, GET, "/img/a.jpg") == "img");
+    CHAT_ASSERT(dispatch(gd, GET, "/doc/api/x") == "doc");
+    CHAT_ASSERT(dispatch(gd, GET, "/src/lib/x") == "lib");
+    CHAT_ASSERT(dispatch(gd, GET, "/src/main.cc") == "src");
+    gd->delGlobServlet("/img/*.png");
+    gd->delGlobServlet("/doc/*");
+    CHAT_ASSERT(dispatch(gd, GET, "/img/a.png") == "img");
+    CHAT_ASSERT(dispatch(gd, GET, "/doc/api/x") == "api");
+    dispatch(gd, GET, "/doc/x", &status);
+    CHAT_ASSERT(status == 404);
+
+    CHAT_ASSERT(sd->getMatchedServlet("/users/1/posts/2") != sd->getDefault());
+    std::map<std::string, chat::http::IServletCreator::ptr> infos;
+    sd->listAllRouteCreator(infos);
+    CHAT_ASSERT(infos.count("GET /users") && infos.count("POST /users")
+            && infos.count("/users/:id/posts/:pid") && infos.count("/files/*path"));
+    return 0;
+}
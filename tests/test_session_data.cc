@@ -0,0 +1,77 @@
+#include "../chat/chat.h"
+
+//会话管理: 按类型存取会话数据, 分片增删查, 时间轮按最后访问时间过期
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+struct UserInfo {
+    int id;
+    std::string name;
+};
+
+void test_data() {
+    chat::http::SessionData::ptr data(new chat::http::SessionData(true));
+    data->setData("uid", 10086);
+    data->setData("name", std::string("chat"));
+    data->setData("vip", true);
+    data->setData("score", 9.5);
+    data->setData("user", UserInfo{7, "seven"});
+    CHAT_ASSERT(data->getId().size() == 32);
+    CHAT_ASSERT(data->getData<int>("uid") == 10086 && data->getData<int64_t>("uid") == 10086);
+    CHAT_ASSERT(data->getData<std::string>("name") == "chat" && data->getData<bool>("vip")
+          && data->getData<double>("score") == 9.5);
+    CHAT_ASSERT(data->getData<UserInfo>("user").name == "seven");
+    //类型不匹配或不存在返回默认值
+    CHAT_ASSERT(data->getData<std::string>("uid", "def") == "def" && data->getData<int>("none", -1) == -1);
+    data->setData("uid", 1);
+    data->del("name");
+    CHAT_ASSERT(data->getData<int>("uid") == 1 && !data->has("name") && data->has("vip"));
+}
+
+void test_manager() {
+    chat::http::SessionDataManager mgr;
+    mgr.setTimeout(4);
+    std::vector<std::string> ids;
+    for (int i = 0; i < 1000; ++i) {
+        chat::http::SessionData::ptr data(new chat::http::SessionData(true));
+        data->setData("i", i);
+        mgr.add(data);
+        ids.push_back(data->getId());
+    }
+    CHAT_ASSERT(mgr.size() == 1000 && mgr.get(ids[10])->getData<int>("i") == 10);
+    mgr.del(ids[0]);
+    CHAT_ASSERT(mgr.size() == 999 && !mgr.get(ids[0]));
+
+    //期间访问过的会话按新的时间过期
+    usleep(2500 * 1000);
+    mgr.check(4);
+    for (int i = 1; i < 100; ++i) {
+        mgr.get(ids[i]);
+    }
+    CHAT_ASSERT(mgr.size() == 999);
+    usleep(2550 * 1000);
+    CHAT_ASSERT(!mgr.get(ids[500]) && mgr.get(ids[50]));
+    mgr.check(4);
+    CHAT_ASSERT(mgr.size() == 99);
+}
+
+void test_timer() {
+    chat::http::SessionDataManager* mgr = new chat::http::SessionDataManager;
+    mgr->setTimeout(1);
+    for (int i = 0; i < 100; ++i) {
+        mgr->add(std::make_shared<chat::http::SessionData>(true));
+    }
+    mgr->start();
+    chat::IOManager::GetThis()->addTimer(3000, [mgr]() {
+        CHAT_ASSERT(mgr->size() == 0);
+        mgr->stop();
+        delete mgr;
+    });
+}
+
+int main(int argc, char** argv) {
+    test_data();
+    test_manager();
+    chat::IOManager iom(1);
+    iom.schedule(test_timer);
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include "../chat/chat.h"
+#include "chat/singleflight.h"
+
+//请求合并: 通用SingleFlight与HttpConnectionPool
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static std::atomic<int> s_upstream = {0};
+
+//并发n个协程执行cb, 等全部完成
+static void parallel(int n, std::function<void(int)> cb) {
+    std::atomic<int> done = {0};
+    for (int i = 0; i < n; ++i) {
+        chat::IOManager::GetThis()->schedule([cb, i, &done]() {
+            cb(i);
+            ++done;
+        });
+    }
+    while (done < n) {
+        usleep(5 * 1000);
+    }
+}
+
+void test_singleflight() {
+    chat::SingleFlight<std::shared_ptr<int> > sf;
+    std::atomic<int> calls = {0};
+    std::atomic<int> shared = {0};
+    std::vector<std::shared_ptr<int> > results(20);
+    parallel(20, [&](int i) {
+        bool s = false;
+        results[i] = sf.call("k", [&]() {
+            ++calls;
+            usleep(50 * 1000);
+            return std::make_shared<int>(42);
+        }, &s);
+        shared += s;
+    });
+    bool same = true;
+    for (auto& i : results) {
+        same = same && i == results[0] && *i == 42;
+    }
+    CHAT_ASSERT(calls == 1 && shared == 19 && same);
+    CHAT_ASSERT(sf.getCallCount() == 1 && sf.getCoalescedCount() == 19 && sf.getInflightCount() == 0);
+
+    //不同key不合并, 完成后再调用重新执行
+    calls = 0;
+    parallel(4, [&](int i) {
+        sf.call("k" + std::to_string(i % 2), [&]() {
+            ++calls;
+            usleep(20 * 1000);
+            return std::make_shared<int>(i);
+        });
+    });
+    CHAT_ASSERT(calls == 2);
+    sf.call("k0", [&]() { ++calls; return std::make_shared<int>(0); });
+    CHAT_ASSERT(calls == 3);
+
+    //执行者抛异常时每个等待者都收到同一个异常
+    std::atomic<int> nulls = {0};
+    std::atomic<int> throws = {0};
+    parallel(5, [&](int i) {
+        try {
+            auto r = sf.call("e", [&]() -> std::shared_ptr<int> {
+                usleep(20 * 1000);
+                throw std::runtime_error("upstream");
+            });
+            nulls += !r;
+        } catch (const std::runtime_error& e) {
+            throws += std::string(e.what()) == "upstream";
+        }
+    });
+    CHAT_ASSERT(throws == 5 && nulls == 0);
+}
+
+void test_pool(chat::http::HttpServer::ptr server) {
+    chat::http::HttpConnectionPool::ptr pool(new chat::http::HttpConnectionPool(
+                "127.0.0.1", "", 8030, false, 64, 30 * 1000, 1000));
+
+    //未开启时不合并
+    s_upstream = 0;
+    parallel(10, [&](int i) {
+        pool->doGet("/count", 2000);
+    });
+    CHAT_ASSERT(s_upstream == 10);
+
+    pool->setSingleFlight(true);
+    s_upstream = 0;
+    std::atomic<int> ok = {0};
+    parallel(30, [&](int i) {
+        auto r = pool->doGet("/count?id=1", 2000);
+        ok += r->result == 0 && r->response->getBody() == "1";
+    });
+    CHAT_ASSERT(s_upstream == 1 && ok == 30);
+    CHAT_ASSERT(pool->getStats().coalesced == 29);
+
+    //不同url/凭证不合并, POST不合并
+    s_upstream = 0;
+    parallel(4, [&](int i) {
+        pool->doGet("/count?id=" + std::to_string(i % 2), 2000);
+    });
+    CHAT_ASSERT(s_upstream == 2);
+    s_upstream = 0;
+    parallel(4, [&](int i) {
+        pool->doGet("/count", 2000, {{"Authorization", "Bearer " + std::to_string(i % 2)}});
+    });
+    CHAT_ASSERT(s_upstream == 2);
+    //Range/Accept-Encoding不同的响应内容不同, 不合并
+    s_upstream = 0;
+    parallel(4, [&](int i) {
+        pool->doGet("/count", 2000, {{i % 2 ? "Range" : "Accept-Encoding", "x"}});
+    });
+    CHAT_ASSERT(s_upstream == 2);
+    s_upstream = 0;
+    parallel(4, [&](int i) {
+        pool->doPost("/count", 2000, {}, "same");
+    });
+    CHAT_ASSERT(s_upstream == 4);
+
+    //显式key对任意method生效
+    s_upstream = 0;
+    parallel(8, [&](int i) {
+        auto req = std::make_shared<chat::http::HttpRequest>();
+        req->setMethod(chat::http::HttpMethod::POST);
+        req->setPath("/count");
+        req->setHeader("Host", "127.0.0.1");
+        req->setBody(std::to_string(i));
+        pool->doRequestShared("refresh", req, 2000);
+    });
+    CHAT_ASSERT(s_upstream == 1);
+
+    pool->stop();
+    server->stop();
+}
+
+void run() {
+    test_singleflight();
+
+    chat::http::HttpServer::ptr server(new chat::http::HttpServer(true));
+    chat::Address::ptr addr = chat::Address::LookupAnyIPAddress("127.0.0.1:8030");
+    while (!server->bind(addr)) {
+        sleep(2);
+    }
+    server->getServletDispatch()->addServlet("/count", [](chat::http::HttpRequest::ptr req
+            , chat::http::HttpResponse::ptr rsp
+            , chat::SocketStream::ptr session) {
+        int n = ++s_upstream;
+        usleep(50 * 1000);
+        rsp->setBody(std::to_string(n));
+        return 0;
+    });
+    server->start();
+    chat::IOManager::GetThis()->schedule(std::bind(test_pool, server));
+}
+
+int main(int argc, char** argv) {
+    chat::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include "../chat/chat.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//静态文件: 整体/Range/304/416/预压缩gz/HEAD
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static const std::string s_root = "/tmp/test_static_file.d";
+static const std::string s_url = "http://127.0.0.1:8025/static/";
+static std::string s_small;
+static std::string s_big;
+
+static void write_file(const std::string& path, const std::string& data) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    write(fd, data.c_str(), data.size());
+    close(fd);
+}
+
+static chat::http::HttpResponse::ptr get(const std::string& path
+        , const std::map<std::string, std::string>& headers = {}) {
+    auto r = chat::http::HttpConnection::DoGet(s_url + path, 3000, headers);
+    if (!r->response) {
+        CHAT_LOG_ERROR(g_logger) << "GET " << path << " fail: " << r->toString();
+    }
+    return r->response;
+}
+
+void test_client(chat::http::HttpServer::ptr server) {
+    auto rsp = get("small.txt");
+    CHAT_ASSERT(rsp && rsp->getStatus() == chat::http::HttpStatus::OK && rsp->getBody() == s_small);
+    CHAT_ASSERT(rsp && rsp->getHeader("Content-Type") == "text/plain;charset=utf-8");
+
+    rsp = get("big.bin");
+    CHAT_ASSERT(rsp && rsp->getBody() == s_big);
+    std::string etag = rsp ? rsp->getHeader("ETag") : "";
+
+    rsp = get("big.bin", {{"Range", "bytes=100-199"}});
+    CHAT_ASSERT(rsp && rsp->getStatus() == chat::http::HttpStatus::PARTIAL_CONTENT
+            && rsp->getBody() == s_big.substr(100, 100)
+            && rsp->getHeader("Content-Range") == "bytes 100-199/" + std::to_string(s_big.size()));
+
+    rsp = get("big.bin", {{"Range", "bytes=-10"}});
+    CHAT_ASSERT(rsp && rsp->getBody() == s_big.substr(s_big.size() - 10));
+
+    rsp = get("big.bin", {{"Range", "bytes=500000-"}});
+    CHAT_ASSERT(rsp && rsp->getBody() == s_big.substr(500000));
+
+    rsp = get("big.bin", {{"Range", "bytes=99999999-"}});
+    CHAT_ASSERT(rsp && rsp->getStatus() == chat::http::HttpStatus::RANGE_NOT_SATISFIABLE);
+
+    rsp = get("big.bin", {{"Range", "bytes=0-9"}, {"If-Range", "\"stale\""}});
+    CHAT_ASSERT(rsp && rsp->getStatus() == chat::http::HttpStatus::OK && rsp->getBody() == s_big);
+
+    rsp = get("big.bin", {{"If-None-Match", etag}});
+    CHAT_ASSERT(rsp && rsp->getStatus() == chat::http::HttpStatus::NOT_MODIFIED);
+
+    rsp = get("small.txt", {{"Accept-Encoding", "gzip, deflate"}});
+    CHAT_ASSERT(rsp && rsp->getHeader("Content-Encoding") == "gzip" && rsp->getBody() == "gzip variant");
+
+    rsp = get("", {});
+    CHAT_ASSERT(rsp && rsp->getBody() == "<html></html>");
+
+    rsp = get("../etc/passwd");
+    CHAT_ASSERT(rsp && rsp->getStatus() != chat::http::HttpStatus::OK);
+
+    rsp = get("none.txt");
+    CHAT_ASSERT(rsp && rsp->getStatus() == chat::http::HttpStatus::NOT_FOUND
+            && rsp->getHeader("Content-Length") == "0");
+
+    //HEAD: 只有头部
+    chat::Address::ptr addr = chat::Address::LookupAny("127.0.0.1:8025");
+    chat::Socket::ptr sock = chat::Socket::CreateTCP(addr);
+    sock->connect(addr);
+    std::string req = "HEAD /static/big.bin HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+    sock->send(req.c_str(), req.size());
+    std::string out;
+    char buf[4096];
+    int n;
+    while ((n = sock->recv(buf, sizeof(buf))) > 0) {
+        out.append(buf, n);
+    }
+    CHAT_ASSERT(out.find("content-length: " + std::to_string(s_big.size())) != std::string::npos
+            || out.find("Content-Length: " + std::to_string(s_big.size())) != std::string::npos);
+    CHAT_ASSERT(out.size() < 1024);
+
+    //缓存期内文件被原地截断: 小文件仍返回打开时的内容, 大文件连接被断开, 服务端不能崩溃
+    rsp = get("small.txt");
+    rsp = get("big.bin", {{"Range", "bytes=0-9"}});
+    truncate((s_root + "/small.txt").c_str(), 0);
+    truncate((s_root + "/big.bin").c_str(), 0);
+    rsp = get("small.txt");
+    CHAT_ASSERT(rsp && rsp->getBody() == s_small);
+    auto r = chat::http::HttpConnection::DoGet(s_url + "big.bin", 3000);
+    CHAT_ASSERT(!r->response || r->response->getBody() != s_big);
+    rsp = get("index.html");
+    CHAT_ASSERT(rsp && rsp->getBody() == "<html></html>");
+
+    server->stop();
+}
+
+void run() {
+    mkdir(s_root.c_str(), 0755);
+    s_small = "hello static file\n";
+    for (int i = 0; i < 1024 * 1024 / 16; ++i) {
+        s_big.append("0123456789abcdef");
+    }
+    s_big.append("tail");
+    write_file(s_root + "/small.txt", s_small);
+    auto zs = chat::ZlibStream::CreateGzip(true);
+    zs->write("gzip variant", 12);
+    zs->flush();
+    write_file(s_root + "/small.txt.gz", zs->getResult());
+    write_file(s_root + "/big.bin", s_big);
+    write_file(s_root + "/index.html", "<html></html>");
+
+    chat::http::HttpServer::ptr server(new chat::http::HttpServer);
+    chat::Address::ptr addr = chat::Address::LookupAnyIPAddress("0.0.0.0:8025");
+    while (!server->bind(addr)) {
+        sleep(2);
+    }
+    server->getServletDispatch()->addGlobServlet("/static/*"
+            , std::make_shared<chat::http::StaticFileServlet>(s_root, "/static/"));
+    server->start();
+    chat::IOManager::GetThis()->schedule(std::bind(test_client, server));
+}
+
+int main(int argc, char** argv) {
+    chat::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
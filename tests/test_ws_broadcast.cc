@@ -0,0 +1,185 @@
+#include "../chat/chat.h"
+
+//WebSocket广播: 帧编码、按线程分组投递且保持顺序、与sendMessage交错写、慢消费者丢弃/断开
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static chat::http::WSBroadcaster::ptr s_room;
+static chat::http::WSBroadcaster::ptr s_drop;
+static chat::http::WSBroadcaster::ptr s_kick;
+
+template<class Pred>
+static bool wait_for(Pred pred, int ms = 5000) {
+    for (int i = 0; i < ms / 10; ++i) {
+        if (pred()) {
+            return true;
+        }
+        usleep(10 * 1000);
+    }
+    return pred();
+}
+
+void test_encode() {
+    auto f1 = chat::http::WSEncodeFrame("hi");
+    CHAT_ASSERT(*f1 == std::string("\x81\x02hi", 4));
+    auto f2 = chat::http::WSEncodeFrame(std::string(300, 'x'), chat::http::WSFrameHead::BIN_FRAME);
+    CHAT_ASSERT(f2->size() == 304 && f2->substr(0, 4) == std::string("\x82\x7e\x01\x2c", 4));
+    auto f3 = chat::http::WSEncodeFrame(std::string(70000, 'x'));
+    CHAT_ASSERT(f3->size() == 70010 && (unsigned char)(*f3)[1] == 127);
+}
+
+static chat::http::WSConnection::ptr connect(const std::string& path) {
+    return chat::http::WSConnection::Create("http://127.0.0.1:8036" + path, 2000
+            , {{"Sec-WebSocket-Extensions", "x-none"}}).second;
+}
+
+void test_room() {
+    std::vector<chat::http::WSConnection::ptr> conns;
+    for (int i = 0; i < 20; ++i) {
+        auto c = connect("/room");
+        if (c) {
+            conns.push_back(c);
+        }
+    }
+    CHAT_ASSERT(conns.size() == 20 && wait_for([]() { return s_room->size() == 20;}));
+
+    //一个连接边收广播边让服务端用sendMessage回显, 两种写入不能交错在帧中间
+    for (int i = 0; i < 50; ++i) {
+        s_room->broadcast("msg " + std::to_string(i));
+        if (i % 10 == 0) {
+            conns[0]->sendMessage("echo " + std::to_string(i));
+        }
+    }
+    bool ordered = true;
+    int echoes = 0;
+    for (size_t c = 0; c < conns.size(); ++c) {
+        int next = 0;
+        while (next < 50) {
+            auto msg = conns[c]->recvMessage();
+            if (!msg) {
+                ordered = false;
+                break;
+            }
+            if (msg->getData().compare(0, 5, "echo ") == 0) {
+                ++echoes;
+                continue;
+            }
+            ordered = ordered && msg->getData() == "msg " + std::to_string(next);
+            ++next;
+        }
+    }
+    //剩下的回显
+    while (echoes < 5) {
+        auto msg = conns[0]->recvMessage();
+        if (!msg) {
+            break;
+        }
+        echoes += msg->getData().compare(0, 5, "echo ") == 0;
+    }
+    CHAT_ASSERT(ordered && echoes == 5);
+    //投递任务在计数前客户端可能已经收到
+    CHAT_ASSERT(wait_for([]() {
+        auto st = s_room->getStats();
+        return st.broadcasts == 50 && st.delivered == 1000 && st.dropped == 0;
+    }));
+
+    //断开的会话自动取消订阅
+    for (int i = 0; i < 5; ++i) {
+        conns[i]->close();
+    }
+    CHAT_ASSERT(wait_for([]() {
+        s_room->broadcast("ping");
+        return s_room->size() == 15;
+    }));
+}
+
+void test_slow() {
+    auto cfg_frames = chat::Config::Lookup<uint32_t>("websocket.send_queue.max_frames");
+    auto cfg_bytes = chat::Config::Lookup<uint64_t>("websocket.send_queue.max_bytes");
+    cfg_frames->setValue(16);
+    cfg_bytes->setValue(256 * 1024);
+
+    //不读数据的客户端, 内核缓冲写满后进队列, 队列满后按策略处理
+    auto slow_drop = connect("/drop");
+    auto slow_kick = connect("/kick");
+    CHAT_ASSERT(slow_drop && slow_kick && wait_for([]() {
+        return s_drop->size() == 1 && s_kick->size() == 1;
+    }));
+    std::string payload(64 * 1024, 'p');
+    auto frame = chat::http::WSEncodeFrame(payload, chat::http::WSFrameHead::BIN_FRAME);
+    for (int i = 0; i < 400; ++i) {
+        s_drop->broadcast(frame);
+        s_kick->broadcast(frame);
+        if (i % 20 == 0) {
+            usleep(1000);
+        }
+    }
+    CHAT_ASSERT(wait_for([]() {
+        auto st = s_drop->getStats();
+        return st.broadcasts == 400 && st.delivered + st.dropped == 400;
+    }));
+    auto st = s_drop->getStats();
+    CHAT_LOG_INFO(g_logger) << "drop: delivered=" << st.delivered << " dropped=" << st.dropped;
+    CHAT_ASSERT(st.dropped > 0 && s_drop->size() == 1);
+    CHAT_ASSERT(wait_for([]() { return s_kick->size() == 0;}) && s_kick->getStats().disconnected == 1);
+
+    //丢弃策略下的客户端之后仍能收到完整的帧
+    int got = 0;
+    bool ok = true;
+    while (got < (int)st.delivered) {
+        auto msg = slow_drop->recvMessage();
+        if (!msg) {
+            ok = false;
+            break;
+        }
+        ok = ok && msg->getData() == payload;
+        ++got;
+    }
+    CHAT_ASSERT(ok && got == (int)st.delivered);
+    slow_drop->close();
+    slow_kick->close();
+    cfg_frames->setValue(1024);
+    cfg_bytes->setValue(4 * 1024 * 1024);
+}
+
+void run() {
+    test_encode();
+
+    s_room = std::make_shared<chat::http::WSBroadcaster>();
+    s_drop = std::make_shared<chat::http::WSBroadcaster>(chat::http::WSBroadcaster::DROP);
+    s_kick = std::make_shared<chat::http::WSBroadcaster>(chat::http::WSBroadcaster::DISCONNECT);
+
+    chat::http::WSServer::ptr server(new chat::http::WSServer);
+    chat::Address::ptr addr = chat::Address::LookupAnyIPAddress("127.0.0.1:8036");
+    while (!server->bind(addr)) {
+        sleep(2);
+    }
+    auto dispatch = server->getWSServletDispatch();
+    std::pair<std::string, chat::http::WSBroadcaster::ptr> rooms[] = {
+        {"/room", s_room}, {"/drop", s_drop}, {"/kick", s_kick}};
+    for (auto& r : rooms) {
+        auto b = r.second;
+        dispatch->addServlet(r.first, [](chat::http::HttpRequest::ptr header
+                    , chat::http::WSFrameMessage::ptr msg
+                    , chat::http::WSSession::ptr session) {
+            session->sendMessage(msg);
+            return 0;
+        }, [b](chat::http::HttpRequest::ptr header, chat::http::WSSession::ptr session) {
+            b->subscribe(session);
+            return 0;
+        }, [b](chat::http::HttpRequest::ptr header, chat::http::WSSession::ptr session) {
+            b->unsubscribe(session);
+            return 0;
+        });
+    }
+    server->start();
+    test_room();
+    test_slow();
+    server->stop();
+}
+
+int main(int argc, char** argv) {
+    CHAT_LOG_NAME("system")->setLevel(chat::LogLevel::WARN);
+    chat::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include "../chat/chat.h"
+
+//permessage-deflate: 扩展协商、窗口/上下文参数、压缩往返、握手后的收发
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+static std::string chat_msg(int i) {
+    return "{\"type\":\"chat\",\"room\":\"lobby\",\"from\":\"user_" + std::to_string(i % 7)
+         + "\",\"seq\":" + std::to_string(i) + ",\"text\":\"hello everyone, this is message "
+         + std::to_string(i) + "\"}";
+}
+
+void test_negotiate() {
+    typedef chat::http::WSDeflate D;
+    std::string rsp;
+    auto s1 = D::ServerNegotiate("permessage-deflate; client_max_window_bits", rsp);
+    CHAT_ASSERT(s1 && rsp == "permessage-deflate; client_max_window_bits=15");
+
+    //第一个提议无法接受时选下一个
+    auto s2 = D::ServerNegotiate("permessage-deflate; server_max_window_bits=8, "
+            "permessage-deflate; server_max_window_bits=10; server_no_context_takeover", rsp);
+    CHAT_ASSERT(s2 && s2->getDeflateWindowBits() == 10 && s2->getParams().serverNoContextTakeover
+          && rsp == "permessage-deflate; server_no_context_takeover; server_max_window_bits=10");
+    //接受并回复client_max_window_bits=8, 但按9位窗口解压, 兼容把8提升为9的压缩端
+    auto s3 = D::ServerNegotiate("permessage-deflate; client_max_window_bits=8", rsp);
+    CHAT_ASSERT(s3 && rsp == "permessage-deflate; client_max_window_bits=8" && s3->getInflateWindowBits() == 9);
+    chat::http::WSDeflateParams p9;
+    p9.clientMaxWindowBits = 9;
+    D c9(false, p9, 6, 8);
+    //对端按9位窗口压缩并保留上下文, 连续的消息都能还原
+    std::string text, z, out;
+    uint32_t seed = 1;
+    for (int i = 0; i < 300; ++i) {
+        seed = seed * 1103515245 + 12345;
+        text.push_back('a' + (seed >> 16) % 26);
+    }
+    bool ok = true;
+    for (int i = 0; i < 3; ++i) {
+        ok = ok && c9.compress(text.c_str(), text.size(), z)
+                && s3->decompress(z.c_str(), z.size(), out, 1 << 20) && out == text;
+    }
+    CHAT_ASSERT(ok);
+    CHAT_ASSERT(!D::ServerNegotiate("x-webkit-deflate-frame", rsp)
+          && !D::ServerNegotiate("permessage-deflate; unknown=1", rsp));
+
+    bool valid = true;
+    auto c1 = D::ClientAccept("permessage-deflate; client_max_window_bits=12; server_no_context_takeover", valid);
+    CHAT_ASSERT(valid && c1 && c1->getDeflateWindowBits() == 12 && c1->getInflateWindowBits() == 15);
+    D::ClientAccept("permessage-deflate; client_max_window_bits=8", valid);
+    CHAT_ASSERT(!valid);
+    D::ClientAccept("foo", valid);
+    CHAT_ASSERT(!valid);
+}
+
+void test_roundtrip() {
+    typedef chat::http::WSDeflate D;
+    std::string rsp;
+    bool valid;
+    auto server = D::ServerNegotiate(D::ClientOffer(), rsp);
+    auto client = D::ClientAccept(rsp, valid);
+    CHAT_ASSERT(server && client && valid);
+
+    //保留上下文: 重复的内容第二次压缩后更小
+    std::string z1, z2, out;
+    bool ok = server->compress(chat_msg(1).c_str(), chat_msg(1).size(), z1)
+           && client->decompress(z1.c_str(), z1.size(), out, 1 << 20) && out == chat_msg(1)
+           && server->compress(chat_msg(2).c_str(), chat_msg(2).size(), z2)
+           && client->decompress(z2.c_str(), z2.size(), out, 1 << 20) && out == chat_msg(2);
+    CHAT_ASSERT(ok && z2.size() < z1.size() / 2);
+
+    //不保留上下文: 每条消息独立, z_stream来自线程池
+    chat::http::WSDeflateParams params;
+    params.serverNoContextTakeover = true;
+    params.clientNoContextTakeover = true;
+    D s(true, params, 6, 8), c(false, params, 6, 8);
+    std::string a, b;
+    ok = true;
+    for (int i = 0; i < 3; ++i) {
+        ok = ok && s.compress(chat_msg(5).c_str(), chat_msg(5).size(), a)
+                && c.decompress(a.c_str(), a.size(), out, 1 << 20) && out == chat_msg(5);
+        ok = ok && (i == 0 || a == b);
+        b = a;
+    }
+    CHAT_ASSERT(ok && s.getMemoryUsage() == 0);
+
+    //解压结果超过上限
+    std::string big(1 << 20, 'a');
+    ok = client->compress(big.c_str(), big.size(), a);
+    CHAT_ASSERT(ok && a.size() < 4096 && !server->decompress(a.c_str(), a.size(), out, 1000));
+}
+
+void test_session() {
+    auto r = chat::http::WSConnection::Create("http://127.0.0.1:8035/chat", 2000);
+    auto conn = r.second;
+    CHAT_ASSERT(conn && conn->getDeflate()
+          && r.first->response->getHeader("Sec-WebSocket-Extensions").find("permessage-deflate") == 0);
+    bool ok = conn != nullptr;
+    for (int i = 0; ok && i < 20; ++i) {
+        ok = conn->sendMessage(chat_msg(i)) > 0;
+        auto msg = conn->recvMessage();
+        ok = ok && msg && msg->getData() == chat_msg(i);
+    }
+    CHAT_ASSERT(ok);
+    if (conn) {
+        auto& st = conn->getDeflate()->getStats();
+        CHAT_ASSERT(st.messages == 20 && st.inflated == 20 && st.bytesOut * 3 < st.bytesIn);
+
+        //1MB二进制消息与分片消息
+        std::string big;
+        for (int i = 0; big.size() < (1 << 20); ++i) {
+            big += chat_msg(i);
+        }
+        conn->sendMessage(big, chat::http::WSFrameHead::BIN_FRAME);
+        auto msg = conn->recvMessage();
+        CHAT_ASSERT(msg && msg->getData() == big && msg->getOpcode() == chat::http::WSFrameHead::BIN_FRAME);
+        conn->sendMessage("part1,", chat::http::WSFrameHead::TEXT_FRAME, false);
+        conn->sendMessage("part2", chat::http::WSFrameHead::CONTINUE, true);
+        msg = conn->recvMessage();
+        CHAT_ASSERT(msg && msg->getData() == "part1,part2");
+        conn->close();
+    }
+
+    //客户端不带扩展时按原来的方式收发
+    auto r2 = chat::http::WSConnection::Create("http://127.0.0.1:8035/chat", 2000
+            , {{"Sec-WebSocket-Extensions", "x-none"}});
+    auto plain = r2.second;
+    CHAT_ASSERT(plain && !plain->getDeflate()
+          && r2.first->response->getHeader("Sec-WebSocket-Extensions").empty());
+    if (plain) {
+        plain->sendMessage(chat_msg(100));
+        auto msg = plain->recvMessage();
+        CHAT_ASSERT(msg && msg->getData() == chat_msg(100));
+        plain->close();
+    }
+}
+
+void run() {
+    test_negotiate();
+    test_roundtrip();
+
+    chat::http::WSServer::ptr server(new chat::http::WSServer);
+    chat::Address::ptr addr = chat::Address::LookupAnyIPAddress("127.0.0.1:8035");
+    while (!server->bind(addr)) {
+        sleep(2);
+    }
+    server->getWSServletDispatch()->addServlet("/chat", [](chat::http::HttpRequest::ptr header
+                , chat::http::WSFrameMessage::ptr msg
+                , chat::http::WSSession::ptr session) {
+        session->sendMessage(msg);
+        return 0;
+    });
+    server->start();
+    test_session();
+    server->stop();
+}
+
+int main(int argc, char** argv) {
+    chat::IOManager iom(2);
+    iom.schedule(run);
+    return 0;
+}
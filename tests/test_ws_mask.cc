@@ -0,0 +1,110 @@
+#include "../chat/chat.h"
+#include "../chat/http/http_simd.h"
+
+//WebSocket掩码: 各实现与逐字节结果一致, 原地处理, 收发往返且不修改发送的消息
+chat::Logger::ptr g_logger = CHAT_LOG_ROOT();
+
+//内存中的Stream, 写入的数据可以再读出来
+class StringStream : public chat::Stream {
+public:
+    int read(void* buffer, size_t length) override {
+        length = std::min(length, m_data.size() - m_pos);
+        if (length == 0) {
+            return 0;
+        }
+        memcpy(buffer, &m_data[m_pos], length);
+        m_pos += length;
+        return length;
+    }
+    int read(chat::ByteArray::ptr ba, size_t length) override { return -1;}
+    int write(const void* buffer, size_t length) override {
+        m_data.append((const char*)buffer, length);
+        return length;
+    }
+    using chat::Stream::writeFixSize;
+    int writeFixSize(const void* buffer, size_t length) override {
+        ++m_writes;
+        return chat::Stream::writeFixSize(buffer, length);
+    }
+    int write(chat::ByteArray::ptr ba, size_t length) override { return -1;}
+    void close() override {}
+
+    int getWrites() const { return m_writes;}
+private:
+    std::string m_data;
+    size_t m_pos = 0;
+    int m_writes = 0;
+};
+
+static void mask_bytewise(char* dst, const char* src, size_t len, const char* mask) {
+    for (size_t i = 0; i < len; ++i) {
+        dst[i] = src[i] ^ mask[i % 4];
+    }
+}
+
+void test_kernels() {
+    const char mask[4] = {(char)0x37, (char)0xfa, (char)0x21, (char)0x3d};
+    std::string src(4096 + 64, 0);
+    for (size_t i = 0; i < src.size(); ++i) {
+        src[i] = (char)(i * 131 + 7);
+    }
+    CHAT_ASSERT(chat::http::GetWSMaskFunc("scalar") && !chat::http::GetWSMaskFunc("none"));
+    CHAT_LOG_INFO(g_logger) << "mask level=" << chat::http::GetWSMaskLevel();
+
+    const char* levels[] = {"scalar", "sse2", "avx2"};
+    for (auto level : levels) {
+        auto func = chat::http::GetWSMaskFunc(level);
+        if (!func) {
+            CHAT_LOG_INFO(g_logger) << level << " not supported";
+            continue;
+        }
+        bool ok = true;
+        //各种长度和非对齐的起始位置
+        for (size_t off = 0; off < 8; ++off) {
+            for (size_t len = 0; len <= 300; ++len) {
+                std::string expect(len, 0), out(len + 1, 'x');
+                mask_bytewise(&expect[0], &src[off], len, mask);
+                func(&out[1], &src[off], len, mask);
+                ok = ok && !memcmp(&out[1], expect.c_str(), len) && out[0] == 'x';
+            }
+        }
+        std::string big = src;
+        std::string expect(big.size(), 0);
+        mask_bytewise(&expect[0], big.c_str(), big.size(), mask);
+        func(&big[0], big.c_str(), big.size(), mask);
+        CHAT_LOG_INFO(g_logger) << (ok && big == expect ? "PASS " : "FAIL ") << level;
+    }
+}
+
+void test_roundtrip() {
+    std::string data(70000, 0);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = 'a' + i % 26;
+    }
+    const size_t sizes[] = {5, 200, 70000};
+    bool ok = true;
+    for (auto size : sizes) {
+        StringStream stream;
+        auto msg = std::make_shared<chat::http::WSFrameMessage>(
+                chat::http::WSFrameHead::BIN_FRAME, data.substr(0, size));
+        ok = ok && chat::http::WSSendMessage(&stream, msg, true, true) > 0;
+        //掩码不再写回调用方的消息, 帧一次写出
+        ok = ok && msg->getData() == data.substr(0, size) && stream.getWrites() == 1;
+        auto recv = chat::http::WSRecvMessage(&stream, false);
+        ok = ok && recv && recv->getData() == msg->getData();
+    }
+    CHAT_ASSERT(ok);
+
+    //服务端发送不带掩码
+    StringStream stream;
+    chat::http::WSSendMessage(&stream, std::make_shared<chat::http::WSFrameMessage>(
+                chat::http::WSFrameHead::TEXT_FRAME, "hello"), false, true);
+    auto recv = chat::http::WSRecvMessage(&stream, true);
+    CHAT_ASSERT(recv && recv->getData() == "hello");
+}
+
+int main(int argc, char** argv) {
+    test_kernels();
+    test_roundtrip();
+    return 0;
+}